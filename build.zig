@@ -32,7 +32,7 @@ pub fn build(b: *std.Build) void {
         .api = .gl,
         .version = .@"4.1",
         .profile = .core,
-        .extensions = &.{ .ARB_clip_control, .NV_scissor_exclusive },
+        .extensions = &.{ .ARB_clip_control, .NV_scissor_exclusive, .KHR_debug },
     });
     exe.root_module.addImport("gl", gl_bindings);
 
@@ -72,4 +72,61 @@ pub fn build(b: *std.Build) void {
     const run_cmd = b.addRunArtifact(exe);
     const run_step = b.step("run", "Run the executable");
     run_step.dependOn(&run_cmd.step);
+
+    // GL capture replay tool
+    const replay = b.addExecutable(.{
+        .name = "zigGL-replay",
+        .root_source_file = b.path("src/replay.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    replay.root_module.addImport("gl", gl_bindings);
+    replay.root_module.addImport("mach-glfw", glfw_dep.module("mach-glfw"));
+    replay.addLibraryPath(glfw_lib_path);
+    replay.linkSystemLibrary("glfw3");
+    replay.linkSystemLibrary("opengl32");
+    replay.linkLibC();
+    b.installArtifact(replay);
+
+    const replay_cmd = b.addRunArtifact(replay);
+    if (b.args) |args| replay_cmd.addArgs(args);
+    const replay_step = b.step("replay", "Replay a GL capture: zig build replay -- <capture>");
+    replay_step.dependOn(&replay_cmd.step);
+
+    // Mesh inspection and load report tool
+    const inspect = b.addExecutable(.{
+        .name = "zigGL-inspect",
+        .root_source_file = b.path("src/inspect.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    inspect.root_module.addImport("gl", gl_bindings);
+    inspect.root_module.addImport("mach-glfw", glfw_dep.module("mach-glfw"));
+    inspect.root_module.addImport("zmath", zmath.module("root"));
+    inspect.root_module.addImport("zstbi", zstbi.module("root"));
+    inspect.addLibraryPath(glfw_lib_path);
+    inspect.linkSystemLibrary("glfw3");
+    inspect.linkSystemLibrary("opengl32");
+    inspect.linkLibC();
+    b.installArtifact(inspect);
+
+    const inspect_cmd = b.addRunArtifact(inspect);
+    if (b.args) |args| inspect_cmd.addArgs(args);
+    const inspect_step = b.step("inspect", "Report mesh statistics and load timings: zig build inspect -- <model> [--json]");
+    inspect_step.dependOn(&inspect_cmd.step);
+
+    // Inline unit tests
+    const tests = b.addTest(.{
+        .name = "zigGL-tests",
+        .root_source_file = b.path("src/tests.zig"),
+        .target = target,
+        .optimize = optimize,
+    });
+    tests.root_module.addImport("zstbi", zstbi.module("root")); // PNG decoder tests compare against stb_image
+    tests.root_module.addImport("gl", gl_bindings); // Loader tests reference (but never call) GL
+    tests.linkLibC();
+    const test_cmd = b.addRunArtifact(tests);
+    test_cmd.setCwd(b.path(".")); // Textures in objects/ are read relative to the repository root
+    const test_step = b.step("test", "Run the unit tests");
+    test_step.dependOn(&test_cmd.step);
 }
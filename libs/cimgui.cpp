@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstdarg>
 #include "cimgui.h"
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
@@ -15,11 +16,14 @@ const float INNER_WIDTH = 0.0f;
 
 int ImGuiInputTextFlagsEnterReturnsTrue = ImGuiInputTextFlags_::ImGuiInputTextFlags_EnterReturnsTrue;
 int ImGuiTableFlagsNone = ImGuiTableFlags_::ImGuiTableFlags_None;
+int ImGuiTreeNodeFlagsLeaf = ImGuiTreeNodeFlags_::ImGuiTreeNodeFlags_Leaf;
+int ImGuiTreeNodeFlagsDefaultOpen = ImGuiTreeNodeFlags_::ImGuiTreeNodeFlags_DefaultOpen;
 
 void InitImgui(void* window) {
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
-    ImGui_ImplGlfw_InitForOpenGL((GLFWwindow*)window, true);
+    // Callbacks are installed by window.zig, which only forwards input while the overlay is visible
+    ImGui_ImplGlfw_InitForOpenGL((GLFWwindow*)window, false);
     ImGui_ImplOpenGL3_Init("#version 130");
 }
 
@@ -89,6 +93,18 @@ void ImGui_ScrollCallback(GLFWwindow* window, double xoffset, double yoffset){
     ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
 }
 
+void ImGui_CharCallback(GLFWwindow* window, unsigned int codepoint) {
+    ImGui_ImplGlfw_CharCallback(window, codepoint);
+}
+
+void ImGui_WindowFocusCallback(GLFWwindow* window, int focused) {
+    ImGui_ImplGlfw_WindowFocusCallback(window, focused);
+}
+
+void ImGui_CursorEnterCallback(GLFWwindow* window, int entered) {
+    ImGui_ImplGlfw_CursorEnterCallback(window, entered);
+}
+
 void ImGuiBeginGroup() {
     ImGui::BeginGroup();
 }
@@ -128,7 +144,10 @@ bool InputText(const char* label, char* buf, size_t buf_size, ImGuiInputTextFlag
 }
 
 void BulletText(const char* fmt, ...) {
-  ImGui::BulletText(fmt);
+  va_list args;
+  va_start(args, fmt);
+  ImGui::BulletTextV(fmt, args);
+  va_end(args);
 }
 
 void SameLine(float offset_from_start_x, float spacing) {
@@ -136,12 +155,18 @@ void SameLine(float offset_from_start_x, float spacing) {
 }
 
 void Text(const char* fmt, ...) {
-  ImGui::Text(fmt);
+  va_list args;
+  va_start(args, fmt);
+  ImGui::TextV(fmt, args);
+  va_end(args);
 }
 
 void TextColoredRGBA(float r, float g, float b, float a, const char* fmt, ...) {
   ImVec4 col = ImVec4(r, g, b, a);
-  ImGui::TextColored(col, fmt);
+  va_list args;
+  va_start(args, fmt);
+  ImGui::TextColoredV(col, fmt, args);
+  va_end(args);
 }
 
 bool DragFloat(const char* label, float* v, float v_speed, float v_min, float v_max, const char* format, ImGuiSliderFlags flags){
@@ -156,6 +181,22 @@ void Separator(){
   ImGui::Separator();
 }
 
+bool TreeNodeEx(const char* label, ImGuiTreeNodeFlags flags) {
+  return ImGui::TreeNodeEx(label, flags);
+}
+
+void TreePop() {
+  ImGui::TreePop();
+}
+
+void PushID(int id) {
+  ImGui::PushID(id);
+}
+
+void PopID() {
+  ImGui::PopID();
+}
+
 bool BeginTable(const char* str_id, int columns, ImGuiTableFlags flags, const ImVec2* outer_size, float inner_width) {
     return ImGui::BeginTable(str_id, columns, flags, *outer_size, inner_width);
 }
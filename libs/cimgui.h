@@ -9,6 +9,8 @@ extern "C" {
 
     extern int ImGuiInputTextFlagsEnterReturnsTrue;
     extern int ImGuiTableFlagsNone;
+    extern int ImGuiTreeNodeFlagsLeaf;
+    extern int ImGuiTreeNodeFlagsDefaultOpen;
 
     struct GLFWwindow;
     struct ImVec2;
@@ -39,6 +41,10 @@ extern "C" {
     void SameLine(float offset_from_start_x, float spacing);
     void NewLine();
     void Separator();
+    bool TreeNodeEx(const char* label, ImGuiTreeNodeFlags flags);
+    void TreePop();
+    void PushID(int id);
+    void PopID();
 
     // Components
     bool Button(const char* label);
@@ -63,6 +69,9 @@ extern "C" {
     void ImGui_CursorPosCallback(struct GLFWwindow* window, double x, double y);
     void ImGui_KeyCallback(struct GLFWwindow* window, int key, int scancode, int action, int mods);
     void ImGui_ScrollCallback(struct GLFWwindow* window, double xoffset, double yoffset);
+    void ImGui_CharCallback(struct GLFWwindow* window, unsigned int codepoint);
+    void ImGui_WindowFocusCallback(struct GLFWwindow* window, int focused);
+    void ImGui_CursorEnterCallback(struct GLFWwindow* window, int entered);
 
     // Other functions
     void InitImgui(void* window);
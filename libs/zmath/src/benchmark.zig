@@ -0,0 +1,140 @@
+// -------------------------------------------------------------------------------------------------
+// zmath - benchmarks
+// -------------------------------------------------------------------------------------------------
+// 'zig build benchmark' in the root project directory will build and run 'ReleaseFast' configuration.
+//
+// Compares the structure-of-arrays kernels from soa.zig against the per-vertex loops over
+// [3]f32 arrays that callers write today. Throughput is reported in millions of vertices per second.
+//
+// -------------------------------------------------------------------------------------------------
+const std = @import("std");
+const zm = @import("zmath");
+
+const vertex_count = 1 << 20;
+const repeat_count = 50;
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    std.debug.print("\n", .{});
+    std.debug.print("{s:>24} | {s:>12} | {s:>12} | {s:>8}\n", .{ "kernel", "scalar Mv/s", "soa Mv/s", "speedup" });
+    std.debug.print("{s:-<66}\n", .{""});
+
+    const aos = try allocator.alloc([3]f32, vertex_count);
+    defer allocator.free(aos);
+    const aos_out = try allocator.alloc([3]f32, vertex_count);
+    defer allocator.free(aos_out);
+
+    var prng = std.Random.DefaultPrng.init(0);
+    const random = prng.random();
+    for (aos) |*p| {
+        p.* = .{ random.float(f32) * 20.0 - 10.0, random.float(f32) * 20.0 - 10.0, random.float(f32) * 20.0 - 10.0 };
+    }
+
+    const storage = try allocator.alloc(f32, vertex_count * 6);
+    defer allocator.free(storage);
+    const in = zm.soa.Arrays3{
+        .x = storage[0..vertex_count],
+        .y = storage[vertex_count .. 2 * vertex_count],
+        .z = storage[2 * vertex_count .. 3 * vertex_count],
+    };
+    const out = zm.soa.Arrays3{
+        .x = storage[3 * vertex_count .. 4 * vertex_count],
+        .y = storage[4 * vertex_count .. 5 * vertex_count],
+        .z = storage[5 * vertex_count .. 6 * vertex_count],
+    };
+    zm.soa.deinterleave3(in, aos);
+
+    const m = zm.mul(zm.mul(zm.scaling(2.0, 3.0, 4.0), zm.rotationY(0.7)), zm.translation(1.0, -2.0, 3.0));
+
+    // Transform points
+    {
+        const scalar = measure(struct {
+            fn run(a: []const [3]f32, o: [][3]f32, mat: zm.Mat) void {
+                for (a, o) |p, *r| zm.storeArr3(r, zm.mul(zm.loadArr3w(p, 1.0), mat));
+            }
+        }.run, .{ aos, aos_out, m });
+        const soa = measure(zm.soa.transformPoints, .{ out, in.asConst(), m });
+        report("transformPoints", scalar, soa);
+    }
+
+    // Transform vectors
+    {
+        const scalar = measure(struct {
+            fn run(a: []const [3]f32, o: [][3]f32, mat: zm.Mat) void {
+                for (a, o) |p, *r| zm.storeArr3(r, zm.mul(zm.loadArr3(p), mat));
+            }
+        }.run, .{ aos, aos_out, m });
+        const soa = measure(zm.soa.transformVectors, .{ out, in.asConst(), m });
+        report("transformVectors", scalar, soa);
+    }
+
+    // Transform normals
+    {
+        const scalar = measure(struct {
+            fn run(a: []const [3]f32, o: [][3]f32, mat: zm.Mat) void {
+                const n = zm.transpose(zm.inverse(mat));
+                for (a, o) |p, *r| zm.storeArr3(r, zm.normalize3(zm.mul(zm.loadArr3(p), n)));
+            }
+        }.run, .{ aos, aos_out, m });
+        const soa = measure(zm.soa.transformNormals, .{ out, in.asConst(), m });
+        report("transformNormals", scalar, soa);
+    }
+
+    // Normalize
+    {
+        const scalar = measure(struct {
+            fn run(a: []const [3]f32, o: [][3]f32) void {
+                for (a, o) |p, *r| zm.storeArr3(r, zm.normalize3(zm.loadArr3(p)));
+            }
+        }.run, .{ aos, aos_out });
+        const soa = measure(zm.soa.normalize, .{ out, in.asConst() });
+        report("normalize", scalar, soa);
+    }
+
+    // Bounding box
+    {
+        const scalar = measure(struct {
+            fn run(a: []const [3]f32) void {
+                var min = zm.loadArr3(a[0]);
+                var max = min;
+                for (a) |p| {
+                    const v = zm.loadArr3(p);
+                    min = @min(min, v);
+                    max = @max(max, v);
+                }
+                std.mem.doNotOptimizeAway(min);
+                std.mem.doNotOptimizeAway(max);
+            }
+        }.run, .{aos});
+        const soa = measure(struct {
+            fn run(a: zm.soa.ConstArrays3) void {
+                std.mem.doNotOptimizeAway(zm.soa.computeAabb(a));
+            }
+        }.run, .{in.asConst()});
+        report("computeAabb", scalar, soa);
+    }
+
+    std.mem.doNotOptimizeAway(aos_out);
+    std.mem.doNotOptimizeAway(storage);
+}
+
+/// Best time of repeat_count runs in nanoseconds
+fn measure(comptime function: anytype, args: anytype) u64 {
+    var best: u64 = std.math.maxInt(u64);
+    var timer = std.time.Timer.start() catch unreachable;
+    for (0..repeat_count) |_| {
+        timer.reset();
+        @call(.never_inline, function, args);
+        best = @min(best, timer.read());
+    }
+    return best;
+}
+
+fn report(name: []const u8, scalar_ns: u64, soa_ns: u64) void {
+    const scalar_rate = @as(f64, vertex_count) * 1e3 / @as(f64, @floatFromInt(@max(scalar_ns, 1)));
+    const soa_rate = @as(f64, vertex_count) * 1e3 / @as(f64, @floatFromInt(@max(soa_ns, 1)));
+    std.debug.print("{s:>24} | {d:>12.1} | {d:>12.1} | {d:>7.2}x\n", .{ name, scalar_rate, soa_rate, soa_rate / scalar_rate });
+}
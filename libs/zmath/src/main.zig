@@ -5,13 +5,16 @@
 //
 // See zmath.zig for more details.
 // See util.zig for additional functionality.
+// See soa.zig for bulk kernels over structure-of-arrays geometry.
 //
 //
 //--------------------------------------------------------------------------------------------------
 pub usingnamespace @import("zmath.zig");
 pub const util = @import("util.zig");
+pub const soa = @import("soa.zig");
 
 // ensure transitive closure of test coverage
 comptime {
     _ = util;
+    _ = soa;
 }
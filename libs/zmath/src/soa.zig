@@ -0,0 +1,348 @@
+// ==============================================================================
+//
+// Bulk kernels over structure-of-arrays geometry, building on top of core zmath.
+// https://github.com/michal-z/zig-gamedev/tree/main/libs/zmath
+//
+// Components are stored in separate arrays (x[], y[], z[]), so every kernel works on
+// 16 elements per step (F32x16), then 8 (F32x8), then finishes the tail one element at a time.
+// Matrices use the zmath convention: row vectors, p' = mul(p, m).
+// Output arrays may alias the input arrays.
+//
+// ------------------------------------------------------------------------------
+// 1. Layout conversion
+// ------------------------------------------------------------------------------
+//
+// deinterleave3(out: Arrays3, in: []const [3]f32) void
+// interleave3(out: [][3]f32, in: ConstArrays3) void
+//
+// ------------------------------------------------------------------------------
+// 2. Transforms
+// ------------------------------------------------------------------------------
+//
+// transformPoints(out: Arrays3, in: ConstArrays3, m: Mat) void   - w = 1, translated
+// transformVectors(out: Arrays3, in: ConstArrays3, m: Mat) void  - w = 0, not translated
+// transformNormals(out: Arrays3, in: ConstArrays3, m: Mat) void  - inverse transpose, normalized
+//
+// ------------------------------------------------------------------------------
+// 3. Reductions and normalization
+// ------------------------------------------------------------------------------
+//
+// computeAabb(in: ConstArrays3) Aabb
+// normalize(out: Arrays3, in: ConstArrays3) void                 - zero vectors stay zero
+//
+// ==============================================================================
+//
+const zm = @import("zmath.zig");
+const std = @import("std");
+const expect = std.testing.expect;
+
+pub const Arrays3 = struct {
+    x: []f32,
+    y: []f32,
+    z: []f32,
+
+    pub fn len(self: Arrays3) usize {
+        return self.x.len;
+    }
+
+    pub fn asConst(self: Arrays3) ConstArrays3 {
+        return .{ .x = self.x, .y = self.y, .z = self.z };
+    }
+};
+
+pub const ConstArrays3 = struct {
+    x: []const f32,
+    y: []const f32,
+    z: []const f32,
+
+    pub fn len(self: ConstArrays3) usize {
+        return self.x.len;
+    }
+};
+
+pub const Aabb = struct {
+    min: [3]f32,
+    max: [3]f32,
+};
+
+// ------------------------------------------------------------------------------
+//
+// 1. Layout conversion
+//
+// ------------------------------------------------------------------------------
+pub fn deinterleave3(out: Arrays3, in: []const [3]f32) void {
+    std.debug.assert(out.x.len == in.len and out.y.len == in.len and out.z.len == in.len);
+    for (in, 0..) |p, i| {
+        out.x[i] = p[0];
+        out.y[i] = p[1];
+        out.z[i] = p[2];
+    }
+}
+
+pub fn interleave3(out: [][3]f32, in: ConstArrays3) void {
+    std.debug.assert(in.x.len == out.len and in.y.len == out.len and in.z.len == out.len);
+    for (out, 0..) |*p, i| {
+        p.* = .{ in.x[i], in.y[i], in.z[i] };
+    }
+}
+
+test "zmath.soa.interleave" {
+    const points = [_][3]f32{ .{ 1.0, 2.0, 3.0 }, .{ 4.0, 5.0, 6.0 } };
+    var x: [2]f32 = undefined;
+    var y: [2]f32 = undefined;
+    var z: [2]f32 = undefined;
+    deinterleave3(.{ .x = &x, .y = &y, .z = &z }, &points);
+    try expect(x[1] == 4.0 and y[0] == 2.0 and z[1] == 6.0);
+
+    var back: [2][3]f32 = undefined;
+    interleave3(&back, .{ .x = &x, .y = &y, .z = &z });
+    try expect(std.mem.eql(f32, &back[0], &points[0]) and std.mem.eql(f32, &back[1], &points[1]));
+}
+
+// ------------------------------------------------------------------------------
+//
+// 2. Transforms
+//
+// ------------------------------------------------------------------------------
+pub fn transformPoints(out: Arrays3, in: ConstArrays3, m: zm.Mat) void {
+    forEach(Affine(true), out, in, .{ .m = m });
+}
+
+pub fn transformVectors(out: Arrays3, in: ConstArrays3, m: zm.Mat) void {
+    forEach(Affine(false), out, in, .{ .m = m });
+}
+
+pub fn transformNormals(out: Arrays3, in: ConstArrays3, m: zm.Mat) void {
+    forEach(Normal, out, in, .{ .m = zm.transpose(zm.inverse(m)) });
+}
+
+test "zmath.soa.transformPoints" {
+    const m = zm.mul(zm.mul(zm.scaling(2.0, 3.0, 4.0), zm.rotationY(0.7)), zm.translation(1.0, -2.0, 3.0));
+    // Lengths cover the F32x16 body, the F32x8 step and the scalar tail
+    inline for (.{ 0, 1, 7, 8, 9, 16, 25, 33 }) |n| {
+        var data = testData(n);
+        const in = data.arrays().asConst();
+        var out_data = testData(n);
+        const out = out_data.arrays();
+
+        transformPoints(out, in, m);
+        for (0..n) |i| {
+            const expected = zm.mul(zm.f32x4(in.x[i], in.y[i], in.z[i], 1.0), m);
+            try expectClose3(out, i, expected);
+        }
+
+        transformVectors(out, in, m);
+        for (0..n) |i| {
+            const expected = zm.mul(zm.f32x4(in.x[i], in.y[i], in.z[i], 0.0), m);
+            try expectClose3(out, i, expected);
+        }
+    }
+}
+
+test "zmath.soa.transformNormals" {
+    const m = zm.mul(zm.scaling(1.0, 4.0, 1.0), zm.rotationZ(0.3));
+    var data = testData(19);
+    const in = data.arrays().asConst();
+
+    // Normals stay perpendicular to transformed tangents
+    var n_data = testData(19);
+    const normals = n_data.arrays();
+    transformNormals(normals, in, m);
+
+    const tangent = zm.f32x4(1.0, 0.0, 0.0, 0.0);
+    for (0..19) |i| {
+        const n = zm.f32x4(in.x[i], in.y[i], in.z[i], 0.0);
+        const t = zm.cross3(n, tangent); // Perpendicular to n
+        const t_world = zm.mul(t, m);
+        const n_world = zm.f32x4(normals.x[i], normals.y[i], normals.z[i], 0.0);
+        try expect(@abs(zm.dot3(t_world, n_world)[0]) < 1e-4);
+        try expect(std.math.approxEqAbs(f32, zm.length3(n_world)[0], 1.0, 1e-4));
+    }
+}
+
+// ------------------------------------------------------------------------------
+//
+// 3. Reductions and normalization
+//
+// ------------------------------------------------------------------------------
+pub fn computeAabb(in: ConstArrays3) Aabb {
+    const n = in.len();
+    var result = Aabb{
+        .min = .{ std.math.inf(f32), std.math.inf(f32), std.math.inf(f32) },
+        .max = .{ -std.math.inf(f32), -std.math.inf(f32), -std.math.inf(f32) },
+    };
+
+    var i: usize = 0;
+    if (n >= 16) {
+        var min_x = zm.f32x16s(std.math.inf(f32));
+        var min_y = min_x;
+        var min_z = min_x;
+        var max_x = -min_x;
+        var max_y = max_x;
+        var max_z = max_x;
+        while (i + 16 <= n) : (i += 16) {
+            const x: zm.F32x16 = in.x[i..][0..16].*;
+            const y: zm.F32x16 = in.y[i..][0..16].*;
+            const z: zm.F32x16 = in.z[i..][0..16].*;
+            min_x = @min(min_x, x);
+            min_y = @min(min_y, y);
+            min_z = @min(min_z, z);
+            max_x = @max(max_x, x);
+            max_y = @max(max_y, y);
+            max_z = @max(max_z, z);
+        }
+        result.min = .{ @reduce(.Min, min_x), @reduce(.Min, min_y), @reduce(.Min, min_z) };
+        result.max = .{ @reduce(.Max, max_x), @reduce(.Max, max_y), @reduce(.Max, max_z) };
+    }
+    if (i + 8 <= n) {
+        const x: zm.F32x8 = in.x[i..][0..8].*;
+        const y: zm.F32x8 = in.y[i..][0..8].*;
+        const z: zm.F32x8 = in.z[i..][0..8].*;
+        result.min = .{ @min(result.min[0], @reduce(.Min, x)), @min(result.min[1], @reduce(.Min, y)), @min(result.min[2], @reduce(.Min, z)) };
+        result.max = .{ @max(result.max[0], @reduce(.Max, x)), @max(result.max[1], @reduce(.Max, y)), @max(result.max[2], @reduce(.Max, z)) };
+        i += 8;
+    }
+    while (i < n) : (i += 1) {
+        const p = [3]f32{ in.x[i], in.y[i], in.z[i] };
+        for (0..3) |axis| {
+            result.min[axis] = @min(result.min[axis], p[axis]);
+            result.max[axis] = @max(result.max[axis], p[axis]);
+        }
+    }
+    return result;
+}
+
+pub fn normalize(out: Arrays3, in: ConstArrays3) void {
+    forEach(Normalize, out, in, .{});
+}
+
+test "zmath.soa.computeAabb" {
+    inline for (.{ 1, 8, 15, 16, 41 }) |n| {
+        var data = testData(n);
+        const in = data.arrays().asConst();
+        const aabb = computeAabb(in);
+        for (0..n) |i| {
+            try expect(in.x[i] >= aabb.min[0] and in.x[i] <= aabb.max[0]);
+            try expect(in.y[i] >= aabb.min[1] and in.y[i] <= aabb.max[1]);
+            try expect(in.z[i] >= aabb.min[2] and in.z[i] <= aabb.max[2]);
+        }
+        try expect(std.mem.indexOfScalar(f32, in.x, aabb.min[0]) != null);
+        try expect(std.mem.indexOfScalar(f32, in.z, aabb.max[2]) != null);
+    }
+}
+
+test "zmath.soa.normalize" {
+    inline for (.{ 3, 8, 24, 27 }) |n| {
+        var data = testData(n);
+        const v = data.arrays();
+        v.x[0] = 0.0;
+        v.y[0] = 0.0;
+        v.z[0] = 0.0;
+        normalize(v, v.asConst());
+
+        try expect(v.x[0] == 0.0 and v.y[0] == 0.0 and v.z[0] == 0.0);
+        for (1..n) |i| {
+            const length = @sqrt(v.x[i] * v.x[i] + v.y[i] * v.y[i] + v.z[i] * v.z[i]);
+            try expect(std.math.approxEqAbs(f32, length, 1.0, 1e-5));
+        }
+    }
+}
+
+// ------------------------------------------------------------------------------
+//
+// Private functions and tests
+//
+// ------------------------------------------------------------------------------
+
+/// Runs Kernel.apply over all elements: F32x16 steps, one F32x8 step, then single elements
+fn forEach(comptime Kernel: type, out: Arrays3, in: ConstArrays3, kernel: Kernel) void {
+    const n = in.len();
+    std.debug.assert(in.y.len == n and in.z.len == n);
+    std.debug.assert(out.x.len == n and out.y.len == n and out.z.len == n);
+
+    var i: usize = 0;
+    while (i + 16 <= n) : (i += 16) {
+        step(Kernel, 16, out, in, kernel, i);
+    }
+    if (i + 8 <= n) {
+        step(Kernel, 8, out, in, kernel, i);
+        i += 8;
+    }
+    while (i < n) : (i += 1) {
+        step(Kernel, 1, out, in, kernel, i);
+    }
+}
+
+inline fn step(comptime Kernel: type, comptime width: comptime_int, out: Arrays3, in: ConstArrays3, kernel: Kernel, i: usize) void {
+    const T = @Vector(width, f32);
+    const x: T = in.x[i..][0..width].*;
+    const y: T = in.y[i..][0..width].*;
+    const z: T = in.z[i..][0..width].*;
+    const r = kernel.apply(T, x, y, z);
+    out.x[i..][0..width].* = r[0];
+    out.y[i..][0..width].* = r[1];
+    out.z[i..][0..width].* = r[2];
+}
+
+fn Affine(comptime translate: bool) type {
+    return struct {
+        m: zm.Mat,
+
+        inline fn apply(self: @This(), comptime T: type, x: T, y: T, z: T) [3]T {
+            var r: [3]T = undefined;
+            inline for (0..3) |c| {
+                r[c] = x * @as(T, @splat(self.m[0][c])) + y * @as(T, @splat(self.m[1][c])) + z * @as(T, @splat(self.m[2][c]));
+                if (translate) r[c] += @as(T, @splat(self.m[3][c]));
+            }
+            return r;
+        }
+    };
+}
+
+const Normal = struct {
+    m: zm.Mat, // Inverse transpose
+
+    inline fn apply(self: Normal, comptime T: type, x: T, y: T, z: T) [3]T {
+        const r = (Affine(false){ .m = self.m }).apply(T, x, y, z);
+        return Normalize.apply(.{}, T, r[0], r[1], r[2]);
+    }
+};
+
+const Normalize = struct {
+    inline fn apply(_: Normalize, comptime T: type, x: T, y: T, z: T) [3]T {
+        const length_sq = x * x + y * y + z * z;
+        const zero: T = @splat(0.0);
+        const inv = @select(f32, length_sq > zero, @as(T, @splat(1.0)) / @sqrt(length_sq), zero);
+        return .{ x * inv, y * inv, z * inv };
+    }
+};
+
+/// Deterministic test data in SoA form
+fn TestData(comptime n: usize) type {
+    return struct {
+        x: [n]f32,
+        y: [n]f32,
+        z: [n]f32,
+
+        fn arrays(self: *@This()) Arrays3 {
+            return .{ .x = &self.x, .y = &self.y, .z = &self.z };
+        }
+    };
+}
+
+fn testData(comptime n: usize) TestData(n) {
+    var data: TestData(n) = undefined;
+    for (0..n) |i| {
+        const f: f32 = @floatFromInt(i);
+        data.x[i] = @sin(f * 1.3) * 5.0 + 0.5;
+        data.y[i] = @cos(f * 0.7) * 3.0 - 1.0;
+        data.z[i] = @sin(f * 2.1 + 0.4) * 7.0;
+    }
+    return data;
+}
+
+fn expectClose3(out: Arrays3, i: usize, expected: zm.F32x4) !void {
+    try expect(std.math.approxEqAbs(f32, out.x[i], expected[0], 1e-4));
+    try expect(std.math.approxEqAbs(f32, out.y[i], expected[1], 1e-4));
+    try expect(std.math.approxEqAbs(f32, out.z[i], expected[2], 1e-4));
+}
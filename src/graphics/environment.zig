@@ -0,0 +1,818 @@
+//! Image based lighting from an HDR panorama
+//!
+//! An equirectangular panorama (.hdr, LDR images are linearized) is prefiltered on the CPU by a
+//! background thread that splits every stage over worker threads:
+//! - conversion to a cubemap with a box filtered mip chain
+//! - projection of the diffuse irradiance onto 9 spherical harmonics
+//! - GGX prefiltered specular mips (roughness 0 .. 1)
+//! - the split-sum BRDF lookup table
+//! Texel loops run LANES texels at a time with @Vector. Results are cached in .zglcache/ keyed by
+//! a hash of the panorama bytes, so a known panorama only costs a file read. The fragment shader
+//! evaluates the SH and does one cubemap and one LUT fetch.
+
+const std = @import("std");
+const gl = @import("gl");
+
+const glDebug = @import("glDebug.zig");
+const imageDecoder = @import("imageDecoder.zig");
+const diagnostics = @import("../util/diagnostics.zig");
+const memory = @import("../util/memory.zig");
+
+const MAGIC = "ZGE1";
+const CACHE_DIR = ".zglcache";
+const MAX_SOURCE_SIZE = 1 << 30;
+
+const BASE_SIZE = 256; // Face size of the converted panorama
+const BASE_LEVELS = std.math.log2_int(usize, BASE_SIZE) + 1;
+const SPECULAR_SIZE = 128; // Face size of specular mip 0
+const SPECULAR_LEVELS = 6; // 128 .. 4 texels, roughness 0 .. 1
+const SPECULAR_SAMPLES = 64;
+const LUT_SIZE = 64;
+const LUT_SAMPLES = 256;
+const SH_COUNT = 9;
+
+const MAX_THREADS = 16;
+const LANES = 8;
+
+// Texture units after the four material maps
+pub const SPECULAR_UNIT = 4;
+pub const LUT_UNIT = 5;
+
+const Color = @Vector(4, f32); // RGB, the last lane is unused
+const Lanes = @Vector(LANES, f32);
+
+const allocator = memory.allocator(.textures);
+
+/// Prefiltered environment, computed on the CPU or read from the cache
+///
+/// Contains:
+/// - sh: irradiance / pi as SH coefficients (RGB), multiplied with the albedo in the shader
+/// - specular: RGB half floats of the six faces, level after level
+/// - lut: BRDF scale and bias (RG half floats), NdotV along x, roughness along y
+const Prefiltered = struct {
+    sh: [SH_COUNT][3]f32,
+    specular: []f16,
+    lut: []f16,
+
+    fn deinit(self: *Prefiltered) void {
+        allocator.free(self.specular);
+        allocator.free(self.lut);
+    }
+};
+
+/// Environment textures on the GPU
+///
+/// Contains:
+/// - specular: prefiltered cubemap with SPECULAR_LEVELS mips
+/// - lut: BRDF lookup table
+/// - sh: irradiance coefficients
+pub const Environment = struct {
+    specular: gl.uint = 0,
+    lut: gl.uint = 0,
+    sh: [SH_COUNT][3]f32 = [_][3]f32{.{ 0, 0, 0 }} ** SH_COUNT,
+};
+
+pub var current: ?Environment = null;
+
+// Background preparation, the result is picked up by update on the main thread
+var thread: ?std.Thread = null;
+var ready = std.atomic.Value(bool).init(false);
+var outcome: anyerror!Prefiltered = error.NotStarted;
+
+/// Start preparing a panorama in the background, the current environment stays until it is done
+pub fn load(path: []const u8) !void {
+    if (thread != null) return error.EnvironmentBusy;
+
+    const ownedPath = try allocator.dupe(u8, path);
+    errdefer allocator.free(ownedPath);
+
+    ready.store(false, .release);
+    thread = try std.Thread.spawn(.{}, prepare, .{ownedPath});
+}
+
+/// True while a panorama is being prepared
+pub fn isLoading() bool {
+    return thread != null;
+}
+
+/// Upload a finished environment, call once per frame on the GL thread
+pub fn update() void {
+    if (thread == null or !ready.load(.acquire)) return;
+    thread.?.join();
+    thread = null;
+
+    var prefiltered = outcome catch |err| {
+        diagnostics.report(.EnvironmentLoadFailed, 0, "Could not load environment: {s}", .{@errorName(err)});
+        return;
+    };
+    defer prefiltered.deinit();
+
+    unload();
+    current = upload(&prefiltered);
+}
+
+/// Bind the environment for the mesh shader
+/// The samplers always point at their own units, samplers of different types may not share one
+pub fn bind(program: gl.uint) void {
+    gl.Uniform1i(gl.GetUniformLocation(program, "environmentSpecular"), SPECULAR_UNIT);
+    gl.Uniform1i(gl.GetUniformLocation(program, "brdfLut"), LUT_UNIT);
+
+    const environment = current orelse {
+        gl.Uniform1i(gl.GetUniformLocation(program, "useEnvironment"), 0);
+        return;
+    };
+
+    gl.ActiveTexture(gl.TEXTURE0 + SPECULAR_UNIT);
+    gl.BindTexture(gl.TEXTURE_CUBE_MAP, environment.specular);
+    gl.ActiveTexture(gl.TEXTURE0 + LUT_UNIT);
+    gl.BindTexture(gl.TEXTURE_2D, environment.lut);
+    gl.ActiveTexture(gl.TEXTURE0);
+
+    gl.Uniform1i(gl.GetUniformLocation(program, "useEnvironment"), 1);
+    gl.Uniform1f(gl.GetUniformLocation(program, "specularLevels"), SPECULAR_LEVELS);
+    gl.Uniform3fv(gl.GetUniformLocation(program, "shCoefficients"), SH_COUNT, &environment.sh[0]);
+}
+
+/// Delete the environment textures
+pub fn unload() void {
+    const environment = current orelse return;
+    memory.untrackGpu(.texture, environment.specular);
+    memory.untrackGpu(.texture, environment.lut);
+    gl.DeleteTextures(1, (&environment.specular)[0..1]);
+    gl.DeleteTextures(1, (&environment.lut)[0..1]);
+    current = null;
+}
+
+/// Wait for a running preparation and free everything
+pub fn deinit() void {
+    if (thread) |running| {
+        running.join();
+        thread = null;
+        if (outcome) |*prefiltered| prefiltered.deinit() else |_| {}
+    }
+    unload();
+}
+
+fn prepare(path: []u8) void {
+    defer allocator.free(path);
+    outcome = prepareCached(path);
+    ready.store(true, .release);
+}
+
+/// Read the prefiltered environment from the cache or compute and store it
+fn prepareCached(path: []const u8) !Prefiltered {
+    const source = try std.fs.cwd().readFileAlloc(allocator, path, MAX_SOURCE_SIZE);
+    defer allocator.free(source);
+
+    const cachePath = try std.fmt.allocPrint(allocator, CACHE_DIR ++ "/{x:0>16}.zge", .{std.hash.Wyhash.hash(0, source)});
+    defer allocator.free(cachePath);
+
+    if (readCache(cachePath)) |prefiltered| {
+        std.log.info("Environment {s} read from {s}", .{ path, cachePath });
+        return prefiltered;
+    } else |err| if (err != error.FileNotFound) {
+        std.log.warn("Ignoring environment cache {s}: {s}", .{ cachePath, @errorName(err) });
+    }
+
+    var timer = try std.time.Timer.start();
+    var prefiltered = try compute(source);
+    errdefer prefiltered.deinit();
+    std.log.info("Environment {s} prefiltered in {d} ms", .{ path, timer.read() / std.time.ns_per_ms });
+
+    std.fs.cwd().makePath(CACHE_DIR) catch {};
+    writeCache(cachePath, &prefiltered) catch |err| {
+        std.log.warn("Could not write environment cache {s}: {s}", .{ cachePath, @errorName(err) });
+    };
+    return prefiltered;
+}
+
+/// Run all prefiltering stages on a decoded panorama
+fn compute(source: []const u8) !Prefiltered {
+    var panorama = try Panorama.decode(source);
+    defer panorama.deinit();
+
+    var base = try Cubemap.init(BASE_SIZE, BASE_LEVELS);
+    defer base.deinit();
+
+    var conversion = ConversionJob{ .panorama = &panorama, .cubemap = &base };
+    parallelFor(6 * BASE_SIZE, &conversion, ConversionJob.run);
+    base.buildMips();
+
+    var projection = ProjectionJob{ .cubemap = &base };
+    parallelFor(6 * BASE_SIZE, &projection, ProjectionJob.run);
+
+    const specular = try allocator.alloc(f16, specularOffset(SPECULAR_LEVELS));
+    errdefer allocator.free(specular);
+    var prefilter = PrefilterJob{ .cubemap = &base, .output = specular };
+    for (&prefilter.samples, &prefilter.sampleCounts, 0..) |*samples, *count, level| {
+        count.* = specularSamples(roughnessOfLevel(level), samples);
+    }
+    parallelFor(specularRows(SPECULAR_LEVELS), &prefilter, PrefilterJob.run);
+
+    const lut = try allocator.alloc(f16, LUT_SIZE * LUT_SIZE * 2);
+    errdefer allocator.free(lut);
+    var integration = LutJob{ .output = lut };
+    parallelFor(LUT_SIZE, &integration, LutJob.run);
+
+    return .{ .sh = projection.coefficients(), .specular = specular, .lut = lut };
+}
+
+/// Run task(context, first, last, thread) over 0..count, one contiguous range per thread
+/// The calling thread takes the first range, ranges whose thread could not be spawned run inline
+fn parallelFor(count: usize, context: anytype, comptime task: fn (@TypeOf(context), usize, usize, usize) void) void {
+    const cpuCount = std.Thread.getCpuCount() catch 1;
+    const threadCount = std.math.clamp(@min(cpuCount, count), 1, MAX_THREADS);
+
+    var threads: [MAX_THREADS]?std.Thread = [_]?std.Thread{null} ** MAX_THREADS;
+    for (1..threadCount) |t| {
+        threads[t] = std.Thread.spawn(.{}, task, .{ context, count * t / threadCount, count * (t + 1) / threadCount, t }) catch null;
+    }
+    task(context, 0, count / threadCount, 0);
+    for (threads[1..threadCount], 1..) |spawned, t| {
+        if (spawned) |handle| handle.join() else task(context, count * t / threadCount, count * (t + 1) / threadCount, t);
+    }
+}
+
+/// Equirectangular panorama in linear RGB
+const Panorama = struct {
+    texels: []Color,
+    width: usize,
+    height: usize,
+
+    /// Decode an .hdr (or an sRGB image, which is linearized)
+    fn decode(source: []const u8) !Panorama {
+        // Explicit orientation, this runs on a background thread while models may be decoded
+        var image = try imageDecoder.loadFromMemory(source, 4, true);
+        defer image.deinit();
+
+        const count = @as(usize, image.width) * image.height;
+        const texels = try allocator.alloc(Color, count);
+        if (image.is_hdr) {
+            const floats = std.mem.bytesAsSlice(f32, image.data);
+            for (texels, 0..) |*texel, i| {
+                texel.* = .{ floats[i * 4], floats[i * 4 + 1], floats[i * 4 + 2], 0 };
+            }
+        } else {
+            const gamma: Color = @splat(2.2);
+            for (texels, 0..) |*texel, i| {
+                const bytes = image.data[i * 4 ..][0..4];
+                const srgb = Color{ @floatFromInt(bytes[0]), @floatFromInt(bytes[1]), @floatFromInt(bytes[2]), 0 } / @as(Color, @splat(255));
+                texel.* = @exp2(@log2(srgb + @as(Color, @splat(1e-8))) * gamma);
+            }
+        }
+        return .{ .texels = texels, .width = image.width, .height = image.height };
+    }
+
+    fn deinit(self: *Panorama) void {
+        allocator.free(self.texels);
+    }
+
+    /// Bilinear sample in a direction, wraps horizontally
+    /// decode flips the rows, so row 0 is the bottom of the panorama
+    fn sample(self: *const Panorama, x: f32, y: f32, z: f32) Color {
+        const u = 0.5 + std.math.atan2(x, -z) / (2 * std.math.pi);
+        const v = std.math.acos(std.math.clamp(-y, -1, 1)) / std.math.pi;
+
+        const fx = u * @as(f32, @floatFromInt(self.width)) - 0.5;
+        const fy = std.math.clamp(v * @as(f32, @floatFromInt(self.height)) - 0.5, 0, @as(f32, @floatFromInt(self.height - 1)));
+        const x0 = @floor(fx);
+        const y0 = @floor(fy);
+        const tx: Color = @splat(fx - x0);
+        const ty: Color = @splat(fy - y0);
+
+        const w: isize = @intCast(self.width);
+        const column0: usize = @intCast(@mod(@as(isize, @intFromFloat(x0)), w));
+        const column1: usize = @intCast(@mod(@as(isize, @intFromFloat(x0)) + 1, w));
+        const row0: usize = @intFromFloat(y0);
+        const row1 = @min(row0 + 1, self.height - 1);
+
+        const top = lerp(self.texels[row0 * self.width + column0], self.texels[row0 * self.width + column1], tx);
+        const bottom = lerp(self.texels[row1 * self.width + column0], self.texels[row1 * self.width + column1], tx);
+        return lerp(top, bottom, ty);
+    }
+};
+
+/// Cubemap with a mip chain, faces in GL order (+X, -X, +Y, -Y, +Z, -Z)
+const Cubemap = struct {
+    size: usize,
+    levels: [BASE_LEVELS][]Color,
+    levelCount: usize,
+
+    fn init(size: usize, levelCount: usize) !Cubemap {
+        var cubemap = Cubemap{ .size = size, .levels = undefined, .levelCount = 0 };
+        errdefer cubemap.deinit();
+        for (0..levelCount) |level| {
+            const levelSize = size >> @intCast(level);
+            cubemap.levels[level] = try allocator.alloc(Color, 6 * levelSize * levelSize);
+            cubemap.levelCount += 1;
+        }
+        return cubemap;
+    }
+
+    fn deinit(self: *Cubemap) void {
+        for (self.levels[0..self.levelCount]) |level| allocator.free(level);
+    }
+
+    /// Box filter every level from the one above
+    fn buildMips(self: *Cubemap) void {
+        const quarter: Color = @splat(0.25);
+        for (1..self.levelCount) |level| {
+            const size = self.size >> @intCast(level);
+            const src = self.levels[level - 1];
+            for (0..6) |face| {
+                for (0..size) |y| {
+                    for (0..size) |x| {
+                        const row0 = (face * size * 2 + y * 2) * size * 2;
+                        const row1 = row0 + size * 2;
+                        self.levels[level][(face * size + y) * size + x] = (src[row0 + x * 2] + src[row0 + x * 2 + 1] + src[row1 + x * 2] + src[row1 + x * 2 + 1]) * quarter;
+                    }
+                }
+            }
+        }
+    }
+
+    /// Bilinear sample of one level, clamped at the face edges
+    fn sampleLevel(self: *const Cubemap, direction: [3]f32, level: usize) Color {
+        const face, const u, const v = project(direction);
+        const size = self.size >> @intCast(level);
+        const last: f32 = @floatFromInt(size - 1);
+
+        const fx = std.math.clamp(u * @as(f32, @floatFromInt(size)) - 0.5, 0, last);
+        const fy = std.math.clamp(v * @as(f32, @floatFromInt(size)) - 0.5, 0, last);
+        const x0: usize = @intFromFloat(fx);
+        const y0: usize = @intFromFloat(fy);
+        const x1 = @min(x0 + 1, size - 1);
+        const y1 = @min(y0 + 1, size - 1);
+        const tx: Color = @splat(fx - @floor(fx));
+        const ty: Color = @splat(fy - @floor(fy));
+
+        const texels = self.levels[level][face * size * size ..];
+        const top = lerp(texels[y0 * size + x0], texels[y0 * size + x1], tx);
+        const bottom = lerp(texels[y1 * size + x0], texels[y1 * size + x1], tx);
+        return lerp(top, bottom, ty);
+    }
+
+    /// Trilinear sample between two levels
+    fn sample(self: *const Cubemap, direction: [3]f32, lod: f32) Color {
+        const clamped = std.math.clamp(lod, 0, @as(f32, @floatFromInt(self.levelCount - 1)));
+        const level: usize = @intFromFloat(clamped);
+        const next = @min(level + 1, self.levelCount - 1);
+        return lerp(self.sampleLevel(direction, level), self.sampleLevel(direction, next), @splat(clamped - @floor(clamped)));
+    }
+};
+
+/// Panorama -> base cubemap, 2x2 samples per texel
+const ConversionJob = struct {
+    panorama: *const Panorama,
+    cubemap: *Cubemap,
+
+    fn run(self: *ConversionJob, first: usize, last: usize, _: usize) void {
+        const size = self.cubemap.size;
+        const offsets = [_][2]f32{ .{ 0.25, 0.25 }, .{ 0.75, 0.25 }, .{ 0.25, 0.75 }, .{ 0.75, 0.75 } };
+        const quarter: Color = @splat(0.25);
+
+        for (first..last) |row| {
+            const face = row / size;
+            const y = row % size;
+            const out = self.cubemap.levels[0][row * size ..][0..size];
+
+            var x: usize = 0;
+            while (x < size) : (x += LANES) {
+                const lanes = @min(LANES, size - x);
+                var sums = [_]Color{@splat(0)} ** LANES;
+                for (offsets) |offset| {
+                    const directions = faceDirections(face, x, y, size, offset);
+                    for (sums[0..lanes], 0..) |*sum, lane| {
+                        sum.* += self.panorama.sample(directions[0][lane], directions[1][lane], directions[2][lane]);
+                    }
+                }
+                for (out[x..][0..lanes], sums[0..lanes]) |*texel, sum| {
+                    texel.* = sum * quarter;
+                }
+            }
+        }
+    }
+};
+
+/// Projection of the base cubemap onto 9 SH, weighted by the solid angle of every texel
+const ProjectionJob = struct {
+    cubemap: *const Cubemap,
+    partial: [MAX_THREADS][SH_COUNT]Color = [_][SH_COUNT]Color{[_]Color{@splat(0)} ** SH_COUNT} ** MAX_THREADS,
+
+    fn run(self: *ProjectionJob, first: usize, last: usize, t: usize) void {
+        const size = self.cubemap.size;
+        const texelArea = 4.0 / @as(f32, @floatFromInt(size * size)); // (2 / size)^2 in face coordinates
+        var sums = [_]Color{@splat(0)} ** SH_COUNT;
+
+        for (first..last) |row| {
+            const face = row / size;
+            const y = row % size;
+            const texels = self.cubemap.levels[0][row * size ..][0..size];
+
+            var x: usize = 0;
+            while (x < size) : (x += LANES) {
+                const lanes = @min(LANES, size - x);
+                const d = faceDirections(face, x, y, size, .{ 0.5, 0.5 });
+
+                // Solid angle: texel area / (1 + s^2 + t^2)^(3/2), the unnormalized direction has length sqrt(1 + s^2 + t^2)
+                const s, const tc = faceCoordinates(x, y, size, .{ 0.5, 0.5 });
+                const lengthSq = @as(Lanes, @splat(1)) + s * s + tc * tc;
+                var weight = @as(Lanes, @splat(texelArea)) / (lengthSq * @sqrt(lengthSq));
+                if (lanes < LANES) {
+                    weight = @select(f32, std.simd.iota(u32, LANES) < @as(@Vector(LANES, u32), @splat(@intCast(lanes))), weight, @as(Lanes, @splat(0)));
+                }
+
+                // Channels of the texels as lanes
+                var red: Lanes = @splat(0);
+                var green: Lanes = @splat(0);
+                var blue: Lanes = @splat(0);
+                for (texels[x..][0..lanes], 0..) |texel, lane| {
+                    red[lane] = texel[0];
+                    green[lane] = texel[1];
+                    blue[lane] = texel[2];
+                }
+
+                const basis = shBasis(d[0], d[1], d[2]);
+                for (&sums, basis) |*sum, b| {
+                    const bw = b * weight;
+                    sum.* += Color{ @reduce(.Add, bw * red), @reduce(.Add, bw * green), @reduce(.Add, bw * blue), 0 };
+                }
+            }
+        }
+        self.partial[t] = sums;
+    }
+
+    /// Sum of the partial results convolved with the cosine lobe, divided by pi
+    fn coefficients(self: *const ProjectionJob) [SH_COUNT][3]f32 {
+        const bands = [SH_COUNT]f32{ 1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+        var result: [SH_COUNT][3]f32 = undefined;
+        for (&result, 0..) |*coefficient, k| {
+            var sum: Color = @splat(0);
+            for (self.partial) |partial| sum += partial[k];
+            coefficient.* = .{ sum[0] * bands[k], sum[1] * bands[k], sum[2] * bands[k] };
+        }
+        return result;
+    }
+};
+
+/// GGX sample of the prefilter, in tangent space with N = V = +Z
+///
+/// Contains:
+/// - direction: light direction
+/// - weight: NdotL
+/// - lod: base cubemap level matching the solid angle of the sample
+const Sample = struct {
+    direction: [3]f32,
+    weight: f32,
+    lod: f32,
+};
+
+/// Base cubemap -> prefiltered specular mips
+const PrefilterJob = struct {
+    cubemap: *const Cubemap,
+    output: []f16,
+    samples: [SPECULAR_LEVELS][SPECULAR_SAMPLES]Sample = undefined,
+    sampleCounts: [SPECULAR_LEVELS]usize = undefined,
+
+    fn run(self: *PrefilterJob, first: usize, last: usize, _: usize) void {
+        for (first..last) |row| {
+            // Row -> level, face and y
+            var level: usize = 0;
+            while (row >= specularRows(level + 1)) level += 1;
+            const size = SPECULAR_SIZE >> @intCast(level);
+            const levelRow = row - specularRows(level);
+            const face = levelRow / size;
+            const y = levelRow % size;
+            const out = self.output[specularOffset(level) + levelRow * size * 3 ..][0 .. size * 3];
+
+            var x: usize = 0;
+            while (x < size) : (x += LANES) {
+                const lanes = @min(LANES, size - x);
+                const d = faceDirections(face, x, y, size, .{ 0.5, 0.5 });
+                for (0..lanes) |lane| {
+                    const color = self.filter(.{ d[0][lane], d[1][lane], d[2][lane] }, level);
+                    for (0..3) |channel| {
+                        out[(x + lane) * 3 + channel] = @floatCast(color[channel]);
+                    }
+                }
+            }
+        }
+    }
+
+    fn filter(self: *const PrefilterJob, normal: [3]f32, level: usize) Color {
+        // Mirror reflection, the base is twice the size of level 0
+        if (level == 0) return self.cubemap.sample(normal, std.math.log2(@as(f32, BASE_SIZE / SPECULAR_SIZE)));
+
+        const up: [3]f32 = if (@abs(normal[2]) < 0.999) .{ 0, 0, 1 } else .{ 1, 0, 0 };
+        const tangent = normalize(cross(up, normal));
+        const bitangent = cross(normal, tangent);
+
+        var sum: Color = @splat(0);
+        var weight: f32 = 0;
+        for (self.samples[level][0..self.sampleCounts[level]]) |s| {
+            const l = s.direction;
+            const direction = [3]f32{
+                tangent[0] * l[0] + bitangent[0] * l[1] + normal[0] * l[2],
+                tangent[1] * l[0] + bitangent[1] * l[1] + normal[1] * l[2],
+                tangent[2] * l[0] + bitangent[2] * l[1] + normal[2] * l[2],
+            };
+            sum += self.cubemap.sample(direction, s.lod) * @as(Color, @splat(s.weight));
+            weight += s.weight;
+        }
+        return sum / @as(Color, @splat(@max(weight, 1e-6)));
+    }
+};
+
+/// Importance samples of the GGX lobe for a roughness, returns the number with NdotL > 0
+/// The source level of every sample follows from its pdf (filtered importance sampling)
+fn specularSamples(roughness: f32, out: *[SPECULAR_SAMPLES]Sample) usize {
+    const a = roughness * roughness;
+    const texelSolidAngle = 4.0 * std.math.pi / (6.0 * BASE_SIZE * BASE_SIZE);
+
+    var count: usize = 0;
+    for (0..SPECULAR_SAMPLES) |i| {
+        const xi = hammersley(@intCast(i), SPECULAR_SAMPLES);
+        const phi = 2.0 * std.math.pi * xi[0];
+        const cosTheta = @sqrt((1.0 - xi[1]) / (1.0 + (a * a - 1.0) * xi[1]));
+        const sinTheta = @sqrt(1.0 - cosTheta * cosTheta);
+
+        // L = reflect(-V, H) with V = N
+        const h = [3]f32{ sinTheta * @cos(phi), sinTheta * @sin(phi), cosTheta };
+        const l = [3]f32{ 2 * cosTheta * h[0], 2 * cosTheta * h[1], 2 * cosTheta * cosTheta - 1 };
+        if (l[2] <= 0) continue;
+
+        const d = (cosTheta * cosTheta * (a * a - 1) + 1);
+        const pdf = a * a / (std.math.pi * d * d) / 4.0; // D * NdotH / (4 * VdotH), NdotH = VdotH
+        const sampleSolidAngle = 1.0 / (SPECULAR_SAMPLES * pdf);
+        out[count] = .{
+            .direction = l,
+            .weight = l[2],
+            .lod = 0.5 * std.math.log2(sampleSolidAngle / texelSolidAngle) + 1.0,
+        };
+        count += 1;
+    }
+    return count;
+}
+
+/// Split-sum BRDF integration, LANES values of NdotV per step
+const LutJob = struct {
+    output: []f16,
+
+    fn run(self: *LutJob, first: usize, last: usize, _: usize) void {
+        const one: Lanes = @splat(1);
+        const zero: Lanes = @splat(0);
+
+        for (first..last) |row| {
+            const roughness = (@as(f32, @floatFromInt(row)) + 0.5) / LUT_SIZE;
+            const a = roughness * roughness;
+            const k: Lanes = @splat(a / 2.0);
+
+            var x: usize = 0;
+            while (x < LUT_SIZE) : (x += LANES) {
+                const s, _ = faceCoordinates(x, 0, LUT_SIZE, .{ 0.5, 0.5 });
+                const nDotV = (s + one) * @as(Lanes, @splat(0.5));
+                const vx = @sqrt(one - nDotV * nDotV);
+
+                var scale = zero;
+                var bias = zero;
+                for (0..LUT_SAMPLES) |i| {
+                    // Half vector is the same for all lanes, only V changes
+                    const xi = hammersley(@intCast(i), LUT_SAMPLES);
+                    const cosTheta = @sqrt((1.0 - xi[1]) / (1.0 + (a * a - 1.0) * xi[1]));
+                    const sinTheta = @sqrt(1.0 - cosTheta * cosTheta);
+                    const hx: Lanes = @splat(sinTheta * @cos(2.0 * std.math.pi * xi[0]));
+                    const hz: Lanes = @splat(cosTheta);
+
+                    const vDotH = @max(vx * hx + nDotV * hz, zero);
+                    const nDotL = @as(Lanes, @splat(2)) * vDotH * hz - nDotV;
+                    const nDotLPositive = @max(nDotL, zero);
+
+                    const g = (nDotV / (nDotV * (one - k) + k)) * (nDotLPositive / (nDotLPositive * (one - k) + k));
+                    const visibility = g * vDotH / (hz * nDotV);
+                    const fresnelBase = one - vDotH;
+                    const fresnel = fresnelBase * fresnelBase * fresnelBase * fresnelBase * fresnelBase;
+
+                    const valid = nDotL > zero;
+                    scale += @select(f32, valid, (one - fresnel) * visibility, zero);
+                    bias += @select(f32, valid, fresnel * visibility, zero);
+                }
+
+                const inv: Lanes = @splat(1.0 / @as(f32, LUT_SAMPLES));
+                scale *= inv;
+                bias *= inv;
+                for (0..LANES) |lane| {
+                    self.output[(row * LUT_SIZE + x + lane) * 2] = @floatCast(scale[lane]);
+                    self.output[(row * LUT_SIZE + x + lane) * 2 + 1] = @floatCast(bias[lane]);
+                }
+            }
+        }
+    }
+};
+
+/// Face coordinates in -1 .. 1 of LANES texels starting at x
+fn faceCoordinates(x: usize, y: usize, size: usize, offset: [2]f32) [2]Lanes {
+    const scale: f32 = 2.0 / @as(f32, @floatFromInt(size));
+    const column = std.simd.iota(f32, LANES) + @as(Lanes, @splat(@as(f32, @floatFromInt(x)) + offset[0]));
+    const s = column * @as(Lanes, @splat(scale)) - @as(Lanes, @splat(1));
+    const t: Lanes = @splat((@as(f32, @floatFromInt(y)) + offset[1]) * scale - 1);
+    return .{ s, t };
+}
+
+/// Normalized directions of LANES texels of a face row (GL cubemap conventions)
+fn faceDirections(face: usize, x: usize, y: usize, size: usize, offset: [2]f32) [3]Lanes {
+    const s, const t = faceCoordinates(x, y, size, offset);
+    const one: Lanes = @splat(1);
+    const d: [3]Lanes = switch (face) {
+        0 => .{ one, -t, -s },
+        1 => .{ -one, -t, s },
+        2 => .{ s, one, t },
+        3 => .{ s, -one, -t },
+        4 => .{ s, -t, one },
+        else => .{ -s, -t, -one },
+    };
+    const inv = one / @sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    return .{ d[0] * inv, d[1] * inv, d[2] * inv };
+}
+
+/// Direction -> face and texture coordinates in 0 .. 1 (inverse of faceDirections)
+fn project(d: [3]f32) struct { usize, f32, f32 } {
+    const ax = @abs(d[0]);
+    const ay = @abs(d[1]);
+    const az = @abs(d[2]);
+
+    var face: usize = undefined;
+    var sc: f32 = undefined;
+    var tc: f32 = undefined;
+    var ma: f32 = undefined;
+    if (ax >= ay and ax >= az) {
+        face = if (d[0] > 0) 0 else 1;
+        sc = if (d[0] > 0) -d[2] else d[2];
+        tc = -d[1];
+        ma = ax;
+    } else if (ay >= az) {
+        face = if (d[1] > 0) 2 else 3;
+        sc = d[0];
+        tc = if (d[1] > 0) d[2] else -d[2];
+        ma = ay;
+    } else {
+        face = if (d[2] > 0) 4 else 5;
+        sc = if (d[2] > 0) d[0] else -d[0];
+        tc = -d[1];
+        ma = az;
+    }
+    return .{ face, (sc / ma + 1) * 0.5, (tc / ma + 1) * 0.5 };
+}
+
+/// Real SH basis of bands 0 .. 2 for LANES directions
+fn shBasis(x: Lanes, y: Lanes, z: Lanes) [SH_COUNT]Lanes {
+    const c = struct {
+        fn splat(v: f32) Lanes {
+            return @splat(v);
+        }
+    }.splat;
+    return .{
+        c(0.282095),
+        c(0.488603) * y,
+        c(0.488603) * z,
+        c(0.488603) * x,
+        c(1.092548) * x * y,
+        c(1.092548) * y * z,
+        c(0.315392) * (c(3) * z * z - c(1)),
+        c(1.092548) * x * z,
+        c(0.546274) * (x * x - y * y),
+    };
+}
+
+fn roughnessOfLevel(level: usize) f32 {
+    return @as(f32, @floatFromInt(level)) / (SPECULAR_LEVELS - 1);
+}
+
+/// Face rows of all specular levels before a level
+fn specularRows(level: usize) usize {
+    var rows: usize = 0;
+    for (0..level) |l| rows += 6 * (SPECULAR_SIZE >> @intCast(l));
+    return rows;
+}
+
+/// Offset of a specular level in half floats
+fn specularOffset(level: usize) usize {
+    var offset: usize = 0;
+    for (0..level) |l| {
+        const size = SPECULAR_SIZE >> @intCast(l);
+        offset += 6 * size * size * 3;
+    }
+    return offset;
+}
+
+fn hammersley(i: u32, count: u32) [2]f32 {
+    const radicalInverse = @as(f32, @floatFromInt(@bitReverse(i))) * 2.3283064365386963e-10;
+    return .{ @as(f32, @floatFromInt(i)) / @as(f32, @floatFromInt(count)), radicalInverse };
+}
+
+fn lerp(a: Color, b: Color, t: Color) Color {
+    return a + (b - a) * t;
+}
+
+fn cross(a: [3]f32, b: [3]f32) [3]f32 {
+    return .{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+}
+
+fn normalize(v: [3]f32) [3]f32 {
+    const inv = 1.0 / @sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    return .{ v[0] * inv, v[1] * inv, v[2] * inv };
+}
+
+/// Upload the prefiltered environment
+fn upload(prefiltered: *const Prefiltered) Environment {
+    var environment = Environment{ .sh = prefiltered.sh };
+    gl.Enable(gl.TEXTURE_CUBE_MAP_SEAMLESS);
+
+    // Specular cubemap with all levels
+    gl.ActiveTexture(gl.TEXTURE0 + SPECULAR_UNIT);
+    gl.GenTextures(1, (&environment.specular)[0..1]);
+    gl.BindTexture(gl.TEXTURE_CUBE_MAP, environment.specular);
+    for (0..SPECULAR_LEVELS) |level| {
+        const size = SPECULAR_SIZE >> @intCast(level);
+        for (0..6) |face| {
+            const data = prefiltered.specular[specularOffset(level) + face * size * size * 3 ..];
+            gl.TexImage2D(@intCast(gl.TEXTURE_CUBE_MAP_POSITIVE_X + face), @intCast(level), gl.RGB16F, @intCast(size), @intCast(size), 0, gl.RGB, gl.HALF_FLOAT, data.ptr);
+        }
+    }
+    gl.TexParameteri(gl.TEXTURE_CUBE_MAP, gl.TEXTURE_MIN_FILTER, gl.LINEAR_MIPMAP_LINEAR);
+    gl.TexParameteri(gl.TEXTURE_CUBE_MAP, gl.TEXTURE_MAG_FILTER, gl.LINEAR);
+    gl.TexParameteri(gl.TEXTURE_CUBE_MAP, gl.TEXTURE_WRAP_S, gl.CLAMP_TO_EDGE);
+    gl.TexParameteri(gl.TEXTURE_CUBE_MAP, gl.TEXTURE_WRAP_T, gl.CLAMP_TO_EDGE);
+    gl.TexParameteri(gl.TEXTURE_CUBE_MAP, gl.TEXTURE_WRAP_R, gl.CLAMP_TO_EDGE);
+    gl.TexParameteri(gl.TEXTURE_CUBE_MAP, gl.TEXTURE_MAX_LEVEL, SPECULAR_LEVELS - 1);
+    memory.trackGpu(.texture, environment.specular, prefiltered.specular.len * @sizeOf(f16));
+    glDebug.label(.texture, environment.specular, "Environment specular", .{});
+
+    // BRDF lookup table
+    gl.ActiveTexture(gl.TEXTURE0 + LUT_UNIT);
+    gl.GenTextures(1, (&environment.lut)[0..1]);
+    gl.BindTexture(gl.TEXTURE_2D, environment.lut);
+    gl.TexImage2D(gl.TEXTURE_2D, 0, gl.RG16F, LUT_SIZE, LUT_SIZE, 0, gl.RG, gl.HALF_FLOAT, prefiltered.lut.ptr);
+    gl.TexParameteri(gl.TEXTURE_2D, gl.TEXTURE_MIN_FILTER, gl.LINEAR);
+    gl.TexParameteri(gl.TEXTURE_2D, gl.TEXTURE_MAG_FILTER, gl.LINEAR);
+    gl.TexParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_S, gl.CLAMP_TO_EDGE);
+    gl.TexParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_T, gl.CLAMP_TO_EDGE);
+    memory.trackGpu(.texture, environment.lut, prefiltered.lut.len * @sizeOf(f16));
+    glDebug.label(.texture, environment.lut, "BRDF LUT", .{});
+
+    gl.ActiveTexture(gl.TEXTURE0);
+    return environment;
+}
+
+/// Cache file: magic, layout constants, SH, specular levels, LUT
+const CacheHeader = extern struct {
+    magic: [4]u8 = MAGIC.*,
+    specularSize: u32 = SPECULAR_SIZE,
+    specularLevels: u32 = SPECULAR_LEVELS,
+    lutSize: u32 = LUT_SIZE,
+    sh: [SH_COUNT][3]f32,
+};
+
+fn writeCache(path: []const u8, prefiltered: *const Prefiltered) !void {
+    const header = CacheHeader{ .sh = prefiltered.sh };
+
+    // Written to a temporary file first, so readers never see a partial file
+    const tmpPath = try std.fmt.allocPrint(allocator, "{s}.tmp", .{path});
+    defer allocator.free(tmpPath);
+    {
+        const file = try std.fs.cwd().createFile(tmpPath, .{});
+        defer file.close();
+
+        const specular = std.mem.sliceAsBytes(prefiltered.specular);
+        const lut = std.mem.sliceAsBytes(prefiltered.lut);
+        var iovecs = [_]std.posix.iovec_const{
+            .{ .base = std.mem.asBytes(&header), .len = @sizeOf(CacheHeader) },
+            .{ .base = specular.ptr, .len = specular.len },
+            .{ .base = lut.ptr, .len = lut.len },
+        };
+        try file.writevAll(&iovecs);
+    }
+    try std.fs.cwd().rename(tmpPath, path);
+}
+
+fn readCache(path: []const u8) !Prefiltered {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    const reader = file.reader();
+
+    const header = try reader.readStruct(CacheHeader);
+    if (!std.mem.eql(u8, &header.magic, MAGIC) or header.specularSize != SPECULAR_SIZE or
+        header.specularLevels != SPECULAR_LEVELS or header.lutSize != LUT_SIZE)
+    {
+        return error.InvalidEnvironmentCache;
+    }
+
+    const specular = try allocator.alloc(f16, specularOffset(SPECULAR_LEVELS));
+    errdefer allocator.free(specular);
+    try reader.readNoEof(std.mem.sliceAsBytes(specular));
+
+    const lut = try allocator.alloc(f16, LUT_SIZE * LUT_SIZE * 2);
+    errdefer allocator.free(lut);
+    try reader.readNoEof(std.mem.sliceAsBytes(lut));
+
+    return .{ .sh = header.sh, .specular = specular, .lut = lut };
+}
@@ -0,0 +1,530 @@
+//! Export the loaded object as .obj/.mtl, binary .ply or compressed .zgm
+//!
+//! Vertices and faces are split into chunks that worker threads format into per-chunk buffers.
+//! Finished batches are written with one vectored write while the next batch is being formatted.
+//! Floats are printed with the shortest representation that round-trips to the same f32.
+
+const std = @import("std");
+const gl = @import("gl");
+
+const mesh = @import("mesh.zig");
+const meshCache = @import("meshCache.zig");
+const objectLoader = @import("objectLoader.zig");
+const pointCloud = @import("pointCloud.zig");
+const diagnostics = @import("../util/diagnostics.zig");
+const memory = @import("../util/memory.zig");
+
+const CHUNK_SIZE = 1 << 15; // Records per chunk
+const MAX_THREADS = 16;
+const BATCH_CHUNKS = MAX_THREADS * 2; // Chunks formatted per batch (one vectored write)
+
+const allocator = memory.allocator(.exporter);
+
+/// Which optional attributes are written
+const Source = struct {
+    obj: *const objectLoader.ObjectStruct,
+    hasTexCoords: bool,
+    hasNormals: bool,
+    hasColors: bool,
+    hasMaterials: bool,
+    colorScale: f32 = 255.0, // PLY colors: factor to 0..255, the same for every vertex
+};
+
+/// Formats the records [start, end) of one section into out
+const FormatFn = *const fn (src: *const Source, start: usize, end: usize, out: *std.ArrayList(u8)) std.mem.Allocator.Error!void;
+
+/// A run of records that share one format function (e.g. all "v" lines)
+const Section = struct {
+    count: usize,
+    format: FormatFn,
+};
+
+/// Records [start, end) of a section
+const Chunk = struct {
+    format: FormatFn,
+    start: usize,
+    end: usize,
+};
+
+/// Export the loaded mesh, the format is picked by the file extension (.ply, .zgm or .obj)
+pub fn exportMesh(loaded: *const mesh.Mesh, path: []const u8) !void {
+    var timer = try std.time.Timer.start();
+    exportLoaded(loaded, path) catch |err| {
+        diagnostics.report(.ExportFailed, 0, "Export to {s} failed: {s}", .{ path, @errorName(err) });
+        return err;
+    };
+    std.log.info("Exported {s} in {d} ms", .{ path, timer.read() / std.time.ns_per_ms });
+}
+
+/// Export from the object struct, or from the GPU buffers if the geometry only lives there
+fn exportLoaded(loaded: *const mesh.Mesh, path: []const u8) !void {
+    const obj = loaded.object;
+    if (obj.vbo.items.len > 0) {
+        return exportObject(obj, path);
+    }
+
+    // Cache hits and .zgm files are uploaded without filling the object struct
+    if (loaded.vbo != 0 and loaded.index_count > 0) {
+        var copy = try readBack(loaded);
+        defer deinitCopy(&copy);
+        return exportObject(&copy, path);
+    }
+
+    // Point clouds only keep their points in the GPU buffer
+    if (loaded.points) |cloud| {
+        var copy = try readBackPoints(loaded, cloud);
+        defer deinitCopy(&copy);
+        return exportObject(&copy, path);
+    }
+
+    std.log.err("Nothing to export: the loaded object has no triangle geometry", .{});
+    return error.NothingToExport;
+}
+
+fn exportObject(obj: *const objectLoader.ObjectStruct, path: []const u8) !void {
+    if (std.ascii.endsWithIgnoreCase(path, ".ply")) {
+        // PLY indices are written as uint32
+        if (obj.vbo.items.len > std.math.maxInt(u32)) return error.TooManyVertices;
+        try exportPly(obj, path);
+    } else if (std.ascii.endsWithIgnoreCase(path, ".zgm")) {
+        if (obj.ebo.items.len == 0) {
+            std.log.err("Nothing to export: .zgm needs triangles, export point clouds as .ply or .obj", .{});
+            return error.NothingToExport;
+        }
+        try exportZgm(obj, path);
+    } else {
+        try exportObj(obj, path);
+    }
+    std.log.info("Exported {d} vertices and {d} faces", .{ obj.vbo.items.len, obj.ebo.items.len });
+}
+
+/// Write the compressed .zgm format of the mesh cache
+fn exportZgm(obj: *const objectLoader.ObjectStruct, path: []const u8) !void {
+    const interleaved = try mesh.convertFaces(@constCast(obj), allocator);
+    defer allocator.free(interleaved.indices);
+    defer allocator.free(interleaved.vertices);
+
+    try meshCache.writeFile(path, interleaved, obj, .{});
+}
+
+/// Read the interleaved buffers back from the GPU into a temporary object struct
+///
+/// Every attribute uses the same index per corner. Materials and groups are shared with the loaded object.
+fn readBack(loaded: *const mesh.Mesh) !objectLoader.ObjectStruct {
+    // COPY_READ_BUFFER leaves the vertex array bindings untouched
+    var vertexBytes: gl.int = 0;
+    gl.BindBuffer(gl.COPY_READ_BUFFER, loaded.vbo);
+    gl.GetBufferParameteriv(gl.COPY_READ_BUFFER, gl.BUFFER_SIZE, &vertexBytes);
+    const vertices = try allocator.alloc(f32, @as(usize, @intCast(vertexBytes)) / @sizeOf(f32));
+    defer allocator.free(vertices);
+    gl.GetBufferSubData(gl.COPY_READ_BUFFER, 0, vertexBytes, vertices.ptr);
+
+    const indices = try allocator.alloc(u32, loaded.index_count);
+    defer allocator.free(indices);
+    gl.BindBuffer(gl.COPY_READ_BUFFER, loaded.ebo);
+    gl.GetBufferSubData(gl.COPY_READ_BUFFER, 0, @intCast(indices.len * @sizeOf(u32)), indices.ptr);
+    gl.BindBuffer(gl.COPY_READ_BUFFER, 0);
+
+    const source = loaded.object;
+    var copy = objectLoader.initObject(allocator);
+    errdefer deinitCopy(&copy);
+    copy.materials = source.materials;
+    copy.groups = source.groups;
+    copy.mtllib = source.mtllib;
+    try copy.name.appendSlice(source.name.items);
+
+    const vertexCount = vertices.len / mesh.VERTEX_STRIDE;
+    try copy.vbo.ensureTotalCapacity(vertexCount);
+    try copy.texCoords.ensureTotalCapacity(vertexCount);
+    try copy.normals.ensureTotalCapacity(vertexCount);
+    for (0..vertexCount) |v| {
+        const vertex = vertices[v * mesh.VERTEX_STRIDE ..][0..mesh.VERTEX_STRIDE];
+        copy.vbo.appendAssumeCapacity(.{ .position = vertex[0..3].* });
+        copy.texCoords.appendAssumeCapacity(vertex[3..5].*);
+        copy.normals.appendAssumeCapacity(vertex[5..8].*);
+    }
+
+    // The buffers keep the face order, so the per-face materials of the object still apply
+    const faceCount = indices.len / 3;
+    try copy.ebo.ensureTotalCapacity(faceCount);
+    if (source.faceMaterialIndices.items.len == faceCount) {
+        try copy.faceMaterialIndices.appendSlice(source.faceMaterialIndices.items);
+    } else {
+        try copy.faceMaterialIndices.appendNTimes(0, faceCount);
+    }
+    for (0..faceCount) |f| {
+        const face = [3]usize{ indices[f * 3], indices[f * 3 + 1], indices[f * 3 + 2] };
+        copy.ebo.appendAssumeCapacity(.{ .face = face, .texCoordIndices = face, .normalIndices = face });
+    }
+
+    return copy;
+}
+
+/// Read the point buffer back from the GPU into a temporary object struct (positions and colors, in octree order)
+fn readBackPoints(loaded: *const mesh.Mesh, cloud: *const pointCloud.PointCloud) !objectLoader.ObjectStruct {
+    const points = try allocator.alloc(pointCloud.PointVertex, cloud.pointCount);
+    defer allocator.free(points);
+    gl.BindBuffer(gl.COPY_READ_BUFFER, cloud.vbo);
+    gl.GetBufferSubData(gl.COPY_READ_BUFFER, 0, @intCast(points.len * @sizeOf(pointCloud.PointVertex)), points.ptr);
+    gl.BindBuffer(gl.COPY_READ_BUFFER, 0);
+
+    const source = loaded.object;
+    var copy = objectLoader.initObject(allocator);
+    errdefer deinitCopy(&copy);
+    try copy.name.appendSlice(source.name.items);
+
+    try copy.vbo.ensureTotalCapacity(points.len);
+    try copy.colors.ensureTotalCapacity(points.len);
+    for (points) |point| {
+        copy.vbo.appendAssumeCapacity(.{ .position = point.position });
+        copy.colors.appendAssumeCapacity(.{
+            @as(f32, @floatFromInt(point.color[0])) / 255.0,
+            @as(f32, @floatFromInt(point.color[1])) / 255.0,
+            @as(f32, @floatFromInt(point.color[2])) / 255.0,
+        });
+    }
+    return copy;
+}
+
+/// Free a read back copy without touching the shared materials
+fn deinitCopy(copy: *objectLoader.ObjectStruct) void {
+    copy.vbo.deinit();
+    copy.ebo.deinit();
+    copy.colors.deinit();
+    copy.normals.deinit();
+    copy.texCoords.deinit();
+    copy.name.deinit();
+    copy.faceMaterialIndices.deinit();
+}
+
+/// Write .obj (and .mtl next to it if the object has materials)
+fn exportObj(obj: *const objectLoader.ObjectStruct, path: []const u8) !void {
+    const src = Source{
+        .obj = obj,
+        .hasTexCoords = obj.texCoords.items.len > 0,
+        .hasNormals = obj.normals.items.len > 0,
+        .hasColors = obj.colors.items.len == obj.vbo.items.len,
+        .hasMaterials = obj.materials.items.len > 0 and obj.faceMaterialIndices.items.len == obj.ebo.items.len,
+    };
+
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+
+    // Header
+    var header = std.ArrayList(u8).init(allocator);
+    defer header.deinit();
+    try header.appendSlice("# Exported by zigGL\n");
+    if (src.hasMaterials) {
+        const mtlPath = try std.fmt.allocPrint(allocator, "{s}.mtl", .{std.fs.path.stem(path)});
+        defer allocator.free(mtlPath);
+        try header.writer().print("mtllib {s}\n", .{mtlPath});
+
+        const fullMtlPath = try std.fmt.allocPrint(allocator, "{s}.mtl", .{path[0 .. path.len - std.fs.path.extension(path).len]});
+        defer allocator.free(fullMtlPath);
+        try exportMtl(obj, fullMtlPath);
+    }
+    if (obj.name.items.len > 0) {
+        try header.writer().print("o {s}\n", .{obj.name.items});
+    }
+    try file.writeAll(header.items);
+
+    const sections = [_]Section{
+        .{ .count = obj.vbo.items.len, .format = formatObjVertices },
+        .{ .count = if (src.hasTexCoords) obj.texCoords.items.len else 0, .format = formatObjTexCoords },
+        .{ .count = if (src.hasNormals) obj.normals.items.len else 0, .format = formatObjNormals },
+        .{ .count = obj.ebo.items.len, .format = formatObjFaces },
+    };
+    try writeSections(file, &src, &sections);
+}
+
+/// Write the materials as .mtl (small, written sequentially)
+fn exportMtl(obj: *const objectLoader.ObjectStruct, path: []const u8) !void {
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    try out.appendSlice("# Exported by zigGL\n");
+    for (obj.materials.items) |material| {
+        try out.writer().print("\nnewmtl {s}\n", .{material.name});
+        try appendLine(&out, "Ka", &material.ambient);
+        try appendLine(&out, "Kd", &material.diffuse);
+        try appendLine(&out, "Ks", &material.specular);
+        try appendLine(&out, "Pr", &.{material.roughness});
+        try appendLine(&out, "Pm", &.{material.metallic});
+        if (material.opacity < 1.0) try appendLine(&out, "d", &.{material.opacity});
+
+        const maps = [_]struct { []const u8, ?[]const u8 }{
+            .{ "map_Kd", material.texturePath },
+            .{ "map_Bump", material.normalMapPath },
+            .{ "map_Pr", material.roughnessMapPath },
+            .{ "map_Pm", material.metallicMapPath },
+        };
+        for (maps) |map| {
+            if (map[1]) |mapPath| try out.writer().print("{s} {s}\n", .{ map[0], mapPath });
+        }
+    }
+
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+    try file.writeAll(out.items);
+}
+
+/// Write binary little endian .ply (one attribute set per vertex, faces index positions)
+fn exportPly(obj: *const objectLoader.ObjectStruct, path: []const u8) !void {
+    const vertexCount = obj.vbo.items.len;
+    const src = Source{
+        .obj = obj,
+        // PLY has a single index per corner, so only per-position attributes can be kept
+        .hasTexCoords = obj.texCoords.items.len == vertexCount,
+        .hasNormals = obj.normals.items.len == vertexCount,
+        .hasColors = obj.colors.items.len == vertexCount,
+        .hasMaterials = false,
+        .colorScale = pointCloud.byteColorScale(obj.colors.items),
+    };
+
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+
+    var header = std.ArrayList(u8).init(allocator);
+    defer header.deinit();
+    const writer = header.writer();
+    try writer.print("ply\nformat binary_little_endian 1.0\ncomment Exported by zigGL\nelement vertex {d}\n", .{vertexCount});
+    try writer.writeAll("property float x\nproperty float y\nproperty float z\n");
+    if (src.hasNormals) try writer.writeAll("property float nx\nproperty float ny\nproperty float nz\n");
+    if (src.hasTexCoords) try writer.writeAll("property float u\nproperty float v\n");
+    if (src.hasColors) try writer.writeAll("property uchar red\nproperty uchar green\nproperty uchar blue\n");
+    try writer.print("element face {d}\nproperty list uchar uint vertex_indices\nend_header\n", .{obj.ebo.items.len});
+    try file.writeAll(header.items);
+
+    const sections = [_]Section{
+        .{ .count = vertexCount, .format = formatPlyVertices },
+        .{ .count = obj.ebo.items.len, .format = formatPlyFaces },
+    };
+    try writeSections(file, &src, &sections);
+}
+
+/// Formats one batch of chunks on several threads
+const Batch = struct {
+    src: *const Source,
+    chunks: []const Chunk,
+    buffers: []std.ArrayList(u8),
+    next: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    failed: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    fn run(self: *Batch) void {
+        while (true) {
+            const i = self.next.fetchAdd(1, .monotonic);
+            if (i >= self.chunks.len) return;
+            const chunk = self.chunks[i];
+            self.buffers[i].clearRetainingCapacity();
+            chunk.format(self.src, chunk.start, chunk.end, &self.buffers[i]) catch {
+                self.failed.store(true, .monotonic);
+                return;
+            };
+        }
+    }
+};
+
+/// Workers of one batch, the batch is finished after join
+const Workers = struct {
+    threads: [MAX_THREADS]?std.Thread = [_]?std.Thread{null} ** MAX_THREADS,
+
+    fn start(self: *Workers, batch: *Batch, count: usize) void {
+        for (self.threads[0..count]) |*thread| {
+            thread.* = std.Thread.spawn(.{}, Batch.run, .{batch}) catch null;
+        }
+    }
+
+    /// The calling thread helps with the remaining chunks, then waits for the workers
+    fn join(self: *Workers, batch: *Batch) void {
+        batch.run();
+        for (&self.threads) |*thread| {
+            if (thread.*) |t| t.join();
+            thread.* = null;
+        }
+    }
+};
+
+/// Format the sections chunk by chunk and write them in order
+///
+/// Two buffer sets alternate: one is written while the other is being formatted.
+fn writeSections(file: std.fs.File, src: *const Source, sections: []const Section) !void {
+    var chunks = std.ArrayList(Chunk).init(allocator);
+    defer chunks.deinit();
+    for (sections) |section| {
+        var start: usize = 0;
+        while (start < section.count) : (start += CHUNK_SIZE) {
+            try chunks.append(.{ .format = section.format, .start = start, .end = @min(start + CHUNK_SIZE, section.count) });
+        }
+    }
+    if (chunks.items.len == 0) return;
+
+    const cpuCount = std.Thread.getCpuCount() catch 1;
+    const threadCount = std.math.clamp(cpuCount, 1, MAX_THREADS);
+    const batchSize = @min(threadCount * 2, BATCH_CHUNKS);
+
+    var buffers: [2][BATCH_CHUNKS]std.ArrayList(u8) = undefined;
+    for (&buffers) |*set| {
+        for (set) |*buffer| buffer.* = std.ArrayList(u8).init(allocator);
+    }
+    defer for (&buffers) |*set| {
+        for (set) |*buffer| buffer.deinit();
+    };
+
+    var batches: [2]Batch = undefined;
+    var workers = Workers{};
+
+    // First batch
+    var first: usize = 0;
+    var current: usize = 0;
+    batches[0] = .{ .src = src, .chunks = chunks.items[0..@min(batchSize, chunks.items.len)], .buffers = &buffers[0] };
+    workers.start(&batches[0], threadCount - 1);
+    workers.join(&batches[0]);
+
+    while (true) {
+        if (batches[current].failed.load(.monotonic)) return error.OutOfMemory;
+        const written = batches[current].chunks.len;
+
+        // Start formatting the next batch into the other buffer set
+        const nextFirst = first + written;
+        const hasNext = nextFirst < chunks.items.len;
+        const other = 1 - current;
+        if (hasNext) {
+            batches[other] = .{ .src = src, .chunks = chunks.items[nextFirst..@min(nextFirst + batchSize, chunks.items.len)], .buffers = &buffers[other] };
+            workers.start(&batches[other], threadCount);
+        }
+
+        // Write the finished batch in one vectored write
+        var iovecs: [BATCH_CHUNKS]std.posix.iovec_const = undefined;
+        for (buffers[current][0..written], 0..) |buffer, i| {
+            iovecs[i] = .{ .base = buffer.items.ptr, .len = buffer.items.len };
+        }
+        const writeResult = file.writevAll(iovecs[0..written]);
+
+        if (!hasNext) return writeResult;
+        workers.join(&batches[other]);
+        try writeResult;
+
+        first = nextFirst;
+        current = other;
+    }
+}
+
+// OBJ records
+
+fn formatObjVertices(src: *const Source, start: usize, end: usize, out: *std.ArrayList(u8)) std.mem.Allocator.Error!void {
+    for (start..end) |i| {
+        const position = src.obj.vbo.items[i].position;
+        if (src.hasColors) {
+            const color = src.obj.colors.items[i];
+            try appendLine(out, "v", &.{ position[0], position[1], position[2], color[0], color[1], color[2] });
+        } else {
+            try appendLine(out, "v", &position);
+        }
+    }
+}
+
+fn formatObjTexCoords(src: *const Source, start: usize, end: usize, out: *std.ArrayList(u8)) std.mem.Allocator.Error!void {
+    for (src.obj.texCoords.items[start..end]) |texCoord| {
+        try appendLine(out, "vt", &texCoord);
+    }
+}
+
+fn formatObjNormals(src: *const Source, start: usize, end: usize, out: *std.ArrayList(u8)) std.mem.Allocator.Error!void {
+    for (src.obj.normals.items[start..end]) |normal| {
+        try appendLine(out, "vn", &normal);
+    }
+}
+
+fn formatObjFaces(src: *const Source, start: usize, end: usize, out: *std.ArrayList(u8)) std.mem.Allocator.Error!void {
+    const materialIndices = src.obj.faceMaterialIndices.items;
+    for (start..end) |i| {
+        // Material switch, compared with the previous face so chunks need no shared state
+        if (src.hasMaterials) {
+            const material = materialIndices[i];
+            if ((i == 0 or materialIndices[i - 1] != material) and material < src.obj.materials.items.len) {
+                try out.appendSlice("usemtl ");
+                try out.appendSlice(src.obj.materials.items[material].name);
+                try out.append('\n');
+            }
+        }
+
+        const face = src.obj.ebo.items[i];
+        try out.append('f');
+        for (0..3) |j| {
+            try out.append(' ');
+            try appendInt(out, face.face[j] + 1);
+            if (src.hasTexCoords or src.hasNormals) {
+                try out.append('/');
+                if (src.hasTexCoords) try appendInt(out, face.texCoordIndices[j] + 1);
+                if (src.hasNormals) {
+                    try out.append('/');
+                    try appendInt(out, face.normalIndices[j] + 1);
+                }
+            }
+        }
+        try out.append('\n');
+    }
+}
+
+// PLY records
+
+fn formatPlyVertices(src: *const Source, start: usize, end: usize, out: *std.ArrayList(u8)) std.mem.Allocator.Error!void {
+    for (start..end) |i| {
+        for (src.obj.vbo.items[i].position) |value| try appendF32(out, value);
+        if (src.hasNormals) {
+            for (src.obj.normals.items[i]) |value| try appendF32(out, value);
+        }
+        if (src.hasTexCoords) {
+            for (src.obj.texCoords.items[i]) |value| try appendF32(out, value);
+        }
+        if (src.hasColors) {
+            for (src.obj.colors.items[i]) |value| try out.append(@intFromFloat(std.math.clamp(value * src.colorScale, 0.0, 255.0)));
+        }
+    }
+}
+
+fn formatPlyFaces(src: *const Source, start: usize, end: usize, out: *std.ArrayList(u8)) std.mem.Allocator.Error!void {
+    try out.ensureUnusedCapacity((end - start) * 13);
+    for (src.obj.ebo.items[start..end]) |face| {
+        out.appendAssumeCapacity(3);
+        for (face.face) |index| {
+            var bytes: [4]u8 = undefined;
+            std.mem.writeInt(u32, &bytes, @intCast(index), .little); // Vertex count checked by exportObject
+            out.appendSliceAssumeCapacity(&bytes);
+        }
+    }
+}
+
+// Number formatting
+
+/// Append "<keyword> a b c\n"
+fn appendLine(out: *std.ArrayList(u8), keyword: []const u8, values: []const f32) std.mem.Allocator.Error!void {
+    try out.appendSlice(keyword);
+    for (values) |value| {
+        try out.append(' ');
+        try appendFloat(out, value);
+    }
+    try out.append('\n');
+}
+
+/// Append the shortest decimal that parses back to the same f32
+///
+/// Uses the Ryu based std.fmt.formatFloat, plain notation first and scientific for very large or small values.
+fn appendFloat(out: *std.ArrayList(u8), value: f32) std.mem.Allocator.Error!void {
+    var buf: [32]u8 = undefined;
+    const text = std.fmt.formatFloat(&buf, value, .{ .mode = .decimal }) catch
+        std.fmt.formatFloat(&buf, value, .{ .mode = .scientific }) catch unreachable; // f32 fits in 32 bytes
+    try out.appendSlice(text);
+}
+
+fn appendInt(out: *std.ArrayList(u8), value: usize) std.mem.Allocator.Error!void {
+    var buf: [20]u8 = undefined;
+    const len = std.fmt.formatIntBuf(&buf, value, 10, .lower, .{});
+    try out.appendSlice(buf[0..len]);
+}
+
+fn appendF32(out: *std.ArrayList(u8), value: f32) std.mem.Allocator.Error!void {
+    var bytes: [4]u8 = undefined;
+    std.mem.writeInt(u32, &bytes, @bitCast(value), .little);
+    try out.appendSlice(&bytes);
+}
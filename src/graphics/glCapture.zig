@@ -0,0 +1,758 @@
+//! GL call stream capture and replay
+//!
+//! Capture swaps the current proc table for a table of shims that forward every call to the real
+//! driver and append it to a file: procedure index, arguments and the memory behind pointer arguments
+//! (buffer and texture data, uniform arrays, shader sources, names). Frames are separated by markers.
+//! The same module decodes the stream again, see replay.zig for the headless benchmark tool.
+//!
+//! Replay does not rely on the driver handing out the captured object names: the names written by
+//! Gen* and returned by Create* are mapped to the names replay receives, and every name argument is
+//! translated through that map (per namespace, like apitrace). ImGui creates its objects outside the
+//! stream, so the captured names are not the ones a fresh context returns.
+//!
+//! ImGui renders through its own loader and is not part of the stream.
+//! Procedures with callbacks, sync objects or mapped memory are forwarded without being captured.
+
+const std = @import("std");
+const gl = @import("gl");
+
+const MAGIC = "ZGC2";
+const HEADER_SIZE = MAGIC.len + 4 + 8 + 2 * 4; // Magic, procedure count, table hash, framebuffer size
+const FRAME_MARKER: u16 = 0xFFFF;
+const NULL_PAYLOAD: u32 = 0xFFFF_FFFF; // Null pointer or memory of unknown size
+const MAX_PARAMS = 12;
+const SCRATCH_SIZE = 1 << 16; // Output memory of Get* calls without a recorded size during replay
+
+/// Payloads are aligned in the file, so replay can pass pointers into the loaded file directly
+pub const PAYLOAD_ALIGNMENT = 16;
+
+/// Names of all procedures of the table, the position is the id used in the stream
+const procs = blk: {
+    @setEvalBranchQuota(100_000);
+    var names: []const []const u8 = &.{};
+    for (std.meta.fields(gl.ProcTable)) |field| {
+        if (FnOf(field.type) != null) {
+            names = names ++ &[_][]const u8{field.name};
+        }
+    }
+    break :blk names;
+};
+
+var real: gl.ProcTable = undefined;
+var shims: gl.ProcTable = undefined;
+
+var file: ?std.fs.File = null;
+var writer: std.io.BufferedWriter(1 << 16, std.fs.File.Writer) = undefined;
+var written: u64 = 0;
+var failed = false;
+var capturedFrames: usize = 0;
+var capturedCalls: usize = 0;
+var unknownPayloads: usize = 0;
+
+/// Start capturing all GL calls issued through the gl module into a file
+/// The table must be the current one, it is restored by finish
+/// width and height are the framebuffer size, replay renders at the same size
+pub fn start(path: []const u8, table: *const gl.ProcTable, width: u32, height: u32) !void {
+    const created = try std.fs.cwd().createFile(path, .{});
+    file = created;
+    writer = std.io.bufferedWriter(created.writer());
+    written = 0;
+
+    put(MAGIC);
+    put(std.mem.asBytes(&@as(u32, procs.len)));
+    put(std.mem.asBytes(&tableHash()));
+    put(std.mem.asBytes(&[2]u32{ width, height }));
+
+    real = table.*;
+    shims = real;
+    inline for (procs, 0..) |name, i| {
+        if (comptime capturable(i)) {
+            const isAvailable = if (@typeInfo(@TypeOf(@field(real, name))) == .Optional) @field(real, name) != null else true;
+            if (isAvailable) {
+                @field(shims, name) = &Shim(i).call;
+            }
+        }
+    }
+    gl.makeProcTableCurrent(&shims);
+    std.log.info("Capturing GL calls to {s}", .{path});
+}
+
+/// Mark the end of a frame, call before swapping buffers
+pub fn endFrame() void {
+    if (file == null) return;
+    put(std.mem.asBytes(&FRAME_MARKER));
+    capturedFrames += 1;
+}
+
+/// Stop capturing, flush the file and restore the real proc table
+pub fn finish() void {
+    const captured = file orelse return;
+    gl.makeProcTableCurrent(&real);
+
+    writer.flush() catch {
+        failed = true;
+    };
+    captured.close();
+    file = null;
+
+    if (failed) {
+        std.log.err("GL capture incomplete, writing the file failed", .{});
+        return;
+    }
+    std.log.info("Captured {d} GL calls in {d} frames ({d} KiB)", .{ capturedCalls, capturedFrames, written / 1024 });
+    if (unknownPayloads > 0) {
+        std.log.warn("{d} pointer arguments of unknown size were recorded as null", .{unknownPayloads});
+    }
+}
+
+/// A loaded capture
+///
+/// Contains:
+/// - data: the whole file, output payloads are overwritten during replay
+/// - frames: offset of the first record of every frame, plus the end of the stream
+/// - scratch: output memory for Get* calls without a recorded size
+/// - width, height: framebuffer size when the capture started
+/// - names: captured to replayed object names, one map per namespace
+/// deinit method
+pub const Capture = struct {
+    data: []align(PAYLOAD_ALIGNMENT) u8,
+    frames: []usize,
+    scratch: []align(PAYLOAD_ALIGNMENT) u8,
+    width: u32,
+    height: u32,
+    names: [namespaceCount]NameMap = [_]NameMap{.{}} ** namespaceCount,
+    allocator: std.mem.Allocator,
+
+    /// Load a capture and index its frames
+    pub fn open(path: []const u8, outAllocator: std.mem.Allocator) !Capture {
+        const data = try std.fs.cwd().readFileAllocOptions(outAllocator, path, 1 << 34, null, PAYLOAD_ALIGNMENT, null);
+        errdefer outAllocator.free(data);
+
+        const headerSize = HEADER_SIZE;
+        if (data.len < headerSize or !std.mem.eql(u8, data[0..MAGIC.len], MAGIC)) return error.InvalidCapture;
+        const count = std.mem.bytesToValue(u32, data[MAGIC.len..][0..4]);
+        const hash = std.mem.bytesToValue(u64, data[MAGIC.len + 4 ..][0..8]);
+        if (count != procs.len or hash != tableHash()) return error.CaptureFromOtherBindings;
+        const size = std.mem.bytesToValue([2]u32, data[MAGIC.len + 12 ..][0..8]);
+
+        const scratch = try outAllocator.alignedAlloc(u8, PAYLOAD_ALIGNMENT, SCRATCH_SIZE);
+        errdefer outAllocator.free(scratch);
+
+        var capture = Capture{
+            .data = data,
+            .frames = &.{},
+            .scratch = scratch,
+            .width = @max(size[0], 1),
+            .height = @max(size[1], 1),
+            .allocator = outAllocator,
+        };
+
+        // Walk the stream once without executing to find the frame boundaries
+        var frames = std.ArrayList(usize).init(outAllocator);
+        defer frames.deinit();
+        try frames.append(headerSize);
+
+        var cursor: usize = headerSize;
+        while (cursor < data.len) {
+            if (try capture.step(null, &cursor) == FRAME_MARKER) {
+                try frames.append(cursor);
+            }
+        }
+        if (frames.items[frames.items.len - 1] != data.len) {
+            try frames.append(data.len); // Calls after the last marker
+        }
+
+        capture.frames = try frames.toOwnedSlice();
+        return capture;
+    }
+
+    pub fn deinit(self: *Capture) void {
+        self.allocator.free(self.data);
+        self.allocator.free(self.frames);
+        self.allocator.free(self.scratch);
+        for (&self.names) |*map| map.deinit(self.allocator);
+    }
+
+    /// Number of frames in the capture (frame 0 also contains all setup calls)
+    pub fn frameCount(self: *const Capture) usize {
+        return self.frames.len - 1;
+    }
+
+    /// Execute the calls of frames [first, last] with the given table
+    /// Without a table the records are only decoded (measures the decoding overhead)
+    /// Returns the number of calls
+    pub fn run(self: *Capture, table: ?*const gl.ProcTable, first: usize, last: usize) !usize {
+        var cursor = self.frames[first];
+        const end = self.frames[last + 1];
+        var calls: usize = 0;
+        while (cursor < end) {
+            if (try self.step(table, &cursor) != FRAME_MARKER) calls += 1;
+        }
+        return calls;
+    }
+
+    /// Decode (and execute) the record at cursor, returns its procedure index or FRAME_MARKER
+    fn step(self: *Capture, table: ?*const gl.ProcTable, cursor: *usize) !u16 {
+        const index = try readValue(u16, self.data, cursor);
+        switch (index) {
+            FRAME_MARKER => {},
+            inline 0...procs.len - 1 => |i| {
+                if (comptime !capturable(i)) return error.InvalidCapture;
+                try self.replayCall(i, table, cursor);
+            },
+            else => return error.InvalidCapture,
+        }
+        return index;
+    }
+
+    fn replayCall(self: *Capture, comptime index: u16, table: ?*const gl.ProcTable, cursor: *usize) !void {
+        const F = ProcType(index);
+        const info = @typeInfo(F).Fn;
+        const R = info.return_type.?;
+        const name = procs[index];
+
+        var args: std.meta.ArgsTuple(F) = undefined;
+        inline for (info.params, 0..) |param, i| {
+            args[i] = try self.readArg(param.type.?, cursor);
+        }
+        const recorded = if (R != void) try readValue(R, self.data, cursor) else {};
+
+        // Sources were recorded as one string, see writeArgs
+        var strings: [1][*]const u8 = undefined;
+        var length: [1]gl.int = undefined;
+        if (comptime std.mem.eql(u8, name, "ShaderSource")) {
+            const source: [*]const u8 = @ptrCast(args[2]);
+            strings[0] = source;
+            length[0] = @intCast(args[1]);
+            args[1] = 1;
+            args[2] = @ptrCast(&strings);
+            args[3] = @ptrCast(&length);
+        }
+
+        const procTable = table orelse return;
+        const proc = @field(procTable.*, name);
+        const function = if (@typeInfo(@TypeOf(proc)) == .Optional) proc orelse return error.MissingProcedure else proc;
+
+        // Translate name arguments, the payloads stay untouched so frames can be replayed again
+        inline for (0..info.params.len) |i| {
+            if (comptime nameParam(name, i)) |namespace| args[i] = self.replayName(namespace, args[i]);
+        }
+        if (comptime std.mem.eql(u8, name, "ObjectLabel") or std.mem.eql(u8, name, "GetObjectLabel")) {
+            if (labelNamespace(args[0])) |namespace| args[1] = self.replayName(namespace, args[1]);
+        }
+
+        // Gen*/Delete*(n, names): the driver writes the new names to scratch, deleted names are translated there
+        var generated: []const gl.uint = &.{};
+        const replayed: [*]gl.uint = @ptrCast(self.scratch.ptr);
+        if (comptime arrayNamespace(name, "Gen") != null or arrayNamespace(name, "Delete") != null) {
+            const count: usize = @intCast(args[0]);
+            if (count * @sizeOf(gl.uint) > self.scratch.len) return error.InvalidCapture;
+            const captured: [*]const gl.uint = @ptrCast(args[1]);
+            if (comptime arrayNamespace(name, "Delete")) |namespace| {
+                for (0..count) |k| replayed[k] = self.replayName(namespace, captured[k]);
+            } else {
+                generated = captured[0..count];
+            }
+            args[1] = replayed;
+        }
+
+        const result = @call(.auto, function, args);
+
+        if (comptime arrayNamespace(name, "Gen")) |namespace| {
+            for (generated, 0..) |capturedName, k| {
+                try self.names[@intFromEnum(namespace)].put(self.allocator, capturedName, replayed[k]);
+            }
+        }
+        if (comptime createNamespace(name)) |namespace| {
+            try self.names[@intFromEnum(namespace)].put(self.allocator, recorded, result);
+        }
+    }
+
+    /// Name replay received for a captured name, unknown names (and 0) are passed through
+    fn replayName(self: *const Capture, namespace: Namespace, captured: gl.uint) gl.uint {
+        if (captured == 0) return 0;
+        return self.names[@intFromEnum(namespace)].get(captured) orelse captured;
+    }
+
+    fn readArg(self: *Capture, comptime T: type, cursor: *usize) !T {
+        const pointer = pointerInfo(T) orelse return readValue(T, self.data, cursor);
+
+        const len = try readValue(u32, self.data, cursor);
+        if (len == NULL_PAYLOAD) {
+            // Unknown output memory gets the scratch buffer, unknown input memory null
+            if (!pointer.is_const) return @ptrCast(self.scratch.ptr);
+            return if (@typeInfo(T) == .Optional) null else @ptrCast(self.scratch.ptr);
+        }
+
+        cursor.* = std.mem.alignForward(usize, cursor.*, PAYLOAD_ALIGNMENT);
+        if (cursor.* + len > self.data.len) return error.InvalidCapture;
+        const payload = self.data[cursor.*..][0..len];
+        cursor.* += len;
+        return @ptrCast(@alignCast(payload.ptr));
+    }
+};
+
+/// Shim with the signature of procedure index that records the call after forwarding it
+fn Shim(comptime index: u16) type {
+    const info = @typeInfo(ProcType(index)).Fn;
+    const cc = info.calling_convention;
+    const R = info.return_type.?;
+    const P = struct {
+        fn at(comptime i: usize) type {
+            return info.params[i].type.?;
+        }
+    }.at;
+
+    return switch (info.params.len) {
+        0 => struct {
+            fn call() callconv(cc) R {
+                return forward(index, .{});
+            }
+        },
+        1 => struct {
+            fn call(a0: P(0)) callconv(cc) R {
+                return forward(index, .{a0});
+            }
+        },
+        2 => struct {
+            fn call(a0: P(0), a1: P(1)) callconv(cc) R {
+                return forward(index, .{ a0, a1 });
+            }
+        },
+        3 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2 });
+            }
+        },
+        4 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3 });
+            }
+        },
+        5 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3), a4: P(4)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3, a4 });
+            }
+        },
+        6 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3), a4: P(4), a5: P(5)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3, a4, a5 });
+            }
+        },
+        7 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3), a4: P(4), a5: P(5), a6: P(6)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3, a4, a5, a6 });
+            }
+        },
+        8 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3), a4: P(4), a5: P(5), a6: P(6), a7: P(7)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3, a4, a5, a6, a7 });
+            }
+        },
+        9 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3), a4: P(4), a5: P(5), a6: P(6), a7: P(7), a8: P(8)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3, a4, a5, a6, a7, a8 });
+            }
+        },
+        10 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3), a4: P(4), a5: P(5), a6: P(6), a7: P(7), a8: P(8), a9: P(9)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3, a4, a5, a6, a7, a8, a9 });
+            }
+        },
+        11 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3), a4: P(4), a5: P(5), a6: P(6), a7: P(7), a8: P(8), a9: P(9), a10: P(10)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10 });
+            }
+        },
+        12 => struct {
+            fn call(a0: P(0), a1: P(1), a2: P(2), a3: P(3), a4: P(4), a5: P(5), a6: P(6), a7: P(7), a8: P(8), a9: P(9), a10: P(10), a11: P(11)) callconv(cc) R {
+                return forward(index, .{ a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11 });
+            }
+        },
+        else => @compileError("Too many parameters for a capture shim"),
+    };
+}
+
+/// Call the real procedure and record the call, outputs are recorded after the driver wrote them
+fn forward(comptime index: u16, args: anytype) @typeInfo(ProcType(index)).Fn.return_type.? {
+    const proc = @field(real, procs[index]);
+    const function = if (@typeInfo(@TypeOf(proc)) == .Optional) proc.? else proc;
+    const result = @call(.auto, function, args);
+
+    if (file != null and !failed) {
+        put(std.mem.asBytes(&index));
+        writeArgs(index, args);
+        if (@TypeOf(result) != void) {
+            put(std.mem.asBytes(&result));
+        }
+        capturedCalls += 1;
+    }
+    return result;
+}
+
+fn writeArgs(comptime index: u16, args: anytype) void {
+    const name = procs[index];
+
+    inline for (args, 0..) |arg, i| {
+        const T = @TypeOf(arg);
+        if (comptime std.mem.eql(u8, name, "ShaderSource") and i == 1) {
+            const total: T = @intCast(shaderSourceLength(args));
+            put(std.mem.asBytes(&total));
+        } else if (comptime pointerInfo(T) == null) {
+            put(std.mem.asBytes(&arg));
+        } else if (comptime std.mem.eql(u8, name, "ShaderSource") and i == 2) {
+            writeShaderSource(args);
+        } else if (comptime std.mem.eql(u8, name, "ShaderSource") and i == 3) {
+            writePayload(null); // Part of the source payload
+        } else {
+            const bytes: ?[*]const u8 = @ptrCast(arg);
+            if (bytes) |ptr| {
+                if (payloadSize(name, i, args)) |size| {
+                    writePayload(ptr[0..size]);
+                } else {
+                    if (comptime pointerInfo(T).?.is_const) unknownPayloads += 1;
+                    writePayload(null);
+                }
+            } else {
+                writePayload(null);
+            }
+        }
+    }
+}
+
+/// Shader sources are stored as one string, the count argument holds its length in the stream
+fn writeShaderSource(args: anytype) void {
+    put(std.mem.asBytes(&@as(u32, @intCast(shaderSourceLength(args)))));
+    pad();
+    for (0..@intCast(args[1])) |s| {
+        const ptr: [*]const u8 = @ptrCast(args[2][s]);
+        put(ptr[0..sourceLength(args, s)]);
+    }
+}
+
+fn shaderSourceLength(args: anytype) usize {
+    var total: usize = 0;
+    for (0..@intCast(args[1])) |s| total += sourceLength(args, s);
+    return total;
+}
+
+fn sourceLength(args: anytype, s: usize) usize {
+    const lengths: ?[*]const gl.int = @ptrCast(args[3]);
+    if (lengths) |values| {
+        if (values[s] >= 0) return @intCast(values[s]);
+    }
+    const ptr: [*:0]const u8 = @ptrCast(args[2][s]);
+    return std.mem.len(ptr);
+}
+
+/// GL object namespaces, shaders and programs share one
+const Namespace = enum {
+    buffer,
+    texture,
+    vertexArray,
+    framebuffer,
+    renderbuffer,
+    query,
+    sampler,
+    transformFeedback,
+    pipeline,
+    program,
+};
+
+const namespaceCount = std.meta.fields(Namespace).len;
+const NameMap = std.AutoHashMapUnmanaged(gl.uint, gl.uint);
+
+/// Scalar object name parameters that are not covered by the prefix rules of nameParam
+const NameParam = struct { proc: []const u8, param: usize, namespace: Namespace };
+const nameParams = [_]NameParam{
+    .{ .proc = "BindBuffer", .param = 1, .namespace = .buffer },
+    .{ .proc = "BindBufferBase", .param = 2, .namespace = .buffer },
+    .{ .proc = "BindBufferRange", .param = 2, .namespace = .buffer },
+    .{ .proc = "TexBuffer", .param = 2, .namespace = .buffer },
+    .{ .proc = "IsBuffer", .param = 0, .namespace = .buffer },
+    .{ .proc = "BindTexture", .param = 1, .namespace = .texture },
+    .{ .proc = "FramebufferTexture", .param = 2, .namespace = .texture },
+    .{ .proc = "FramebufferTexture1D", .param = 3, .namespace = .texture },
+    .{ .proc = "FramebufferTexture2D", .param = 3, .namespace = .texture },
+    .{ .proc = "FramebufferTexture3D", .param = 3, .namespace = .texture },
+    .{ .proc = "FramebufferTextureLayer", .param = 2, .namespace = .texture },
+    .{ .proc = "IsTexture", .param = 0, .namespace = .texture },
+    .{ .proc = "BindVertexArray", .param = 0, .namespace = .vertexArray },
+    .{ .proc = "IsVertexArray", .param = 0, .namespace = .vertexArray },
+    .{ .proc = "BindFramebuffer", .param = 1, .namespace = .framebuffer },
+    .{ .proc = "IsFramebuffer", .param = 0, .namespace = .framebuffer },
+    .{ .proc = "BindRenderbuffer", .param = 1, .namespace = .renderbuffer },
+    .{ .proc = "FramebufferRenderbuffer", .param = 3, .namespace = .renderbuffer },
+    .{ .proc = "IsRenderbuffer", .param = 0, .namespace = .renderbuffer },
+    .{ .proc = "BeginQuery", .param = 1, .namespace = .query },
+    .{ .proc = "BeginQueryIndexed", .param = 2, .namespace = .query },
+    .{ .proc = "QueryCounter", .param = 0, .namespace = .query },
+    .{ .proc = "IsQuery", .param = 0, .namespace = .query },
+    .{ .proc = "BindSampler", .param = 1, .namespace = .sampler },
+    .{ .proc = "IsSampler", .param = 0, .namespace = .sampler },
+    .{ .proc = "BindTransformFeedback", .param = 1, .namespace = .transformFeedback },
+    .{ .proc = "IsTransformFeedback", .param = 0, .namespace = .transformFeedback },
+    .{ .proc = "BindProgramPipeline", .param = 0, .namespace = .pipeline },
+    .{ .proc = "UseProgramStages", .param = 0, .namespace = .pipeline },
+    .{ .proc = "UseProgramStages", .param = 2, .namespace = .program },
+    .{ .proc = "ActiveShaderProgram", .param = 0, .namespace = .pipeline },
+    .{ .proc = "ActiveShaderProgram", .param = 1, .namespace = .program },
+    .{ .proc = "ValidateProgramPipeline", .param = 0, .namespace = .pipeline },
+    .{ .proc = "IsProgramPipeline", .param = 0, .namespace = .pipeline },
+    .{ .proc = "UseProgram", .param = 0, .namespace = .program },
+    .{ .proc = "LinkProgram", .param = 0, .namespace = .program },
+    .{ .proc = "ValidateProgram", .param = 0, .namespace = .program },
+    .{ .proc = "DeleteProgram", .param = 0, .namespace = .program },
+    .{ .proc = "IsProgram", .param = 0, .namespace = .program },
+    .{ .proc = "AttachShader", .param = 0, .namespace = .program },
+    .{ .proc = "AttachShader", .param = 1, .namespace = .program },
+    .{ .proc = "DetachShader", .param = 0, .namespace = .program },
+    .{ .proc = "DetachShader", .param = 1, .namespace = .program },
+    .{ .proc = "BindAttribLocation", .param = 0, .namespace = .program },
+    .{ .proc = "GetAttribLocation", .param = 0, .namespace = .program },
+    .{ .proc = "GetAttachedShaders", .param = 0, .namespace = .program },
+    .{ .proc = "BindFragDataLocation", .param = 0, .namespace = .program },
+    .{ .proc = "BindFragDataLocationIndexed", .param = 0, .namespace = .program },
+    .{ .proc = "UniformBlockBinding", .param = 0, .namespace = .program },
+    .{ .proc = "TransformFeedbackVaryings", .param = 0, .namespace = .program },
+    .{ .proc = "ProgramParameteri", .param = 0, .namespace = .program },
+    .{ .proc = "ProgramBinary", .param = 0, .namespace = .program },
+    .{ .proc = "ShaderSource", .param = 0, .namespace = .program },
+    .{ .proc = "CompileShader", .param = 0, .namespace = .program },
+    .{ .proc = "DeleteShader", .param = 0, .namespace = .program },
+    .{ .proc = "IsShader", .param = 0, .namespace = .program },
+};
+
+/// Namespace of scalar parameter i when it is an object name, null otherwise
+fn nameParam(comptime name: []const u8, comptime i: usize) ?Namespace {
+    @setEvalBranchQuota(10_000);
+    const eql = std.mem.eql;
+    const startsWith = std.mem.startsWith;
+
+    for (nameParams) |entry| {
+        if (eql(u8, entry.proc, name) and entry.param == i) return entry.namespace;
+    }
+    if (i != 0) return null;
+
+    // Procedures that take the object as their first parameter
+    if (startsWith(u8, name, "GetProgramPipeline")) return .pipeline;
+    if (startsWith(u8, name, "ProgramUniform") or startsWith(u8, name, "GetProgram") or
+        startsWith(u8, name, "GetActive") or startsWith(u8, name, "GetFragData") or
+        startsWith(u8, name, "GetSubroutine") or
+        (startsWith(u8, name, "GetUniform") and !eql(u8, name, "GetUniformSubroutineuiv")) or
+        (startsWith(u8, name, "GetShader") and !eql(u8, name, "GetShaderPrecisionFormat")))
+    {
+        return .program;
+    }
+    if (startsWith(u8, name, "SamplerParameter") or startsWith(u8, name, "GetSamplerParameter")) return .sampler;
+    if (startsWith(u8, name, "GetQueryObject")) return .query;
+    return null;
+}
+
+/// Namespace of the name array of prefix ("Gen" or "Delete") procedures, e.g. GenBuffers
+fn arrayNamespace(comptime name: []const u8, comptime prefix: []const u8) ?Namespace {
+    if (!std.mem.startsWith(u8, name, prefix)) return null;
+    const kinds = .{
+        .{ "Buffers", .buffer },
+        .{ "Textures", .texture },
+        .{ "VertexArrays", .vertexArray },
+        .{ "Framebuffers", .framebuffer },
+        .{ "Renderbuffers", .renderbuffer },
+        .{ "Queries", .query },
+        .{ "Samplers", .sampler },
+        .{ "TransformFeedbacks", .transformFeedback },
+        .{ "ProgramPipelines", .pipeline },
+    };
+    inline for (kinds) |kind| {
+        if (std.mem.eql(u8, name[prefix.len..], kind[0])) return kind[1];
+    }
+    return null;
+}
+
+/// Namespace of the name returned by Create* procedures
+fn createNamespace(comptime name: []const u8) ?Namespace {
+    const eql = std.mem.eql;
+    if (eql(u8, name, "CreateProgram") or eql(u8, name, "CreateShader") or eql(u8, name, "CreateShaderProgramv")) {
+        return .program;
+    }
+    return null;
+}
+
+/// Namespace of an ObjectLabel identifier
+fn labelNamespace(identifier: gl.@"enum") ?Namespace {
+    return switch (identifier) {
+        gl.BUFFER => .buffer,
+        gl.TEXTURE => .texture,
+        gl.VERTEX_ARRAY => .vertexArray,
+        gl.FRAMEBUFFER => .framebuffer,
+        gl.RENDERBUFFER => .renderbuffer,
+        gl.QUERY => .query,
+        gl.SAMPLER => .sampler,
+        gl.TRANSFORM_FEEDBACK => .transformFeedback,
+        gl.PROGRAM_PIPELINE => .pipeline,
+        gl.SHADER, gl.PROGRAM => .program,
+        else => null,
+    };
+}
+
+/// Bytes behind pointer argument i, null when unknown
+fn payloadSize(comptime name: []const u8, comptime i: usize, args: anytype) ?usize {
+    const eql = std.mem.eql;
+
+    if (comptime eql(u8, name, "BufferData") and i == 2) return @intCast(args[1]);
+    if (comptime eql(u8, name, "BufferSubData") and i == 3) return @intCast(args[2]);
+    if (comptime eql(u8, name, "GetBufferSubData") and i == 3) return @intCast(args[2]);
+    if (comptime eql(u8, name, "TexImage2D") and i == 8) return imageSize(args[3], args[4], args[6], args[7]);
+    if (comptime eql(u8, name, "TexSubImage2D") and i == 8) return imageSize(args[4], args[5], args[6], args[7]);
+    if (comptime eql(u8, name, "ObjectLabel") and i == 3) return stringSize(args[3], args[2]);
+    if (comptime eql(u8, name, "PushDebugGroup") and i == 3) return stringSize(args[3], args[2]);
+    if (comptime eql(u8, name, "DrawBuffers") and i == 1) return @as(usize, @intCast(args[0])) * 4;
+    if (comptime eql(u8, name, "MultiDrawArrays") and (i == 1 or i == 2)) return @as(usize, @intCast(args[3])) * 4;
+
+    // Object names in and out: Gen*/Delete*(n, names), replay maps them, see Capture.replayCall
+    if (comptime i == 1 and (std.mem.startsWith(u8, name, "Gen") or std.mem.startsWith(u8, name, "Delete")) and
+        std.mem.endsWith(u8, name, "s"))
+    {
+        return @as(usize, @intCast(args[0])) * 4;
+    }
+
+    // Name strings
+    if (comptime (eql(u8, name, "GetUniformLocation") or eql(u8, name, "GetAttribLocation") or
+        eql(u8, name, "GetUniformBlockIndex")) and i == 1)
+    {
+        return stringSize(args[1], -1);
+    }
+    if (comptime eql(u8, name, "BindAttribLocation") and i == 2) return stringSize(args[2], -1);
+
+    // Uniform arrays: Uniform{1,2,3,4}{f,i,ui}v(location, count, value), UniformMatrix{2,3,4}fv(location, count, transpose, value)
+    if (comptime std.mem.startsWith(u8, name, "UniformMatrix") and name.len == "UniformMatrix4fv".len and i == 3) {
+        const n = name["UniformMatrix".len] - '0';
+        return @as(usize, @intCast(args[1])) * n * n * 4;
+    }
+    if (comptime std.mem.startsWith(u8, name, "Uniform") and std.mem.endsWith(u8, name, "v") and
+        name["Uniform".len] >= '1' and name["Uniform".len] <= '4' and i == 2)
+    {
+        const n = name["Uniform".len] - '0';
+        return @as(usize, @intCast(args[1])) * n * 4;
+    }
+
+    return null;
+}
+
+/// Bytes read by TexImage2D for the default unpack alignment of 4
+fn imageSize(width: gl.sizei, height: gl.sizei, format: gl.@"enum", pixelType: gl.@"enum") ?usize {
+    const components: usize = switch (format) {
+        gl.RED, gl.RED_INTEGER, gl.DEPTH_COMPONENT => 1,
+        gl.RG, gl.RG_INTEGER => 2,
+        gl.RGB, gl.BGR, gl.RGB_INTEGER => 3,
+        gl.RGBA, gl.BGRA, gl.RGBA_INTEGER => 4,
+        else => return null,
+    };
+    const componentSize: usize = switch (pixelType) {
+        gl.UNSIGNED_BYTE, gl.BYTE => 1,
+        gl.UNSIGNED_SHORT, gl.SHORT, gl.HALF_FLOAT => 2,
+        gl.UNSIGNED_INT, gl.INT, gl.FLOAT => 4,
+        else => return null,
+    };
+    if (width <= 0 or height <= 0) return 0;
+
+    const rowBytes = @as(usize, @intCast(width)) * components * componentSize;
+    const rowStride = std.mem.alignForward(usize, rowBytes, 4);
+    return rowStride * (@as(usize, @intCast(height)) - 1) + rowBytes; // The last row is not padded
+}
+
+/// Size of a string with an explicit length, or NUL-terminated (including the terminator) when negative
+fn stringSize(string: anytype, length: gl.sizei) usize {
+    if (length >= 0) return @intCast(length);
+    const ptr: [*:0]const u8 = @ptrCast(string);
+    return std.mem.len(ptr) + 1;
+}
+
+fn writePayload(bytes: ?[]const u8) void {
+    const payload = bytes orelse {
+        put(std.mem.asBytes(&NULL_PAYLOAD));
+        return;
+    };
+    put(std.mem.asBytes(&@as(u32, @intCast(payload.len))));
+    pad();
+    put(payload);
+}
+
+fn pad() void {
+    const zeros = [_]u8{0} ** PAYLOAD_ALIGNMENT;
+    const padding = std.mem.alignForward(u64, written, PAYLOAD_ALIGNMENT) - written;
+    put(zeros[0..@intCast(padding)]);
+}
+
+fn put(bytes: []const u8) void {
+    writer.writer().writeAll(bytes) catch {
+        failed = true;
+        return;
+    };
+    written += bytes.len;
+}
+
+fn readValue(comptime T: type, data: []const u8, cursor: *usize) !T {
+    if (cursor.* + @sizeOf(T) > data.len) return error.InvalidCapture;
+    const value = std.mem.bytesToValue(T, data[cursor.*..][0..@sizeOf(T)]);
+    cursor.* += @sizeOf(T);
+    return value;
+}
+
+/// Identifies the bindings a capture was made with
+fn tableHash() u64 {
+    var hasher = std.hash.Wyhash.init(0);
+    for (procs) |name| hasher.update(name);
+    return hasher.final();
+}
+
+/// Function type of a table field, null for fields that are not procedures
+fn FnOf(comptime T: type) ?type {
+    const Ptr = switch (@typeInfo(T)) {
+        .Optional => |optional| optional.child,
+        else => T,
+    };
+    return switch (@typeInfo(Ptr)) {
+        .Pointer => |pointer| if (@typeInfo(pointer.child) == .Fn) pointer.child else null,
+        else => null,
+    };
+}
+
+fn ProcType(comptime index: u16) type {
+    const field = std.meta.fieldInfo(gl.ProcTable, @field(std.meta.FieldEnum(gl.ProcTable), procs[index]));
+    return FnOf(field.type).?;
+}
+
+/// Pointer info of a (nullable) data pointer type, null for scalars
+fn pointerInfo(comptime T: type) ?std.builtin.Type.Pointer {
+    return switch (@typeInfo(T)) {
+        .Pointer => |pointer| pointer,
+        .Optional => |optional| switch (@typeInfo(optional.child)) {
+            .Pointer => |pointer| pointer,
+            else => null,
+        },
+        else => null,
+    };
+}
+
+/// Whether calls of a procedure can be recorded and replayed
+fn capturable(comptime index: u16) bool {
+    const info = @typeInfo(ProcType(index)).Fn;
+    const name = procs[index];
+    if (info.params.len > MAX_PARAMS) return false;
+
+    // Mapped memory is written outside of GL calls, sync objects are per context
+    if (std.mem.startsWith(u8, name, "MapBuffer") or std.mem.eql(u8, name, "UnmapBuffer")) return false;
+
+    for (info.params) |param| {
+        const pointer = pointerInfo(param.type.?) orelse continue;
+        switch (@typeInfo(pointer.child)) {
+            .Fn, .Opaque => if (pointer.child != anyopaque) return false, // Callbacks and handles (GLsync)
+            else => {},
+        }
+    }
+    return switch (@typeInfo(info.return_type.?)) {
+        .Pointer, .Optional => std.mem.eql(u8, name, "GetString") or std.mem.eql(u8, name, "GetStringi"),
+        else => true,
+    };
+}
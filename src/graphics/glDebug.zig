@@ -0,0 +1,189 @@
+//! OpenGL debug output
+//!
+//! Installs a DebugMessageCallback (KHR_debug, core since 4.3) that routes driver messages by severity
+//! into std.log and keeps counters plus the latest performance warning for the overlay.
+//! Object labels and debug groups make messages and frame captures (RenderDoc, Nsight) attributable
+//! to assets and render phases. Without a debug context every function here is a no-op.
+
+const std = @import("std");
+const builtin = @import("builtin");
+const gl = @import("gl");
+
+const log = std.log.scoped(.gl);
+
+/// Object kinds that can be labeled
+pub const ObjectKind = enum {
+    buffer,
+    vertexArray,
+    texture,
+    shader,
+    program,
+    framebuffer,
+
+    fn identifier(self: ObjectKind) gl.@"enum" {
+        return switch (self) {
+            .buffer => gl.BUFFER,
+            .vertexArray => gl.VERTEX_ARRAY,
+            .texture => gl.TEXTURE,
+            .shader => gl.SHADER,
+            .program => gl.PROGRAM,
+            .framebuffer => gl.FRAMEBUFFER,
+        };
+    }
+};
+
+/// Message severities in increasing order
+pub const Severity = enum {
+    notification,
+    low,
+    medium,
+    high,
+};
+
+/// Message counters since start
+///
+/// Contains:
+/// - bySeverity: messages per severity
+/// - performance: messages of type DEBUG_TYPE_PERFORMANCE
+pub const Counters = struct {
+    bySeverity: [std.meta.fields(Severity).len]usize = .{0} ** std.meta.fields(Severity).len,
+    performance: usize = 0,
+};
+
+const MAX_LABEL_LENGTH = 256; // Minimum GL_MAX_LABEL_LENGTH guaranteed by the spec
+const WARNING_LENGTH = 256;
+
+var active = false;
+
+// Written from the callback, which may run on a driver thread when output is asynchronous
+var mutex = std.Thread.Mutex{};
+var counters = Counters{};
+var lastWarning: [WARNING_LENGTH]u8 = undefined;
+var lastWarningLength: usize = 0;
+
+/// Install the callback when the current context is a debug context
+/// Output is synchronous in debug builds, so messages carry the stack of the offending call
+pub fn init() void {
+    var flags: gl.int = 0;
+    gl.GetIntegerv(gl.CONTEXT_FLAGS, (&flags)[0..1]);
+    if (flags & gl.CONTEXT_FLAG_DEBUG_BIT == 0) {
+        log.info("No debug context, GL debug output disabled", .{});
+        return;
+    }
+
+    gl.Enable(gl.DEBUG_OUTPUT);
+    if (builtin.mode == .Debug) {
+        gl.Enable(gl.DEBUG_OUTPUT_SYNCHRONOUS);
+    }
+    gl.DebugMessageCallback(callback, null);
+
+    // Own debug groups are echoed as notifications, they only add noise to the log
+    gl.DebugMessageControl(gl.DEBUG_SOURCE_APPLICATION, gl.DEBUG_TYPE_PUSH_GROUP, gl.DONT_CARE, 0, null, gl.FALSE);
+    gl.DebugMessageControl(gl.DEBUG_SOURCE_APPLICATION, gl.DEBUG_TYPE_POP_GROUP, gl.DONT_CARE, 0, null, gl.FALSE);
+
+    active = true;
+}
+
+/// Attach a formatted name to a GL object (truncated to the minimum label length)
+pub fn label(kind: ObjectKind, id: gl.uint, comptime fmt: []const u8, args: anytype) void {
+    if (!active or id == 0) return;
+
+    var buf: [MAX_LABEL_LENGTH]u8 = undefined;
+    const name = std.fmt.bufPrint(buf[0 .. MAX_LABEL_LENGTH - 1], fmt, args) catch buf[0 .. MAX_LABEL_LENGTH - 1];
+    gl.ObjectLabel(kind.identifier(), id, @intCast(name.len), name.ptr);
+}
+
+/// Open a named debug group, close it with popGroup
+pub fn pushGroup(name: []const u8) void {
+    if (!active) return;
+    gl.PushDebugGroup(gl.DEBUG_SOURCE_APPLICATION, 0, @intCast(name.len), name.ptr);
+}
+
+/// Close the innermost debug group
+pub fn popGroup() void {
+    if (!active) return;
+    gl.PopDebugGroup();
+}
+
+/// Message counters since start
+pub fn getCounters() Counters {
+    mutex.lock();
+    defer mutex.unlock();
+    return counters;
+}
+
+/// Copy the newest performance warning into buf, null if there was none
+pub fn latestWarning(buf: []u8) ?[]const u8 {
+    mutex.lock();
+    defer mutex.unlock();
+
+    if (counters.performance == 0) return null;
+    const len = @min(buf.len, lastWarningLength);
+    @memcpy(buf[0..len], lastWarning[0..len]);
+    return buf[0..len];
+}
+
+fn callback(
+    source: gl.@"enum",
+    messageType: gl.@"enum",
+    id: gl.uint,
+    severity: gl.@"enum",
+    length: gl.sizei,
+    message: [*:0]const gl.char,
+    userParam: ?*const anyopaque,
+) callconv(.C) void {
+    _ = userParam;
+
+    const text = if (length > 0) message[0..@intCast(length)] else std.mem.span(message);
+    const level: Severity = switch (severity) {
+        gl.DEBUG_SEVERITY_HIGH => .high,
+        gl.DEBUG_SEVERITY_MEDIUM => .medium,
+        gl.DEBUG_SEVERITY_LOW => .low,
+        else => .notification,
+    };
+    const isPerformance = messageType == gl.DEBUG_TYPE_PERFORMANCE;
+
+    record(level, isPerformance, text);
+
+    const args = .{ sourceName(source), typeName(messageType), id, text };
+    switch (level) {
+        .high => log.err("[{s}/{s} {d}] {s}", args),
+        .medium, .low => log.warn("[{s}/{s} {d}] {s}", args),
+        .notification => log.debug("[{s}/{s} {d}] {s}", args),
+    }
+}
+
+fn record(level: Severity, isPerformance: bool, text: []const u8) void {
+    mutex.lock();
+    defer mutex.unlock();
+
+    counters.bySeverity[@intFromEnum(level)] += 1;
+    if (!isPerformance) return;
+
+    counters.performance += 1;
+    lastWarningLength = @min(text.len, WARNING_LENGTH);
+    @memcpy(lastWarning[0..lastWarningLength], text[0..lastWarningLength]);
+}
+
+fn sourceName(source: gl.@"enum") []const u8 {
+    return switch (source) {
+        gl.DEBUG_SOURCE_API => "api",
+        gl.DEBUG_SOURCE_WINDOW_SYSTEM => "window",
+        gl.DEBUG_SOURCE_SHADER_COMPILER => "compiler",
+        gl.DEBUG_SOURCE_THIRD_PARTY => "third party",
+        gl.DEBUG_SOURCE_APPLICATION => "application",
+        else => "other",
+    };
+}
+
+fn typeName(messageType: gl.@"enum") []const u8 {
+    return switch (messageType) {
+        gl.DEBUG_TYPE_ERROR => "error",
+        gl.DEBUG_TYPE_DEPRECATED_BEHAVIOR => "deprecated",
+        gl.DEBUG_TYPE_UNDEFINED_BEHAVIOR => "undefined",
+        gl.DEBUG_TYPE_PORTABILITY => "portability",
+        gl.DEBUG_TYPE_PERFORMANCE => "performance",
+        gl.DEBUG_TYPE_MARKER => "marker",
+        else => "other",
+    };
+}
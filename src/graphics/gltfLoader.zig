@@ -0,0 +1,512 @@
+//! Load binary glTF 2.0 (.glb) files
+//!
+//! Maps the file and uploads the binary chunk as a single GPU buffer.
+//! Vertex attributes and indices point directly into that buffer with the accessor's
+//! offset, stride and component type, so vertices are never reprocessed on the CPU.
+//! PBR metallic-roughness materials are mapped onto the existing Material fields.
+//! Node transforms of the default scene are flattened into one transform per draw.
+
+const std = @import("std");
+const gl = @import("gl");
+const zmath = @import("zmath");
+const zstbi = @import("zstbi");
+
+const objectLoader = @import("objectLoader.zig");
+const glDebug = @import("glDebug.zig");
+const imageDecoder = @import("imageDecoder.zig");
+const mappedFile = @import("../util/mappedFile.zig");
+const memory = @import("../util/memory.zig");
+
+const GLB_MAGIC: u32 = 0x46546C67; // "glTF"
+const CHUNK_JSON: u32 = 0x4E4F534A; // "JSON"
+const CHUNK_BIN: u32 = 0x004E4942; // "BIN\0"
+const MODE_TRIANGLES: u32 = 4;
+
+// Subset of the glTF 2.0 JSON schema, unknown fields are ignored
+const Gltf = struct {
+    accessors: []const Accessor = &.{},
+    bufferViews: []const BufferView = &.{},
+    meshes: []const GltfMesh = &.{},
+    materials: []const GltfMaterial = &.{},
+    textures: []const Texture = &.{},
+    images: []const Image = &.{},
+    nodes: []const Node = &.{},
+    scenes: []const GltfScene = &.{},
+    scene: ?u32 = null,
+};
+
+const Node = struct {
+    children: []const u32 = &.{},
+    mesh: ?u32 = null,
+    matrix: ?[16]f32 = null,
+    translation: [3]f32 = .{ 0.0, 0.0, 0.0 },
+    rotation: [4]f32 = .{ 0.0, 0.0, 0.0, 1.0 },
+    scale: [3]f32 = .{ 1.0, 1.0, 1.0 },
+};
+
+const GltfScene = struct {
+    nodes: []const u32 = &.{},
+};
+
+const Accessor = struct {
+    bufferView: ?u32 = null,
+    byteOffset: u32 = 0,
+    componentType: u32,
+    normalized: bool = false,
+    count: u32,
+    @"type": []const u8,
+};
+
+const BufferView = struct {
+    buffer: u32 = 0,
+    byteOffset: u32 = 0,
+    byteLength: u32,
+    byteStride: ?u32 = null,
+};
+
+const Attributes = struct {
+    POSITION: ?u32 = null,
+    NORMAL: ?u32 = null,
+    TEXCOORD_0: ?u32 = null,
+    TANGENT: ?u32 = null,
+};
+
+const Primitive = struct {
+    attributes: Attributes,
+    indices: ?u32 = null,
+    material: ?u32 = null,
+    mode: u32 = MODE_TRIANGLES,
+};
+
+const GltfMesh = struct {
+    primitives: []const Primitive = &.{},
+};
+
+const TextureInfo = struct {
+    index: u32,
+};
+
+const PbrMetallicRoughness = struct {
+    baseColorFactor: [4]f32 = .{ 1.0, 1.0, 1.0, 1.0 },
+    baseColorTexture: ?TextureInfo = null,
+    metallicFactor: f32 = 1.0,
+    roughnessFactor: f32 = 1.0,
+    metallicRoughnessTexture: ?TextureInfo = null,
+};
+
+const GltfMaterial = struct {
+    name: ?[]const u8 = null,
+    pbrMetallicRoughness: PbrMetallicRoughness = .{},
+    normalTexture: ?TextureInfo = null,
+    alphaMode: []const u8 = "OPAQUE",
+};
+
+const Texture = struct {
+    source: ?u32 = null,
+};
+
+const Image = struct {
+    bufferView: ?u32 = null,
+};
+
+/// Draw struct
+///
+/// Contains:
+/// - vao: vertex array pointing into the shared buffer
+/// - count: number of indices (or vertices when not indexed)
+/// - indexType: OpenGL type of the indices
+/// - indexOffset: byte offset of the indices in the shared buffer
+/// - indexed: whether the primitive has indices
+/// - material: index into the object's materials
+/// - transform: world matrix of the glTF node, relative to the model's root
+pub const Draw = struct {
+    vao: gl.uint,
+    count: usize,
+    indexType: gl.@"enum" = gl.UNSIGNED_INT,
+    indexOffset: usize = 0,
+    indexed: bool = false,
+    material: usize = 0,
+    transform: zmath.Mat = zmath.identity(),
+
+    /// Issue the draw call of the primitive
+    pub fn draw(self: Draw) void {
+        gl.BindVertexArray(self.vao);
+        if (self.indexed) {
+            gl.DrawElements(gl.TRIANGLES, @intCast(self.count), self.indexType, self.indexOffset);
+        } else {
+            gl.DrawArrays(gl.TRIANGLES, 0, @intCast(self.count));
+        }
+    }
+};
+
+/// Model struct
+///
+/// Contains:
+/// - buffer: the binary chunk on the GPU
+/// - vaos: one per triangle primitive, shared by every node instancing the mesh
+/// - draws: one per (node, primitive)
+///
+/// deinit method
+pub const Model = struct {
+    buffer: gl.uint,
+    vaos: []gl.uint,
+    draws: []Draw,
+    allocator: std.mem.Allocator,
+
+    /// Deinitialize the model (vertex arrays and buffer)
+    pub fn deinit(self: *Model) void {
+        if (self.vaos.len > 0) gl.DeleteVertexArrays(@intCast(self.vaos.len), self.vaos);
+        memory.untrackGpu(.buffer, self.buffer);
+        gl.DeleteBuffers(1, (&self.buffer)[0..1]);
+        self.allocator.free(self.vaos);
+        self.allocator.free(self.draws);
+    }
+};
+
+/// Load a .glb file, materials are added to the given object
+pub fn load(path: []const u8, obj: *objectLoader.ObjectStruct, allocator: std.mem.Allocator) !Model {
+    var file = try mappedFile.MappedFile.open(allocator, path);
+    defer file.close();
+    const data = file.data;
+
+    // Header
+    if (data.len < 20) return error.InvalidGlb;
+    if (std.mem.readInt(u32, data[0..4], .little) != GLB_MAGIC) return error.InvalidGlb;
+    if (std.mem.readInt(u32, data[4..8], .little) != 2) return error.UnsupportedGltfVersion;
+
+    // JSON chunk
+    const jsonLength: usize = std.mem.readInt(u32, data[12..16], .little);
+    if (std.mem.readInt(u32, data[16..20], .little) != CHUNK_JSON) return error.InvalidGlb;
+    if (20 + jsonLength > data.len) return error.InvalidGlb;
+    const json = data[20..][0..jsonLength];
+
+    // Binary chunk (optional)
+    var binary: []const u8 = &.{};
+    const binStart = 20 + jsonLength;
+    if (binStart + 8 <= data.len) {
+        const binLength: usize = std.mem.readInt(u32, data[binStart..][0..4], .little);
+        if (std.mem.readInt(u32, data[binStart + 4 ..][0..4], .little) != CHUNK_BIN) return error.InvalidGlb;
+        if (binStart + 8 + binLength > data.len) return error.InvalidGlb;
+        binary = data[binStart + 8 ..][0..binLength];
+    }
+
+    const parsed = try std.json.parseFromSlice(Gltf, allocator, json, .{ .ignore_unknown_fields = true });
+    defer parsed.deinit();
+    const doc = parsed.value;
+
+    try loadMaterials(&doc, binary, obj);
+
+    // Upload the whole binary chunk once, every primitive references it
+    var buffer: gl.uint = 0;
+    gl.GenBuffers(1, (&buffer)[0..1]);
+    gl.BindBuffer(gl.ARRAY_BUFFER, buffer);
+    gl.BufferData(gl.ARRAY_BUFFER, @intCast(binary.len), binary.ptr, gl.STATIC_DRAW);
+    memory.trackGpu(.buffer, buffer, binary.len);
+    errdefer {
+        memory.untrackGpu(.buffer, buffer);
+        gl.DeleteBuffers(1, (&buffer)[0..1]);
+    }
+    glDebug.label(.buffer, buffer, "{s} binary chunk", .{path});
+
+    // Primitives of every mesh, uploaded once
+    var primitives = std.ArrayList(Draw).init(allocator);
+    defer primitives.deinit();
+    errdefer for (primitives.items) |primitive| gl.DeleteVertexArrays(1, (&primitive.vao)[0..1]);
+    const meshRanges = try allocator.alloc([2]usize, doc.meshes.len);
+    defer allocator.free(meshRanges);
+
+    for (doc.meshes, meshRanges) |gltfMesh, *range| {
+        range[0] = primitives.items.len;
+        for (gltfMesh.primitives) |primitive| {
+            if (primitive.mode != MODE_TRIANGLES) {
+                std.log.warn("Skipping glTF primitive with mode {d}", .{primitive.mode});
+                continue;
+            }
+            const positionIndex = primitive.attributes.POSITION orelse continue;
+
+            var vao: gl.uint = 0;
+            gl.GenVertexArrays(1, (&vao)[0..1]);
+            errdefer gl.DeleteVertexArrays(1, (&vao)[0..1]); // Until it is in primitives
+            gl.BindVertexArray(vao);
+            gl.BindBuffer(gl.ARRAY_BUFFER, buffer);
+            glDebug.label(.vertexArray, vao, "{s} primitive {d}", .{ path, primitives.items.len });
+
+            const vertexCount = (try getAccessor(&doc, positionIndex, binary.len)).accessor.count;
+            var primitiveDraw = Draw{
+                .vao = vao,
+                .count = vertexCount,
+                .material = primitive.material orelse 0,
+            };
+
+            // Same attribute locations as the .obj layout
+            try bindAttribute(&doc, 0, primitive.attributes.POSITION, vertexCount, binary.len);
+            try bindAttribute(&doc, 1, primitive.attributes.TEXCOORD_0, vertexCount, binary.len);
+            try bindAttribute(&doc, 2, primitive.attributes.NORMAL, vertexCount, binary.len);
+            try bindAttribute(&doc, 3, primitive.attributes.TANGENT, vertexCount, binary.len);
+
+            if (primitive.indices) |indicesIndex| {
+                const indices = try getIndexAccessor(&doc, indicesIndex, binary.len);
+                gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER, buffer);
+
+                primitiveDraw.indexed = true;
+                primitiveDraw.count = indices.accessor.count;
+                primitiveDraw.indexType = indices.accessor.componentType;
+                primitiveDraw.indexOffset = indices.offset;
+            }
+
+            try primitives.append(primitiveDraw);
+        }
+        range[1] = primitives.items.len;
+    }
+
+    // One draw per (node, primitive) with the node's world transform
+    var draws = std.ArrayList(Draw).init(allocator);
+    errdefer draws.deinit();
+    if (doc.nodes.len == 0) {
+        try draws.appendSlice(primitives.items);
+    } else if (doc.scenes.len > 0) {
+        const sceneIndex = doc.scene orelse 0;
+        if (sceneIndex >= doc.scenes.len) return error.InvalidGltfScene;
+        for (doc.scenes[sceneIndex].nodes) |root| {
+            try addNodeDraws(&doc, root, zmath.identity(), primitives.items, meshRanges, &draws, 0);
+        }
+    } else {
+        // Without scenes every node that is not a child is a root
+        var isChild = try std.DynamicBitSet.initEmpty(allocator, doc.nodes.len);
+        defer isChild.deinit();
+        for (doc.nodes) |node| {
+            for (node.children) |child| {
+                if (child < doc.nodes.len) isChild.set(child);
+            }
+        }
+        for (0..doc.nodes.len) |root| {
+            if (isChild.isSet(root)) continue;
+            try addNodeDraws(&doc, @intCast(root), zmath.identity(), primitives.items, meshRanges, &draws, 0);
+        }
+    }
+
+    const vaos = try allocator.alloc(gl.uint, primitives.items.len);
+    errdefer allocator.free(vaos);
+    for (vaos, primitives.items) |*vao, primitiveDraw| vao.* = primitiveDraw.vao;
+
+    // Constant values for attributes a primitive does not provide
+    gl.VertexAttrib2f(1, 0.0, 0.0);
+    gl.VertexAttrib3f(2, 0.0, 0.0, 1.0);
+    gl.VertexAttrib3f(3, 1.0, 0.0, 0.0);
+
+    return Model{
+        .buffer = buffer,
+        .vaos = vaos,
+        .draws = try draws.toOwnedSlice(),
+        .allocator = allocator,
+    };
+}
+
+/// Append the draws of a node and its children, world = local * parent (row vectors)
+fn addNodeDraws(doc: *const Gltf, index: u32, parent: zmath.Mat, primitives: []const Draw, meshRanges: []const [2]usize, draws: *std.ArrayList(Draw), depth: usize) !void {
+    // Deeper than the node count means the hierarchy has a cycle
+    if (index >= doc.nodes.len or depth > doc.nodes.len) return error.InvalidGltfNode;
+    const node = doc.nodes[index];
+    const world = zmath.mul(localMatrix(node), parent);
+
+    if (node.mesh) |meshIndex| {
+        if (meshIndex >= meshRanges.len) return error.InvalidGltfNode;
+        const range = meshRanges[meshIndex];
+        for (primitives[range[0]..range[1]]) |primitive| {
+            var nodeDraw = primitive;
+            nodeDraw.transform = world;
+            try draws.append(nodeDraw);
+        }
+    }
+    for (node.children) |child| {
+        try addNodeDraws(doc, child, world, primitives, meshRanges, draws, depth + 1);
+    }
+}
+
+/// Local matrix of a node, either the given matrix or scale, rotation, translation
+fn localMatrix(node: Node) zmath.Mat {
+    // glTF matrices are column major, read row by row they are already in zmath's row vector form
+    if (node.matrix) |matrix| return zmath.loadMat(&matrix);
+
+    const t = node.translation;
+    const s = node.scale;
+    const rotation = zmath.matFromQuat(zmath.f32x4(node.rotation[0], node.rotation[1], node.rotation[2], node.rotation[3]));
+    return zmath.mul(zmath.mul(zmath.scaling(s[0], s[1], s[2]), rotation), zmath.translation(t[0], t[1], t[2]));
+}
+
+/// Accessor resolved against its buffer view
+///
+/// Contains:
+/// - accessor and view
+/// - offset: byte offset of the first element in the binary chunk
+/// - components: components per element (1 for SCALAR up to 4 for VEC4)
+/// - stride: bytes from one element to the next
+const ResolvedAccessor = struct {
+    accessor: Accessor,
+    view: BufferView,
+    offset: usize,
+    components: u32,
+    stride: usize,
+};
+
+/// Resolve an accessor with its buffer view and validate it against the binary chunk
+/// Every element of the accessor has to lie inside its view, so GL never reads past the buffer
+fn getAccessor(doc: *const Gltf, index: u32, binaryLength: usize) !ResolvedAccessor {
+    if (index >= doc.accessors.len) return error.InvalidGltfAccessor;
+    const accessor = doc.accessors[index];
+
+    const viewIndex = accessor.bufferView orelse return error.UnsupportedSparseAccessor;
+    if (viewIndex >= doc.bufferViews.len) return error.InvalidGltfAccessor;
+    const view = doc.bufferViews[viewIndex];
+
+    // Only the GLB binary chunk is supported, no external buffers
+    if (view.buffer != 0) return error.UnsupportedExternalBuffer;
+    if (@as(usize, view.byteOffset) + view.byteLength > binaryLength) return error.InvalidGltfAccessor;
+
+    // Tightly packed accessors step by the full element, even when fewer components are read
+    const components = try typeComponents(accessor.@"type");
+    const elementSize: usize = components * try componentSize(accessor.componentType);
+    const stride: usize = view.byteStride orelse elementSize;
+
+    // Offset of the end of the last element, counts and offsets come straight from the file
+    if (accessor.count > 0) {
+        const last = std.math.mul(usize, accessor.count - 1, stride) catch return error.InvalidGltfAccessor;
+        const start = std.math.add(usize, accessor.byteOffset, last) catch return error.InvalidGltfAccessor;
+        const end = std.math.add(usize, start, elementSize) catch return error.InvalidGltfAccessor;
+        if (end > view.byteLength) return error.InvalidGltfAccessor;
+    }
+
+    return .{
+        .accessor = accessor,
+        .view = view,
+        .offset = @as(usize, view.byteOffset) + accessor.byteOffset,
+        .components = components,
+        .stride = stride,
+    };
+}
+
+/// Resolve an index accessor: unsigned scalar indices, tightly packed and aligned for glDrawElements
+fn getIndexAccessor(doc: *const Gltf, index: u32, binaryLength: usize) !ResolvedAccessor {
+    const resolved = try getAccessor(doc, index, binaryLength);
+    switch (resolved.accessor.componentType) {
+        gl.UNSIGNED_BYTE, gl.UNSIGNED_SHORT, gl.UNSIGNED_INT => {},
+        else => return error.InvalidGltfIndices,
+    }
+    if (resolved.components != 1 or resolved.view.byteStride != null) return error.InvalidGltfIndices;
+    if (resolved.offset % try componentSize(resolved.accessor.componentType) != 0) return error.InvalidGltfIndices;
+    return resolved;
+}
+
+/// Point a vertex attribute at an accessor, disables the attribute if not present
+/// The accessor needs at least one element per vertex of the primitive
+fn bindAttribute(doc: *const Gltf, location: gl.uint, accessorIndex: ?u32, vertexCount: usize, binaryLength: usize) !void {
+    const index = accessorIndex orelse {
+        gl.DisableVertexAttribArray(location);
+        return;
+    };
+    const resolved = try getAccessor(doc, index, binaryLength);
+    if (resolved.accessor.count < vertexCount) return error.InvalidGltfAccessor;
+
+    // glTF component types are the OpenGL type enums
+    gl.VertexAttribPointer(
+        location,
+        @intCast(@min(resolved.components, 3)), // Tangent handedness (w) is not used
+        resolved.accessor.componentType,
+        if (resolved.accessor.normalized) gl.TRUE else gl.FALSE,
+        @intCast(resolved.stride),
+        resolved.offset,
+    );
+    gl.EnableVertexAttribArray(location);
+}
+
+/// Components per element of a glTF accessor type
+fn typeComponents(accessorType: []const u8) !u32 {
+    if (std.mem.eql(u8, accessorType, "SCALAR")) return 1;
+    if (std.mem.eql(u8, accessorType, "VEC2")) return 2;
+    if (std.mem.eql(u8, accessorType, "VEC3")) return 3;
+    if (std.mem.eql(u8, accessorType, "VEC4")) return 4;
+    return error.UnsupportedGltfAccessorType;
+}
+
+/// Size in bytes of a glTF component type
+fn componentSize(componentType: u32) !u32 {
+    return switch (componentType) {
+        gl.BYTE, gl.UNSIGNED_BYTE => 1,
+        gl.SHORT, gl.UNSIGNED_SHORT => 2,
+        gl.UNSIGNED_INT, gl.FLOAT => 4,
+        else => error.UnsupportedGltfComponentType,
+    };
+}
+
+/// Map glTF materials onto Material structs
+fn loadMaterials(doc: *const Gltf, binary: []const u8, obj: *objectLoader.ObjectStruct) !void {
+    for (doc.materials) |gltfMaterial| {
+        const pbr = gltfMaterial.pbrMetallicRoughness;
+
+        var material = objectLoader.Material{
+            .name = try obj.allocator.dupe(u8, gltfMaterial.name orelse "glTF material"),
+            .ambient = .{ 0.2, 0.2, 0.2 },
+            .diffuse = .{ pbr.baseColorFactor[0], pbr.baseColorFactor[1], pbr.baseColorFactor[2] },
+            .specular = .{ 0.04, 0.04, 0.04 },
+            .roughness = pbr.roughnessFactor,
+            .metallic = pbr.metallicFactor,
+            .opacity = if (std.mem.eql(u8, gltfMaterial.alphaMode, "BLEND")) pbr.baseColorFactor[3] else 1.0,
+            .texturePath = null,
+            .texture = null,
+            .textureId = 0,
+            .normalMapPath = null,
+            .normalMap = null,
+            .normalMapId = 0,
+            .roughnessMapPath = null,
+            .roughnessMap = null,
+            .roughnessMapId = 0,
+            .metallicMapPath = null,
+            .metallicMap = null,
+            .metallicMapId = 0,
+        };
+
+        if (pbr.baseColorTexture) |info| {
+            if (try loadImage(doc, binary, info.index, 4)) |image| {
+                material.texture = image;
+                material.textureId = objectLoader.uploadTexture(image, material.name);
+            }
+        }
+        if (gltfMaterial.normalTexture) |info| {
+            if (try loadImage(doc, binary, info.index, 4)) |image| {
+                material.normalMap = image;
+                material.normalMapId = objectLoader.uploadTexture(image, material.name);
+            }
+        }
+
+        // Roughness is stored in green, metallic in blue of one texture, uploaded once and bound twice
+        if (pbr.metallicRoughnessTexture) |info| {
+            if (try loadImage(doc, binary, info.index, 4)) |image| {
+                material.roughnessMap = image;
+                material.roughnessMapId = objectLoader.uploadTexture(image, material.name);
+                material.metallicMapId = material.roughnessMapId;
+                material.roughnessChannel = 1;
+                material.metallicChannel = 2;
+            }
+        }
+
+        try obj.materials.append(material);
+    }
+}
+
+/// Decode an image embedded in the binary chunk, null for external images
+fn loadImage(doc: *const Gltf, binary: []const u8, textureIndex: u32, components: u32) !?zstbi.Image {
+    if (textureIndex >= doc.textures.len) return error.InvalidGltfTexture;
+    const source = doc.textures[textureIndex].source orelse return null;
+    if (source >= doc.images.len) return error.InvalidGltfTexture;
+
+    const viewIndex = doc.images[source].bufferView orelse {
+        std.log.warn("Skipping external glTF image {d}", .{source});
+        return null;
+    };
+    if (viewIndex >= doc.bufferViews.len) return error.InvalidGltfTexture;
+    const view = doc.bufferViews[viewIndex];
+    if (@as(usize, view.byteOffset) + view.byteLength > binary.len) return error.InvalidGltfTexture;
+
+    // glTF UVs have their origin at the top left, images are uploaded unflipped
+    return try imageDecoder.loadFromMemory(binary[view.byteOffset..][0..view.byteLength], components, false);
+}
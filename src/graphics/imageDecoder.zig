@@ -0,0 +1,511 @@
+//! Texture decoding
+//!
+//! Front end for all texture decodes. 8 bit, non-interlaced PNG files are decoded natively: the
+//! IDAT chunks are inflated row by row with std.compress.zlib (no concatenated copy, no full size
+//! inflated buffer), each row is unfiltered with vector operations (one pixel per vector for Sub,
+//! Average and Paeth, 16 bytes per vector for Up) and converted straight into the requested number
+//! of components at its final, optionally flipped, position in the image.
+//!
+//! The orientation is passed with every decode instead of stb_image's global flip flag, which stays
+//! off: decodes run on several threads at once (material jobs, the environment thread) and a loader
+//! toggling the flag would flip the images of the others. stb_image results are flipped here.
+//!
+//! The output is byte for byte the output of stb_image, including its luminance weights and the
+//! vertical flip (checked by the tests at the end of this file). Everything else (JPEG, 16 bit,
+//! interlaced and color keyed PNG files) is decoded by stb_image through zstbi.
+//!
+//! JPEG is deliberately not decoded here: stb_image already runs its IDCT, chroma upsampling and
+//! YCbCr conversion with SSE2 on x86-64, and a native decoder would have to reproduce its integer
+//! IDCT and upsampling filters bit for bit to keep the textures identical.
+
+const std = @import("std");
+const zstbi = @import("zstbi");
+
+const memory = @import("../util/memory.zig");
+const mappedFile = @import("../util/mappedFile.zig");
+
+const allocator = memory.allocator(.textures);
+
+const SIGNATURE = "\x89PNG\r\n\x1a\n";
+const MAX_DIMENSION = 1 << 24; // Same limit as stb_image
+
+/// Decoder used for PNG files
+pub const Backend = enum {
+    stb, // Everything through zstbi
+    native, // PNG files decoded here, the rest through zstbi
+};
+
+pub var backend: Backend = .native;
+
+/// Parse a backend name (stb, native)
+pub fn parseBackend(name: []const u8) ?Backend {
+    return std.meta.stringToEnum(Backend, name);
+}
+
+/// Decode an image file, components 0 keeps the components of the file
+/// flip puts the last row of the file first (OpenGL texture origin)
+/// The image is freed with deinit like every zstbi image
+pub fn loadFromFile(path: [:0]const u8, components: u32, flip: bool) !zstbi.Image {
+    if (backend == .stb) {
+        var image = try zstbi.Image.loadFromFile(path, components);
+        if (flip) flipRows(&image);
+        return image;
+    }
+
+    var file = try mappedFile.MappedFile.open(allocator, path);
+    defer file.close();
+    return loadFromMemory(file.data, components, flip);
+}
+
+/// Decode an image in memory (e.g. embedded in a .glb file)
+pub fn loadFromMemory(data: []const u8, components: u32, flip: bool) !zstbi.Image {
+    if (backend == .native) {
+        if (decodePng(data, components, flip)) |image| {
+            return image;
+        } else |err| switch (err) {
+            error.Unsupported => {},
+            else => return err,
+        }
+    }
+    var image = try zstbi.Image.loadFromMemory(data, components);
+    if (flip) flipRows(&image);
+    return image;
+}
+
+/// Reverse the row order of a decoded image in place
+fn flipRows(image: *zstbi.Image) void {
+    const stride: usize = image.bytes_per_row;
+    var top: usize = 0;
+    var bottom: usize = image.height;
+    while (top + 1 < bottom) : (top += 1) {
+        bottom -= 1;
+        const upper = image.data[top * stride ..][0..stride];
+        const lower = image.data[bottom * stride ..][0..stride];
+        for (upper, lower) |*a, *b| std.mem.swap(u8, a, b);
+    }
+}
+
+/// PNG color types
+const ColorType = enum(u8) {
+    gray = 0,
+    rgb = 2,
+    palette = 3,
+    grayAlpha = 4,
+    rgba = 6,
+
+    /// Bytes per pixel in the 8 bit scanlines
+    fn channels(self: ColorType) usize {
+        return switch (self) {
+            .gray, .palette => 1,
+            .grayAlpha => 2,
+            .rgb => 3,
+            .rgba => 4,
+        };
+    }
+};
+
+/// Chunk of a PNG file (CRCs are not checked, like stb_image)
+const Chunk = struct {
+    kind: [4]u8,
+    body: []const u8,
+};
+
+/// Read the chunk at pos and advance pos past it, null at the end of the data
+fn nextChunk(data: []const u8, pos: *usize) !?Chunk {
+    if (pos.* + 12 > data.len) return null;
+    const length = std.mem.readInt(u32, data[pos.*..][0..4], .big);
+    if (length > data.len - pos.* - 12) return error.InvalidPng;
+
+    const chunk = Chunk{
+        .kind = data[pos.* + 4 ..][0..4].*,
+        .body = data[pos.* + 8 ..][0..length],
+    };
+    pos.* += 12 + length;
+    return chunk;
+}
+
+/// Reader over the data of consecutive IDAT chunks
+///
+/// Contains:
+/// - data: whole file
+/// - pos: start of the next chunk
+/// - remaining: unread part of the current IDAT chunk
+const IdatReader = struct {
+    data: []const u8,
+    pos: usize,
+    remaining: []const u8,
+
+    const Reader = std.io.GenericReader(*IdatReader, error{InvalidPng}, read);
+
+    fn read(self: *IdatReader, buffer: []u8) error{InvalidPng}!usize {
+        while (self.remaining.len == 0) {
+            const chunk = try nextChunk(self.data, &self.pos) orelse return 0;
+            if (!std.mem.eql(u8, &chunk.kind, "IDAT")) return 0;
+            self.remaining = chunk.body;
+        }
+
+        const count = @min(buffer.len, self.remaining.len);
+        @memcpy(buffer[0..count], self.remaining[0..count]);
+        self.remaining = self.remaining[count..];
+        return count;
+    }
+
+    fn reader(self: *IdatReader) Reader {
+        return .{ .context = self };
+    }
+};
+
+/// Decode a PNG file, error.Unsupported for files left to stb_image
+fn decodePng(data: []const u8, components: u32, flip: bool) !zstbi.Image {
+    if (!std.mem.startsWith(u8, data, SIGNATURE)) return error.Unsupported;
+    if (components > 4) return error.Unsupported;
+
+    var width: u32 = 0;
+    var height: u32 = 0;
+    var colorType: ColorType = .rgba;
+    var palette = [_][4]u8{.{ 0, 0, 0, 255 }} ** 256;
+    var hasPalette = false;
+    var hasTransparency = false;
+
+    // Header chunks up to the first IDAT
+    var pos: usize = SIGNATURE.len;
+    const idat = while (try nextChunk(data, &pos)) |chunk| {
+        if (std.mem.eql(u8, &chunk.kind, "IHDR")) {
+            if (chunk.body.len != 13) return error.InvalidPng;
+            width = std.mem.readInt(u32, chunk.body[0..4], .big);
+            height = std.mem.readInt(u32, chunk.body[4..8], .big);
+            const bitDepth = chunk.body[8];
+            colorType = std.meta.intToEnum(ColorType, chunk.body[9]) catch return error.InvalidPng;
+            if (chunk.body[10] != 0 or chunk.body[11] != 0) return error.InvalidPng;
+
+            // 1/2/4/16 bit and Adam7 images are left to stb_image
+            if (bitDepth != 8 or chunk.body[12] != 0) return error.Unsupported;
+        } else if (std.mem.eql(u8, &chunk.kind, "PLTE")) {
+            if (chunk.body.len % 3 != 0 or chunk.body.len > 256 * 3) return error.InvalidPng;
+            for (0..chunk.body.len / 3) |i| {
+                palette[i] = .{ chunk.body[i * 3], chunk.body[i * 3 + 1], chunk.body[i * 3 + 2], 255 };
+            }
+            hasPalette = true;
+        } else if (std.mem.eql(u8, &chunk.kind, "tRNS")) {
+            // Color keys of gray and RGB images are left to stb_image
+            if (colorType != .palette) return error.Unsupported;
+            if (chunk.body.len > 256) return error.InvalidPng;
+            for (chunk.body, 0..) |alpha, i| palette[i][3] = alpha;
+            hasTransparency = true;
+        } else if (std.mem.eql(u8, &chunk.kind, "CgBI")) {
+            return error.Unsupported; // Apple PNG with BGR and no zlib header
+        } else if (std.mem.eql(u8, &chunk.kind, "IDAT")) {
+            break chunk;
+        }
+    } else return error.InvalidPng;
+
+    if (width == 0 or height == 0 or width > MAX_DIMENSION or height > MAX_DIMENSION) return error.InvalidPng;
+    if (colorType == .palette and !hasPalette) return error.InvalidPng;
+
+    // Palette images expand to RGB, or RGBA with transparency
+    const channels = colorType.channels();
+    const native: u32 = if (colorType == .palette) (if (hasTransparency) 4 else 3) else @intCast(channels);
+    const outComponents = if (components == 0) native else components;
+
+    const imageBytes = @as(u64, width) * height * outComponents;
+    if (imageBytes > std.math.maxInt(u32)) return error.Unsupported;
+
+    var image = try zstbi.Image.createEmpty(width, height, outComponents, .{});
+    errdefer image.deinit();
+
+    // Two scanlines: the one being unfiltered and the one above it (zero for the first row)
+    const stride = @as(usize, width) * channels;
+    const rows = try allocator.alloc(u8, stride * 2);
+    defer allocator.free(rows);
+    @memset(rows, 0);
+    var current = rows[0..stride];
+    var prior = rows[stride..];
+
+    var idatReader = IdatReader{ .data = data, .pos = pos, .remaining = idat.body };
+    var inflate = std.compress.zlib.decompressor(idatReader.reader());
+    const scanlines = inflate.reader();
+
+    const outStride = @as(usize, width) * outComponents;
+    for (0..height) |y| {
+        const filter = scanlines.readByte() catch return error.InvalidPng;
+        scanlines.readNoEof(current) catch return error.InvalidPng;
+
+        switch (channels) {
+            inline 1, 2, 3, 4 => |bpp| try unfilterRow(bpp, filter, current, prior),
+            else => unreachable,
+        }
+
+        const row = if (flip) height - 1 - y else y;
+        const out = image.data[row * outStride ..][0..outStride];
+        if (colorType == .palette) {
+            convertPaletteRow(current, out, outComponents, &palette);
+        } else switch (channels) {
+            inline 1, 2, 3, 4 => |n| convertRow(n, current, out, outComponents),
+            else => unreachable,
+        }
+
+        std.mem.swap([]u8, &current, &prior);
+    }
+
+    return image;
+}
+
+/// Undo the filter of a scanline in place, prior is the unfiltered scanline above
+/// Whole pixels are processed as vectors, the first pixel has no left neighbor
+fn unfilterRow(comptime bpp: usize, filter: u8, row: []u8, prior: []const u8) !void {
+    const Pixel = @Vector(bpp, u8);
+    const Wide = @Vector(bpp, i16);
+    const zero: Pixel = @splat(0);
+
+    switch (filter) {
+        0 => {}, // None
+        1 => { // Sub
+            var i: usize = bpp;
+            while (i < row.len) : (i += bpp) {
+                const left: Pixel = row[i - bpp ..][0..bpp].*;
+                const x: Pixel = row[i..][0..bpp].*;
+                row[i..][0..bpp].* = x +% left;
+            }
+        },
+        2 => { // Up, independent bytes
+            const Block = @Vector(16, u8);
+            var i: usize = 0;
+            while (i + 16 <= row.len) : (i += 16) {
+                const x: Block = row[i..][0..16].*;
+                const above: Block = prior[i..][0..16].*;
+                row[i..][0..16].* = x +% above;
+            }
+            while (i < row.len) : (i += 1) {
+                row[i] +%= prior[i];
+            }
+        },
+        3 => { // Average
+            var i: usize = 0;
+            while (i < row.len) : (i += bpp) {
+                const left: Pixel = if (i >= bpp) row[i - bpp ..][0..bpp].* else zero;
+                const above: Pixel = prior[i..][0..bpp].*;
+                const x: Pixel = row[i..][0..bpp].*;
+
+                const sum = @as(Wide, @intCast(left)) + @as(Wide, @intCast(above));
+                const average: Pixel = @intCast(sum / @as(Wide, @splat(2)));
+                row[i..][0..bpp].* = x +% average;
+            }
+        },
+        4 => { // Paeth
+            var i: usize = 0;
+            while (i < row.len) : (i += bpp) {
+                const a: Wide = @intCast(if (i >= bpp) @as(Pixel, row[i - bpp ..][0..bpp].*) else zero);
+                const b: Wide = @intCast(@as(Pixel, prior[i..][0..bpp].*));
+                const c: Wide = @intCast(if (i >= bpp) @as(Pixel, prior[i - bpp ..][0..bpp].*) else zero);
+                const x: Pixel = row[i..][0..bpp].*;
+
+                // Distances of a + b - c to a, b and c; ties prefer a, then b
+                const pa = @abs(b - c);
+                const pb = @abs(a - c);
+                const pc = @abs(a + b - c - c);
+                const bOrC = @select(i16, pb <= pc, b, c);
+                const predictor: Pixel = @intCast(@select(i16, pa <= @min(pb, pc), a, bOrC));
+                row[i..][0..bpp].* = x +% predictor;
+            }
+        },
+        else => return error.InvalidPng,
+    }
+}
+
+/// Convert an unfiltered scanline of n components into the requested components
+fn convertRow(comptime n: usize, src: []const u8, dst: []u8, components: u32) void {
+    if (components == n) {
+        @memcpy(dst, src);
+        return;
+    }
+
+    switch (components) {
+        inline 1, 2, 3, 4 => |m| {
+            for (0..src.len / n) |i| {
+                convertPixel(n, m, src[i * n ..][0..n], dst[i * m ..][0..m]);
+            }
+        },
+        else => unreachable,
+    }
+}
+
+/// Expand a scanline of palette indices into the requested components
+/// stb_image expands to RGB(A) first, unset alpha is 255 so RGBA covers both cases
+fn convertPaletteRow(src: []const u8, dst: []u8, components: u32, palette: *const [256][4]u8) void {
+    switch (components) {
+        inline 1, 2, 3, 4 => |m| {
+            for (src, 0..) |index, i| {
+                convertPixel(4, m, &palette[index], dst[i * m ..][0..m]);
+            }
+        },
+        else => unreachable,
+    }
+}
+
+/// Component conversion of stb_image (stbi__convert_format)
+inline fn convertPixel(comptime n: usize, comptime m: usize, src: *const [n]u8, dst: *[m]u8) void {
+    const alpha: u8 = switch (n) {
+        2 => src[1],
+        4 => src[3],
+        else => 255,
+    };
+    const gray = if (n <= 2) src[0] else luminance(src[0], src[1], src[2]);
+
+    if (m <= 2) {
+        dst[0] = gray;
+        if (m == 2) dst[1] = alpha;
+    } else {
+        if (n <= 2) {
+            dst[0..3].* = .{ src[0], src[0], src[0] };
+        } else {
+            dst[0..3].* = src[0..3].*;
+        }
+        if (m == 4) dst[3] = alpha;
+    }
+}
+
+/// Luminance with the integer weights of stb_image
+inline fn luminance(r: u8, g: u8, b: u8) u8 {
+    return @intCast((@as(u32, r) * 77 + @as(u32, g) * 150 + @as(u32, b) * 29) >> 8);
+}
+
+/// Append a chunk with its CRC
+fn appendChunk(png: *std.ArrayList(u8), kind: *const [4]u8, body: []const u8) !void {
+    var crc = std.hash.Crc32.init();
+    crc.update(kind);
+    crc.update(body);
+    try png.writer().writeInt(u32, @intCast(body.len), .big);
+    try png.appendSlice(kind);
+    try png.appendSlice(body);
+    try png.writer().writeInt(u32, crc.final(), .big);
+}
+
+/// Build an 8 bit PNG from filtered scanlines (filter byte first), caller frees
+fn buildPng(colorType: ColorType, width: u32, height: u32, plte: []const u8, trns: []const u8, scanlines: []const u8) ![]u8 {
+    var png = std.ArrayList(u8).init(std.testing.allocator);
+    errdefer png.deinit();
+    try png.appendSlice(SIGNATURE);
+
+    var header: [13]u8 = undefined;
+    std.mem.writeInt(u32, header[0..4], width, .big);
+    std.mem.writeInt(u32, header[4..8], height, .big);
+    header[8..13].* = .{ 8, @intFromEnum(colorType), 0, 0, 0 };
+    try appendChunk(&png, "IHDR", &header);
+    if (plte.len > 0) try appendChunk(&png, "PLTE", plte);
+    if (trns.len > 0) try appendChunk(&png, "tRNS", trns);
+
+    var compressed = std.ArrayList(u8).init(std.testing.allocator);
+    defer compressed.deinit();
+    var stream = std.io.fixedBufferStream(scanlines);
+    try std.compress.zlib.compress(stream.reader(), compressed.writer(), .{});
+
+    // Split in two IDAT chunks to cover the chunk boundary of IdatReader
+    const half = compressed.items.len / 2;
+    try appendChunk(&png, "IDAT", compressed.items[0..half]);
+    try appendChunk(&png, "IDAT", compressed.items[half..]);
+    try appendChunk(&png, "IEND", "");
+    return png.toOwnedSlice();
+}
+
+/// Decode with decodePng and stb_image for every component count, flipped and not
+/// The reference uses stb_image's own flip (tests run on one thread), the stb path of
+/// loadFromMemory is checked against it as well
+fn expectSameAsStb(data: []const u8) !void {
+    defer zstbi.setFlipVerticallyOnLoad(false);
+    for ([_]bool{ false, true }) |flip| {
+        for (0..5) |components| {
+            zstbi.setFlipVerticallyOnLoad(flip);
+            var expected = try zstbi.Image.loadFromMemory(data, @intCast(components));
+            defer expected.deinit();
+            zstbi.setFlipVerticallyOnLoad(false);
+
+            var actual = try decodePng(data, @intCast(components), flip);
+            defer actual.deinit();
+            var flipped = try zstbi.Image.loadFromMemory(data, @intCast(components));
+            defer flipped.deinit();
+            if (flip) flipRows(&flipped);
+            try std.testing.expectEqualSlices(u8, expected.data, flipped.data);
+
+            try std.testing.expectEqual(expected.width, actual.width);
+            try std.testing.expectEqual(expected.height, actual.height);
+            try std.testing.expectEqual(expected.num_components, actual.num_components);
+            try std.testing.expectEqualSlices(u8, expected.data, actual.data);
+        }
+    }
+}
+
+test "imageDecoder.catTextures" {
+    zstbi.init(std.testing.allocator);
+    defer zstbi.deinit();
+
+    var dir = std.fs.cwd().openDir("objects/cat", .{ .iterate = true }) catch return error.SkipZigTest;
+    defer dir.close();
+
+    var tested: usize = 0;
+    var iterator = dir.iterate();
+    while (try iterator.next()) |entry| {
+        if (!std.mem.endsWith(u8, entry.name, ".png")) continue;
+        const data = try dir.readFileAlloc(std.testing.allocator, entry.name, 64 << 20);
+        defer std.testing.allocator.free(data);
+        try expectSameAsStb(data);
+        tested += 1;
+    }
+    try std.testing.expect(tested > 0);
+}
+
+test "imageDecoder.filters" {
+    zstbi.init(std.testing.allocator);
+    defer zstbi.deinit();
+
+    var prng = std.Random.DefaultPrng.init(0x9E7);
+    const random = prng.random();
+
+    // Odd width for the Up tail, every filter type on consecutive rows (the first row has no prior)
+    const width = 19;
+    const height = 10;
+    for ([_]ColorType{ .gray, .grayAlpha, .rgb, .rgba }) |colorType| {
+        const stride = width * colorType.channels() + 1;
+        var scanlines: [height * (width * 4 + 1)]u8 = undefined;
+        random.bytes(&scanlines);
+        for (0..height) |y| scanlines[y * stride] = @intCast(y % 5);
+
+        const png = try buildPng(colorType, width, height, "", "", scanlines[0 .. height * stride]);
+        defer std.testing.allocator.free(png);
+        try expectSameAsStb(png);
+    }
+}
+
+test "imageDecoder.palette" {
+    zstbi.init(std.testing.allocator);
+    defer zstbi.deinit();
+
+    var prng = std.Random.DefaultPrng.init(0xA1E77E);
+    const random = prng.random();
+
+    var plte: [256 * 3]u8 = undefined;
+    random.bytes(&plte);
+    var trns: [100]u8 = undefined; // Shorter than the palette, the rest stays opaque
+    random.bytes(&trns);
+
+    const width = 23;
+    const height = 10;
+    var scanlines: [height * (width + 1)]u8 = undefined;
+    random.bytes(&scanlines);
+    for (0..height) |y| scanlines[y * (width + 1)] = @intCast(y % 5);
+
+    // Without tRNS the palette expands to RGB, with it to RGBA
+    for ([_][]const u8{ "", &trns }) |transparency| {
+        const png = try buildPng(.palette, width, height, &plte, transparency, &scanlines);
+        defer std.testing.allocator.free(png);
+        try expectSameAsStb(png);
+    }
+}
+
+test "imageDecoder.unsupported" {
+    // Color keyed RGB images are left to stb_image
+    const scanlines = [_]u8{ 0, 1, 2, 3 };
+    const png = try buildPng(.rgb, 1, 1, "", &.{ 0, 1, 0, 2, 0, 3 }, &scanlines);
+    defer std.testing.allocator.free(png);
+    try std.testing.expectError(error.Unsupported, decodePng(png, 0, false));
+    try std.testing.expectError(error.Unsupported, decodePng("GIF89a", 0, false));
+}
@@ -5,10 +5,19 @@
 
 const gl = @import("gl");
 const objectLoader = @import("objectLoader.zig");
+const pointCloud = @import("pointCloud.zig");
+const gltfLoader = @import("gltfLoader.zig");
+const plyLoader = @import("plyLoader.zig");
+const stlLoader = @import("stlLoader.zig");
+const meshCache = @import("meshCache.zig");
+const glDebug = @import("glDebug.zig");
+const scene = @import("scene.zig");
 const std = @import("std");
 
 const validator = @import("../util/validator.zig");
-const errors = @import("../util/errors.zig");
+const diagnostics = @import("../util/diagnostics.zig");
+const memory = @import("../util/memory.zig");
+const metrics = @import("../util/metrics.zig");
 
 /// Mesh struct
 ///
@@ -17,6 +26,9 @@ const errors = @import("../util/errors.zig");
 /// - vbo: vertex buffer object
 /// - ebo: element buffer object
 /// - index_count: number of indices
+/// - points: point cloud of vertex-only objects (drawn instead of the triangles)
+/// - gltf: primitives of a .glb model (drawn instead of the triangles)
+/// - scene: transform hierarchy, the root holds the model transform
 /// deinit method
 pub const Mesh = struct {
     vao: gl.uint,
@@ -24,6 +36,9 @@ pub const Mesh = struct {
     ebo: gl.uint,
     index_count: usize,
     object: *objectLoader.ObjectStruct,
+    points: ?*pointCloud.PointCloud = null,
+    gltf: ?*gltfLoader.Model = null,
+    scene: scene.Scene,
 
     pub fn init() !void {
         try load("cube"); // Load default cube
@@ -35,18 +50,70 @@ pub const Mesh = struct {
         var vboArr: [1]gl.uint = .{self.vbo};
         var eboArr: [1]gl.uint = .{self.ebo};
 
+        memory.untrackGpu(.buffer, self.vbo);
+        memory.untrackGpu(.buffer, self.ebo);
         gl.DeleteVertexArrays(1, &vaoArr);
         gl.DeleteBuffers(1, &vboArr);
         gl.DeleteBuffers(1, &eboArr);
         self.object.deinit(); // Object struct
+
+        var nodes = self.scene;
+        nodes.deinit();
+
+        if (self.points) |cloud| {
+            cloud.deinit();
+            allocator.destroy(cloud);
+        }
+
+        if (self.gltf) |model| {
+            model.deinit();
+            allocator.destroy(model);
+        }
     }
 };
 
-var gpa = std.heap.GeneralPurposeAllocator(.{}){};
-const allocator = gpa.allocator();
+/// Interleaved vertex data ready for upload
+///
+/// Contains:
+/// - vertices: VERTEX_STRIDE floats per vertex (position, UV, normal, tangent)
+/// - indices: triangle indices into vertices
+pub const Interleaved = struct {
+    vertices: []f32,
+    indices: []u32,
+};
+
+/// Floats per interleaved vertex: 3 positions + 2 UVs + 3 normals + 3 tangent
+pub const VERTEX_STRIDE = 11;
+
+const allocator = memory.allocator(.mesh);
+const parserAllocator = memory.allocator(.parser); // Object structs (CPU-side geometry and materials)
 
 pub var loadedObject: Mesh = undefined;
 
+/// Durations of the stages of the last load in nanoseconds, 0 for stages that did not run
+///
+/// Contains:
+/// - cached: geometry came from a .zgm file or the mesh cache
+/// - read: parsing (or reading the cached geometry), includes the material stages below
+/// - materials, materialWait, textureUpload: see objectLoader.LoadTimings
+/// - convert: faces to interleaved vertices and indices
+/// - upload: vertex and index buffers and scene nodes
+/// - cacheStore: writing the compressed copy
+/// - total: whole load
+pub const LoadStages = struct {
+    cached: bool = false,
+    read: u64 = 0,
+    materials: u64 = 0,
+    materialWait: u64 = 0,
+    textureUpload: u64 = 0,
+    convert: u64 = 0,
+    upload: u64 = 0,
+    cacheStore: u64 = 0,
+    total: u64 = 0,
+};
+
+pub var lastStages: LoadStages = .{};
+
 /// Load the mesh from the .obj file using the objectLoader
 pub fn load(path: []const u8) !void {
     // Clean and validate obj path
@@ -55,46 +122,173 @@ pub fn load(path: []const u8) !void {
         return;
     }
 
+    var timer = try std.time.Timer.start();
+    // Failed loads are not recorded, they would skew the load time metrics
+    var failed = false;
+    defer if (!failed) metrics.recordLoad(timer.read());
+    errdefer failed = true;
+    defer diagnostics.logSuppressed();
+
+    lastStages = .{};
+    defer lastStages.total = timer.read();
+    var stage = try std.time.Timer.start();
+
     const obj = try allocator.create(objectLoader.ObjectStruct);
 
-    obj.* = try objectLoader.load(cleanObjPath, allocator);
+    // Binary glTF: buffers are uploaded as stored in the file
+    if (std.ascii.endsWithIgnoreCase(cleanObjPath, ".glb")) {
+        obj.* = objectLoader.initObject(parserAllocator);
+        const model = try allocator.create(gltfLoader.Model);
+        model.* = try gltfLoader.load(cleanObjPath, obj, allocator);
+        lastStages.read = stage.lap();
+
+        loadedObject = Mesh{
+            .vao = 0,
+            .vbo = 0,
+            .ebo = 0,
+            .index_count = 0,
+            .object = obj,
+            .gltf = model,
+            .scene = try scene.single(cleanObjPath, 0),
+        };
+        return;
+    }
+
+    // Binary STL: welded on load, already indexed
+    if (std.ascii.endsWithIgnoreCase(cleanObjPath, ".stl")) {
+        obj.* = objectLoader.initObject(parserAllocator);
+        const interleaved = try stlLoader.load(cleanObjPath, obj, allocator);
+        defer allocator.free(interleaved.indices);
+        defer allocator.free(interleaved.vertices);
+        lastStages.read = stage.lap();
+
+        try upload(cleanObjPath, obj, interleaved);
+        lastStages.upload = stage.lap();
+        return;
+    }
+
+    // Compressed meshes (.zgm files and cache hits) skip parsing, only the materials are loaded
+    const isZgm = std.ascii.endsWithIgnoreCase(cleanObjPath, ".zgm");
+    const cached = if (isZgm) try meshCache.readFile(cleanObjPath, allocator) else meshCache.load(cleanObjPath, allocator);
+    if (cached) |loadedGeometry| {
+        var geometry = loadedGeometry;
+        defer geometry.deinit();
+
+        obj.* = objectLoader.initObject(parserAllocator);
+        obj.mtllib = try parserAllocator.dupe(u8, geometry.mtllib);
+        try objectLoader.loadMaterials(cleanObjPath, obj);
+
+        // After loadMaterials, which would resolve the stored indices as usemtl names
+        // 0 is also used without materials, every other index has to exist in the loaded .mtl
+        for (geometry.faceMaterials) |material| {
+            if (material != 0 and material >= obj.materials.items.len) return error.InvalidMeshFile;
+        }
+        try obj.faceMaterialIndices.appendSlice(geometry.faceMaterials);
+        for (geometry.groups) |group| {
+            const name = try parserAllocator.dupe(u8, group.name);
+            try obj.groups.append(.{ .name = name, .kind = group.kind, .firstFace = group.firstFace });
+        }
+        recordRead(obj, stage.lap());
+        lastStages.cached = true;
+
+        try upload(cleanObjPath, obj, geometry.interleaved);
+        lastStages.upload = stage.lap();
+        return;
+    }
+
+    // Stanford .ply scans share the .obj path from here on
+    if (std.ascii.endsWithIgnoreCase(cleanObjPath, ".ply")) {
+        obj.* = objectLoader.initObject(parserAllocator);
+        try plyLoader.load(cleanObjPath, obj);
+    } else {
+        obj.* = try objectLoader.load(cleanObjPath, parserAllocator);
+    }
+    recordRead(obj, stage.lap());
+
+    // Vertex-only files (scans, lidar exports) are rendered as point clouds
+    if (obj.ebo.items.len == 0 and obj.vbo.items.len > 0) {
+        const cloud = try allocator.create(pointCloud.PointCloud);
+        cloud.* = try pointCloud.build(obj, allocator);
+
+        // The points now live on the GPU
+        obj.vbo.clearAndFree();
+        obj.colors.clearAndFree();
+
+        loadedObject = Mesh{
+            .vao = 0,
+            .vbo = 0,
+            .ebo = 0,
+            .index_count = 0,
+            .object = obj,
+            .points = cloud,
+            .scene = try scene.single(cleanObjPath, 0),
+        };
+        return;
+    }
 
     // Convert faces to indices
     const interleaved  = try convertFaces(obj, allocator);
     defer allocator.free(interleaved .indices);
     defer allocator.free(interleaved .vertices);
+    lastStages.convert = stage.lap();
+
+    try upload(cleanObjPath, obj, interleaved);
+    lastStages.upload = stage.lap();
+
+    // Compressed copy for the next load (reorders the buffers, so after the upload)
+    meshCache.store(cleanObjPath, interleaved, obj);
+    lastStages.cacheStore = stage.lap();
+}
+
+/// Record the read stage and the material stages of the object
+fn recordRead(obj: *const objectLoader.ObjectStruct, elapsed: u64) void {
+    lastStages.read = elapsed;
+    lastStages.materials = obj.timings.materials;
+    lastStages.materialWait = obj.timings.materialWait;
+    lastStages.textureUpload = obj.timings.textureUpload;
+}
+
+/// Upload interleaved vertex data and set it as the currently loaded object
+/// The o/g groups of the object become scene nodes (cached geometry keeps the face order and its groups)
+fn upload(name: []const u8, obj: *objectLoader.ObjectStruct, interleaved: Interleaved) !void {
+    const nodes = try scene.fromGroups(std.fs.path.basename(name), obj.groups.items, obj.faceMaterialIndices.items, interleaved.vertices, interleaved.indices, VERTEX_STRIDE);
 
     // Create vertex array object
     var vao: gl.uint = undefined;
     gl.GenVertexArrays(1, (&vao)[0..1]); // Generate the buffer
     gl.BindVertexArray(vao); // Bind the buffer
+    glDebug.label(.vertexArray, vao, "{s} vao", .{name});
 
     // Create vertex buffer object
     var vbo: gl.uint = undefined;
     gl.GenBuffers(1, (&vbo)[0..1]); // Generate the buffer
     gl.BindBuffer(gl.ARRAY_BUFFER, vbo); // Bind the buffer
     gl.BufferData(gl.ARRAY_BUFFER, @intCast(interleaved.vertices.len * @sizeOf(f32)), interleaved.vertices.ptr, gl.STATIC_DRAW); // Fill the buffer with data
+    memory.trackGpu(.buffer, vbo, interleaved.vertices.len * @sizeOf(f32));
+    glDebug.label(.buffer, vbo, "{s} vertices", .{name});
 
     // Create element buffer object
     var ebo: gl.uint = undefined;
     gl.GenBuffers(1, (&ebo)[0..1]); // Generate the buffer
     gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER, ebo); // Bind the buffer
     gl.BufferData(gl.ELEMENT_ARRAY_BUFFER, @intCast(interleaved.indices.len * @sizeOf(u32)), interleaved.indices.ptr, gl.STATIC_DRAW); // Fill the buffer with data
+    memory.trackGpu(.buffer, ebo, interleaved.indices.len * @sizeOf(u32));
+    glDebug.label(.buffer, ebo, "{s} indices", .{name});
 
     // Position (location = 0)
-    gl.VertexAttribPointer(0, 3, gl.FLOAT, gl.FALSE, 11 * @sizeOf(f32), 0);
+    gl.VertexAttribPointer(0, 3, gl.FLOAT, gl.FALSE, VERTEX_STRIDE * @sizeOf(f32), 0);
     gl.EnableVertexAttribArray(0);
 
     // UVs (location = 1)
-    gl.VertexAttribPointer(1, 2, gl.FLOAT, gl.FALSE, 11 * @sizeOf(f32), 3 * @sizeOf(f32));
+    gl.VertexAttribPointer(1, 2, gl.FLOAT, gl.FALSE, VERTEX_STRIDE * @sizeOf(f32), 3 * @sizeOf(f32));
     gl.EnableVertexAttribArray(1);
 
     // Normals (location = 2)
-    gl.VertexAttribPointer(2, 3, gl.FLOAT, gl.FALSE, 11 * @sizeOf(f32), 5 * @sizeOf(f32));
+    gl.VertexAttribPointer(2, 3, gl.FLOAT, gl.FALSE, VERTEX_STRIDE * @sizeOf(f32), 5 * @sizeOf(f32));
     gl.EnableVertexAttribArray(2);
 
     // Tangents (location = 3)
-    gl.VertexAttribPointer(3, 3, gl.FLOAT, gl.FALSE, 11 * @sizeOf(f32), 8 * @sizeOf(f32));
+    gl.VertexAttribPointer(3, 3, gl.FLOAT, gl.FALSE, VERTEX_STRIDE * @sizeOf(f32), 8 * @sizeOf(f32));
     gl.EnableVertexAttribArray(3);
 
     // Set the currently loaded object
@@ -104,6 +298,7 @@ pub fn load(path: []const u8) !void {
         .ebo = ebo,
         .index_count = interleaved.indices.len,
         .object = obj,
+        .scene = nodes,
     };
 }
 
@@ -114,21 +309,34 @@ pub fn deinit() void {
 
 /// Convert faces to indices and generate interleaved vertex data
 /// Also calculates tangent vectors
-fn convertFaces(obj: *objectLoader.ObjectStruct, faceAllocator: std.mem.Allocator) !struct { vertices: []f32, indices: []u32 } {
+pub fn convertFaces(obj: *objectLoader.ObjectStruct, faceAllocator: std.mem.Allocator) !Interleaved {
     const face_count = obj.ebo.items.len;
     const vert_count = face_count * 3; // 3 vertices per face
-    const vertices = try faceAllocator.alloc(f32, vert_count * 11); // 3 positions + 2 UVs + 3 normals + 3 tangent = 11 floats per vertex
+    const vertices = try faceAllocator.alloc(f32, vert_count * VERTEX_STRIDE); // 3 positions + 2 UVs + 3 normals + 3 tangent = 11 floats per vertex
     const indices = try faceAllocator.alloc(u32, vert_count);
 
     // Check if the object has the necessary data
-    if(obj.vbo.items.len == 0 or obj.ebo.items.len == 0 or obj.texCoords.items.len == 0 or obj.normals.items.len == 0) {
-        errors.errorCollector.reportError(errors.ErrorCode.ObjFileMalformed);
-        std.log.err("vbo len: {d}, ebo len: {d}, texCoord len: {d}, normal len: {d}", .{obj.vbo.items.len, obj.ebo.items.len, obj.texCoords.items.len, obj.normals.items.len});
+    if(obj.vbo.items.len == 0 or obj.ebo.items.len == 0) {
+        diagnostics.report(.ObjFileMalformed, 0, "vbo len: {d}, ebo len: {d}, texCoord len: {d}, normal len: {d}", .{obj.vbo.items.len, obj.ebo.items.len, obj.texCoords.items.len, obj.normals.items.len});
         return .{ .vertices = vertices, .indices = indices };
     }
 
+    // UVs and normals are optional (e.g. scan data), missing ones are zero UVs and face normals
+    const hasTexCoords = obj.texCoords.items.len > 0;
+    const hasNormals = obj.normals.items.len > 0;
+
     // Iterate over faces and fill the vertices and indices arrays
     for (obj.ebo.items, 0..) |face, i| {
+        // Faces with missing vertices become degenerate triangles, the index layout stays intact
+        if (!faceInRange(obj, face, hasTexCoords, hasNormals)) {
+            diagnostics.report(.ObjFileMalformed, 0, "Face {d} references a missing vertex, texture coordinate or normal", .{i + 1});
+            @memset(vertices[i * 33 ..][0..33], 0);
+            for (0..3) |j| {
+                indices[i * 3 + j] = @intCast(i * 3 + j);
+            }
+            continue;
+        }
+
         // Get positions for face
         const pos = [3][3]f32{
             obj.vbo.items[face.face[0]].position,
@@ -137,11 +345,11 @@ fn convertFaces(obj: *objectLoader.ObjectStruct, faceAllocator: std.mem.Allocato
         };
 
         // Get UVs for face
-        const uv = [3][2]f32{
+        const uv = if (hasTexCoords) [3][2]f32{
             obj.texCoords.items[face.texCoordIndices[0]],
             obj.texCoords.items[face.texCoordIndices[1]],
             obj.texCoords.items[face.texCoordIndices[2]],
-        };
+        } else [_][2]f32{.{ 0.0, 0.0 }} ** 3;
 
         // Calculate tangent vectors for face
         const edge1 = [3]f32{
@@ -167,17 +375,31 @@ fn convertFaces(obj: *objectLoader.ObjectStruct, faceAllocator: std.mem.Allocato
             uv[2][1] - uv[0][1],
         };
 
-        // Calculate tangent
-        const f = 1.0 / (deltaUV1[0] * deltaUV2[1] - deltaUV2[0] * deltaUV1[1]);
-        const tangent = [3]f32{
+        // Calculate tangent (along the first edge if the UVs are degenerate)
+        const det = deltaUV1[0] * deltaUV2[1] - deltaUV2[0] * deltaUV1[1];
+        const f = 1.0 / det;
+        const tangent = if (det != 0) [3]f32{
             f * (deltaUV2[1] * edge1[0] - deltaUV1[1] * edge2[0]),
             f * (deltaUV2[1] * edge1[1] - deltaUV1[1] * edge2[1]),
             f * (deltaUV2[1] * edge1[2] - deltaUV1[1] * edge2[2]),
+        } else edge1;
+
+        // Face normal for objects without normals
+        const cross = [3]f32{
+            edge1[1] * edge2[2] - edge1[2] * edge2[1],
+            edge1[2] * edge2[0] - edge1[0] * edge2[2],
+            edge1[0] * edge2[1] - edge1[1] * edge2[0],
         };
+        const crossLength = @sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+        const faceNormal = if (crossLength > 0) [3]f32{
+            cross[0] / crossLength,
+            cross[1] / crossLength,
+            cross[2] / crossLength,
+        } else [3]f32{ 0.0, 0.0, 1.0 };
 
         // Fill vertices and indices arrays
         for (0..3) |j| {
-            const vn_idx = face.normalIndices[j];
+            const normal = if (hasNormals) obj.normals.items[face.normalIndices[j]] else faceNormal;
 
             // Positions
             vertices[i * 33 + j * 11 + 0] = pos[j][0];
@@ -189,9 +411,9 @@ fn convertFaces(obj: *objectLoader.ObjectStruct, faceAllocator: std.mem.Allocato
             vertices[i * 33 + j * 11 + 4] = uv[j][1];
 
             // Normals
-            vertices[i * 33 + j * 11 + 5] = obj.normals.items[vn_idx][0];
-            vertices[i * 33 + j * 11 + 6] = obj.normals.items[vn_idx][1];
-            vertices[i * 33 + j * 11 + 7] = obj.normals.items[vn_idx][2];
+            vertices[i * 33 + j * 11 + 5] = normal[0];
+            vertices[i * 33 + j * 11 + 6] = normal[1];
+            vertices[i * 33 + j * 11 + 7] = normal[2];
 
             // Tangents
             vertices[i * 33 + j * 11 + 8] = tangent[0];
@@ -203,4 +425,14 @@ fn convertFaces(obj: *objectLoader.ObjectStruct, faceAllocator: std.mem.Allocato
     }
 
     return .{ .vertices = vertices, .indices = indices };
+}
+
+/// Check that all indices of a face point into the object's arrays
+fn faceInRange(obj: *const objectLoader.ObjectStruct, face: objectLoader.Face, hasTexCoords: bool, hasNormals: bool) bool {
+    for (0..3) |j| {
+        if (face.face[j] >= obj.vbo.items.len) return false;
+        if (hasTexCoords and face.texCoordIndices[j] >= obj.texCoords.items.len) return false;
+        if (hasNormals and face.normalIndices[j] >= obj.normals.items.len) return false;
+    }
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,349 @@
+//! Compressed mesh files (.zgm) and the on-disk mesh cache
+//!
+//! A .zgm file holds the interleaved vertex buffer and the index buffer as produced by convertFaces,
+//! with bit-identical vertices merged and both buffers compressed by meshCodec, followed by the o/g groups
+//! and the per-face material runs (faces keep their order, so both stay valid).
+//! The cache stores one .zgm per source file in .zglcache/, keyed by format version, path, size and
+//! modification time. Size and modification time of the .mtl are stored in the file and checked on a hit.
+
+const std = @import("std");
+
+const mesh = @import("mesh.zig");
+const meshCodec = @import("meshCodec.zig");
+const objectLoader = @import("objectLoader.zig");
+const mappedFile = @import("../util/mappedFile.zig");
+const memory = @import("../util/memory.zig");
+const metrics = @import("../util/metrics.zig");
+const validator = @import("../util/validator.zig");
+
+const MAGIC = "ZGM2"; // Format version, also part of the cache key
+const MAGIC_V1 = "ZGM1"; // Geometry only, still readable
+const FIELDS = 8;
+const FIELDS_V1 = 5;
+const CACHE_DIR = ".zglcache";
+const VERTEX_SIZE = mesh.VERTEX_STRIDE * @sizeOf(f32);
+
+const allocator = memory.allocator(.cache);
+
+/// Size and modification time of the .mtl a cache entry was built with (zero without .mtl)
+pub const MtlStamp = struct {
+    size: u64 = 0,
+    mtime: i64 = 0,
+};
+
+/// Geometry read from a .zgm file
+///
+/// Contains:
+/// - interleaved: vertex and index buffers ready for upload
+/// - mtllib: material library of the source .obj (may be empty)
+/// - groups: o/g groups, names owned by the allocator
+/// - faceMaterials: material index per face (empty for version 1 files)
+/// - mtlStamp: .mtl the material indices were resolved against
+/// deinit method
+pub const Cached = struct {
+    interleaved: mesh.Interleaved,
+    mtllib: []const u8,
+    groups: []objectLoader.Group = &.{},
+    faceMaterials: []usize = &.{},
+    mtlStamp: MtlStamp = .{},
+    allocator: std.mem.Allocator,
+
+    pub fn deinit(self: *Cached) void {
+        self.allocator.free(self.interleaved.vertices);
+        self.allocator.free(self.interleaved.indices);
+        self.allocator.free(self.mtllib);
+        for (self.groups) |group| self.allocator.free(group.name);
+        self.allocator.free(self.groups);
+        self.allocator.free(self.faceMaterials);
+    }
+};
+
+/// Write interleaved geometry with the groups and face materials of obj as .zgm
+///
+/// Merges duplicate vertices in place, so the buffers are reordered afterwards (faces keep their order).
+pub fn writeFile(path: []const u8, interleaved: mesh.Interleaved, obj: *const objectLoader.ObjectStruct, mtlStamp: MtlStamp) !void {
+    const mtllib = obj.mtllib;
+    const metadata = try encodeMetadata(obj, interleaved.indices.len / 3);
+    defer allocator.free(metadata);
+
+    const vertexBytes = std.mem.sliceAsBytes(interleaved.vertices);
+    const vertexCount = try meshCodec.deduplicateVertices(allocator, vertexBytes, VERTEX_SIZE, interleaved.indices);
+
+    const encodedVertices = try meshCodec.encodeVertexBuffer(allocator, vertexBytes[0 .. vertexCount * VERTEX_SIZE], VERTEX_SIZE);
+    defer allocator.free(encodedVertices);
+    const encodedIndices = try meshCodec.encodeIndexBuffer(allocator, interleaved.indices);
+    defer allocator.free(encodedIndices);
+
+    // Written to a temporary file first, so readers never see a partial file
+    const tmpPath = try std.fmt.allocPrint(allocator, "{s}.tmp", .{path});
+    defer allocator.free(tmpPath);
+    {
+        const file = try std.fs.cwd().createFile(tmpPath, .{});
+        defer file.close();
+
+        var header: [4 + FIELDS * 8]u8 = undefined;
+        @memcpy(header[0..4], MAGIC);
+        const fields = [FIELDS]u64{
+            vertexCount,         interleaved.indices.len, encodedVertices.len,           encodedIndices.len,
+            mtllib.len,          metadata.len,            mtlStamp.size,                 @bitCast(mtlStamp.mtime),
+        };
+        for (fields, 0..) |field, i| {
+            std.mem.writeInt(u64, header[4 + i * 8 ..][0..8], field, .little);
+        }
+
+        var iovecs = [_]std.posix.iovec_const{
+            .{ .base = &header, .len = header.len },
+            .{ .base = mtllib.ptr, .len = mtllib.len },
+            .{ .base = metadata.ptr, .len = metadata.len },
+            .{ .base = encodedVertices.ptr, .len = encodedVertices.len },
+            .{ .base = encodedIndices.ptr, .len = encodedIndices.len },
+        };
+        try file.writevAll(&iovecs);
+    }
+    try std.fs.cwd().rename(tmpPath, path);
+
+    const rawSize = interleaved.vertices.len * @sizeOf(f32) + interleaved.indices.len * @sizeOf(u32);
+    const encodedSize = encodedVertices.len + encodedIndices.len;
+    std.log.info("Mesh file {s}: {d} KiB -> {d} KiB", .{ path, rawSize / 1024, encodedSize / 1024 });
+}
+
+/// Read and decode a .zgm file
+pub fn readFile(path: []const u8, outAllocator: std.mem.Allocator) !Cached {
+    var file = try mappedFile.MappedFile.open(allocator, path);
+    defer file.close();
+    const data = file.data;
+
+    if (data.len < 4) return error.InvalidMeshFile;
+    const fieldCount: usize = if (std.mem.eql(u8, data[0..4], MAGIC))
+        FIELDS
+    else if (std.mem.eql(u8, data[0..4], MAGIC_V1))
+        FIELDS_V1
+    else
+        return error.InvalidMeshFile;
+    if (data.len < 4 + fieldCount * 8) return error.InvalidMeshFile;
+
+    var fields = [_]u64{0} ** FIELDS; // Missing in version 1: no metadata, no .mtl stamp
+    for (fields[0..fieldCount], 0..) |*field, i| {
+        field.* = std.mem.readInt(u64, data[4 + i * 8 ..][0..8], .little);
+    }
+    // Counts and lengths come from the file, all arithmetic on them is checked
+    const vertexCount = try fieldSize(fields[0]);
+    const indexCount = try fieldSize(fields[1]);
+    const vertexLen = try fieldSize(fields[2]);
+    const indexLen = try fieldSize(fields[3]);
+    const mtllibLen = try fieldSize(fields[4]);
+    const metadataLen = try fieldSize(fields[5]);
+    const vertexFloats = std.math.mul(usize, vertexCount, mesh.VERTEX_STRIDE) catch return error.InvalidMeshFile;
+
+    var cursor: usize = 4 + fieldCount * 8;
+    var end = cursor;
+    for ([_]usize{ mtllibLen, metadataLen, vertexLen, indexLen }) |len| {
+        end = std.math.add(usize, end, len) catch return error.InvalidMeshFile;
+    }
+    if (end > data.len) return error.InvalidMeshFile;
+
+    const mtllib = try outAllocator.dupe(u8, data[cursor..][0..mtllibLen]);
+    errdefer outAllocator.free(mtllib);
+    cursor += mtllibLen;
+
+    var result = Cached{
+        .interleaved = undefined,
+        .mtllib = mtllib,
+        .mtlStamp = .{ .size = fields[6], .mtime = @bitCast(fields[7]) },
+        .allocator = outAllocator,
+    };
+    errdefer {
+        for (result.groups) |group| outAllocator.free(group.name);
+        outAllocator.free(result.groups);
+        outAllocator.free(result.faceMaterials);
+    }
+    if (metadataLen > 0) try decodeMetadata(&result, data[cursor..][0..metadataLen], indexCount / 3);
+    cursor += metadataLen;
+
+    const vertices = try outAllocator.alloc(f32, vertexFloats);
+    errdefer outAllocator.free(vertices);
+    try meshCodec.decodeVertexBuffer(std.mem.sliceAsBytes(vertices), VERTEX_SIZE, data[cursor..][0..vertexLen]);
+    cursor += vertexLen;
+
+    const indices = try outAllocator.alloc(u32, indexCount);
+    errdefer outAllocator.free(indices);
+    try meshCodec.decodeIndexBuffer(indices, data[cursor..][0..indexLen]);
+
+    for (indices) |index| {
+        if (index >= vertexCount) return error.InvalidMeshFile;
+    }
+
+    result.interleaved = .{ .vertices = vertices, .indices = indices };
+    return result;
+}
+
+/// Header field as a size, error.InvalidMeshFile if it does not fit
+fn fieldSize(value: u64) !usize {
+    return std.math.cast(usize, value) orelse error.InvalidMeshFile;
+}
+
+/// Groups (first face, kind, name) and face material runs (first face, material)
+fn encodeMetadata(obj: *const objectLoader.ObjectStruct, faceCount: usize) ![]u8 {
+    var out = std.ArrayList(u8).init(allocator);
+    errdefer out.deinit();
+    const writer = out.writer();
+
+    try writer.writeInt(u32, @intCast(obj.groups.items.len), .little);
+    for (obj.groups.items) |group| {
+        try writer.writeInt(u64, group.firstFace, .little);
+        try writer.writeByte(@intFromEnum(group.kind));
+        try writer.writeInt(u32, @intCast(group.name.len), .little);
+        try writer.writeAll(group.name);
+    }
+
+    // Materials only if there is one per face (not for reordered or partial data)
+    const faceMaterials = obj.faceMaterialIndices.items;
+    const runs = if (faceMaterials.len == faceCount) faceMaterials else &.{};
+    var runCount: u32 = 0;
+    for (runs, 0..) |material, face| {
+        if (face == 0 or runs[face - 1] != material) runCount += 1;
+    }
+    try writer.writeInt(u32, runCount, .little);
+    for (runs, 0..) |material, face| {
+        if (face > 0 and runs[face - 1] == material) continue;
+        try writer.writeInt(u64, face, .little);
+        try writer.writeInt(u64, material, .little);
+    }
+
+    return out.toOwnedSlice();
+}
+
+/// Read the metadata into the groups and expand the material runs to one entry per face
+fn decodeMetadata(cached: *Cached, metadata: []const u8, faceCount: usize) !void {
+    var stream = std.io.fixedBufferStream(metadata);
+    const reader = stream.reader();
+    const outAllocator = cached.allocator;
+
+    const groupCount = reader.readInt(u32, .little) catch return error.InvalidMeshFile;
+    var groups = std.ArrayList(objectLoader.Group).init(outAllocator);
+    errdefer {
+        for (groups.items) |group| outAllocator.free(group.name);
+        groups.deinit();
+    }
+    for (0..groupCount) |_| {
+        const firstFace = reader.readInt(u64, .little) catch return error.InvalidMeshFile;
+        const kind = std.meta.intToEnum(objectLoader.GroupKind, reader.readByte() catch return error.InvalidMeshFile) catch return error.InvalidMeshFile;
+        if (firstFace > faceCount) return error.InvalidMeshFile;
+        const nameLen = reader.readInt(u32, .little) catch return error.InvalidMeshFile;
+        if (nameLen > metadata.len - stream.pos) return error.InvalidMeshFile;
+        const name = try outAllocator.dupe(u8, metadata[stream.pos..][0..nameLen]);
+        stream.pos += nameLen;
+        groups.append(.{ .name = name, .kind = kind, .firstFace = @intCast(firstFace) }) catch |err| {
+            outAllocator.free(name);
+            return err;
+        };
+    }
+
+    const runCount = reader.readInt(u32, .little) catch return error.InvalidMeshFile;
+    const faceMaterials = try outAllocator.alloc(usize, if (runCount > 0) faceCount else 0);
+    errdefer outAllocator.free(faceMaterials);
+    var previous: ?struct { face: usize, material: usize } = null;
+    for (0..runCount) |_| {
+        const face = try fieldSize(reader.readInt(u64, .little) catch return error.InvalidMeshFile);
+        const material = try fieldSize(reader.readInt(u64, .little) catch return error.InvalidMeshFile);
+        if (face > faceCount) return error.InvalidMeshFile;
+        if (previous) |run| {
+            if (face < run.face) return error.InvalidMeshFile;
+            @memset(faceMaterials[run.face..face], run.material);
+        } else if (face != 0) return error.InvalidMeshFile;
+        previous = .{ .face = face, .material = material };
+    }
+    if (previous) |run| @memset(faceMaterials[run.face..], run.material);
+
+    cached.groups = try groups.toOwnedSlice();
+    cached.faceMaterials = faceMaterials;
+}
+
+/// Cache file path for a source file, changes whenever the source is modified
+/// Caller owns the returned path
+pub fn cachePath(sourcePath: []const u8) ![]u8 {
+    const stat = try std.fs.cwd().statFile(sourcePath);
+
+    var hasher = std.hash.Wyhash.init(0);
+    hasher.update(MAGIC);
+    hasher.update(sourcePath);
+    hasher.update(std.mem.asBytes(&stat.size));
+    hasher.update(std.mem.asBytes(&stat.mtime));
+
+    return std.fmt.allocPrint(allocator, CACHE_DIR ++ "/{x:0>16}.zgm", .{hasher.final()});
+}
+
+/// Look up cached geometry for a source file, null on a miss
+pub fn load(sourcePath: []const u8, outAllocator: std.mem.Allocator) ?Cached {
+    const path = cachePath(sourcePath) catch return null;
+    defer allocator.free(path);
+
+    var cached = readFile(path, outAllocator) catch |err| {
+        if (err != error.FileNotFound) {
+            std.log.warn("Ignoring mesh cache {s}: {s}", .{ path, @errorName(err) });
+        }
+        metrics.add(.cacheMisses, 1);
+        return null;
+    };
+
+    // Material indices are only valid for the same .mtl
+    if (!std.meta.eql(cached.mtlStamp, mtlStamp(sourcePath, cached.mtllib))) {
+        std.log.info("Ignoring mesh cache {s}: material library changed", .{path});
+        cached.deinit();
+        metrics.add(.cacheMisses, 1);
+        return null;
+    }
+    metrics.add(.cacheHits, 1);
+    return cached;
+}
+
+/// Stat the .mtl next to the source file, zero if there is none
+pub fn mtlStamp(sourcePath: []const u8, mtllib: []const u8) MtlStamp {
+    const name = validator.trimString(mtllib);
+    if (name.len == 0) return .{};
+
+    const path = std.fs.path.join(allocator, &.{ std.fs.path.dirname(sourcePath) orelse ".", name }) catch return .{};
+    defer allocator.free(path);
+    const stat = std.fs.cwd().statFile(path) catch return .{};
+    return .{ .size = stat.size, .mtime = @truncate(stat.mtime) };
+}
+
+/// Store geometry for a source file in the cache (failures only skip the cache)
+///
+/// Reorders the buffers, see writeFile.
+pub fn store(sourcePath: []const u8, interleaved: mesh.Interleaved, obj: *const objectLoader.ObjectStruct) void {
+    std.fs.cwd().makePath(CACHE_DIR) catch |err| {
+        std.log.warn("Mesh cache disabled: {s}", .{@errorName(err)});
+        return;
+    };
+
+    const path = cachePath(sourcePath) catch return;
+    defer allocator.free(path);
+
+    writeFile(path, interleaved, obj, mtlStamp(sourcePath, obj.mtllib)) catch |err| {
+        std.log.warn("Could not write mesh cache {s}: {s}", .{ path, @errorName(err) });
+    };
+}
+
+test "meshCache.corruptHeader" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // Lengths whose sum wraps around and a vertex count whose float count overflows
+    const max = std.math.maxInt(u64);
+    const headers = [_][FIELDS]u64{
+        .{ 1, 3, max, 2, 0, 0, 0, 0 },
+        .{ 1, 3, 1, 1, max - 40, 0, 0, 0 },
+        .{ max / 2, 3, 0, 0, 0, 0, 0, 0 },
+    };
+    for (headers) |header| {
+        var data: [4 + FIELDS * 8]u8 = undefined;
+        @memcpy(data[0..4], MAGIC);
+        for (header, 0..) |field, i| std.mem.writeInt(u64, data[4 + i * 8 ..][0..8], field, .little);
+        try tmp.dir.writeFile(.{ .sub_path = "corrupt.zgm", .data = &data });
+
+        const path = try tmp.dir.realpathAlloc(std.testing.allocator, "corrupt.zgm");
+        defer std.testing.allocator.free(path);
+        try std.testing.expectError(error.InvalidMeshFile, readFile(path, std.testing.allocator));
+    }
+}
@@ -0,0 +1,403 @@
+//! Lossless geometry codec for interleaved vertex and index buffers
+//!
+//! Vertex buffers are encoded byte channel by byte channel: every byte of a vertex is delta coded
+//! against the same byte of the previous vertex, zigzag mapped and bit packed in groups of 16
+//! with a 2 bit width header (0, 2, 4 or 8 bits). Decoding unpacks and prefix sums a whole group
+//! in one 16 lane vector.
+//! Index buffers are delta coded against the previous index, zigzag mapped and stored as varints.
+
+const std = @import("std");
+
+const VERTEX_VERSION: u8 = 0xA0;
+const INDEX_VERSION: u8 = 0xE0;
+
+const GROUP_SIZE = 16; // Vertices per bit packed group (one vector)
+const BLOCK_SIZE = 256; // Vertices per block, keeps the block headers small
+const MAX_VERTEX_SIZE = 256;
+
+const Group = @Vector(GROUP_SIZE, u8);
+
+/// Bits per value for the 2 bit width header
+const widths = [4]u4{ 0, 2, 4, 8 };
+
+pub const DecodeError = error{ InvalidVersion, Truncated };
+
+/// Worst case encoded size of a vertex buffer
+pub fn vertexBound(vertexCount: usize, vertexSize: usize) usize {
+    const blocks = (vertexCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const groupsPerBlock = BLOCK_SIZE / GROUP_SIZE;
+    return 1 + blocks * vertexSize * (groupsPerBlock / 4 + groupsPerBlock * GROUP_SIZE);
+}
+
+/// Encode vertexCount vertices of vertexSize bytes each
+pub fn encodeVertexBuffer(allocator: std.mem.Allocator, vertices: []const u8, vertexSize: usize) ![]u8 {
+    std.debug.assert(vertexSize > 0 and vertexSize <= MAX_VERTEX_SIZE and vertices.len % vertexSize == 0);
+    const vertexCount = vertices.len / vertexSize;
+
+    var out = try std.ArrayList(u8).initCapacity(allocator, vertexBound(vertexCount, vertexSize) / 2);
+    errdefer out.deinit();
+    try out.append(VERTEX_VERSION);
+
+    var previous: [MAX_VERTEX_SIZE]u8 = [_]u8{0} ** MAX_VERTEX_SIZE;
+    var blockStart: usize = 0;
+    while (blockStart < vertexCount) : (blockStart += BLOCK_SIZE) {
+        const blockCount = @min(BLOCK_SIZE, vertexCount - blockStart);
+        const groupCount = (blockCount + GROUP_SIZE - 1) / GROUP_SIZE;
+
+        for (0..vertexSize) |k| {
+            // Zigzag deltas of this byte channel, the tail of the last group repeats the last vertex
+            var deltas: [BLOCK_SIZE]u8 = [_]u8{0} ** BLOCK_SIZE;
+            var last = previous[k];
+            for (0..blockCount) |i| {
+                const value = vertices[(blockStart + i) * vertexSize + k];
+                deltas[i] = zigzag(value -% last);
+                last = value;
+            }
+            previous[k] = last;
+
+            // Width header, 4 groups per byte
+            const headerStart = out.items.len;
+            try out.appendNTimes(0, (groupCount + 3) / 4);
+            for (0..groupCount) |g| {
+                const group = deltas[g * GROUP_SIZE ..][0..GROUP_SIZE];
+                const maxDelta = std.mem.max(u8, group);
+                const mode: u2 = if (maxDelta == 0) 0 else if (maxDelta < 4) 1 else if (maxDelta < 16) 2 else 3;
+                out.items[headerStart + g / 4] |= @as(u8, mode) << @intCast((g % 4) * 2);
+                try packGroup(&out, group, widths[mode]);
+            }
+        }
+    }
+
+    return out.toOwnedSlice();
+}
+
+/// Decode a vertex buffer into out (vertexCount * vertexSize bytes)
+pub fn decodeVertexBuffer(out: []u8, vertexSize: usize, encoded: []const u8) DecodeError!void {
+    std.debug.assert(vertexSize > 0 and vertexSize <= MAX_VERTEX_SIZE and out.len % vertexSize == 0);
+    const vertexCount = out.len / vertexSize;
+
+    if (encoded.len == 0 or encoded[0] != VERTEX_VERSION) return error.InvalidVersion;
+    var cursor: usize = 1;
+
+    var previous: [MAX_VERTEX_SIZE]u8 = [_]u8{0} ** MAX_VERTEX_SIZE;
+    var blockStart: usize = 0;
+    while (blockStart < vertexCount) : (blockStart += BLOCK_SIZE) {
+        const blockCount = @min(BLOCK_SIZE, vertexCount - blockStart);
+        const groupCount = (blockCount + GROUP_SIZE - 1) / GROUP_SIZE;
+
+        for (0..vertexSize) |k| {
+            const headerSize = (groupCount + 3) / 4;
+            if (cursor + headerSize > encoded.len) return error.Truncated;
+            const header = encoded[cursor..][0..headerSize];
+            cursor += headerSize;
+
+            var last = previous[k];
+            for (0..groupCount) |g| {
+                const mode: u2 = @truncate(header[g / 4] >> @intCast((g % 4) * 2));
+                const values = try unpackGroup(encoded, &cursor, mode);
+                const decoded = prefixSum(unzigzag(values)) +% @as(Group, @splat(last));
+
+                // Scatter the channel back into the interleaved vertices
+                const count = @min(GROUP_SIZE, blockCount - g * GROUP_SIZE);
+                const base = (blockStart + g * GROUP_SIZE) * vertexSize + k;
+                const lanes: [GROUP_SIZE]u8 = decoded;
+                for (0..count) |i| {
+                    out[base + i * vertexSize] = lanes[i];
+                }
+                last = lanes[count - 1];
+            }
+            previous[k] = last;
+        }
+    }
+}
+
+/// Encode triangle indices as zigzag deltas in varints
+pub fn encodeIndexBuffer(allocator: std.mem.Allocator, indices: []const u32) ![]u8 {
+    var out = try std.ArrayList(u8).initCapacity(allocator, 1 + indices.len * 2);
+    errdefer out.deinit();
+    try out.append(INDEX_VERSION);
+
+    var last: u32 = 0;
+    for (indices) |index| {
+        const delta = index -% last;
+        var value: u32 = (delta << 1) ^ (0 -% (delta >> 31));
+        while (value >= 0x80) : (value >>= 7) {
+            try out.append(@as(u8, @truncate(value)) | 0x80);
+        }
+        try out.append(@intCast(value));
+        last = index;
+    }
+
+    return out.toOwnedSlice();
+}
+
+/// Decode triangle indices into out
+pub fn decodeIndexBuffer(out: []u32, encoded: []const u8) DecodeError!void {
+    if (encoded.len == 0 or encoded[0] != INDEX_VERSION) return error.InvalidVersion;
+    var cursor: usize = 1;
+
+    var last: u32 = 0;
+    for (out) |*index| {
+        var value: u32 = 0;
+        var shift: u5 = 0;
+        while (true) {
+            if (cursor >= encoded.len) return error.Truncated;
+            const byte = encoded[cursor];
+            cursor += 1;
+            value |= @as(u32, byte & 0x7F) << shift;
+            if (byte < 0x80) break;
+            if (shift >= 28) return error.Truncated;
+            shift += 7;
+        }
+        const delta: u32 = (value >> 1) ^ (0 -% (value & 1));
+        last +%= delta;
+        index.* = last;
+    }
+}
+
+/// Merge bit-identical vertices in place and remap the indices
+///
+/// Returns the new vertex count; vertices keep the order of their first use.
+pub fn deduplicateVertices(allocator: std.mem.Allocator, vertices: []u8, vertexSize: usize, indices: []u32) !usize {
+    const vertexCount = vertices.len / vertexSize;
+
+    const Context = struct {
+        vertices: []const u8,
+        vertexSize: usize,
+
+        pub fn hash(self: @This(), index: u32) u64 {
+            return std.hash.Wyhash.hash(0, self.vertices[index * self.vertexSize ..][0..self.vertexSize]);
+        }
+
+        pub fn eql(self: @This(), a: u32, b: u32) bool {
+            return std.mem.eql(u8, self.vertices[a * self.vertexSize ..][0..self.vertexSize], self.vertices[b * self.vertexSize ..][0..self.vertexSize]);
+        }
+    };
+
+    const remap = try allocator.alloc(u32, vertexCount);
+    defer allocator.free(remap);
+    @memset(remap, std.math.maxInt(u32));
+
+    // Unique vertex lookup over the original (not yet compacted) data
+    var unique = std.HashMap(u32, u32, Context, std.hash_map.default_max_load_percentage).initContext(allocator, .{ .vertices = vertices, .vertexSize = vertexSize });
+    defer unique.deinit();
+    try unique.ensureTotalCapacity(@intCast(vertexCount));
+
+    var newCount: u32 = 0;
+    const order = try allocator.alloc(u32, vertexCount); // New index -> original vertex
+    defer allocator.free(order);
+    for (indices) |*index| {
+        if (remap[index.*] == std.math.maxInt(u32)) {
+            const entry = unique.getOrPutAssumeCapacity(index.*);
+            if (!entry.found_existing) {
+                entry.value_ptr.* = newCount;
+                order[newCount] = index.*;
+                newCount += 1;
+            }
+            remap[index.*] = entry.value_ptr.*;
+        }
+        index.* = remap[index.*];
+    }
+
+    // Compact through a scratch buffer, first-use order may move vertices backwards and forwards
+    const compacted = try allocator.alloc(u8, newCount * vertexSize);
+    defer allocator.free(compacted);
+    for (order[0..newCount], 0..) |original, i| {
+        @memcpy(compacted[i * vertexSize ..][0..vertexSize], vertices[original * vertexSize ..][0..vertexSize]);
+    }
+    @memcpy(vertices[0..compacted.len], compacted);
+
+    return newCount;
+}
+
+/// Small negative and positive deltas map to small values (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...)
+inline fn zigzag(delta: u8) u8 {
+    return (delta << 1) ^ (0 -% (delta >> 7));
+}
+
+inline fn unzigzag(values: Group) Group {
+    const one: Group = @splat(1);
+    return (values >> @as(@Vector(GROUP_SIZE, u3), @splat(1))) ^ (@as(Group, @splat(0)) -% (values & one));
+}
+
+/// Inclusive prefix sum over the 16 lanes (log steps of lane shifts)
+inline fn prefixSum(values: Group) Group {
+    var sum = values;
+    inline for (.{ 1, 2, 4, 8 }) |shift| {
+        sum +%= @shuffle(u8, sum, @as(Group, @splat(0)), comptime shiftMask(shift));
+    }
+    return sum;
+}
+
+/// Shuffle mask that moves every lane up by shift and fills with zeros
+fn shiftMask(comptime shift: usize) @Vector(GROUP_SIZE, i32) {
+    var mask: [GROUP_SIZE]i32 = undefined;
+    for (&mask, 0..) |*lane, i| {
+        lane.* = if (i >= shift) @intCast(i - shift) else -1; // -1 selects lane 0 of the zero vector
+    }
+    return mask;
+}
+
+/// Append a group of 16 values with the given bit width (values must fit)
+fn packGroup(out: *std.ArrayList(u8), group: *const [GROUP_SIZE]u8, width: u4) !void {
+    switch (width) {
+        0 => {},
+        8 => try out.appendSlice(group),
+        else => {
+            const perByte = 8 / @as(usize, width);
+            for (0..GROUP_SIZE / perByte) |b| {
+                var byte: u8 = 0;
+                for (0..perByte) |j| {
+                    byte |= group[b * perByte + j] << @intCast(j * width);
+                }
+                try out.append(byte);
+            }
+        },
+    }
+}
+
+/// Read a group of 16 values with the width of the header mode, expanded to one byte per lane
+inline fn unpackGroup(encoded: []const u8, cursor: *usize, mode: u2) DecodeError!Group {
+    switch (mode) {
+        0 => return @splat(0),
+        1 => return unpackBits(encoded, cursor, 2),
+        2 => return unpackBits(encoded, cursor, 4),
+        3 => {
+            if (cursor.* + GROUP_SIZE > encoded.len) return error.Truncated;
+            const group: Group = encoded[cursor.*..][0..GROUP_SIZE].*;
+            cursor.* += GROUP_SIZE;
+            return group;
+        },
+    }
+}
+
+/// Broadcast every packed byte to its lanes, then shift and mask all lanes at once
+inline fn unpackBits(encoded: []const u8, cursor: *usize, comptime width: comptime_int) DecodeError!Group {
+    const byteCount = GROUP_SIZE * width / 8;
+    if (cursor.* + byteCount > encoded.len) return error.Truncated;
+
+    var packedBytes: Group = @splat(0);
+    inline for (0..byteCount) |b| {
+        packedBytes[b] = encoded[cursor.* + b];
+    }
+    cursor.* += byteCount;
+
+    const perByte = 8 / width;
+    comptime var lanes: [GROUP_SIZE]i32 = undefined;
+    comptime var shifts: [GROUP_SIZE]u3 = undefined;
+    inline for (0..GROUP_SIZE) |i| {
+        lanes[i] = i / perByte;
+        shifts[i] = (i % perByte) * width;
+    }
+
+    const spread = @shuffle(u8, packedBytes, undefined, lanes);
+    const mask: Group = @splat((1 << width) - 1);
+    return (spread >> @as(@Vector(GROUP_SIZE, u3), shifts)) & mask;
+}
+
+fn expectVertexRoundTrip(vertices: []const u8, vertexSize: usize) !void {
+    const allocator = std.testing.allocator;
+    const encoded = try encodeVertexBuffer(allocator, vertices, vertexSize);
+    defer allocator.free(encoded);
+    try std.testing.expect(encoded.len <= vertexBound(vertices.len / vertexSize, vertexSize));
+
+    const decoded = try allocator.alloc(u8, vertices.len);
+    defer allocator.free(decoded);
+    try decodeVertexBuffer(decoded, vertexSize, encoded);
+    try std.testing.expectEqualSlices(u8, vertices, decoded);
+}
+
+fn expectIndexRoundTrip(indices: []const u32) !void {
+    const allocator = std.testing.allocator;
+    const encoded = try encodeIndexBuffer(allocator, indices);
+    defer allocator.free(encoded);
+
+    const decoded = try allocator.alloc(u32, indices.len);
+    defer allocator.free(decoded);
+    try decodeIndexBuffer(decoded, encoded);
+    try std.testing.expectEqualSlices(u32, indices, decoded);
+}
+
+test "meshCodec.vertexRoundTrip" {
+    var prng = std.Random.DefaultPrng.init(0x5EED);
+    const random = prng.random();
+
+    // Partial groups and blocks, every bit width and the 8 bit wrap around
+    for ([_]usize{ 1, 4, 12, 44, MAX_VERTEX_SIZE }) |vertexSize| {
+        for ([_]usize{ 0, 1, 15, 16, 17, 255, 256, 257, 1000 }) |vertexCount| {
+            const vertices = try std.testing.allocator.alloc(u8, vertexCount * vertexSize);
+            defer std.testing.allocator.free(vertices);
+
+            random.bytes(vertices);
+            try expectVertexRoundTrip(vertices, vertexSize);
+
+            @memset(vertices, 0x7F);
+            try expectVertexRoundTrip(vertices, vertexSize);
+
+            for ([_]u8{ 1, 3, 7, 15, 127 }) |maxStep| {
+                var value: u8 = random.int(u8);
+                for (vertices) |*byte| {
+                    value +%= random.intRangeAtMost(u8, 0, maxStep);
+                    byte.* = value;
+                }
+                try expectVertexRoundTrip(vertices, vertexSize);
+            }
+        }
+    }
+}
+
+test "meshCodec.vertexFloats" {
+    // Interleaved f32 vertices like the mesh layout, including NaN payloads and signed zeros
+    var vertices: [300 * 11]f32 = undefined;
+    for (&vertices, 0..) |*value, i| {
+        value.* = @as(f32, @floatFromInt(i % 97)) * 0.125 - 6.0;
+    }
+    vertices[5] = -0.0;
+    vertices[17] = std.math.nan(f32);
+    vertices[33] = std.math.inf(f32);
+    vertices[34] = std.math.floatMin(f32);
+    try expectVertexRoundTrip(std.mem.sliceAsBytes(&vertices), 11 * @sizeOf(f32));
+}
+
+test "meshCodec.indexRoundTrip" {
+    try expectIndexRoundTrip(&.{});
+    try expectIndexRoundTrip(&.{ 0, 1, 2, 2, 1, 3 });
+    try expectIndexRoundTrip(&.{ std.math.maxInt(u32), 0, std.math.maxInt(u32), 1 << 31, (1 << 31) - 1, 0 });
+
+    var prng = std.Random.DefaultPrng.init(0x1D5);
+    var indices: [3000]u32 = undefined;
+    prng.random().bytes(std.mem.sliceAsBytes(&indices));
+    try expectIndexRoundTrip(&indices);
+}
+
+test "meshCodec.truncated" {
+    const allocator = std.testing.allocator;
+    var prng = std.Random.DefaultPrng.init(7);
+    var vertices: [64 * 12]u8 = undefined;
+    prng.random().bytes(&vertices);
+    const encoded = try encodeVertexBuffer(allocator, &vertices, 12);
+    defer allocator.free(encoded);
+
+    var decoded: [64 * 12]u8 = undefined;
+    try std.testing.expectError(error.Truncated, decodeVertexBuffer(&decoded, 12, encoded[0 .. encoded.len - 1]));
+    try std.testing.expectError(error.InvalidVersion, decodeVertexBuffer(&decoded, 12, &.{INDEX_VERSION}));
+
+    var indices: [3]u32 = undefined;
+    try std.testing.expectError(error.Truncated, decodeIndexBuffer(&indices, &.{ INDEX_VERSION, 0x02, 0x80 }));
+}
+
+test "meshCodec.deduplicateVertices" {
+    const allocator = std.testing.allocator;
+    var vertices = [_]u8{ 1, 1, 2, 2, 1, 1, 3, 3, 2, 2 };
+    const original = vertices;
+    var indices = [_]u32{ 0, 1, 2, 3, 4, 2, 0 };
+    const before = indices;
+
+    const count = try deduplicateVertices(allocator, &vertices, 2, &indices);
+    try std.testing.expectEqual(@as(usize, 3), count);
+    try std.testing.expectEqualSlices(u8, &.{ 1, 1, 2, 2, 3, 3 }, vertices[0 .. count * 2]);
+    for (indices, before) |index, old| {
+        try std.testing.expect(index < count);
+        try std.testing.expectEqualSlices(u8, original[old * 2 ..][0..2], vertices[index * 2 ..][0..2]);
+    }
+}
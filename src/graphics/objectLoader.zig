@@ -1,6 +1,11 @@
 //! Parse .obj files into the custom object struct
 //!
 //! Loads, parses, and processes .obj files
+//!
+//! The mtllib line starts a worker that parses the .mtl file and decodes its textures while the
+//! rest of the .obj is read, so a load takes about as long as the slower of the two. The worker
+//! makes no OpenGL calls; textures are uploaded after the join and usemtl names are resolved to
+//! material indices once both are done.
 
 const fs = std.fs;
 const io = std.io;
@@ -10,11 +15,14 @@ const std = @import("std");
 const gl = @import("gl");
 const zstbi = @import("zstbi");
 
-const overlay = @import("../ui/overlay.zig");
-const errors = @import("../util/errors.zig");
+const glDebug = @import("glDebug.zig");
+const imageDecoder = @import("imageDecoder.zig");
+const diagnostics = @import("../util/diagnostics.zig");
 const validator = @import("../util/validator.zig");
+const memory = @import("../util/memory.zig");
 
-var objDir: []const u8 = undefined; // Directory of the relevant files
+const MAX_THREADS = 8; // Texture decode threads, including the material worker
+const NO_MATERIAL = std.math.maxInt(usize); // Faces before the first usemtl line
 
 /// Vertex struct
 ///
@@ -34,44 +42,80 @@ pub const Face = struct {
     normalIndices: [3]usize,
 };
 
+/// Kind of a group line
+pub const GroupKind = enum { object, group };
+
+/// Group struct, one per o or g line
+///
+/// Contains:
+/// - name: name after the keyword
+/// - kind: object (o) or group (g)
+/// - firstFace: index of the first face of the group
+pub const Group = struct {
+    name: []const u8,
+    kind: GroupKind,
+    firstFace: usize,
+};
+
 /// Object struct
 ///
 /// Contains:
 /// - vbo: vertex buffer object
 /// - ebo: element buffer object
+/// - colors: optional vertex colors (v x y z r g b)
 /// - normals: normals of the object
 /// - texCoords: texture coordinates of the object
 /// - name: name of the object
+/// - groups: o/g groups in file order
 /// - mtllib: name of the material file
 /// - allocator: memory allocator
 /// - materials: list of materials
-/// - currentMaterialName: name of the current material
+/// - faceMaterialIndices: material index per face (usemtl name index while parsing)
+/// - materialNames: usemtl names in order of first use
+/// - currentMaterial: index into materialNames for the following faces
+/// - materialJob: .mtl worker started by the mtllib line, only set while parsing
+/// - timings: material stages of the load
+/// - line: line being parsed, for diagnostics
 ///
 /// deinit method
 /// deinitMaterials method
 pub const ObjectStruct = struct {
     vbo: std.ArrayList(Vertex), // v
     ebo: std.ArrayList(Face), // f
+    colors: std.ArrayList([3]f32), // v (color extension)
     normals: std.ArrayList([3]f32), // vn
     texCoords: std.ArrayList([2]f32), // vt
     name: std.ArrayList(u8), // o
+    groups: std.ArrayList(Group), // o, g
     mtllib: []const u8, // mtllib
     allocator: std.mem.Allocator, // Memory allocator
     materials: std.ArrayList(Material), // List of materials
     faceMaterialIndices: std.ArrayList(usize), // Material index per face
-    currentMaterialName: ?[]const u8, // Current material name
+    materialNames: std.ArrayList([]const u8), // usemtl
+    currentMaterial: ?usize = null, // Index into materialNames
+    materialJob: ?*MaterialJob = null, // Worker of the mtllib line
+    timings: LoadTimings = .{}, // Filled by load and loadMaterials
+    line: usize = 0, // Line being parsed
 
     /// Deinitialize the object (vbo, ebo, name)
     pub fn deinit(self: *ObjectStruct) void {
         self.vbo.deinit();
         self.ebo.deinit();
+        self.colors.deinit();
         self.normals.deinit();
         self.texCoords.deinit();
         self.name.deinit();
+        for (self.groups.items) |group| self.allocator.free(group.name);
+        self.groups.deinit();
         self.faceMaterialIndices.deinit();
+        for (self.materialNames.items) |name| self.allocator.free(name);
+        self.materialNames.deinit();
 
+        if (self.mtllib.len > 0) {
+            self.allocator.free(self.mtllib);
+        }
         self.mtllib = undefined;
-        self.currentMaterialName = undefined;
+        self.currentMaterial = null;
 
         deinitMaterials(self);
         self.materials.deinit();
@@ -84,6 +128,18 @@ pub const ObjectStruct = struct {
     }
 };
 
+/// Material stages of a load in nanoseconds
+///
+/// Contains:
+/// - materials: .mtl parsing and texture decoding on the worker
+/// - materialWait: time the parser waited for the worker after the last .obj line
+/// - textureUpload: upload of the decoded maps
+pub const LoadTimings = struct {
+    materials: u64 = 0,
+    materialWait: u64 = 0,
+    textureUpload: u64 = 0,
+};
+
 /// Material struct
 ///
 /// Contains:
@@ -100,6 +156,9 @@ pub const ObjectStruct = struct {
 /// - roughnessMapPath: path to the roughness map
 /// - roughnessMap: zstbi.Image struct
 /// - roughnessMapId: OpenGL texture ID
+/// - roughness, metallic: scalar values used without maps
+/// - roughnessChannel, metallicChannel: channel sampled from the maps (glTF packs both in one texture)
+/// - opacity: dissolve, materials below 1 are drawn in the transparent pass
 ///
 /// deinit method
 pub const Material = struct {
@@ -107,22 +166,27 @@ pub const Material = struct {
     ambient: [3]f32, // Ka
     diffuse: [3]f32, // Kd
     specular: [3]f32, // Ks
+    roughness: f32 = 0.5, // Pr
+    metallic: f32 = 0.0, // Pm
+    opacity: f32 = 1.0, // d (1 - Tr)
     // Texture
     texturePath: ?[]const u8, // map_Kd
-    texture: ?zstbi.Image = undefined,
-    textureId: gl.uint = undefined,
+    texture: ?zstbi.Image = null,
+    textureId: gl.uint = 0,
     // Normal Map
     normalMapPath: ?[]const u8, // map_Bump
-    normalMap: ?zstbi.Image = undefined,
-    normalMapId: gl.uint = undefined,
+    normalMap: ?zstbi.Image = null,
+    normalMapId: gl.uint = 0,
     // Roughness
     roughnessMapPath: ?[]const u8, // map_Pr
-    roughnessMap: ?zstbi.Image = undefined,
-    roughnessMapId: gl.uint = undefined,
+    roughnessMap: ?zstbi.Image = null,
+    roughnessMapId: gl.uint = 0,
     // Metallic
     metallicMapPath: ?[]const u8, // map_Pm
-    metallicMap: ?zstbi.Image = undefined,
-    metallicMapId: gl.uint = undefined,
+    metallicMap: ?zstbi.Image = null,
+    metallicMapId: gl.uint = 0,
+    roughnessChannel: u8 = 0,
+    metallicChannel: u8 = 0,
 
     pub fn deinit(self: *Material, allocator: std.mem.Allocator) void {
         allocator.free(self.name);
@@ -130,6 +194,7 @@ pub const Material = struct {
             image.deinit(); // Free CPU image data
         }
         if (self.textureId != 0) {
+            memory.untrackGpu(.texture, self.textureId);
             gl.DeleteTextures(1, (&self.textureId)[0..1]); // Free GPU texture
         }
         if (self.texturePath) |path| {
@@ -144,6 +209,7 @@ pub const Material = struct {
             image.deinit();
         }
         if (self.normalMapId != 0) {
+            memory.untrackGpu(.texture, self.normalMapId);
             gl.DeleteTextures(1, (&self.normalMapId)[0..1]);
         }
         if (self.normalMapPath) |path| {
@@ -158,6 +224,7 @@ pub const Material = struct {
             image.deinit();
         }
         if (self.roughnessMapId != 0) {
+            memory.untrackGpu(.texture, self.roughnessMapId);
             gl.DeleteTextures(1, (&self.roughnessMapId)[0..1]);
         }
         if (self.roughnessMapPath) |path| {
@@ -168,7 +235,8 @@ pub const Material = struct {
         if (self.metallicMap) |*image| {
             image.deinit();
         }
-        if (self.metallicMapId != 0) {
+        if (self.metallicMapId != 0 and self.metallicMapId != self.roughnessMapId) {
+            memory.untrackGpu(.texture, self.metallicMapId);
             gl.DeleteTextures(1, (&self.metallicMapId)[0..1]);
         }
         if (self.metallicMapPath) |path| {
@@ -178,29 +246,77 @@ pub const Material = struct {
 };
 
 /// Load the .obj file
+/// The .mtl file is prepared on a worker while the geometry is parsed (see handleMtlFileName)
 pub fn load(objPath: []const u8, allocator: std.mem.Allocator) !ObjectStruct {
-    // Initialize the object struct
-    var object = ObjectStruct{
+    var object = initObject(allocator);
+    errdefer object.deinit();
+
+    // Started before parsing, a failure here must not skip the join below
+    var timer = try std.time.Timer.start();
+
+    var job = MaterialJob.init(objPath, allocator);
+    object.materialJob = &job;
+    const parsed = parseObjFile(objPath, &object);
+    object.materialJob = null;
+
+    // Join even if parsing failed, the worker still writes into the job
+    timer.reset();
+    const prepared = joinMaterials(&job, &object);
+    object.timings.materialWait = timer.lap();
+    try parsed;
+    try prepared;
+
+    uploadMaterials(&object);
+    object.timings.textureUpload = timer.read();
+    try resolveFaceMaterials(&object);
+
+    return object;
+}
+
+/// Load only the geometry of the .obj file
+/// Skips the .mtl file and makes no OpenGL calls, so it can run on worker threads
+pub fn loadGeometry(objPath: []const u8, allocator: std.mem.Allocator) !ObjectStruct {
+    var object = initObject(allocator);
+    errdefer object.deinit();
+
+    try parseObjFile(objPath, &object);
+    try resolveFaceMaterials(&object);
+
+    return object;
+}
+
+/// Load only the materials of an object whose mtllib is already set (e.g. geometry from the mesh cache)
+/// There is no geometry to overlap with, so the .mtl file is parsed on the calling thread
+pub fn loadMaterials(objPath: []const u8, object: *ObjectStruct) !void {
+    if (object.mtllib.len == 0) return;
+
+    var job = MaterialJob.init(objPath, object.allocator);
+    job.mtlPath = try std.fs.path.join(object.allocator, &.{ job.directory, validator.trimString(object.mtllib) });
+    prepareMaterials(&job);
+    try joinMaterials(&job, object);
+
+    var timer = try std.time.Timer.start();
+    uploadMaterials(object);
+    object.timings.textureUpload = timer.read();
+    try resolveFaceMaterials(object);
+}
+
+/// Create an empty object struct
+pub fn initObject(allocator: std.mem.Allocator) ObjectStruct {
+    return ObjectStruct{
         .vbo = std.ArrayList(Vertex).init(allocator),
         .ebo = std.ArrayList(Face).init(allocator),
+        .colors = std.ArrayList([3]f32).init(allocator),
         .normals = std.ArrayList([3]f32).init(allocator),
         .texCoords = std.ArrayList([2]f32).init(allocator),
         .name = std.ArrayList(u8).init(allocator),
+        .groups = std.ArrayList(Group).init(allocator),
         .mtllib = "",
         .allocator = allocator,
         .materials = std.ArrayList(Material).init(allocator),
         .faceMaterialIndices = std.ArrayList(usize).init(allocator),
-        .currentMaterialName = undefined,
+        .materialNames = std.ArrayList([]const u8).init(allocator),
     };
-
-    try parseObjFile(objPath, &object);
-
-    // Dont parse .mtl file if not present
-    if (object.mtllib.len > 0) {
-        try parseMtlFile(objPath, &object);
-    }
-
-    return object;
 }
 
 /// Parse the .obj file
@@ -215,25 +331,91 @@ fn parseObjFile(path: []const u8, object: *ObjectStruct) !void {
 
     var line_buf: [1024]u8 = undefined;
 
+    object.line = 0;
     while (try in_stream.readUntilDelimiterOrEof(&line_buf, '\n')) |line| {
-        try processObjLine(line, object);
+        object.line += 1;
+        processObjLine(line, object) catch |err| {
+            diagnostics.report(.ObjFileMalformed, object.line, "{s}: {s}", .{ @errorName(err), line });
+            return err;
+        };
     }
 }
 
-/// Parse the .mtl file
-fn parseMtlFile(path: []const u8, object: *ObjectStruct) !void {
-    // Get mtl file path from obj file location
-    const mtlPath = try getMtlFilePath(object, path);
+/// Materials of the .mtl file, parsed and decoded on a worker
+///
+/// Contains:
+/// - thread: worker started by the mtllib line, null if it ran on the calling thread
+/// - directory: directory of the .obj file, the .mtl file and textures are relative to it
+/// - mtlPath: path of the .mtl file
+/// - materials: parsed materials with decoded images, moved into the object by joinMaterials
+/// - result: outcome of the worker
+/// - elapsed: time the worker took
+const MaterialJob = struct {
+    thread: ?std.Thread = null,
+    directory: []const u8,
+    mtlPath: []const u8 = "",
+    materials: std.ArrayList(Material),
+    result: anyerror!void = {},
+    elapsed: u64 = 0,
+
+    fn init(objPath: []const u8, allocator: std.mem.Allocator) MaterialJob {
+        return .{
+            .directory = std.fs.path.dirname(objPath) orelse ".",
+            .materials = std.ArrayList(Material).init(allocator),
+        };
+    }
+};
+
+/// Start preparing the materials on a worker, runs on the calling thread if no thread can be spawned
+fn startMaterials(job: *MaterialJob, mtllib: []const u8) !void {
+    const allocator = job.materials.allocator;
+    job.mtlPath = try std.fs.path.join(allocator, &.{ job.directory, validator.trimString(mtllib) });
+
+    job.thread = std.Thread.spawn(.{}, prepareMaterials, .{job}) catch null;
+    if (job.thread == null) prepareMaterials(job);
+}
 
+/// Parse the .mtl file and decode its textures, makes no OpenGL calls
+fn prepareMaterials(job: *MaterialJob) void {
+    defer diagnostics.flush();
+    var timer = std.time.Timer.start() catch null;
+    defer job.elapsed = if (timer) |*t| t.read() else 0;
+
+    job.result = parseMtlFile(job.mtlPath, &job.materials);
+    if (job.result) |_| {
+        job.result = decodeTextures(job.directory, job.materials.items, job.materials.allocator);
+    } else |_| {}
+}
+
+/// Wait for the worker and move its materials into the object (also on failure, deinit frees them)
+fn joinMaterials(job: *MaterialJob, object: *ObjectStruct) !void {
+    if (job.thread) |thread| thread.join();
+    job.thread = null;
+
+    const allocator = job.materials.allocator;
+    if (job.mtlPath.len > 0) allocator.free(job.mtlPath);
+    job.mtlPath = "";
+    object.timings.materials = job.elapsed;
+    defer job.materials.deinit();
+
+    object.materials.ensureUnusedCapacity(job.materials.items.len) catch |err| {
+        for (job.materials.items) |*material| material.deinit(allocator);
+        return err;
+    };
+    object.materials.appendSliceAssumeCapacity(job.materials.items);
+
+    return job.result;
+}
+
+/// Parse the .mtl file
+fn parseMtlFile(mtlPath: []const u8, materials: *std.ArrayList(Material)) !void {
     if (!validator.fileExists(mtlPath)) {
-        errors.errorCollector.reportError(errors.ErrorCode.MtlFileNotFound);
-        std.log.err("Mtl file does not exist!", .{});
+        diagnostics.report(.MtlFileNotFound, 0, "Mtl file does not exist: {s}", .{mtlPath});
         return;
     }
 
     // Open the file
-    const newMtlPath = validator.trimString(mtlPath);
-    const file = try fs.cwd().openFile(newMtlPath, .{});
+    const file = try fs.cwd().openFile(mtlPath, .{});
     defer file.close();
 
     // Read the file line by line
@@ -243,24 +425,10 @@ fn parseMtlFile(path: []const u8, object: *ObjectStruct) !void {
     var line_buf: [1024]u8 = undefined;
 
     while (try in_stream.readUntilDelimiterOrEof(&line_buf, '\n')) |line| {
-        try processMtlLine(line, object);
+        try processMtlLine(line, materials);
     }
 }
 
-/// Get the path to the .mtl file from the .obj file
-pub fn getMtlFilePath(object: *ObjectStruct, objPath: []const u8) ![]const u8 {
-    // Get the directory of the obj file.
-    objDir = std.fs.path.dirname(objPath) orelse ".";
-
-    // Extract the filename from the objPath.
-    const mtlFilename = object.mtllib;
-
-    // Build the final path as: objDir + "/" + mtlFilename
-    var parts = [_][]const u8{ objDir, "/", mtlFilename };
-    const finalPath = try std.mem.concat(object.allocator, u8, &parts);
-    return finalPath;
-}
-
 /// Process a single line from the .obj file
 fn processObjLine(line: []const u8, obj: *ObjectStruct) !void {
     if (line.len == 0) return;
@@ -272,9 +440,12 @@ fn processObjLine(line: []const u8, obj: *ObjectStruct) !void {
 
     // Currently supported prefixes:
     if (mem.eql(u8, prefix, "usemtl")) { // Material for subsequent faces
-        obj.currentMaterialName = content;
+        try handleUseMaterial(content, obj);
     } else if (mem.eql(u8, prefix, "o")) { // Object name
         try handleObjectName(content, obj);
+        try handleGroup(content, .object, obj);
+    } else if (mem.eql(u8, prefix, "g")) { // Group
+        try handleGroup(content, .group, obj);
     } else if (mem.eql(u8, prefix, "mtllib")) { // Mtl file name
         try handleMtlFileName(content, obj);
     } else if (mem.eql(u8, prefix, "v")) { // Vertex
@@ -289,7 +460,7 @@ fn processObjLine(line: []const u8, obj: *ObjectStruct) !void {
 }
 
 /// Process a single line from the .mtl file
-fn processMtlLine(line: []const u8, obj: *ObjectStruct) !void {
+fn processMtlLine(line: []const u8, materials: *std.ArrayList(Material)) !void {
     if (line.len == 0) return;
 
     // Parse line prefix
@@ -299,137 +470,241 @@ fn processMtlLine(line: []const u8, obj: *ObjectStruct) !void {
 
     // Currently supported prefixes:
     if (mem.eql(u8, prefix, "newmtl")) { // Name
-        try handleName(content, obj);
+        try handleName(content, materials);
     } else if (mem.eql(u8, prefix, "Ka")) { // Ambient
-        try handleAmbient(content, obj);
+        try handleAmbient(content, materials);
     } else if (mem.eql(u8, prefix, "Kd")) { // Diffuse
-        try handleDiffuse(content, obj);
+        try handleDiffuse(content, materials);
     } else if (mem.eql(u8, prefix, "Ks")) { // Specular
-        try handleSpecular(content, obj);
+        try handleSpecular(content, materials);
+    } else if (mem.eql(u8, prefix, "Pr")) { // Roughness
+        try handleRoughness(content, materials);
+    } else if (mem.eql(u8, prefix, "Pm")) { // Metallic
+        try handleMetallic(content, materials);
+    } else if (mem.eql(u8, prefix, "d")) { // Dissolve
+        try handleOpacity(content, false, materials);
+    } else if (mem.eql(u8, prefix, "Tr")) { // Transparency (inverse dissolve)
+        try handleOpacity(content, true, materials);
     } else if (mem.eql(u8, prefix, "map_Bump")) { // Normal map
-        try handleNormalMapPath(content, obj);
+        try handleNormalMapPath(content, materials);
     } else if (mem.eql(u8, prefix, "map_Kd")) { // TexturePath
-        try handleTexturePath(content, obj);
+        try handleTexturePath(content, materials);
     } else if (mem.eql(u8, prefix, "map_Pr")) { // Roughness map
-        try handleRoughnessMapPath(content, obj);
+        try handleRoughnessMapPath(content, materials);
     } else if (mem.eql(u8, prefix, "map_Pm")) { // Metallic map
-        try handleMetallicMapPath(content, obj);
+        try handleMetallicMapPath(content, materials);
     }
 }
 
 /// Handle the name of the material
-fn handleName(content: []const u8, obj: *ObjectStruct) !void {
+fn handleName(content: []const u8, materials: *std.ArrayList(Material)) !void {
     // Create a new material with default values
     const material = Material{
-        .name = try obj.allocator.dupe(u8, content),
+        .name = try materials.allocator.dupe(u8, validator.trimString(content)),
         .ambient = [3]f32{ 0.2, 0.2, 0.2 }, // Default value
         .diffuse = [3]f32{ 0.8, 0.8, 0.8 }, // Default value
         .specular = [3]f32{ 0.0, 0.0, 0.0 }, // Default value
         .texturePath = null,
-        .texture = null,
         .normalMapPath = null,
-        .normalMap = null,
         .roughnessMapPath = null,
-        .roughnessMap = null,
         .metallicMapPath = null,
-        .metallicMap = null,
     };
+    errdefer materials.allocator.free(material.name);
 
-    try obj.materials.append(material);
+    try materials.append(material);
 }
 
 /// Handle the ambient color of the material
-fn handleAmbient(content: []const u8, obj: *ObjectStruct) !void {
+fn handleAmbient(content: []const u8, materials: *std.ArrayList(Material)) !void {
     // Ensure there's at least one material
-    if (obj.materials.items.len == 0) return error.NoMaterialDefined;
+    if (materials.items.len == 0) return error.NoMaterialDefined;
 
     // Get the last material (current one being parsed)
-    var material = &obj.materials.items[obj.materials.items.len - 1];
+    var material = &materials.items[materials.items.len - 1];
     const ambient = try get3CoordsFromString(content);
 
     material.ambient = ambient;
 }
 
 /// Handle the diffuse color of the material
-fn handleDiffuse(content: []const u8, obj: *ObjectStruct) !void {
-    if (obj.materials.items.len == 0) return error.NoMaterialDefined;
-    var material = &obj.materials.items[obj.materials.items.len - 1];
+fn handleDiffuse(content: []const u8, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
     const diffuse = try get3CoordsFromString(content);
 
     material.diffuse = diffuse;
 }
 
 /// Handle the specular color of the material
-fn handleSpecular(content: []const u8, obj: *ObjectStruct) !void {
-    if (obj.materials.items.len == 0) return error.NoMaterialDefined;
-    var material = &obj.materials.items[obj.materials.items.len - 1];
+fn handleSpecular(content: []const u8, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
     const specular = try get3CoordsFromString(content);
 
     material.specular = specular;
 }
 
-/// Handle normal map path of material
-fn handleNormalMapPath(content: []const u8, obj: *ObjectStruct) !void {
-    if (obj.materials.items.len == 0) return error.NoMaterialDefined;
-    var material = &obj.materials.items[obj.materials.items.len - 1];
+/// Handle the scalar roughness of the material
+fn handleRoughness(content: []const u8, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
 
-    const result = try loadTextureFromFile(obj, content, 4);
-    material.normalMap = result.image;
-    material.normalMapId = result.textureId;
-    material.normalMapPath = result.path;
+    material.roughness = try std.fmt.parseFloat(f32, mem.trim(u8, content, &std.ascii.whitespace));
 }
 
-/// Handle the texture path of material
-fn handleTexturePath(content: []const u8, obj: *ObjectStruct) !void {
-    if (obj.materials.items.len == 0) return error.NoMaterialDefined;
-    var material = &obj.materials.items[obj.materials.items.len - 1];
+/// Handle the scalar metallic value of the material
+fn handleMetallic(content: []const u8, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
 
-    const result = try loadTextureFromFile(obj, content, 4);
-    material.texture = result.image;
-    material.textureId = result.textureId;
-    material.texturePath = result.path;
+    material.metallic = try std.fmt.parseFloat(f32, mem.trim(u8, content, &std.ascii.whitespace));
 }
 
-/// Handle the roughness map path of material
-fn handleRoughnessMapPath(content: []const u8, obj: *ObjectStruct) !void {
-    if (obj.materials.items.len == 0) return error.NoMaterialDefined;
-    var material = &obj.materials.items[obj.materials.items.len - 1];
+/// Handle the dissolve (d) or transparency (Tr = 1 - d) of the material
+fn handleOpacity(content: []const u8, inverted: bool, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
 
-    const result = try loadTextureFromFile(obj, content, 4);
-    material.roughnessMap = result.image;
-    material.roughnessMapId = result.textureId;
-    material.roughnessMapPath = result.path;
+    // "d -halo 0.5" is read as 0.5
+    var tokens = mem.tokenizeAny(u8, content, &std.ascii.whitespace);
+    var token = tokens.next() orelse return error.InvalidOpacity;
+    if (mem.eql(u8, token, "-halo")) token = tokens.next() orelse return error.InvalidOpacity;
+
+    const value = std.math.clamp(try std.fmt.parseFloat(f32, token), 0.0, 1.0);
+    material.opacity = if (inverted) 1.0 - value else value;
 }
 
-/// Handle the metallic map path of material
-fn handleMetallicMapPath(content: []const u8, obj: *ObjectStruct) !void {
-    if (obj.materials.items.len == 0) return error.NoMaterialDefined;
-    var material = &obj.materials.items[obj.materials.items.len - 1];
+/// Handle normal map path of material, decoded by decodeTextures
+fn handleNormalMapPath(content: []const u8, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
 
-    const result = try loadTextureFromFile(obj, content, 1);
-    material.metallicMap = result.image;
-    material.metallicMapId = result.textureId;
-    material.metallicMapPath = result.path;
+    try setMapPath(&material.normalMapPath, content, materials.allocator);
 }
 
-/// Load a texture from a file
-fn loadTextureFromFile(obj: *ObjectStruct, content: []const u8, components: u8) !struct { image: zstbi.Image, textureId: gl.uint, path: []const u8 } {
-    // Path building
-    var texturePath: []const u8 = undefined;
-    if (validator.fileExists(content)) {
-        texturePath = content;
-    } else {
-        texturePath = try std.fs.path.join(obj.allocator, &[_][]const u8{ objDir, content });
+/// Handle the texture path of material, decoded by decodeTextures
+fn handleTexturePath(content: []const u8, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
+
+    try setMapPath(&material.texturePath, content, materials.allocator);
+}
+
+/// Handle the roughness map path of material, decoded by decodeTextures
+fn handleRoughnessMapPath(content: []const u8, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
+
+    try setMapPath(&material.roughnessMapPath, content, materials.allocator);
+}
+
+/// Handle the metallic map path of material, decoded by decodeTextures
+fn handleMetallicMapPath(content: []const u8, materials: *std.ArrayList(Material)) !void {
+    if (materials.items.len == 0) return error.NoMaterialDefined;
+    var material = &materials.items[materials.items.len - 1];
+
+    try setMapPath(&material.metallicMapPath, content, materials.allocator);
+}
+
+/// Save the path of a map as written in the file, a repeated map line replaces the previous one
+fn setMapPath(path: *?[]const u8, content: []const u8, allocator: std.mem.Allocator) !void {
+    const savedPath = try allocator.dupe(u8, content);
+    if (path.*) |previous| allocator.free(previous);
+    path.* = savedPath;
+}
+
+/// Map of a material to decode
+///
+/// Contains:
+/// - path: path as written in the .mtl file
+/// - components: channels to decode
+/// - image: decoded image of the material
+/// - result: outcome of the decode
+const TextureJob = struct {
+    path: []const u8,
+    components: u8,
+    image: *?zstbi.Image,
+    result: anyerror!void = {},
+};
+
+/// Texture jobs shared by the decode threads, each thread takes the next job until none are left
+const DecodeJob = struct {
+    directory: []const u8,
+    textures: []TextureJob,
+    allocator: std.mem.Allocator,
+    next: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+
+    fn run(self: *DecodeJob) void {
+        defer diagnostics.flush();
+        while (true) {
+            const index = self.next.fetchAdd(1, .monotonic);
+            if (index >= self.textures.len) return;
+
+            const texture = &self.textures[index];
+            texture.result = decodeTexture(self.directory, texture, self.allocator);
+        }
+    }
+};
+
+/// Decode all maps of the materials, in parallel on up to MAX_THREADS threads (including the calling thread)
+fn decodeTextures(directory: []const u8, materials: []Material, allocator: std.mem.Allocator) !void {
+    var textures = std.ArrayList(TextureJob).init(allocator);
+    defer textures.deinit();
+
+    for (materials) |*material| {
+        if (material.texturePath) |path| try textures.append(.{ .path = path, .components = 4, .image = &material.texture });
+        if (material.normalMapPath) |path| try textures.append(.{ .path = path, .components = 4, .image = &material.normalMap });
+        if (material.roughnessMapPath) |path| try textures.append(.{ .path = path, .components = 4, .image = &material.roughnessMap });
+        if (material.metallicMapPath) |path| try textures.append(.{ .path = path, .components = 1, .image = &material.metallicMap });
     }
-    const cleanPath = validator.trimString(texturePath);
+    if (textures.items.len == 0) return;
 
-    // Convert to null-terminated string
-    const texturePathZ = try obj.allocator.dupeZ(u8, cleanPath);
-    defer obj.allocator.free(texturePathZ);
+    var job = DecodeJob{ .directory = directory, .textures = textures.items, .allocator = allocator };
+
+    const cpuCount = std.Thread.getCpuCount() catch 1;
+    const threadCount = @max(@min(@min(cpuCount, MAX_THREADS), textures.items.len), 1);
+
+    var threads: [MAX_THREADS]?std.Thread = [_]?std.Thread{null} ** MAX_THREADS;
+    for (1..threadCount) |i| {
+        threads[i] = std.Thread.spawn(.{}, DecodeJob.run, .{&job}) catch null;
+    }
+    job.run();
+    for (threads) |thread| {
+        if (thread) |t| t.join();
+    }
+
+    for (textures.items) |texture| {
+        try texture.result;
+    }
+}
+
+/// Decode a texture from a file, relative paths start at the directory of the .obj file
+fn decodeTexture(directory: []const u8, texture: *TextureJob, allocator: std.mem.Allocator) !void {
+    // Path building
+    const name = validator.trimString(texture.path);
+    const texturePathZ = if (validator.fileExists(name))
+        try allocator.dupeZ(u8, name)
+    else
+        try std.fs.path.joinZ(allocator, &.{ directory, name });
+    defer allocator.free(texturePathZ);
 
     // Loading image
-    const image = try zstbi.Image.loadFromFile(texturePathZ, components);
+    texture.image.* = try imageDecoder.loadFromFile(texturePathZ, texture.components, true); // .obj UVs start at the bottom
+}
+
+/// Upload the decoded maps of all materials, call on the GL thread after joinMaterials
+fn uploadMaterials(obj: *ObjectStruct) void {
+    for (obj.materials.items) |*material| {
+        if (material.texture) |image| material.textureId = uploadTexture(image, material.texturePath.?);
+        if (material.normalMap) |image| material.normalMapId = uploadTexture(image, material.normalMapPath.?);
+        if (material.roughnessMap) |image| material.roughnessMapId = uploadTexture(image, material.roughnessMapPath.?);
+        if (material.metallicMap) |image| material.metallicMapId = uploadTexture(image, material.metallicMapPath.?);
+    }
+}
 
+/// Upload a decoded image as OpenGL texture
+/// The name labels the texture in debug output and frame captures
+pub fn uploadTexture(image: zstbi.Image, name: []const u8) gl.uint {
     // Generating OpenGL texture
     var textureId: gl.uint = 0;
     gl.GenTextures(1, (&textureId)[0..1]);
@@ -462,22 +737,73 @@ fn loadTextureFromFile(obj: *ObjectStruct, content: []const u8, components: u8)
 
     // Upload texture data to GPU
     gl.TexImage2D(gl.TEXTURE_2D, 0, @intCast(format), @intCast(image.width), @intCast(image.height), 0, format, gl.UNSIGNED_BYTE, image.data.ptr);
+    memory.trackGpu(.texture, textureId, memory.textureBytes(image.width, image.height, image.num_components));
+    glDebug.label(.texture, textureId, "{s}", .{name});
 
-    // Save path from file
-    const savedPath = try obj.allocator.dupe(u8, content);
-
-    return .{ .image = image, .textureId = textureId, .path = savedPath };
+    return textureId;
 }
 
 /// Add the object name to the object struct
+/// The first o line names the whole object, later ones only name their group
 fn handleObjectName(content: []const u8, obj: *ObjectStruct) !void {
-    obj.name.clearRetainingCapacity(); // Clear the name
-    try obj.name.appendSlice(content); // Append the new name
+    if (obj.name.items.len > 0) return;
+    try obj.name.appendSlice(content);
 }
 
-/// Add the material file name to the object struct
+/// Start a new group, the faces that follow belong to it
+fn handleGroup(content: []const u8, kind: GroupKind, obj: *ObjectStruct) !void {
+    const name = try obj.allocator.dupe(u8, validator.trimString(content));
+    errdefer obj.allocator.free(name);
+    try obj.groups.append(.{ .name = name, .kind = kind, .firstFace = obj.ebo.items.len });
+}
+
+/// Add the material file name to the object struct and start preparing the materials
+/// Only the first mtllib line is used
 fn handleMtlFileName(content: []const u8, obj: *ObjectStruct) !void {
+    if (obj.mtllib.len > 0) return;
     obj.mtllib = try obj.allocator.dupe(u8, content);
+
+    if (obj.materialJob) |job| {
+        try startMaterials(job, obj.mtllib);
+    }
+}
+
+/// Select the material of the following faces
+/// Faces keep the index of the name until resolveFaceMaterials, the .mtl file may still be loading
+fn handleUseMaterial(content: []const u8, obj: *ObjectStruct) !void {
+    const name = validator.trimString(content);
+    for (obj.materialNames.items, 0..) |known, index| {
+        if (mem.eql(u8, known, name)) {
+            obj.currentMaterial = index;
+            return;
+        }
+    }
+
+    const savedName = try obj.allocator.dupe(u8, name);
+    errdefer obj.allocator.free(savedName);
+    try obj.materialNames.append(savedName);
+    obj.currentMaterial = obj.materialNames.items.len - 1;
+}
+
+/// Replace the usemtl name indices of the faces with material indices
+/// Faces without usemtl or with an unknown name use the first material
+fn resolveFaceMaterials(obj: *ObjectStruct) !void {
+    const lookup = try obj.allocator.alloc(usize, obj.materialNames.items.len);
+    defer obj.allocator.free(lookup);
+
+    for (obj.materialNames.items, lookup) |name, *index| {
+        index.* = 0;
+        for (obj.materials.items, 0..) |material, materialIndex| {
+            if (mem.eql(u8, material.name, name)) {
+                index.* = materialIndex;
+                break;
+            }
+        }
+    }
+
+    for (obj.faceMaterialIndices.items) |*index| {
+        index.* = if (index.* == NO_MATERIAL) 0 else lookup[index.*];
+    }
 }
 
 /// Add a vertex to the object struct
@@ -491,6 +817,23 @@ fn handleVertex(content: []const u8, obj: *ObjectStruct) !void {
     } };
 
     try obj.vbo.append(vertex);
+
+    // Optional vertex color extension (v x y z r g b), only with exactly 6 components
+    // A 4th component alone is the homogeneous w of the standard and is ignored
+    var components = mem.tokenize(u8, content, " \t\r");
+    var tokens: [7][]const u8 = undefined;
+    var count: usize = 0;
+    while (components.next()) |token| : (count += 1) {
+        if (count == tokens.len) return;
+        tokens[count] = token;
+    }
+    if (count != 6) return;
+
+    try obj.colors.append(.{
+        try std.fmt.parseFloat(f32, tokens[3]),
+        try std.fmt.parseFloat(f32, tokens[4]),
+        try std.fmt.parseFloat(f32, tokens[5]),
+    });
 }
 
 /// Add a face to the object struct
@@ -509,8 +852,7 @@ fn handleFace(content: []const u8, obj: *ObjectStruct) !void {
 
         // Vertex index (required)
         const vIdxStr = iter.next() orelse {
-            errors.errorCollector.reportError(errors.ErrorCode.ObjFileMalformed);
-            std.log.err("No further vertex index found!", .{});
+            diagnostics.report(.ObjFileMalformed, obj.line, "No further vertex index found", .{});
             return;
         };
         const vIdx = (try std.fmt.parseInt(usize, vIdxStr, 10)) - 1;
@@ -533,9 +875,7 @@ fn handleFace(content: []const u8, obj: *ObjectStruct) !void {
     // Triangulate the face
     const numVertices = vertices.items.len;
     if (numVertices < 3) {
-        errors.errorCollector.reportError(errors.ErrorCode.ObjFileMalformed);
-        std.log.err("Too few Vertices for face (<3): {d}", .{numVertices});
-        std.log.err("CONTENT: {s}", .{content});
+        diagnostics.report(.ObjFileMalformed, obj.line, "Too few vertices for face ({d}): {s}", .{ numVertices, content });
         return;
     }
 
@@ -551,14 +891,13 @@ fn handleFace(content: []const u8, obj: *ObjectStruct) !void {
         11 => &[_][3]usize{ .{ 0, 1, 2 }, .{ 0, 2, 3 }, .{ 0, 3, 4 }, .{ 0, 4, 5 }, .{ 0, 5, 6 }, .{ 0, 6, 7 }, .{ 0, 7, 8 }, .{ 0, 8, 9 }, .{ 0, 9, 10 } }, // Hendecagon → 9 triangles
         12 => &[_][3]usize{ .{ 0, 1, 2 }, .{ 0, 2, 3 }, .{ 0, 3, 4 }, .{ 0, 4, 5 }, .{ 0, 5, 6 }, .{ 0, 6, 7 }, .{ 0, 7, 8 }, .{ 0, 8, 9 }, .{ 0, 9, 10 }, .{ 0, 10, 11 } }, // Dodecagon → 10 triangles
         else => {
-            errors.errorCollector.reportError(errors.ErrorCode.ObjFileMalformed);
-            std.log.err("Wrong Vertices amount for face: {d}", .{numVertices});
-            std.log.err("CONTENT: {s}", .{content});
+            diagnostics.report(.ObjFileMalformed, obj.line, "Too many vertices for face ({d}): {s}", .{ numVertices, content });
             return;
         },
     };
 
     // Add each triangle to EBO
+    const materialIndex = obj.currentMaterial orelse NO_MATERIAL;
     for (triangles) |tri| {
         var face = Face{
             .face = undefined,
@@ -573,14 +912,6 @@ fn handleFace(content: []const u8, obj: *ObjectStruct) !void {
             face.normalIndices[i] = vertex.vn;
         }
 
-        // Find material index for the current face
-        const materialIndex = if (obj.currentMaterialName) |name| blk: {
-            for (obj.materials.items, 0..) |mat, idx| {
-                if (mem.eql(u8, mat.name, name)) break :blk idx;
-            }
-            break :blk 0; // Fallback to first material
-        } else 0;
-
         try obj.ebo.append(face);
         try obj.faceMaterialIndices.append(materialIndex);
     }
@@ -0,0 +1,627 @@
+//! Parse .ply files (ASCII and binary) into the custom object struct
+//!
+//! Maps the file and compiles the header's vertex properties into a layout of byte offsets.
+//! Binary vertex records are gathered in parallel chunks with loops specialized per scalar type.
+//! Variable-length face lists are indexed sequentially once and triangulated in parallel chunks.
+//! The result feeds the same mesh building path as .obj files.
+
+const std = @import("std");
+
+const objectLoader = @import("objectLoader.zig");
+const diagnostics = @import("../util/diagnostics.zig");
+const mappedFile = @import("../util/mappedFile.zig");
+
+const MAX_THREADS = 8;
+const CHUNK_SIZE = 1 << 16; // Records per parallel work item
+
+/// Scalar property types
+const ScalarType = enum {
+    i8,
+    u8,
+    i16,
+    u16,
+    i32,
+    u32,
+    f32,
+    f64,
+
+    fn parse(name: []const u8) ?ScalarType {
+        const names = [_]struct { []const u8, ScalarType }{
+            .{ "char", .i8 },    .{ "int8", .i8 },
+            .{ "uchar", .u8 },   .{ "uint8", .u8 },
+            .{ "short", .i16 },  .{ "int16", .i16 },
+            .{ "ushort", .u16 }, .{ "uint16", .u16 },
+            .{ "int", .i32 },    .{ "int32", .i32 },
+            .{ "uint", .u32 },   .{ "uint32", .u32 },
+            .{ "float", .f32 },  .{ "float32", .f32 },
+            .{ "double", .f64 }, .{ "float64", .f64 },
+        };
+        for (names) |entry| {
+            if (std.mem.eql(u8, name, entry[0])) return entry[1];
+        }
+        return null;
+    }
+
+    fn size(self: ScalarType) usize {
+        return switch (self) {
+            .i8, .u8 => 1,
+            .i16, .u16 => 2,
+            .i32, .u32, .f32 => 4,
+            .f64 => 8,
+        };
+    }
+};
+
+/// File encoding from the format line
+const Format = enum {
+    ascii,
+    binary_little_endian,
+    binary_big_endian,
+};
+
+/// Property of an element, list properties have a count type
+const Property = struct {
+    name: []const u8,
+    valueType: ScalarType,
+    countType: ?ScalarType = null,
+};
+
+/// Element declared in the header (vertex, face, ...)
+const Element = struct {
+    name: []const u8,
+    count: usize,
+    properties: std.ArrayList(Property),
+
+    fn findProperty(self: *const Element, names: []const []const u8) ?usize {
+        for (self.properties.items, 0..) |property, i| {
+            for (names) |name| {
+                if (std.mem.eql(u8, property.name, name)) return i;
+            }
+        }
+        return null;
+    }
+
+    /// Byte size of a record, null if the element contains lists
+    fn recordSize(self: *const Element) ?usize {
+        var total: usize = 0;
+        for (self.properties.items) |property| {
+            if (property.countType != null) return null;
+            total += property.valueType.size();
+        }
+        return total;
+    }
+
+    /// Byte offset of a property inside a fixed size record
+    fn offsetOf(self: *const Element, index: usize) usize {
+        var offset: usize = 0;
+        for (self.properties.items[0..index]) |property| {
+            offset += property.valueType.size();
+        }
+        return offset;
+    }
+};
+
+/// Three properties gathered into one [3]f32 (or [2]f32) attribute
+const Field3 = struct {
+    offsets: [3]usize,
+    valueType: ScalarType,
+    scale: f32 = 1.0,
+};
+
+/// Compiled vertex layout, byte offsets into a vertex record
+const VertexLayout = struct {
+    stride: usize,
+    position: Field3,
+    normal: ?Field3 = null,
+    color: ?Field3 = null,
+    texCoord: ?Field3 = null, // Only the first two offsets are used
+};
+
+/// Header of a .ply file
+const Header = struct {
+    format: Format,
+    elements: std.ArrayList(Element),
+    bodyStart: usize,
+
+    fn deinit(self: *Header) void {
+        for (self.elements.items) |*element| {
+            element.properties.deinit();
+        }
+        self.elements.deinit();
+    }
+};
+
+/// Load a .ply file into the object struct
+pub fn load(path: []const u8, obj: *objectLoader.ObjectStruct) !void {
+    var file = try mappedFile.MappedFile.open(obj.allocator, path);
+    defer file.close();
+
+    var header = try parseHeader(file.data, obj.allocator);
+    defer header.deinit();
+
+    var cursor = header.bodyStart;
+    for (header.elements.items) |*element| {
+        const isVertex = std.mem.eql(u8, element.name, "vertex");
+        const isFace = std.mem.eql(u8, element.name, "face");
+
+        switch (header.format) {
+            .ascii => {
+                cursor = try readAsciiElement(file.data, cursor, element, isVertex, isFace, obj);
+            },
+            .binary_little_endian, .binary_big_endian => {
+                const endian: std.builtin.Endian = if (header.format == .binary_little_endian) .little else .big;
+                if (isVertex) {
+                    cursor = try readBinaryVertices(file.data, cursor, element, endian, obj);
+                } else if (isFace) {
+                    cursor = try readBinaryFaces(file.data, cursor, element, endian, obj);
+                } else {
+                    cursor = try skipBinaryElement(file.data, cursor, element, endian);
+                }
+            },
+        }
+    }
+}
+
+/// Parse the header lines up to end_header
+fn parseHeader(data: []const u8, allocator: std.mem.Allocator) !Header {
+    var header = Header{
+        .format = .ascii,
+        .elements = std.ArrayList(Element).init(allocator),
+        .bodyStart = 0,
+    };
+    errdefer header.deinit();
+
+    var lineStart: usize = 0;
+    var lineNumber: usize = 0;
+    var formatSeen = false;
+    while (lineStart < data.len) : (lineNumber += 1) {
+        const lineEnd = std.mem.indexOfScalarPos(u8, data, lineStart, '\n') orelse return error.InvalidPlyHeader;
+        const line = std.mem.trimRight(u8, data[lineStart..lineEnd], "\r");
+        lineStart = lineEnd + 1;
+
+        var tokens = std.mem.tokenizeAny(u8, line, " \t");
+        const keyword = tokens.next() orelse continue;
+
+        if (lineNumber == 0) {
+            if (!std.mem.eql(u8, keyword, "ply")) return error.InvalidPlyHeader;
+        } else if (std.mem.eql(u8, keyword, "format")) {
+            const name = tokens.next() orelse return error.InvalidPlyHeader;
+            header.format = std.meta.stringToEnum(Format, name) orelse return error.InvalidPlyHeader;
+            formatSeen = true;
+        } else if (std.mem.eql(u8, keyword, "element")) {
+            const name = tokens.next() orelse return error.InvalidPlyHeader;
+            const count = try std.fmt.parseInt(usize, tokens.next() orelse return error.InvalidPlyHeader, 10);
+            try header.elements.append(.{
+                .name = name,
+                .count = count,
+                .properties = std.ArrayList(Property).init(allocator),
+            });
+        } else if (std.mem.eql(u8, keyword, "property")) {
+            if (header.elements.items.len == 0) return error.InvalidPlyHeader;
+            const element = &header.elements.items[header.elements.items.len - 1];
+
+            const typeName = tokens.next() orelse return error.InvalidPlyHeader;
+            var property: Property = undefined;
+            if (std.mem.eql(u8, typeName, "list")) {
+                property.countType = ScalarType.parse(tokens.next() orelse return error.InvalidPlyHeader) orelse return error.InvalidPlyHeader;
+                property.valueType = ScalarType.parse(tokens.next() orelse return error.InvalidPlyHeader) orelse return error.InvalidPlyHeader;
+            } else {
+                property.countType = null;
+                property.valueType = ScalarType.parse(typeName) orelse return error.InvalidPlyHeader;
+            }
+            property.name = tokens.next() orelse return error.InvalidPlyHeader;
+            try element.properties.append(property);
+        } else if (std.mem.eql(u8, keyword, "end_header")) {
+            if (!formatSeen) return error.InvalidPlyHeader;
+            header.bodyStart = lineStart;
+            return header;
+        }
+        // comment and obj_info lines are ignored
+    }
+    return error.InvalidPlyHeader;
+}
+
+/// Read one scalar, specialized at compile time per type and byte order
+inline fn readScalar(comptime valueType: ScalarType, comptime endian: std.builtin.Endian, bytes: []const u8) f64 {
+    return switch (valueType) {
+        .i8 => @floatFromInt(@as(i8, @bitCast(bytes[0]))),
+        .u8 => @floatFromInt(bytes[0]),
+        .i16 => @floatFromInt(std.mem.readInt(i16, bytes[0..2], endian)),
+        .u16 => @floatFromInt(std.mem.readInt(u16, bytes[0..2], endian)),
+        .i32 => @floatFromInt(std.mem.readInt(i32, bytes[0..4], endian)),
+        .u32 => @floatFromInt(std.mem.readInt(u32, bytes[0..4], endian)),
+        .f32 => @as(f32, @bitCast(std.mem.readInt(u32, bytes[0..4], endian))),
+        .f64 => @bitCast(std.mem.readInt(u64, bytes[0..8], endian)),
+    };
+}
+
+/// Read one scalar of a type known only at runtime
+fn readScalarRuntime(valueType: ScalarType, endian: std.builtin.Endian, bytes: []const u8) f64 {
+    return switch (endian) {
+        inline else => |e| switch (valueType) {
+            inline else => |t| readScalar(t, e, bytes),
+        },
+    };
+}
+
+/// Strided gather of N components per record, one loop per type and byte order
+fn gather(comptime N: usize, comptime valueType: ScalarType, comptime endian: std.builtin.Endian, records: []const u8, stride: usize, field: Field3, out: [][N]f32) void {
+    for (out, 0..) |*value, i| {
+        const record = records[i * stride ..];
+        inline for (0..N) |c| {
+            value[c] = @floatCast(readScalar(valueType, endian, record[field.offsets[c]..]) * field.scale);
+        }
+    }
+}
+
+/// Dispatch to the specialized gather loop
+fn gatherField(comptime N: usize, endian: std.builtin.Endian, records: []const u8, stride: usize, field: Field3, out: [][N]f32) void {
+    switch (endian) {
+        inline else => |e| switch (field.valueType) {
+            inline else => |t| gather(N, t, e, records, stride, field, out),
+        },
+    }
+}
+
+/// Compile the vertex properties into byte offsets
+fn compileVertexLayout(element: *const Element) !VertexLayout {
+    const stride = element.recordSize() orelse return error.UnsupportedPlyVertexList;
+
+    const field = struct {
+        fn get(e: *const Element, names: [3][]const []const u8) ?Field3 {
+            var result = Field3{ .offsets = undefined, .valueType = undefined };
+            for (names, 0..) |alternatives, c| {
+                const index = e.findProperty(alternatives) orelse return null;
+                const valueType = e.properties.items[index].valueType;
+                if (c > 0 and valueType != result.valueType) return null; // Mixed types use separate fields
+                result.valueType = valueType;
+                result.offsets[c] = e.offsetOf(index);
+            }
+            return result;
+        }
+    };
+
+    var layout = VertexLayout{
+        .stride = stride,
+        .position = field.get(element, .{ &.{"x"}, &.{"y"}, &.{"z"} }) orelse return error.PlyMissingPosition,
+        .normal = field.get(element, .{ &.{"nx"}, &.{"ny"}, &.{"nz"} }),
+        .color = field.get(element, .{ &.{ "red", "r" }, &.{ "green", "g" }, &.{ "blue", "b" } }),
+        .texCoord = field.get(element, .{ &.{ "u", "s", "texture_u" }, &.{ "v", "t", "texture_v" }, &.{ "u", "s", "texture_u" } }),
+    };
+
+    // 8 bit colors are normalized to 0..1
+    if (layout.color) |*color| {
+        if (color.valueType == .u8) color.scale = 1.0 / 255.0;
+    }
+
+    return layout;
+}
+
+/// Work item for a chunk of vertices
+const VertexJob = struct {
+    records: []const u8,
+    layout: *const VertexLayout,
+    endian: std.builtin.Endian,
+    obj: *objectLoader.ObjectStruct,
+    nextChunk: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    count: usize,
+
+    fn run(self: *VertexJob) void {
+        while (true) {
+            const chunk = self.nextChunk.fetchAdd(1, .monotonic);
+            const start = chunk * CHUNK_SIZE;
+            if (start >= self.count) return;
+            const end = @min(start + CHUNK_SIZE, self.count);
+            const records = self.records[start * self.layout.stride ..];
+
+            const positions: [][3]f32 = @ptrCast(self.obj.vbo.items[start..end]);
+            gatherField(3, self.endian, records, self.layout.stride, self.layout.position, positions);
+            if (self.layout.normal) |normal| {
+                gatherField(3, self.endian, records, self.layout.stride, normal, self.obj.normals.items[start..end]);
+            }
+            if (self.layout.color) |color| {
+                gatherField(3, self.endian, records, self.layout.stride, color, self.obj.colors.items[start..end]);
+            }
+            if (self.layout.texCoord) |texCoord| {
+                gatherField(2, self.endian, records, self.layout.stride, texCoord, self.obj.texCoords.items[start..end]);
+            }
+        }
+    }
+};
+
+/// Run a job on up to MAX_THREADS threads (including the calling thread)
+fn runParallel(comptime Job: type, job: *Job, count: usize) void {
+    const cpuCount = std.Thread.getCpuCount() catch 1;
+    const chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    const threadCount = @max(@min(@min(cpuCount, MAX_THREADS), chunks), 1);
+
+    var threads: [MAX_THREADS]?std.Thread = [_]?std.Thread{null} ** MAX_THREADS;
+    for (1..threadCount) |i| {
+        threads[i] = std.Thread.spawn(.{}, Job.run, .{job}) catch null;
+    }
+    job.run();
+    for (threads) |thread| {
+        if (thread) |t| t.join();
+    }
+}
+
+/// Read the binary vertex element with the compiled layout
+fn readBinaryVertices(data: []const u8, start: usize, element: *const Element, endian: std.builtin.Endian, obj: *objectLoader.ObjectStruct) !usize {
+    const layout = try compileVertexLayout(element);
+    const end = try elementEnd(start, layout.stride, element.count, data.len);
+    const size = end - start;
+
+    try obj.vbo.resize(element.count);
+    if (layout.normal != null) try obj.normals.resize(element.count);
+    if (layout.color != null) try obj.colors.resize(element.count);
+    if (layout.texCoord != null) try obj.texCoords.resize(element.count);
+
+    var job = VertexJob{
+        .records = data[start..][0..size],
+        .layout = &layout,
+        .endian = endian,
+        .obj = obj,
+        .count = element.count,
+    };
+    runParallel(VertexJob, &job, element.count);
+
+    return end;
+}
+
+/// End of count fixed size records at start, the count comes from the header and may be anything
+fn elementEnd(start: usize, recordSize: usize, count: usize, dataLength: usize) !usize {
+    const size = std.math.mul(usize, recordSize, count) catch return error.PlyTruncated;
+    const end = std.math.add(usize, start, size) catch return error.PlyTruncated;
+    if (end > dataLength) return error.PlyTruncated;
+    return end;
+}
+
+/// Chunk of faces, found by the sequential pass over the variable-length records
+const FaceChunk = struct {
+    offset: usize, // Byte offset of the first face
+    firstTriangle: usize,
+};
+
+/// Work item for chunks of faces
+const FaceJob = struct {
+    data: []const u8,
+    element: *const Element,
+    listIndex: usize,
+    endian: std.builtin.Endian,
+    chunks: []const FaceChunk,
+    obj: *objectLoader.ObjectStruct,
+    hasTexCoords: bool,
+    hasNormals: bool,
+    nextChunk: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    invalidIndex: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    fn run(self: *FaceJob) void {
+        const vertexCount = self.obj.vbo.items.len;
+        while (true) {
+            const chunkIndex = self.nextChunk.fetchAdd(1, .monotonic);
+            if (chunkIndex >= self.chunks.len) return;
+            const chunk = self.chunks[chunkIndex];
+            const faceCount = @min(CHUNK_SIZE, self.element.count - chunkIndex * CHUNK_SIZE);
+
+            var offset = chunk.offset;
+            var triangle = chunk.firstTriangle;
+            for (0..faceCount) |_| {
+                for (self.element.properties.items, 0..) |property, p| {
+                    const countType = property.countType orelse {
+                        offset += property.valueType.size();
+                        continue;
+                    };
+                    // Validated by the sequential pass in readBinaryFaces
+                    const n = toCount(readScalarRuntime(countType, self.endian, self.data[offset..])) catch unreachable;
+                    offset += countType.size();
+
+                    // Triangle fan over the vertex indices
+                    if (p == self.listIndex and n >= 3) {
+                        const valueSize = property.valueType.size();
+                        const first = self.readIndex(property.valueType, offset, vertexCount);
+                        var previous = self.readIndex(property.valueType, offset + valueSize, vertexCount);
+                        for (2..n) |k| {
+                            const current = self.readIndex(property.valueType, offset + k * valueSize, vertexCount);
+                            const face = [3]usize{ first, previous, current };
+                            self.obj.ebo.items[triangle] = .{
+                                .face = face,
+                                .texCoordIndices = if (self.hasTexCoords) face else .{ 0, 0, 0 },
+                                .normalIndices = if (self.hasNormals) face else .{ 0, 0, 0 },
+                            };
+                            previous = current;
+                            triangle += 1;
+                        }
+                    }
+                    offset += n * property.valueType.size();
+                }
+            }
+        }
+    }
+
+    /// Read a vertex index, out of range indices are replaced by 0 and reported
+    fn readIndex(self: *FaceJob, valueType: ScalarType, offset: usize, vertexCount: usize) usize {
+        const value = readScalarRuntime(valueType, self.endian, self.data[offset..]);
+        if (!(value >= 0 and value < @as(f64, @floatFromInt(vertexCount)))) { // NaN fails as well
+            self.invalidIndex.store(true, .monotonic);
+            return 0;
+        }
+        return @intFromFloat(value);
+    }
+};
+
+/// Convert a list count or vertex index stored as any scalar type
+/// NaN, negative, fractional and values beyond uint32 are rejected before the cast
+fn toCount(value: f64) !usize {
+    if (!(value >= 0) or value > std.math.maxInt(u32) or value != @floor(value)) return error.InvalidPly;
+    return @intFromFloat(value);
+}
+
+/// Read the binary face element, triangulating the index lists in parallel
+fn readBinaryFaces(data: []const u8, start: usize, element: *const Element, endian: std.builtin.Endian, obj: *objectLoader.ObjectStruct) !usize {
+    const listIndex = element.findProperty(&.{ "vertex_indices", "vertex_index" }) orelse return error.PlyMissingFaceIndices;
+    if (element.properties.items[listIndex].countType == null) return error.PlyMissingFaceIndices;
+
+    // Sequential pass: record the start of every chunk and count triangles
+    var chunks = std.ArrayList(FaceChunk).init(obj.allocator);
+    defer chunks.deinit();
+
+    var offset = start;
+    var triangleCount: usize = 0;
+    for (0..element.count) |f| {
+        if (f % CHUNK_SIZE == 0) {
+            try chunks.append(.{ .offset = offset, .firstTriangle = triangleCount });
+        }
+        for (element.properties.items, 0..) |property, p| {
+            const countType = property.countType orelse {
+                offset += property.valueType.size();
+                continue;
+            };
+            if (offset + countType.size() > data.len) return error.PlyTruncated;
+            const n = try toCount(readScalarRuntime(countType, endian, data[offset..]));
+            offset += countType.size() + n * property.valueType.size();
+            if (p == listIndex and n >= 3) triangleCount += n - 2;
+        }
+        if (offset > data.len) return error.PlyTruncated;
+    }
+
+    // Parallel pass: triangulate into the preallocated faces
+    const firstTriangle = obj.ebo.items.len;
+    try obj.ebo.resize(firstTriangle + triangleCount);
+    try obj.faceMaterialIndices.appendNTimes(0, triangleCount);
+    for (chunks.items) |*chunk| {
+        chunk.firstTriangle += firstTriangle;
+    }
+
+    var job = FaceJob{
+        .data = data,
+        .element = element,
+        .listIndex = listIndex,
+        .endian = endian,
+        .chunks = chunks.items,
+        .obj = obj,
+        .hasTexCoords = obj.texCoords.items.len == obj.vbo.items.len and obj.texCoords.items.len > 0,
+        .hasNormals = obj.normals.items.len == obj.vbo.items.len and obj.normals.items.len > 0,
+    };
+    runParallel(FaceJob, &job, element.count);
+
+    if (job.invalidIndex.load(.monotonic)) {
+        diagnostics.report(.ObjFileMalformed, 0, "PLY face references a vertex that does not exist", .{});
+    }
+
+    return offset;
+}
+
+/// Skip a binary element that is not used
+fn skipBinaryElement(data: []const u8, start: usize, element: *const Element, endian: std.builtin.Endian) !usize {
+    if (element.recordSize()) |size| {
+        return elementEnd(start, size, element.count, data.len);
+    }
+
+    var offset = start;
+    for (0..element.count) |_| {
+        for (element.properties.items) |property| {
+            const countType = property.countType orelse {
+                offset += property.valueType.size();
+                continue;
+            };
+            if (offset + countType.size() > data.len) return error.PlyTruncated;
+            const n = try toCount(readScalarRuntime(countType, endian, data[offset..]));
+            offset += countType.size() + n * property.valueType.size();
+        }
+        if (offset > data.len) return error.PlyTruncated;
+    }
+    return offset;
+}
+
+/// Read an ASCII element record by record
+fn readAsciiElement(data: []const u8, start: usize, element: *const Element, isVertex: bool, isFace: bool, obj: *objectLoader.ObjectStruct) !usize {
+    var values = std.ArrayList(f64).init(obj.allocator);
+    defer values.deinit();
+
+    // Property indices of the known attributes
+    const x = element.findProperty(&.{"x"});
+    const nx = element.findProperty(&.{"nx"});
+    const red = element.findProperty(&.{ "red", "r" });
+    const u = element.findProperty(&.{ "u", "s", "texture_u" });
+    const listIndex = element.findProperty(&.{ "vertex_indices", "vertex_index" });
+    const colorScale: f64 = if (red) |r| (if (element.properties.items[r].valueType == .u8) 1.0 / 255.0 else 1.0) else 1.0;
+
+    var lineStart = start;
+    for (0..element.count) |_| {
+        if (lineStart >= data.len) return error.PlyTruncated; // Fewer records than the header says
+        const lineEnd = std.mem.indexOfScalarPos(u8, data, lineStart, '\n') orelse data.len;
+        const line = data[lineStart..lineEnd];
+        lineStart = @min(lineEnd + 1, data.len);
+
+        // Flatten the record, list properties are stored as count followed by values
+        values.clearRetainingCapacity();
+        var tokens = std.mem.tokenizeAny(u8, line, " \t\r");
+        while (tokens.next()) |token| {
+            try values.append(try std.fmt.parseFloat(f64, token));
+        }
+
+        if (isVertex) {
+            const v = values.items;
+            const xi = x orelse return error.PlyMissingPosition;
+            if (xi + 2 >= v.len) return error.PlyTruncated;
+            try obj.vbo.append(.{ .position = .{ @floatCast(v[xi]), @floatCast(v[xi + 1]), @floatCast(v[xi + 2]) } });
+            if (nx) |i| if (i + 2 < v.len) try obj.normals.append(.{ @floatCast(v[i]), @floatCast(v[i + 1]), @floatCast(v[i + 2]) });
+            if (red) |i| if (i + 2 < v.len) try obj.colors.append(.{ @floatCast(v[i] * colorScale), @floatCast(v[i + 1] * colorScale), @floatCast(v[i + 2] * colorScale) });
+            if (u) |i| if (i + 1 < v.len) try obj.texCoords.append(.{ @floatCast(v[i]), @floatCast(v[i + 1]) });
+        } else if (isFace) {
+            // Locate the index list, preceding list properties shift the position
+            const li = listIndex orelse return error.PlyMissingFaceIndices;
+            var position: usize = 0;
+            for (element.properties.items[0..li]) |property| {
+                if (property.countType != null) {
+                    if (position >= values.items.len) return error.PlyTruncated;
+                    position += try toCount(values.items[position]);
+                }
+                position += 1;
+            }
+            if (position >= values.items.len) return error.PlyTruncated;
+            const n = try toCount(values.items[position]);
+            if (position + n >= values.items.len) return error.PlyTruncated;
+            if (n < 3) continue;
+            const indices = values.items[position + 1 ..][0..n];
+
+            const hasTexCoords = obj.texCoords.items.len == obj.vbo.items.len and obj.texCoords.items.len > 0;
+            const hasNormals = obj.normals.items.len == obj.vbo.items.len and obj.normals.items.len > 0;
+            for (2..n) |k| {
+                const face = [3]usize{ try toCount(indices[0]), try toCount(indices[k - 1]), try toCount(indices[k]) };
+                if (face[0] >= obj.vbo.items.len or face[1] >= obj.vbo.items.len or face[2] >= obj.vbo.items.len) {
+                    diagnostics.report(.ObjFileMalformed, 0, "PLY face references a vertex that does not exist: {d} {d} {d}", .{ face[0], face[1], face[2] });
+                    continue;
+                }
+                try obj.ebo.append(.{
+                    .face = face,
+                    .texCoordIndices = if (hasTexCoords) face else .{ 0, 0, 0 },
+                    .normalIndices = if (hasNormals) face else .{ 0, 0, 0 },
+                });
+                try obj.faceMaterialIndices.append(0);
+            }
+        }
+    }
+    return lineStart;
+}
+
+test "plyLoader.hugeElementCount" {
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // Counts whose byte size overflows usize, for read, skipped and ASCII elements
+    const files = [_][]const u8{
+        "ply\nformat binary_little_endian 1.0\nelement vertex 18446744073709551615\nproperty float x\nproperty float y\nproperty float z\nend_header\n" ++ "\x00" ** 12,
+        "ply\nformat binary_big_endian 1.0\nelement extra 18446744073709551615\nproperty double a\nend_header\n" ++ "\x00" ** 12,
+        "ply\nformat ascii 1.0\nelement extra 18446744073709551615\nproperty float a\nend_header\n1\n2\n",
+    };
+    for (files) |file| {
+        try tmp.dir.writeFile(.{ .sub_path = "huge.ply", .data = file });
+
+        const path = try tmp.dir.realpathAlloc(std.testing.allocator, "huge.ply");
+        defer std.testing.allocator.free(path);
+        var obj = objectLoader.initObject(std.testing.allocator);
+        defer obj.deinit();
+        try std.testing.expectError(error.PlyTruncated, load(path, &obj));
+    }
+}
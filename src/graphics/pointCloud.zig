@@ -0,0 +1,318 @@
+//! Point cloud rendering for vertex-only .obj files (lidar and scan exports)
+//!
+//! Builds an octree over the points in which every inner node keeps a subsample of its points.
+//! Points are uploaded in node order, so every node is one contiguous range of the vertex buffer.
+//! Each frame the visible nodes with the largest projected size are drawn until the point budget is used up.
+
+const std = @import("std");
+const gl = @import("gl");
+const zmath = @import("zmath");
+
+const objectLoader = @import("objectLoader.zig");
+const glDebug = @import("glDebug.zig");
+const memory = @import("../util/memory.zig");
+
+const NODE_SAMPLES = 4096; // Points kept by an inner node
+const MAX_DEPTH = 21; // Stops the subdivision of duplicate points
+
+/// Vertex layout of the point buffer
+pub const PointVertex = extern struct {
+    position: [3]f32,
+    color: [4]u8,
+};
+
+/// Octree node
+///
+/// Contains:
+/// - center and halfSize of the node cube
+/// - first and count: range of the node's own points in the vertex buffer
+/// - children: node indices per octant (0 = no child, the root is never a child)
+const Node = struct {
+    center: [3]f32,
+    halfSize: f32,
+    first: u32,
+    count: u32,
+    children: [8]u32 = [_]u32{0} ** 8,
+};
+
+/// Candidate node for the current frame, ordered by projected size
+const Candidate = struct {
+    node: u32,
+    priority: f32,
+};
+
+fn compareCandidates(_: void, a: Candidate, b: Candidate) std.math.Order {
+    return std.math.order(b.priority, a.priority); // Largest first
+}
+
+/// PointCloud struct
+///
+/// Contains:
+/// - vao, vbo: GPU point buffer in node order
+/// - nodes: octree, root at index 0
+/// - per-frame selection buffers
+/// - drawnPoints: points drawn in the last frame
+pub const PointCloud = struct {
+    vao: gl.uint,
+    vbo: gl.uint,
+    nodes: []Node,
+    pointCount: usize,
+    allocator: std.mem.Allocator,
+
+    queue: std.PriorityQueue(Candidate, void, compareCandidates),
+    firsts: std.ArrayList(gl.int),
+    counts: std.ArrayList(gl.sizei),
+    drawnPoints: usize = 0,
+
+    /// Deinitialize the point cloud (GPU buffers and octree)
+    pub fn deinit(self: *PointCloud) void {
+        gl.DeleteVertexArrays(1, (&self.vao)[0..1]);
+        memory.untrackGpu(.buffer, self.vbo);
+        gl.DeleteBuffers(1, (&self.vbo)[0..1]);
+        self.allocator.free(self.nodes);
+        self.queue.deinit();
+        self.firsts.deinit();
+        self.counts.deinit();
+    }
+
+    /// Draw the point cloud within the point budget
+    ///
+    /// - clipScale: model scale times the larger projection scale factor
+    /// - viewportHeight: framebuffer height in pixels
+    /// - pointSize: screen-space point size in pixels
+    pub fn draw(self: *PointCloud, mvp: zmath.Mat, clipScale: f32, viewportHeight: f32, pointSize: f32, budget: usize) void {
+        self.queue.items.len = 0;
+        self.firsts.clearRetainingCapacity();
+        self.counts.clearRetainingCapacity();
+
+        // Children are only refined when the parent's samples would leave gaps on screen
+        const refineSize = pointSize * @sqrt(@as(f32, NODE_SAMPLES)) * 0.5;
+
+        var drawn: usize = 0;
+        self.queue.add(.{ .node = 0, .priority = std.math.floatMax(f32) }) catch return;
+        while (self.queue.removeOrNull()) |candidate| {
+            const node = self.nodes[candidate.node];
+            if (drawn + node.count > budget) break;
+
+            self.firsts.append(@intCast(node.first)) catch break;
+            self.counts.append(@intCast(node.count)) catch break;
+            drawn += node.count;
+
+            for (node.children) |child| {
+                if (child == 0) continue;
+                const size = projectedSize(self.nodes[child], mvp, clipScale, viewportHeight) orelse continue;
+                if (size < refineSize) continue;
+                self.queue.add(.{ .node = child, .priority = size }) catch break;
+            }
+        }
+        self.drawnPoints = drawn;
+
+        gl.BindVertexArray(self.vao);
+        gl.MultiDrawArrays(gl.POINTS, self.firsts.items.ptr, self.counts.items.ptr, @intCast(self.firsts.items.len));
+    }
+};
+
+/// Projected diameter of a node in pixels, null if the node is outside the view frustum
+fn projectedSize(node: Node, mvp: zmath.Mat, clipScale: f32, viewportHeight: f32) ?f32 {
+    const radius = node.halfSize * @sqrt(@as(f32, 3.0)) * clipScale;
+    const clip = zmath.mul(zmath.f32x4(node.center[0], node.center[1], node.center[2], 1.0), mvp);
+    const w = clip[3];
+
+    // Bounding sphere against the frustum side planes
+    if (w <= -radius) return null;
+    if (clip[0] < -w - radius or clip[0] > w + radius) return null;
+    if (clip[1] < -w - radius or clip[1] > w + radius) return null;
+
+    // Camera inside or right in front of the node
+    if (w <= radius) return std.math.floatMax(f32);
+
+    return radius / w * viewportHeight;
+}
+
+/// Octree builder, orders the point indices node by node
+const Builder = struct {
+    positions: []const objectLoader.Vertex,
+    nodes: std.ArrayList(Node),
+    ordered: std.ArrayList(u32),
+    scratch: []u32,
+
+    /// Build the node for the given points and its children, returns the node index
+    fn buildNode(self: *Builder, indices: []u32, center: [3]f32, halfSize: f32, depth: usize) std.mem.Allocator.Error!u32 {
+        const nodeIndex: u32 = @intCast(self.nodes.items.len);
+        try self.nodes.append(.{
+            .center = center,
+            .halfSize = halfSize,
+            .first = @intCast(self.ordered.items.len),
+            .count = 0,
+        });
+
+        // Leaf: keep all points
+        if (indices.len <= NODE_SAMPLES or depth >= MAX_DEPTH) {
+            try self.ordered.appendSlice(indices);
+            self.nodes.items[nodeIndex].count = @intCast(indices.len);
+            return nodeIndex;
+        }
+
+        // Every stride-th point stays in this node, the rest moves down to the children
+        const stride = (indices.len + NODE_SAMPLES - 1) / NODE_SAMPLES;
+        var rest: usize = 0;
+        for (indices, 0..) |index, i| {
+            if (i % stride == 0) {
+                try self.ordered.append(index);
+            } else {
+                indices[rest] = index;
+                rest += 1;
+            }
+        }
+        self.nodes.items[nodeIndex].count = @intCast(self.ordered.items.len - self.nodes.items[nodeIndex].first);
+
+        // Bucket the remaining points by octant
+        var counts = [_]usize{0} ** 8;
+        for (indices[0..rest]) |index| {
+            counts[octant(self.positions[index].position, center)] += 1;
+        }
+        var offsets: [8]usize = undefined;
+        var sum: usize = 0;
+        for (counts, 0..) |count, o| {
+            offsets[o] = sum;
+            sum += count;
+        }
+        var cursor = offsets;
+        for (indices[0..rest]) |index| {
+            const o = octant(self.positions[index].position, center);
+            self.scratch[cursor[o]] = index;
+            cursor[o] += 1;
+        }
+        @memcpy(indices[0..rest], self.scratch[0..rest]);
+
+        // Recurse into the occupied octants
+        const childHalf = halfSize * 0.5;
+        for (counts, 0..) |count, o| {
+            if (count == 0) continue;
+            const childCenter = [3]f32{
+                center[0] + (if ((o & 1) != 0) childHalf else -childHalf),
+                center[1] + (if ((o & 2) != 0) childHalf else -childHalf),
+                center[2] + (if ((o & 4) != 0) childHalf else -childHalf),
+            };
+            const child = try self.buildNode(indices[offsets[o]..][0..count], childCenter, childHalf, depth + 1);
+            self.nodes.items[nodeIndex].children[o] = child;
+        }
+
+        return nodeIndex;
+    }
+};
+
+/// Octant of a point relative to a node center
+fn octant(p: [3]f32, center: [3]f32) usize {
+    var o: usize = 0;
+    if (p[0] >= center[0]) o |= 1;
+    if (p[1] >= center[1]) o |= 2;
+    if (p[2] >= center[2]) o |= 4;
+    return o;
+}
+
+/// Build the octree from the vertices (and optional colors) of the object and upload the points
+pub fn build(obj: *const objectLoader.ObjectStruct, allocator: std.mem.Allocator) !PointCloud {
+    const positions = obj.vbo.items;
+    const count = positions.len;
+
+    // Bounding cube
+    var min = positions[0].position;
+    var max = positions[0].position;
+    for (positions) |vertex| {
+        for (0..3) |axis| {
+            min[axis] = @min(min[axis], vertex.position[axis]);
+            max[axis] = @max(max[axis], vertex.position[axis]);
+        }
+    }
+    const center = [3]f32{
+        (min[0] + max[0]) * 0.5,
+        (min[1] + max[1]) * 0.5,
+        (min[2] + max[2]) * 0.5,
+    };
+    const halfSize = @max(@max(max[0] - min[0], max[1] - min[1]), max[2] - min[2]) * 0.5 + 1e-6;
+
+    // Build the octree over point indices
+    const order = try allocator.alloc(u32, count);
+    defer allocator.free(order);
+    for (order, 0..) |*index, i| {
+        index.* = @intCast(i);
+    }
+
+    var builder = Builder{
+        .positions = positions,
+        .nodes = std.ArrayList(Node).init(allocator),
+        .ordered = try std.ArrayList(u32).initCapacity(allocator, count),
+        .scratch = try allocator.alloc(u32, count),
+    };
+    defer builder.ordered.deinit();
+    defer allocator.free(builder.scratch);
+    errdefer builder.nodes.deinit();
+
+    _ = try builder.buildNode(order, center, halfSize, 0);
+
+    const hasColors = obj.colors.items.len == count;
+    const colorScale = byteColorScale(obj.colors.items);
+
+    // Vertex data in node order
+    const vertices = try allocator.alloc(PointVertex, count);
+    defer allocator.free(vertices);
+    for (builder.ordered.items, vertices) |index, *vertex| {
+        vertex.position = positions[index].position;
+        if (hasColors) {
+            const color = obj.colors.items[index];
+            vertex.color = .{
+                @intFromFloat(std.math.clamp(color[0] * colorScale, 0.0, 255.0)),
+                @intFromFloat(std.math.clamp(color[1] * colorScale, 0.0, 255.0)),
+                @intFromFloat(std.math.clamp(color[2] * colorScale, 0.0, 255.0)),
+                255,
+            };
+        } else {
+            vertex.color = .{ 102, 102, 102, 255 }; // Default grey
+        }
+    }
+
+    // Create vertex array and buffer
+    var vao: gl.uint = undefined;
+    gl.GenVertexArrays(1, (&vao)[0..1]);
+    gl.BindVertexArray(vao);
+
+    var vbo: gl.uint = undefined;
+    gl.GenBuffers(1, (&vbo)[0..1]);
+    gl.BindBuffer(gl.ARRAY_BUFFER, vbo);
+    gl.BufferData(gl.ARRAY_BUFFER, @intCast(vertices.len * @sizeOf(PointVertex)), vertices.ptr, gl.STATIC_DRAW);
+    memory.trackGpu(.buffer, vbo, vertices.len * @sizeOf(PointVertex));
+    glDebug.label(.vertexArray, vao, "point cloud vao", .{});
+    glDebug.label(.buffer, vbo, "point cloud ({d} points)", .{count});
+
+    // Position (location = 0)
+    gl.VertexAttribPointer(0, 3, gl.FLOAT, gl.FALSE, @sizeOf(PointVertex), @offsetOf(PointVertex, "position"));
+    gl.EnableVertexAttribArray(0);
+
+    // Color (location = 1)
+    gl.VertexAttribPointer(1, 4, gl.UNSIGNED_BYTE, gl.TRUE, @sizeOf(PointVertex), @offsetOf(PointVertex, "color"));
+    gl.EnableVertexAttribArray(1);
+
+    std.log.info("Point cloud: {d} points in {d} octree nodes", .{ count, builder.nodes.items.len });
+
+    return PointCloud{
+        .vao = vao,
+        .vbo = vbo,
+        .nodes = try builder.nodes.toOwnedSlice(),
+        .pointCount = count,
+        .allocator = allocator,
+        .queue = std.PriorityQueue(Candidate, void, compareCandidates).init(allocator, {}),
+        .firsts = std.ArrayList(gl.int).init(allocator),
+        .counts = std.ArrayList(gl.sizei).init(allocator),
+    };
+}
+
+/// Factor that maps the vertex colors of a mesh to 0..255
+/// Colors may be given as 0..1 or 0..255, decided once for the whole mesh so dark vertices of a
+/// 0..255 mesh are not scaled up
+pub fn byteColorScale(colors: []const [3]f32) f32 {
+    for (colors) |color| {
+        if (color[0] > 1.0 or color[1] > 1.0 or color[2] > 1.0) return 1.0;
+    }
+    return 255.0;
+}
@@ -0,0 +1,254 @@
+//! Offscreen scene target and post-process antialiasing
+//!
+//! When antialiasing is selected (or the transparent pass needs it) the scene is drawn into an
+//! offscreen color and depth target instead of the window. endFrame resolves it into the window
+//! before the overlay is drawn: with an FXAA pass at the selected quality preset, or a plain blit.
+//! Frames that need neither draw straight into the window.
+//!
+//! The FXAA pass is timed with GL_TIME_ELAPSED queries. Results are read QUERY_COUNT frames later,
+//! so the CPU never waits for the GPU.
+
+const std = @import("std");
+const gl = @import("gl");
+
+const shader = @import("shader.zig");
+const glDebug = @import("glDebug.zig");
+const memory = @import("../util/memory.zig");
+
+const QUERY_COUNT = 4; // Frames in flight for the timer queries
+const SCENE_UNIT = 0;
+
+/// Antialiasing presets, FXAA quality settings from fast to thorough
+pub const Quality = enum {
+    off,
+    low,
+    medium,
+    high,
+};
+
+/// FXAA parameters of a preset
+///
+/// Contains:
+/// - subpixel: amount of subpixel aliasing removal (0 .. 1)
+/// - edgeThreshold: minimum local contrast relative to the brightest neighbor
+/// - edgeThresholdMin: minimum absolute contrast, skips dark areas
+/// - searchSteps: samples along the edge in each direction (at most 12)
+const Preset = struct {
+    subpixel: f32,
+    edgeThreshold: f32,
+    edgeThresholdMin: f32,
+    searchSteps: i32,
+};
+
+fn preset(selected: Quality) Preset {
+    return switch (selected) {
+        .off => unreachable,
+        .low => .{ .subpixel = 0.5, .edgeThreshold = 0.25, .edgeThresholdMin = 0.0833, .searchSteps = 4 },
+        .medium => .{ .subpixel = 0.75, .edgeThreshold = 0.166, .edgeThresholdMin = 0.0833, .searchSteps = 8 },
+        .high => .{ .subpixel = 1.0, .edgeThreshold = 0.125, .edgeThresholdMin = 0.0625, .searchSteps = 12 },
+    };
+}
+
+/// Scene target, recreated when the window size changes
+///
+/// Contains:
+/// - framebuffer: color and depth attachments
+/// - color: RGBA8, linear filtering for the FXAA taps
+/// - depth: 24 bit depth texture (shared with the transparent pass)
+const Target = struct {
+    width: u32 = 0,
+    height: u32 = 0,
+    framebuffer: gl.uint = 0,
+    color: gl.uint = 0,
+    depth: gl.uint = 0,
+};
+
+var target: Target = .{};
+var fxaaProgram: gl.uint = 0;
+var emptyVao: gl.uint = 0;
+var quality: Quality = .off;
+var active = false;
+
+// Timer queries of the FXAA pass
+var queries = [_]gl.uint{0} ** QUERY_COUNT;
+var queryPending = [_]bool{false} ** QUERY_COUNT;
+var queryFrame: usize = 0;
+var lastGpuTime: ?f64 = null;
+
+/// Compile the FXAA shader and create the timer queries
+pub fn init(allocator: std.mem.Allocator) !void {
+    fxaaProgram = try shader.compile(allocator,
+        "src/graphics/shaders/fullscreen.vertex.shader.glsl",
+        "src/graphics/shaders/fxaa.fragment.shader.glsl");
+    gl.GenVertexArrays(1, (&emptyVao)[0..1]);
+    glDebug.label(.vertexArray, emptyVao, "Full screen triangle", .{});
+    gl.GenQueries(QUERY_COUNT, &queries);
+}
+
+/// Free the target, shader and queries
+pub fn deinit() void {
+    releaseTarget();
+    if (fxaaProgram != 0) gl.DeleteProgram(fxaaProgram);
+    if (emptyVao != 0) gl.DeleteVertexArrays(1, (&emptyVao)[0..1]);
+    if (queries[0] != 0) gl.DeleteQueries(QUERY_COUNT, &queries);
+    fxaaProgram = 0;
+    emptyVao = 0;
+    queries = [_]gl.uint{0} ** QUERY_COUNT;
+}
+
+/// Redirect the frame into the scene target if antialiasing is selected or offscreen is requested
+/// Call before clearing, returns true if the scene target is bound
+pub fn beginFrame(width: u32, height: u32, selected: Quality, offscreen: bool) bool {
+    quality = selected;
+    if (selected == .off) lastGpuTime = null;
+    if ((selected == .off and !offscreen) or fxaaProgram == 0 or width == 0 or height == 0) return false;
+
+    if (target.width != width or target.height != height) {
+        releaseTarget();
+        createTarget(width, height) catch |err| {
+            std.log.err("Scene target unavailable: {s}", .{@errorName(err)});
+            releaseTarget();
+            return false;
+        };
+    }
+
+    gl.BindFramebuffer(gl.FRAMEBUFFER, target.framebuffer);
+    active = true;
+    return true;
+}
+
+/// Resolve the scene target into the window (FXAA or blit) and bind the window again
+pub fn endFrame() void {
+    if (!active) return;
+    active = false;
+
+    if (quality == .off) {
+        gl.BindFramebuffer(gl.READ_FRAMEBUFFER, target.framebuffer);
+        gl.BindFramebuffer(gl.DRAW_FRAMEBUFFER, 0);
+        const width: gl.int = @intCast(target.width);
+        const height: gl.int = @intCast(target.height);
+        gl.BlitFramebuffer(0, 0, width, height, 0, 0, width, height, gl.COLOR_BUFFER_BIT, gl.NEAREST);
+        gl.BindFramebuffer(gl.FRAMEBUFFER, 0);
+        return;
+    }
+
+    glDebug.pushGroup("FXAA");
+    defer glDebug.popGroup();
+
+    // Read the query issued QUERY_COUNT frames ago before reusing it, the frame is not timed if it is still running
+    const slot = queryFrame % QUERY_COUNT;
+    queryFrame += 1;
+    const timed = readQuery(slot);
+    if (timed) gl.BeginQuery(gl.TIME_ELAPSED, queries[slot]);
+
+    var program: gl.int = 0;
+    gl.GetIntegerv(gl.CURRENT_PROGRAM, (&program)[0..1]);
+
+    gl.BindFramebuffer(gl.FRAMEBUFFER, 0);
+    gl.Disable(gl.DEPTH_TEST);
+
+    const parameters = preset(quality);
+    gl.UseProgram(fxaaProgram);
+    gl.ActiveTexture(gl.TEXTURE0 + SCENE_UNIT);
+    gl.BindTexture(gl.TEXTURE_2D, target.color);
+    gl.Uniform1i(gl.GetUniformLocation(fxaaProgram, "sceneColor"), SCENE_UNIT);
+    gl.Uniform2f(gl.GetUniformLocation(fxaaProgram, "inverseSize"), 1.0 / @as(f32, @floatFromInt(target.width)), 1.0 / @as(f32, @floatFromInt(target.height)));
+    gl.Uniform1f(gl.GetUniformLocation(fxaaProgram, "subpixel"), parameters.subpixel);
+    gl.Uniform1f(gl.GetUniformLocation(fxaaProgram, "edgeThreshold"), parameters.edgeThreshold);
+    gl.Uniform1f(gl.GetUniformLocation(fxaaProgram, "edgeThresholdMin"), parameters.edgeThresholdMin);
+    gl.Uniform1i(gl.GetUniformLocation(fxaaProgram, "searchSteps"), parameters.searchSteps);
+
+    drawFullscreen();
+
+    if (timed) {
+        gl.EndQuery(gl.TIME_ELAPSED);
+        queryPending[slot] = true;
+    }
+
+    gl.Enable(gl.DEPTH_TEST);
+    gl.UseProgram(@intCast(program));
+}
+
+/// Draw a full screen triangle (fullscreen.vertex.shader.glsl)
+pub fn drawFullscreen() void {
+    gl.BindVertexArray(emptyVao);
+    gl.DrawArrays(gl.TRIANGLES, 0, 3);
+}
+
+/// Framebuffer of the scene target (valid between beginFrame and endFrame)
+pub fn sceneFramebuffer() gl.uint {
+    return target.framebuffer;
+}
+
+/// Depth texture of the scene target
+pub fn depthTexture() gl.uint {
+    return target.depth;
+}
+
+/// GPU time of the last measured FXAA pass in milliseconds, null without antialiasing
+pub fn gpuTime() ?f64 {
+    return lastGpuTime;
+}
+
+/// Parse a preset name (off, low, medium, high)
+pub fn parseQuality(name: []const u8) ?Quality {
+    return std.meta.stringToEnum(Quality, name);
+}
+
+/// Collect the result of a query slot, false if the query is still running
+fn readQuery(slot: usize) bool {
+    if (!queryPending[slot]) return true;
+    var available: gl.int = 0;
+    gl.GetQueryObjectiv(queries[slot], gl.QUERY_RESULT_AVAILABLE, (&available)[0..1]);
+    if (available == 0) return false;
+
+    var elapsed: u64 = 0;
+    gl.GetQueryObjectui64v(queries[slot], gl.QUERY_RESULT, (&elapsed)[0..1]);
+    lastGpuTime = @as(f64, @floatFromInt(elapsed)) / std.time.ns_per_ms;
+    queryPending[slot] = false;
+    return true;
+}
+
+fn createTarget(width: u32, height: u32) !void {
+    target.width = width;
+    target.height = height;
+
+    target.color = createTexture(gl.RGBA8, gl.RGBA, gl.UNSIGNED_BYTE, 4, gl.LINEAR, "Scene color");
+    target.depth = createTexture(gl.DEPTH_COMPONENT24, gl.DEPTH_COMPONENT, gl.UNSIGNED_INT, 4, gl.NEAREST, "Scene depth");
+
+    gl.GenFramebuffers(1, (&target.framebuffer)[0..1]);
+    gl.BindFramebuffer(gl.FRAMEBUFFER, target.framebuffer);
+    gl.FramebufferTexture2D(gl.FRAMEBUFFER, gl.COLOR_ATTACHMENT0, gl.TEXTURE_2D, target.color, 0);
+    gl.FramebufferTexture2D(gl.FRAMEBUFFER, gl.DEPTH_ATTACHMENT, gl.TEXTURE_2D, target.depth, 0);
+    glDebug.label(.framebuffer, target.framebuffer, "Scene", .{});
+
+    const status = gl.CheckFramebufferStatus(gl.FRAMEBUFFER);
+    gl.BindFramebuffer(gl.FRAMEBUFFER, 0);
+    if (status != gl.FRAMEBUFFER_COMPLETE) return error.FramebufferIncomplete;
+}
+
+/// Texture of the target size, also used for the transparency targets
+pub fn createTexture(internalFormat: gl.@"enum", format: gl.@"enum", kind: gl.@"enum", bytesPerTexel: usize, filter: gl.int, name: []const u8) gl.uint {
+    var texture: gl.uint = 0;
+    gl.GenTextures(1, (&texture)[0..1]);
+    gl.BindTexture(gl.TEXTURE_2D, texture);
+    gl.TexImage2D(gl.TEXTURE_2D, 0, @intCast(internalFormat), @intCast(target.width), @intCast(target.height), 0, format, kind, null);
+    gl.TexParameteri(gl.TEXTURE_2D, gl.TEXTURE_MIN_FILTER, filter);
+    gl.TexParameteri(gl.TEXTURE_2D, gl.TEXTURE_MAG_FILTER, filter);
+    gl.TexParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_S, gl.CLAMP_TO_EDGE);
+    gl.TexParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_T, gl.CLAMP_TO_EDGE);
+    gl.BindTexture(gl.TEXTURE_2D, 0);
+    memory.trackGpu(.texture, texture, @as(usize, target.width) * target.height * bytesPerTexel);
+    glDebug.label(.texture, texture, "{s}", .{name});
+    return texture;
+}
+
+fn releaseTarget() void {
+    for ([_]gl.uint{ target.color, target.depth }) |texture| {
+        if (texture == 0) continue;
+        memory.untrackGpu(.texture, texture);
+        gl.DeleteTextures(1, (&texture)[0..1]);
+    }
+    if (target.framebuffer != 0) gl.DeleteFramebuffers(1, (&target.framebuffer)[0..1]);
+    target = .{};
+}
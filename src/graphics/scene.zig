@@ -0,0 +1,400 @@
+//! Scene hierarchy
+//!
+//! Nodes live in one flat array in pre-order (parents before children, every subtree is the
+//! contiguous range [node, subtreeEnd)). Node fields are stored as separate arrays with
+//! std.MultiArrayList, so local translation, rotation and scale are SoA.
+//!
+//! setLocal only marks a node dirty. update recomputes the dirty subtrees and nothing else:
+//! local matrices are built BATCH nodes at a time with @Vector lanes, then multiplied with the
+//! already updated parent world matrix. Scale is uniform, so the normal matrix is the upper 3x3
+//! of the world matrix divided by the squared world scale, no inverse is needed.
+//!
+//! Every node has a local bounding box of its own index range and a visibility flag. Hidden
+//! nodes skip their whole subtree and nodes outside the view frustum are not drawn, both
+//! without touching the GPU buffers.
+//!
+//! The index range of a node is split into draw ranges with one material each, so transparent
+//! materials can be drawn in their own pass.
+
+const std = @import("std");
+const zmath = @import("zmath");
+
+const objectLoader = @import("objectLoader.zig");
+const memory = @import("../util/memory.zig");
+
+pub const NO_PARENT = std.math.maxInt(u32);
+const BATCH = 8;
+
+const Lanes = @Vector(BATCH, f32);
+
+const allocator = memory.allocator(.mesh);
+
+/// Node fields, each stored in its own array
+///
+/// Contains:
+/// - parent: index of the parent node or NO_PARENT
+/// - subtreeEnd: one past the last descendant
+/// - firstIndex, indexCount: range of the index buffer drawn for the node
+/// - firstRange, rangeCount: draw ranges covering the index range
+/// - tx, ty, tz: local translation
+/// - qx, qy, qz, qw: local rotation quaternion
+/// - scale: local uniform scale
+/// - visible: drawn together with its subtree
+/// - boundsMin, boundsMax: local bounding box of the node's own indices (min > max if empty)
+pub const Node = struct {
+    parent: u32,
+    subtreeEnd: u32,
+    firstIndex: u32,
+    indexCount: u32,
+    firstRange: u32 = 0,
+    rangeCount: u32 = 0,
+    tx: f32 = 0,
+    ty: f32 = 0,
+    tz: f32 = 0,
+    qx: f32 = 0,
+    qy: f32 = 0,
+    qz: f32 = 0,
+    qw: f32 = 1,
+    scale: f32 = 1,
+    visible: bool = true,
+    boundsMin: [3]f32 = .{ std.math.inf(f32), std.math.inf(f32), std.math.inf(f32) },
+    boundsMax: [3]f32 = .{ -std.math.inf(f32), -std.math.inf(f32), -std.math.inf(f32) },
+};
+
+/// Part of a node's index range with a single material
+///
+/// Contains:
+/// - firstIndex, indexCount: range of the index buffer
+/// - material: index into the object's materials
+pub const Range = struct {
+    firstIndex: u32,
+    indexCount: u32,
+    material: u32,
+};
+
+/// Scene struct
+///
+/// Contains:
+/// - nodes: node fields (SoA)
+/// - names: node names (owned)
+/// - ranges: draw ranges of all nodes, in node order
+/// - world, worldScale: results of the last update
+/// - dirty: nodes whose subtrees need an update
+/// - locals: scratch for the local matrices of one subtree
+/// - drawnNodes: nodes drawn in the last frame, for the overlay
+/// deinit method
+pub const Scene = struct {
+    nodes: std.MultiArrayList(Node) = .{},
+    names: std.ArrayListUnmanaged([]const u8) = .{},
+    ranges: std.ArrayListUnmanaged(Range) = .{},
+    world: std.ArrayListUnmanaged(zmath.Mat) = .{},
+    worldScale: std.ArrayListUnmanaged(f32) = .{},
+    dirty: std.ArrayListUnmanaged(u32) = .{},
+    locals: std.ArrayListUnmanaged(zmath.Mat) = .{},
+    drawnNodes: usize = 0,
+
+    pub fn deinit(self: *Scene) void {
+        for (self.names.items) |name| allocator.free(name);
+        self.nodes.deinit(allocator);
+        self.names.deinit(allocator);
+        self.ranges.deinit(allocator);
+        self.world.deinit(allocator);
+        self.worldScale.deinit(allocator);
+        self.dirty.deinit(allocator);
+        self.locals.deinit(allocator);
+    }
+
+    /// Number of nodes
+    pub fn count(self: *const Scene) usize {
+        return self.nodes.len;
+    }
+
+    /// Append a node, nodes must be added in pre-order (the parent is the last added node or one of its ancestors)
+    pub fn addNode(self: *Scene, name: []const u8, parent: u32, firstIndex: usize, indexCount: usize) !u32 {
+        const index: u32 = @intCast(self.nodes.len);
+        std.debug.assert(parent == NO_PARENT or parent < index);
+
+        const ownedName = try allocator.dupe(u8, name);
+        errdefer allocator.free(ownedName);
+        try self.names.append(allocator, ownedName);
+        errdefer _ = self.names.pop();
+        try self.world.append(allocator, zmath.identity());
+        errdefer _ = self.world.pop();
+        try self.worldScale.append(allocator, 1);
+        errdefer _ = self.worldScale.pop();
+        try self.dirty.append(allocator, index);
+        errdefer _ = self.dirty.pop();
+        try self.nodes.append(allocator, .{
+            .parent = parent,
+            .subtreeEnd = index + 1,
+            .firstIndex = @intCast(firstIndex),
+            .indexCount = @intCast(indexCount),
+        });
+
+        // The new node extends the subtrees of all its ancestors
+        const parents = self.nodes.items(.parent);
+        const ends = self.nodes.items(.subtreeEnd);
+        var ancestor = parent;
+        while (ancestor != NO_PARENT) : (ancestor = parents[ancestor]) {
+            ends[ancestor] = index + 1;
+        }
+        return index;
+    }
+
+    /// Draw ranges of a node
+    pub fn nodeRanges(self: *const Scene, node: usize) []const Range {
+        const slice = self.nodes.slice();
+        return self.ranges.items[slice.items(.firstRange)[node]..][0..slice.items(.rangeCount)[node]];
+    }
+
+    /// Set the local transform of a node, marks its subtree dirty if anything changed
+    pub fn setLocal(self: *Scene, node: u32, translation: [3]f32, rotation: zmath.Quat, scale: f32) void {
+        const slice = self.nodes.slice();
+        const values = [_]f32{ translation[0], translation[1], translation[2], rotation[0], rotation[1], rotation[2], rotation[3], scale };
+        const fields = [_][]f32{ slice.items(.tx), slice.items(.ty), slice.items(.tz), slice.items(.qx), slice.items(.qy), slice.items(.qz), slice.items(.qw), slice.items(.scale) };
+
+        var changed = false;
+        for (fields, values) |field, value| {
+            if (field[node] != value) {
+                field[node] = value;
+                changed = true;
+            }
+        }
+        if (changed) {
+            self.dirty.append(allocator, node) catch {
+                // Without a dirty entry the whole scene is updated
+                self.dirty.clearRetainingCapacity();
+                self.dirty.appendAssumeCapacity(0);
+            };
+        }
+    }
+
+    /// Recompute the world matrices of all dirty subtrees
+    pub fn update(self: *Scene) void {
+        if (self.dirty.items.len == 0) return;
+        std.mem.sort(u32, self.dirty.items, {}, std.sort.asc(u32));
+
+        const ends = self.nodes.items(.subtreeEnd);
+        var coveredEnd: u32 = 0;
+        for (self.dirty.items) |node| {
+            if (node < coveredEnd) continue; // Inside a subtree that was just updated
+            self.updateRange(node, ends[node]);
+            coveredEnd = ends[node];
+        }
+        self.dirty.clearRetainingCapacity();
+    }
+
+    /// World matrix of a node (as of the last update)
+    pub fn worldMatrix(self: *const Scene, node: usize) zmath.Mat {
+        return self.world.items[node];
+    }
+
+    /// Normal matrix of a node, upper 3x3 of the world matrix / worldScale^2 (same row layout as the Model uniform)
+    pub fn normalMatrix(self: *const Scene, node: usize) [9]f32 {
+        const world = self.world.items[node];
+        const s = self.worldScale.items[node];
+        const inv = 1.0 / (s * s);
+        return .{
+            world[0][0] * inv, world[0][1] * inv, world[0][2] * inv,
+            world[1][0] * inv, world[1][1] * inv, world[1][2] * inv,
+            world[2][0] * inv, world[2][1] * inv, world[2][2] * inv,
+        };
+    }
+
+    /// False if the node's bounding box is completely outside the view frustum (or the node is empty)
+    pub fn inFrustum(self: *const Scene, node: usize, viewProj: zmath.Mat) bool {
+        const slice = self.nodes.slice();
+        const min = slice.items(.boundsMin)[node];
+        const max = slice.items(.boundsMax)[node];
+        if (min[0] > max[0]) return false;
+
+        // Corners in clip space, outside if all corners are beyond the same plane
+        const mvp = zmath.mul(self.world.items[node], viewProj);
+        var outside = [_]bool{true} ** 6;
+        for (0..8) |corner| {
+            const point = zmath.f32x4(
+                if (corner & 1 != 0) max[0] else min[0],
+                if (corner & 2 != 0) max[1] else min[1],
+                if (corner & 4 != 0) max[2] else min[2],
+                1,
+            );
+            const clip = zmath.mul(point, mvp);
+            const w = clip[3];
+            outside[0] = outside[0] and clip[0] < -w;
+            outside[1] = outside[1] and clip[0] > w;
+            outside[2] = outside[2] and clip[1] < -w;
+            outside[3] = outside[3] and clip[1] > w;
+            outside[4] = outside[4] and clip[2] < -w;
+            outside[5] = outside[5] and clip[2] > w;
+        }
+        return std.mem.indexOfScalar(bool, &outside, true) == null;
+    }
+
+    /// Split the index range of every node where the material changes, face i covers the indices 3i..3i+2
+    /// Without one material per face every node gets a single range with material 0
+    fn buildRanges(self: *Scene, faceMaterials: []const usize) !void {
+        const slice = self.nodes.slice();
+        self.ranges.clearRetainingCapacity();
+        for (slice.items(.firstIndex), slice.items(.indexCount), slice.items(.firstRange), slice.items(.rangeCount)) |first, count, *firstRange, *rangeCount| {
+            firstRange.* = @intCast(self.ranges.items.len);
+            const firstFace = first / 3;
+            const endFace = (first + count) / 3;
+
+            var runStart = firstFace;
+            for (firstFace..endFace) |face| {
+                const material = materialOf(faceMaterials, face);
+                if (face + 1 == endFace or materialOf(faceMaterials, face + 1) != material) {
+                    try self.ranges.append(allocator, .{
+                        .firstIndex = runStart * 3,
+                        .indexCount = (@as(u32, @intCast(face)) + 1 - runStart) * 3,
+                        .material = material,
+                    });
+                    runStart = @intCast(face + 1);
+                }
+            }
+            rangeCount.* = @as(u32, @intCast(self.ranges.items.len)) - firstRange.*;
+        }
+    }
+
+    /// Grow the bounding box of a node by the positions of its index range
+    fn computeBounds(self: *Scene, node: u32, vertices: []const f32, indices: []const u32, stride: usize) void {
+        const slice = self.nodes.slice();
+        const first = slice.items(.firstIndex)[node];
+        const count = slice.items(.indexCount)[node];
+        const min = &slice.items(.boundsMin)[node];
+        const max = &slice.items(.boundsMax)[node];
+
+        for (indices[first..][0..count]) |index| {
+            const position = vertices[index * stride ..][0..3];
+            for (0..3) |axis| {
+                min[axis] = @min(min[axis], position[axis]);
+                max[axis] = @max(max[axis], position[axis]);
+            }
+        }
+    }
+
+    /// Update the nodes first..end (one subtree, parents before children)
+    fn updateRange(self: *Scene, first: u32, end: u32) void {
+        const len = end - first;
+        self.locals.resize(allocator, len) catch {
+            // Out of memory: the transforms keep their previous values
+            return;
+        };
+
+        const slice = self.nodes.slice();
+
+        // Local matrices, BATCH nodes at a time
+        var offset: usize = 0;
+        while (offset < len) : (offset += BATCH) {
+            const lanes = @min(BATCH, len - offset);
+            const start = first + offset;
+            localMatrices(
+                load(slice.items(.tx), start, lanes),
+                load(slice.items(.ty), start, lanes),
+                load(slice.items(.tz), start, lanes),
+                load(slice.items(.qx), start, lanes),
+                load(slice.items(.qy), start, lanes),
+                load(slice.items(.qz), start, lanes),
+                load(slice.items(.qw), start, lanes),
+                load(slice.items(.scale), start, lanes),
+                self.locals.items[offset..][0..lanes],
+            );
+        }
+
+        // World = local * parent world, the parent is always updated first
+        const parents = slice.items(.parent);
+        const scales = slice.items(.scale);
+        for (first..end, self.locals.items) |node, local| {
+            const parent = parents[node];
+            if (parent == NO_PARENT) {
+                self.world.items[node] = local;
+                self.worldScale.items[node] = scales[node];
+            } else {
+                self.world.items[node] = zmath.mul(local, self.world.items[parent]);
+                self.worldScale.items[node] = scales[node] * self.worldScale.items[parent];
+            }
+        }
+    }
+};
+
+/// Scene with a single root node drawing indexCount indices
+pub fn single(name: []const u8, indexCount: usize) !Scene {
+    var scene = Scene{};
+    errdefer scene.deinit();
+    _ = try scene.addNode(name, NO_PARENT, 0, indexCount);
+    try scene.buildRanges(&.{});
+    return scene;
+}
+
+/// Scene of an .obj file: o lines become children of the root, g lines children of the current o
+/// Faces before the first group are drawn by the root, face i covers the indices 3i..3i+2
+/// vertices holds stride floats per vertex with the position first, faceMaterials one material per face (or empty)
+pub fn fromGroups(name: []const u8, groups: []const objectLoader.Group, faceMaterials: []const usize, vertices: []const f32, indices: []const u32, stride: usize) !Scene {
+    var scene = Scene{};
+    errdefer scene.deinit();
+
+    const faceCount = indices.len / 3;
+    const rootFaces = if (groups.len > 0) @min(groups[0].firstFace, faceCount) else faceCount;
+    const root = try scene.addNode(name, NO_PARENT, 0, rootFaces * 3);
+
+    var currentObject = root;
+    for (groups, 0..) |group, i| {
+        const first = @min(group.firstFace, faceCount);
+        const end = if (i + 1 < groups.len) @min(groups[i + 1].firstFace, faceCount) else faceCount;
+        const parent = switch (group.kind) {
+            .object => root,
+            .group => currentObject,
+        };
+        const node = try scene.addNode(group.name, parent, first * 3, (@max(end, first) - first) * 3);
+        if (group.kind == .object) currentObject = node;
+    }
+
+    for (0..scene.count()) |node| {
+        scene.computeBounds(@intCast(node), vertices, indices, stride);
+    }
+    try scene.buildRanges(if (faceMaterials.len == faceCount) faceMaterials else &.{});
+    return scene;
+}
+
+fn materialOf(faceMaterials: []const usize, face: usize) u32 {
+    if (face >= faceMaterials.len) return 0;
+    return std.math.cast(u32, faceMaterials[face]) orelse 0; // Checked by the loaders, never trusted here
+}
+
+/// Load up to BATCH values of a field, missing lanes are zero
+fn load(field: []const f32, start: usize, lanes: usize) Lanes {
+    var values = [_]f32{0} ** BATCH;
+    @memcpy(values[0..lanes], field[start..][0..lanes]);
+    return values;
+}
+
+/// Scale * rotation * translation for up to BATCH nodes (row vectors, like zmath)
+fn localMatrices(tx: Lanes, ty: Lanes, tz: Lanes, qx: Lanes, qy: Lanes, qz: Lanes, qw: Lanes, scale: Lanes, out: []zmath.Mat) void {
+    const one: Lanes = @splat(1);
+    const two: Lanes = @splat(2);
+
+    const xx = qx * qx;
+    const yy = qy * qy;
+    const zz = qz * qz;
+    const xy = qx * qy;
+    const xz = qx * qz;
+    const yz = qy * qz;
+    const wx = qw * qx;
+    const wy = qw * qy;
+    const wz = qw * qz;
+
+    const rows = [3][3]Lanes{
+        .{ (one - two * (yy + zz)) * scale, two * (xy + wz) * scale, two * (xz - wy) * scale },
+        .{ two * (xy - wz) * scale, (one - two * (xx + zz)) * scale, two * (yz + wx) * scale },
+        .{ two * (xz + wy) * scale, two * (yz - wx) * scale, (one - two * (xx + yy)) * scale },
+    };
+
+    for (out, 0..) |*matrix, lane| {
+        matrix.* = .{
+            zmath.f32x4(rows[0][0][lane], rows[0][1][lane], rows[0][2][lane], 0),
+            zmath.f32x4(rows[1][0][lane], rows[1][1][lane], rows[1][2][lane], 0),
+            zmath.f32x4(rows[2][0][lane], rows[2][1][lane], rows[2][2][lane], 0),
+            zmath.f32x4(tx[lane], ty[lane], tz[lane], 1),
+        };
+    }
+}
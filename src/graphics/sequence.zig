@@ -0,0 +1,405 @@
+//! Playback of numbered .obj sequences (frame_0001.obj, frame_0002.obj, ...)
+//!
+//! Worker threads parse and convert upcoming frames into a small ring of decoded slots.
+//! The main thread uploads ready frames into a ring of GPU vertex buffers.
+//! While the topology stays constant only positions and normals are uploaded.
+//! Only RING_SIZE frames are held in memory, so sequences may be far larger than RAM.
+
+const std = @import("std");
+const gl = @import("gl");
+
+const mesh = @import("mesh.zig");
+const objectLoader = @import("objectLoader.zig");
+const diagnostics = @import("../util/diagnostics.zig");
+const validator = @import("../util/validator.zig");
+const memory = @import("../util/memory.zig");
+const metrics = @import("../util/metrics.zig");
+
+const RING_SIZE = 4; // Decoded frames kept in memory
+const GPU_RING_SIZE = 3; // Dynamic vertex buffers cycled between frames
+const WORKER_COUNT = 2; // Decoder threads
+const MAX_FRAMES = 1_000_000; // Upper bound when probing the sequence length
+
+const DYNAMIC_STRIDE = 6; // 3 positions + 3 normals (uploaded every frame)
+const STATIC_STRIDE = 5; // 2 UVs + 3 tangents (uploaded on topology change)
+
+/// Decoding state of a ring slot
+const SlotState = enum {
+    empty,
+    loading,
+    ready,
+};
+
+/// Slot struct
+///
+/// Contains:
+/// - ticket: playback position the slot was decoded for
+/// - state: decoding state
+/// - dynamic: positions and normals
+/// - static: UVs and tangents
+/// - indices: triangle indices
+/// - topologyHash: hash over the face indices and UVs
+const Slot = struct {
+    ticket: usize = 0,
+    state: SlotState = .empty,
+    dynamic: []f32 = &.{},
+    static: []f32 = &.{},
+    indices: []u32 = &.{},
+    topologyHash: u64 = 0,
+
+    fn free(self: *Slot) void {
+        if (self.dynamic.len > 0) allocator.free(self.dynamic);
+        if (self.static.len > 0) allocator.free(self.static);
+        if (self.indices.len > 0) allocator.free(self.indices);
+        self.dynamic = &.{};
+        self.static = &.{};
+        self.indices = &.{};
+    }
+};
+
+/// Sequence struct
+///
+/// Contains:
+/// - file name pattern (prefix, zero padded frame number, suffix)
+/// - ring of decoded slots shared with the worker threads
+/// - ring of GPU buffers and vertex arrays
+/// - playback timing
+pub const Sequence = struct {
+    active: bool = false,
+
+    // File name pattern
+    prefix: []const u8 = "",
+    suffix: []const u8 = "",
+    digits: usize = 0,
+    firstNumber: usize = 0,
+    frameCount: usize = 0,
+
+    // Decoding (guarded by mutex)
+    slots: [RING_SIZE]Slot = [_]Slot{.{}} ** RING_SIZE,
+    mutex: std.Thread.Mutex = .{},
+    cond: std.Thread.Condition = .{},
+    nextDecode: usize = 0,
+    stopping: bool = false,
+    workers: [WORKER_COUNT]?std.Thread = [_]?std.Thread{null} ** WORKER_COUNT,
+
+    // GPU resources
+    staticVbo: gl.uint = 0,
+    ebo: gl.uint = 0,
+    dynamicVbos: [GPU_RING_SIZE]gl.uint = [_]gl.uint{0} ** GPU_RING_SIZE,
+    vaos: [GPU_RING_SIZE]gl.uint = [_]gl.uint{0} ** GPU_RING_SIZE,
+    ringIndex: usize = 0,
+    indexCount: usize = 0,
+    topologyHash: ?u64 = null,
+
+    // Playback
+    fps: f32 = 24.0,
+    nextDisplay: usize = 0,
+    currentFrame: usize = 0,
+    timer: std.time.Timer = undefined,
+    nextDeadline: u64 = 0,
+
+    /// Build the path of a frame from the file name pattern
+    fn framePath(self: *const Sequence, buf: []u8, frame: usize) ![]const u8 {
+        var numBuf: [20]u8 = undefined;
+        const num = try std.fmt.bufPrint(&numBuf, "{d}", .{self.firstNumber + frame});
+        const padding = if (num.len < self.digits) self.digits - num.len else 0;
+
+        var stream = std.io.fixedBufferStream(buf);
+        const writer = stream.writer();
+        try writer.writeAll(self.prefix);
+        try writer.writeByteNTimes('0', padding);
+        try writer.writeAll(num);
+        try writer.writeAll(self.suffix);
+        return stream.getWritten();
+    }
+};
+
+const allocator = memory.allocator(.mesh);
+
+pub var playback: Sequence = .{};
+
+/// Start playing the numbered sequence the given path belongs to
+pub fn start(path: []const u8, fps: f32) !void {
+    stop();
+
+    const cleanPath = try validator.cleanPath(allocator, path);
+    defer allocator.free(cleanPath); // Prefix and suffix are copied, also freed on errors below
+    if (cleanPath.len == 0) {
+        return;
+    }
+
+    // Split "dir/frame_0001.obj" into "dir/frame_", "0001" and ".obj"
+    const stemEnd = std.mem.lastIndexOfScalar(u8, cleanPath, '.') orelse cleanPath.len;
+    const dirEnd = if (std.mem.lastIndexOfScalar(u8, cleanPath, '/')) |i| i + 1 else 0;
+    var digitStart = stemEnd;
+    while (digitStart > dirEnd and std.ascii.isDigit(cleanPath[digitStart - 1])) {
+        digitStart -= 1;
+    }
+    if (stemEnd < dirEnd or digitStart == stemEnd) {
+        diagnostics.report(.SequenceNotNumbered, 0, "Sequence path has no frame number: {s}", .{cleanPath});
+        return;
+    }
+
+    playback = .{
+        .prefix = try allocator.dupe(u8, cleanPath[0..digitStart]),
+        .suffix = try allocator.dupe(u8, cleanPath[stemEnd..]),
+        .digits = stemEnd - digitStart,
+        .firstNumber = try std.fmt.parseInt(usize, cleanPath[digitStart..stemEnd], 10),
+        .fps = fps,
+    };
+
+    // Probe the sequence length
+    var pathBuf: [512]u8 = undefined;
+    while (playback.frameCount < MAX_FRAMES) : (playback.frameCount += 1) {
+        const framePath = try playback.framePath(&pathBuf, playback.frameCount);
+        if (!validator.fileExists(framePath)) break;
+    }
+    if (playback.frameCount == 0) {
+        diagnostics.report(.InvalidPath, 0, "First frame of sequence does not exist: {s}", .{cleanPath});
+        freePattern();
+        return;
+    }
+
+    // GPU ring
+    gl.GenBuffers(1, (&playback.staticVbo)[0..1]);
+    gl.GenBuffers(1, (&playback.ebo)[0..1]);
+    gl.GenBuffers(GPU_RING_SIZE, &playback.dynamicVbos);
+    gl.GenVertexArrays(GPU_RING_SIZE, &playback.vaos);
+
+    playback.timer = try std.time.Timer.start();
+    playback.active = true;
+
+    for (&playback.workers) |*worker| {
+        worker.* = try std.Thread.spawn(.{}, workerMain, .{&playback});
+    }
+
+    std.log.info("Playing sequence of {d} frames", .{playback.frameCount});
+}
+
+/// Stop playback, join the workers and release all resources
+pub fn stop() void {
+    if (!playback.active) {
+        return;
+    }
+
+    playback.mutex.lock();
+    playback.stopping = true;
+    playback.cond.broadcast();
+    playback.mutex.unlock();
+
+    for (&playback.workers) |*worker| {
+        if (worker.*) |thread| thread.join();
+        worker.* = null;
+    }
+
+    for (&playback.slots) |*slot| {
+        slot.free();
+    }
+
+    for (playback.dynamicVbos) |vbo| memory.untrackGpu(.buffer, vbo);
+    memory.untrackGpu(.buffer, playback.staticVbo);
+    memory.untrackGpu(.buffer, playback.ebo);
+    gl.DeleteVertexArrays(GPU_RING_SIZE, &playback.vaos);
+    gl.DeleteBuffers(GPU_RING_SIZE, &playback.dynamicVbos);
+    gl.DeleteBuffers(1, (&playback.staticVbo)[0..1]);
+    gl.DeleteBuffers(1, (&playback.ebo)[0..1]);
+
+    freePattern();
+    playback = .{};
+}
+
+fn freePattern() void {
+    allocator.free(playback.prefix);
+    allocator.free(playback.suffix);
+    playback.prefix = "";
+    playback.suffix = "";
+}
+
+/// Whether a sequence frame is ready to be drawn instead of the loaded mesh
+pub fn isActive() bool {
+    return playback.active and playback.indexCount > 0;
+}
+
+/// Advance playback when the next frame is due and decoded
+/// Holds the current frame if the decoders fall behind
+pub fn update() void {
+    if (!playback.active) {
+        return;
+    }
+
+    const now = playback.timer.read();
+    if (now < playback.nextDeadline) {
+        return;
+    }
+
+    playback.mutex.lock();
+    const slot = &playback.slots[playback.nextDisplay % RING_SIZE];
+    const ready = slot.state == .ready and slot.ticket == playback.nextDisplay;
+    playback.mutex.unlock();
+
+    if (!ready) {
+        return;
+    }
+
+    // The slot is not touched by the workers until it is marked empty again
+    uploadFrame(slot);
+    playback.currentFrame = playback.nextDisplay % playback.frameCount;
+    playback.nextDisplay += 1;
+
+    playback.mutex.lock();
+    slot.free();
+    slot.state = .empty;
+    playback.cond.broadcast();
+    playback.mutex.unlock();
+
+    // Schedule the next frame, don't try to catch up after a stall
+    const period: u64 = @intFromFloat(std.time.ns_per_s / @max(playback.fps, 0.1));
+    playback.nextDeadline += period;
+    if (playback.nextDeadline < now) {
+        playback.nextDeadline = now + period;
+    }
+}
+
+/// Draw the current sequence frame
+pub fn draw() void {
+    gl.BindVertexArray(playback.vaos[playback.ringIndex]);
+    gl.DrawElements(gl.TRIANGLES, @intCast(playback.indexCount), gl.UNSIGNED_INT, 0);
+}
+
+/// Triangles drawn per sequence frame
+pub fn triangleCount() usize {
+    return playback.indexCount / 3;
+}
+
+/// Upload a decoded frame into the next buffer of the GPU ring
+fn uploadFrame(slot: *const Slot) void {
+    // Failed frames are skipped and keep the previous frame on screen
+    if (slot.dynamic.len == 0) {
+        return;
+    }
+
+    playback.ringIndex = (playback.ringIndex + 1) % GPU_RING_SIZE;
+
+    // New topology: upload UVs, tangents and indices and rebind all vertex arrays
+    const topologyChanged = playback.topologyHash == null or
+        playback.topologyHash.? != slot.topologyHash or
+        playback.indexCount != slot.indices.len;
+    if (topologyChanged) {
+        gl.BindBuffer(gl.ARRAY_BUFFER, playback.staticVbo);
+        gl.BufferData(gl.ARRAY_BUFFER, @intCast(slot.static.len * @sizeOf(f32)), slot.static.ptr, gl.STATIC_DRAW);
+        memory.trackGpu(.buffer, playback.staticVbo, slot.static.len * @sizeOf(f32));
+
+        for (playback.vaos, playback.dynamicVbos) |vao, dynamicVbo| {
+            gl.BindVertexArray(vao);
+            gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER, playback.ebo);
+
+            // Position (location = 0) and normals (location = 2)
+            gl.BindBuffer(gl.ARRAY_BUFFER, dynamicVbo);
+            gl.VertexAttribPointer(0, 3, gl.FLOAT, gl.FALSE, DYNAMIC_STRIDE * @sizeOf(f32), 0);
+            gl.EnableVertexAttribArray(0);
+            gl.VertexAttribPointer(2, 3, gl.FLOAT, gl.FALSE, DYNAMIC_STRIDE * @sizeOf(f32), 3 * @sizeOf(f32));
+            gl.EnableVertexAttribArray(2);
+
+            // UVs (location = 1) and tangents (location = 3)
+            gl.BindBuffer(gl.ARRAY_BUFFER, playback.staticVbo);
+            gl.VertexAttribPointer(1, 2, gl.FLOAT, gl.FALSE, STATIC_STRIDE * @sizeOf(f32), 0);
+            gl.EnableVertexAttribArray(1);
+            gl.VertexAttribPointer(3, 3, gl.FLOAT, gl.FALSE, STATIC_STRIDE * @sizeOf(f32), 2 * @sizeOf(f32));
+            gl.EnableVertexAttribArray(3);
+        }
+
+        gl.BindVertexArray(playback.vaos[playback.ringIndex]);
+        gl.BufferData(gl.ELEMENT_ARRAY_BUFFER, @intCast(slot.indices.len * @sizeOf(u32)), slot.indices.ptr, gl.STATIC_DRAW);
+        memory.trackGpu(.buffer, playback.ebo, slot.indices.len * @sizeOf(u32));
+
+        playback.topologyHash = slot.topologyHash;
+        playback.indexCount = slot.indices.len;
+    }
+
+    // Positions and normals, orphaning the buffer the GPU used GPU_RING_SIZE frames ago
+    gl.BindBuffer(gl.ARRAY_BUFFER, playback.dynamicVbos[playback.ringIndex]);
+    gl.BufferData(gl.ARRAY_BUFFER, @intCast(slot.dynamic.len * @sizeOf(f32)), slot.dynamic.ptr, gl.STREAM_DRAW);
+    memory.trackGpu(.buffer, playback.dynamicVbos[playback.ringIndex], slot.dynamic.len * @sizeOf(f32));
+}
+
+/// Worker thread: decode frames into free ring slots until playback stops
+fn workerMain(seq: *Sequence) void {
+    while (true) {
+        // Claim the next ticket once its slot is free
+        seq.mutex.lock();
+        while (!seq.stopping and seq.slots[seq.nextDecode % RING_SIZE].state != .empty) {
+            seq.cond.wait(&seq.mutex);
+        }
+        if (seq.stopping) {
+            seq.mutex.unlock();
+            return;
+        }
+        const ticket = seq.nextDecode;
+        const slot = &seq.slots[ticket % RING_SIZE];
+        slot.state = .loading;
+        slot.ticket = ticket;
+        seq.nextDecode += 1;
+        seq.mutex.unlock();
+
+        // Decode outside the lock, playback loops over the sequence
+        var decoded = Slot{ .ticket = ticket };
+        if (decodeFrame(seq, ticket % seq.frameCount, &decoded)) {
+            metrics.add(.sequenceFrames, 1);
+        } else |err| {
+            diagnostics.report(.ObjFileMalformed, 0, "Failed to decode sequence frame {d}: {s}", .{ ticket % seq.frameCount, @errorName(err) });
+            decoded.free();
+        }
+        diagnostics.flush();
+
+        seq.mutex.lock();
+        decoded.state = .ready;
+        slot.* = decoded;
+        seq.cond.broadcast();
+        seq.mutex.unlock();
+    }
+}
+
+/// Parse a frame and split its interleaved vertices into the dynamic and static streams
+fn decodeFrame(seq: *const Sequence, frame: usize, slot: *Slot) !void {
+    var pathBuf: [512]u8 = undefined;
+    const path = try seq.framePath(&pathBuf, frame);
+
+    var obj = try objectLoader.loadGeometry(path, allocator);
+    defer obj.deinit();
+    if (obj.ebo.items.len == 0) {
+        return error.EmptyFrame;
+    }
+
+    const data = try mesh.convertFaces(&obj, allocator);
+    defer allocator.free(data.vertices);
+    errdefer allocator.free(data.indices);
+
+    const vertexCount = data.vertices.len / mesh.VERTEX_STRIDE;
+    slot.dynamic = try allocator.alloc(f32, vertexCount * DYNAMIC_STRIDE);
+    slot.static = try allocator.alloc(f32, vertexCount * STATIC_STRIDE);
+
+    for (0..vertexCount) |i| {
+        const src = data.vertices[i * mesh.VERTEX_STRIDE ..][0..mesh.VERTEX_STRIDE];
+        const dynamic = slot.dynamic[i * DYNAMIC_STRIDE ..][0..DYNAMIC_STRIDE];
+        const static = slot.static[i * STATIC_STRIDE ..][0..STATIC_STRIDE];
+
+        @memcpy(dynamic[0..3], src[0..3]); // Position
+        @memcpy(dynamic[3..6], src[5..8]); // Normal
+        @memcpy(static[0..2], src[3..5]); // UV
+        @memcpy(static[2..5], src[8..11]); // Tangent
+    }
+
+    slot.indices = data.indices;
+    slot.topologyHash = topologyHash(&obj);
+}
+
+/// Hash the face indices and UVs, equal hashes share the static stream and index buffer
+fn topologyHash(obj: *const objectLoader.ObjectStruct) u64 {
+    var hasher = std.hash.Wyhash.init(0);
+    for (obj.ebo.items) |face| {
+        hasher.update(std.mem.asBytes(&face.face));
+        hasher.update(std.mem.asBytes(&face.texCoordIndices));
+    }
+    hasher.update(std.mem.sliceAsBytes(obj.texCoords.items));
+    return hasher.final();
+}
@@ -1,10 +1,12 @@
 //! Shader compilation utilities.
 //!
-//! Provides functions to compile vertex and fragment shaders and link them
+//! Provides functions to compile vertex, geometry and fragment shaders and link them
 
 const gl = @import("gl");
 const std = @import("std");
 
+const glDebug = @import("glDebug.zig");
+
 /// Compiles a vertex and fragment shader and links them into a program
 /// Reads the shader source from a file
 pub fn compile(allocator: std.mem.Allocator, vertex_path: []const u8, fragment_path: []const u8) !gl.uint {
@@ -16,8 +18,32 @@ pub fn compile(allocator: std.mem.Allocator, vertex_path: []const u8, fragment_p
 
     // Compile and link shaders
     const vs = try compileShader(vs_src, gl.VERTEX_SHADER);
+    glDebug.label(.shader, vs, "{s}", .{std.fs.path.basename(vertex_path)});
     const fs = try compileShader(fs_src, gl.FRAGMENT_SHADER);
-    return try linkProgram(vs, fs);
+    glDebug.label(.shader, fs, "{s}", .{std.fs.path.basename(fragment_path)});
+
+    const program = try linkProgram(&.{ vs, fs });
+    glDebug.label(.program, program, "{s} + {s}", .{ std.fs.path.basename(vertex_path), std.fs.path.basename(fragment_path) });
+    return program;
+}
+
+/// Compiles a vertex, geometry and fragment shader and links them into a program
+/// Reads the shader source from a file
+pub fn compileWithGeometry(allocator: std.mem.Allocator, vertex_path: []const u8, geometry_path: []const u8, fragment_path: []const u8) !gl.uint {
+    const paths = [_][]const u8{ vertex_path, geometry_path, fragment_path };
+    const types = [_]gl.@"enum"{ gl.VERTEX_SHADER, gl.GEOMETRY_SHADER, gl.FRAGMENT_SHADER };
+
+    var shaders: [paths.len]gl.uint = undefined;
+    for (paths, types, &shaders) |path, shader_type, *shader| {
+        const src = try std.fs.cwd().readFileAlloc(allocator, path, 1 << 20);
+        defer allocator.free(src);
+        shader.* = try compileShader(src, shader_type);
+        glDebug.label(.shader, shader.*, "{s}", .{std.fs.path.basename(path)});
+    }
+
+    const program = try linkProgram(&shaders);
+    glDebug.label(.program, program, "{s} + {s} + {s}", .{ std.fs.path.basename(vertex_path), std.fs.path.basename(geometry_path), std.fs.path.basename(fragment_path) });
+    return program;
 }
 
 /// Compiles a given shader source as a given shader type
@@ -39,12 +65,13 @@ fn compileShader(source: []const u8, shader_type: gl.@"enum") !gl.uint {
     return shader;
 }
 
-/// Links a vertex and fragment shader into a program
-fn linkProgram(vs: gl.uint, fs: gl.uint) !gl.uint {
+/// Links compiled shaders into a program
+fn linkProgram(shaders: []const gl.uint) !gl.uint {
     // Create program in OpenGL and attach shaders
     const program = gl.CreateProgram();
-    gl.AttachShader(program, vs);
-    gl.AttachShader(program, fs);
+    for (shaders) |shader| {
+        gl.AttachShader(program, shader);
+    }
     gl.LinkProgram(program);
 
     // Error handling
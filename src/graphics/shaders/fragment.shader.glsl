@@ -1,10 +1,12 @@
 #version 450 core
 
-in vec2 UV;
-in vec3 Normal;
-in vec3 Tangent;
-in vec3 FragPos;
-out vec4 FragColor;
+layout (location = 0) in vec2 UV;
+layout (location = 1) in vec3 Normal;
+layout (location = 2) in vec3 Tangent;
+layout (location = 3) in vec3 FragPos;
+layout (location = 4) noperspective in vec3 EdgeDistance; // Pixels to the triangle edges (wireframe only)
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out float Revealage; // Only bound in the transparent pass
 
 uniform sampler2D textureDiffuse;
 uniform sampler2D textureNormal;
@@ -22,15 +24,46 @@ uniform vec4 defaultColor;
 uniform vec3 materialSpecular;
 uniform float roughness;
 uniform float metallic;
+uniform int roughnessChannel; // glTF: green of the metallicRoughness texture
+uniform int metallicChannel;  // glTF: blue of the same texture
+uniform float opacity; // MTL d (1 - Tr)
+
+// Weighted blended OIT (see transparency.zig)
+uniform bool oitPass;
+
+// Wireframe on shaded, edge distances from wireframe.geometry.shader.glsl
+uniform bool wireframe;
+uniform float wireframeWidth; // Pixels
+uniform vec3 wireframeColor;
 
 // Lighting uniforms
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
+// Image based lighting (prefiltered on the CPU, see environment.zig)
+uniform bool useEnvironment;
+uniform vec3 shCoefficients[9];
+uniform samplerCube environmentSpecular;
+uniform sampler2D brdfLut;
+uniform float specularLevels;
+
 // PBR Constants
 const float PI = 3.14159265359;
 const vec3 dielectricSpecular = vec3(0.04);
 
+// Irradiance / PI from 9 SH coefficients
+vec3 irradianceSH(vec3 n) {
+    return shCoefficients[0] * 0.282095
+        + shCoefficients[1] * 0.488603 * n.y
+        + shCoefficients[2] * 0.488603 * n.z
+        + shCoefficients[3] * 0.488603 * n.x
+        + shCoefficients[4] * 1.092548 * n.x * n.y
+        + shCoefficients[5] * 1.092548 * n.y * n.z
+        + shCoefficients[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+        + shCoefficients[7] * 1.092548 * n.x * n.z
+        + shCoefficients[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
 void main() {
     // Base color
     vec3 albedo = useTexture ? texture(textureDiffuse, UV).rgb : defaultColor.rgb;
@@ -56,10 +89,10 @@ void main() {
     float finalMetallic = metallic;
 
     if (useRoughnessMap)
-    finalRoughness = texture(textureRoughness, UV).r;
+    finalRoughness = texture(textureRoughness, UV)[roughnessChannel];
 
     if (useMetallicMap)
-    finalMetallic = texture(textureMetallic, UV).r;
+    finalMetallic = texture(textureMetallic, UV)[metallicChannel];
 
     // Metallic workflow
     vec3 diffuseColor = albedo * (1.0 - finalMetallic);
@@ -87,5 +120,30 @@ void main() {
 
     // Combine results with energy conservation
     vec3 finalColor = (diffuse + specular) * NdotL;
-    FragColor = vec4(pow(finalColor, vec3(1.0/2.2)), 1.0); // Gamma correction
+
+    // Environment: SH irradiance, prefiltered specular and split-sum BRDF
+    if (useEnvironment) {
+        vec3 irradiance = max(irradianceSH(normal), vec3(0.0));
+        vec3 reflected = reflect(-viewDir, normal);
+        vec3 prefiltered = textureLod(environmentSpecular, reflected, finalRoughness * (specularLevels - 1.0)).rgb;
+        vec2 brdf = texture(brdfLut, vec2(NdotV, finalRoughness)).rg;
+        finalColor += irradiance * diffuseColor + prefiltered * (specularColor * brdf.x + brdf.y);
+    }
+    vec3 color = pow(finalColor, vec3(1.0/2.2)); // Gamma correction
+
+    if (wireframe) {
+        float edgeDistance = min(EdgeDistance.x, min(EdgeDistance.y, EdgeDistance.z));
+        float edge = 1.0 - smoothstep(wireframeWidth * 0.5 - 0.5, wireframeWidth * 0.5 + 0.5, edgeDistance);
+        color = mix(color, wireframeColor, edge);
+    }
+
+    if (oitPass) {
+        // Weight favors near and opaque surfaces (McGuire and Bavoil, equation 10)
+        float weight = clamp(pow(min(1.0, opacity * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+        FragColor = vec4(color * opacity, opacity) * weight;
+        Revealage = opacity;
+    } else {
+        FragColor = vec4(color, 1.0);
+        Revealage = 1.0;
+    }
 }
\ No newline at end of file
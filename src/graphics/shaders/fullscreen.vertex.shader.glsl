@@ -0,0 +1,10 @@
+#version 450 core
+
+// Full screen triangle from gl_VertexID, drawn without vertex buffers
+out vec2 UV;
+
+void main() {
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    UV = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,119 @@
+#version 450 core
+
+// FXAA (after Timothy Lottes' FXAA 3.11 quality path) on the gamma encoded scene color
+in vec2 UV;
+out vec4 FragColor;
+
+uniform sampler2D sceneColor;
+uniform vec2 inverseSize;       // 1 / target size
+uniform float subpixel;         // Subpixel aliasing removal (0 .. 1)
+uniform float edgeThreshold;    // Minimum contrast relative to the brightest neighbor
+uniform float edgeThresholdMin; // Minimum absolute contrast
+uniform int searchSteps;        // Edge search samples per direction (at most 12)
+
+// Distance between edge search samples, larger steps further out
+const float STEP_SIZES[12] = float[](1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0);
+
+float luma(vec3 color) {
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+float lumaAt(vec2 uv) {
+    return luma(textureLod(sceneColor, uv, 0.0).rgb);
+}
+
+float lumaOffset(ivec2 offset) {
+    return luma(textureLodOffset(sceneColor, UV, 0.0, offset).rgb);
+}
+
+void main() {
+    vec3 center = textureLod(sceneColor, UV, 0.0).rgb;
+    float lumaM = luma(center);
+    float lumaN = lumaOffset(ivec2(0, 1));
+    float lumaS = lumaOffset(ivec2(0, -1));
+    float lumaE = lumaOffset(ivec2(1, 0));
+    float lumaW = lumaOffset(ivec2(-1, 0));
+
+    // Early exit for low contrast
+    float lumaMax = max(lumaM, max(max(lumaN, lumaS), max(lumaE, lumaW)));
+    float lumaMin = min(lumaM, min(min(lumaN, lumaS), min(lumaE, lumaW)));
+    float range = lumaMax - lumaMin;
+    if (range < max(edgeThresholdMin, lumaMax * edgeThreshold)) {
+        FragColor = vec4(center, 1.0);
+        return;
+    }
+
+    float lumaNE = lumaOffset(ivec2(1, 1));
+    float lumaNW = lumaOffset(ivec2(-1, 1));
+    float lumaSE = lumaOffset(ivec2(1, -1));
+    float lumaSW = lumaOffset(ivec2(-1, -1));
+
+    // Subpixel blend from the contrast to the 3x3 average
+    float average = (2.0 * (lumaN + lumaS + lumaE + lumaW) + lumaNE + lumaNW + lumaSE + lumaSW) / 12.0;
+    float subpixelBlend = smoothstep(0.0, 1.0, clamp(abs(average - lumaM) / range, 0.0, 1.0));
+    subpixelBlend = subpixelBlend * subpixelBlend * subpixel;
+
+    // Edge orientation
+    float horizontal = abs(lumaN + lumaS - 2.0 * lumaM) * 2.0 + abs(lumaNE + lumaSE - 2.0 * lumaE) + abs(lumaNW + lumaSW - 2.0 * lumaW);
+    float vertical = abs(lumaE + lumaW - 2.0 * lumaM) * 2.0 + abs(lumaNE + lumaNW - 2.0 * lumaN) + abs(lumaSE + lumaSW - 2.0 * lumaS);
+    bool isHorizontal = horizontal >= vertical;
+
+    // Side of the edge with the steeper gradient
+    float luma1 = isHorizontal ? lumaS : lumaW;
+    float luma2 = isHorizontal ? lumaN : lumaE;
+    float gradient1 = abs(luma1 - lumaM);
+    float gradient2 = abs(luma2 - lumaM);
+    bool negative = gradient1 >= gradient2;
+    float gradientScaled = 0.25 * max(gradient1, gradient2);
+
+    float stepLength = isHorizontal ? inverseSize.y : inverseSize.x;
+    float lumaLocalAverage = 0.5 * ((negative ? luma1 : luma2) + lumaM);
+    if (negative) stepLength = -stepLength;
+
+    vec2 edgeUV = UV;
+    if (isHorizontal) {
+        edgeUV.y += stepLength * 0.5;
+    } else {
+        edgeUV.x += stepLength * 0.5;
+    }
+
+    // Search both directions along the edge for its ends
+    vec2 offset = isHorizontal ? vec2(inverseSize.x, 0.0) : vec2(0.0, inverseSize.y);
+    vec2 uv1 = edgeUV - offset;
+    vec2 uv2 = edgeUV + offset;
+    float lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+    float lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+    bool reached1 = abs(lumaEnd1) >= gradientScaled;
+    bool reached2 = abs(lumaEnd2) >= gradientScaled;
+
+    for (int i = 1; i < searchSteps && !(reached1 && reached2); i++) {
+        if (!reached1) {
+            uv1 -= offset * STEP_SIZES[i];
+            lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+        }
+        if (!reached2) {
+            uv2 += offset * STEP_SIZES[i];
+            lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+        }
+    }
+
+    // Offset towards the closer end, only if the luma there varies in the direction of the center
+    float distance1 = isHorizontal ? UV.x - uv1.x : UV.y - uv1.y;
+    float distance2 = isHorizontal ? uv2.x - UV.x : uv2.y - UV.y;
+    bool closerToEnd1 = distance1 < distance2;
+    float pixelOffset = 0.5 - min(distance1, distance2) / (distance1 + distance2);
+
+    bool centerSmaller = lumaM < lumaLocalAverage;
+    bool correctVariation = ((closerToEnd1 ? lumaEnd1 : lumaEnd2) < 0.0) != centerSmaller;
+    float finalOffset = max(correctVariation ? pixelOffset : 0.0, subpixelBlend);
+
+    vec2 finalUV = UV;
+    if (isHorizontal) {
+        finalUV.y += finalOffset * stepLength;
+    } else {
+        finalUV.x += finalOffset * stepLength;
+    }
+    FragColor = vec4(textureLod(sceneColor, finalUV, 0.0).rgb, 1.0);
+}
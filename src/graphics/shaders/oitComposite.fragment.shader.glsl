@@ -0,0 +1,18 @@
+#version 450 core
+
+// Weighted blended OIT composite, blended over the opaque color with SRC_ALPHA, ONE_MINUS_SRC_ALPHA
+in vec2 UV;
+out vec4 FragColor;
+
+uniform sampler2D accumTexture;
+uniform sampler2D revealageTexture;
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float revealage = texelFetch(revealageTexture, texel, 0).r;
+    if (revealage >= 1.0) discard; // No transparent surface here
+
+    vec4 accum = texelFetch(accumTexture, texel, 0);
+    vec3 average = accum.rgb / clamp(accum.a, 1e-4, 5e4);
+    FragColor = vec4(average, 1.0 - revealage);
+}
@@ -0,0 +1,13 @@
+#version 450 core
+
+in vec4 Color;
+out vec4 FragColor;
+
+void main() {
+    // Round points
+    vec2 coord = gl_PointCoord - vec2(0.5);
+    if (dot(coord, coord) > 0.25)
+    discard;
+
+    FragColor = Color;
+}
\ No newline at end of file
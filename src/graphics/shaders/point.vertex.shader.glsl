@@ -0,0 +1,15 @@
+#version 450 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aColor;
+
+out vec4 Color;
+
+uniform mat4 MVP;
+uniform float pointSize;
+
+void main() {
+    gl_Position = MVP * vec4(aPos, 1.0);
+    gl_PointSize = pointSize; // Screen-space size in pixels
+    Color = aColor;
+}
\ No newline at end of file
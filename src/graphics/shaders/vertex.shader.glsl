@@ -5,18 +5,22 @@ layout (location = 1) in vec2 aUV;
 layout (location = 2) in vec3 aNormal;
 layout (location = 3) in vec3 aTangent;
 
-out vec2 UV;
-out vec3 Normal;
-out vec3 Tangent;
-out vec3 FragPos;
+// Locations match wireframe.geometry.shader.glsl and the fragment shader
+layout (location = 0) out vec2 UV;
+layout (location = 1) out vec3 Normal;
+layout (location = 2) out vec3 Tangent;
+layout (location = 3) out vec3 FragPos;
+layout (location = 4) noperspective out vec3 EdgeDistance; // Written by the wireframe geometry shader
 
 uniform mat4 MVP;
 uniform mat4 Model;
+uniform mat3 NormalMatrix; // Model 3x3 / scale^2, computed with the world matrix
 
 void main() {
     gl_Position = MVP * vec4(aPos, 1.0);
     UV = aUV;
     FragPos = vec3(Model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(Model))) * aNormal;
-    Tangent = mat3(transpose(inverse(Model))) * aTangent;
+    Normal = NormalMatrix * aNormal;
+    Tangent = NormalMatrix * aTangent;
+    EdgeDistance = vec3(0.0);
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+#version 450 core
+
+// Passes triangles through and adds the screen space distance of every vertex to the opposite
+// edge. Interpolated without perspective, the fragment shader gets its distance to each edge in
+// pixels and draws the wireframe in the same pass as the shading.
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 3) out;
+
+layout (location = 0) in vec2 inUV[];
+layout (location = 1) in vec3 inNormal[];
+layout (location = 2) in vec3 inTangent[];
+layout (location = 3) in vec3 inFragPos[];
+
+layout (location = 0) out vec2 UV;
+layout (location = 1) out vec3 Normal;
+layout (location = 2) out vec3 Tangent;
+layout (location = 3) out vec3 FragPos;
+layout (location = 4) noperspective out vec3 EdgeDistance;
+
+uniform vec2 viewportSize;
+
+void main() {
+    // No edges for triangles crossing the camera plane
+    bool visible = gl_in[0].gl_Position.w > 0.0 && gl_in[1].gl_Position.w > 0.0 && gl_in[2].gl_Position.w > 0.0;
+    vec3 heights = vec3(0.0);
+    if (visible) {
+        vec2 p0 = 0.5 * viewportSize * gl_in[0].gl_Position.xy / gl_in[0].gl_Position.w;
+        vec2 p1 = 0.5 * viewportSize * gl_in[1].gl_Position.xy / gl_in[1].gl_Position.w;
+        vec2 p2 = 0.5 * viewportSize * gl_in[2].gl_Position.xy / gl_in[2].gl_Position.w;
+
+        // Height over each edge = 2 * area / edge length
+        vec2 e0 = p2 - p1;
+        vec2 e1 = p2 - p0;
+        vec2 e2 = p1 - p0;
+        float area = abs(e1.x * e2.y - e1.y * e2.x);
+        heights = area / max(vec3(length(e0), length(e1), length(e2)), vec3(1e-6));
+    }
+
+    for (int i = 0; i < 3; i++) {
+        UV = inUV[i];
+        Normal = inNormal[i];
+        Tangent = inTangent[i];
+        FragPos = inFragPos[i];
+        EdgeDistance = visible ? vec3(0.0) : vec3(1e6);
+        EdgeDistance[i] = visible ? heights[i] : 1e6;
+        gl_Position = gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
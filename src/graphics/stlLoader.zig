@@ -0,0 +1,444 @@
+//! Load binary .stl files (CAD exports) as compact indexed meshes
+//!
+//! Maps the file and welds corner positions closer than the tolerance in parallel on a spatial grid.
+//! Corners are bucketed once by hash partition, every thread indexes the cells of its partition
+//! and then searches the 27 surrounding cells read only, so no locking is needed while welding.
+//! Normals are averaged per welded vertex, split at creases sharper than the crease angle.
+
+const std = @import("std");
+
+const mesh = @import("mesh.zig");
+const objectLoader = @import("objectLoader.zig");
+const diagnostics = @import("../util/diagnostics.zig");
+const mappedFile = @import("../util/mappedFile.zig");
+const memory = @import("../util/memory.zig");
+
+const HEADER_SIZE = 84; // 80 byte header + u32 triangle count
+const TRIANGLE_SIZE = 50; // Normal, 3 corners and attribute byte count
+const MAX_THREADS = 16;
+
+/// Weld tolerance relative to the largest bounding box extent
+pub var weldTolerance: f32 = 1e-5;
+
+/// Faces meeting at a sharper angle get separate normals (180 = fully smooth)
+pub var creaseAngle: f32 = 30.0;
+
+/// Weld grid cell of a position, cells are as large as the tolerance
+const Key = [3]i32;
+
+/// Corners of one hash partition, grouped by cell
+///
+/// Contains:
+/// - cells: cell key -> cell index
+/// - cellStart: first entry of every cell in cellCorners (one extra entry at the end)
+/// - cellCorners: corner indices, ascending within every cell
+const Partition = struct {
+    cells: std.AutoHashMapUnmanaged(Key, u32) = .{},
+    cellStart: []u32 = &.{},
+    cellCorners: []u32 = &.{},
+
+    fn deinit(self: *Partition) void {
+        self.cells.deinit(allocator);
+        allocator.free(self.cellStart);
+        allocator.free(self.cellCorners);
+    }
+
+    /// Corners in the given cell, empty if the cell is not owned or empty
+    fn corners(self: *const Partition, key: Key) []const u32 {
+        const cell = self.cells.get(key) orelse return &.{};
+        return self.cellCorners[self.cellStart[cell]..self.cellStart[cell + 1]];
+    }
+};
+
+/// Corner data shared by the weld threads
+const WeldJob = struct {
+    positions: []const [3]f32,
+    keys: []Key,
+    partitionOf: []u8,
+    order: []u32, // Corners bucketed by partition, ascending within a bucket
+    bucketStart: []usize, // threadCount + 1 entries
+    partitions: []Partition,
+    representative: []u32, // Corner -> lowest corner index within the tolerance
+    threadCount: usize,
+    min: [3]f32,
+    invCell: f32,
+    failed: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    /// Phase 1: quantize a contiguous range of corners and pick their partition
+    fn quantize(self: *WeldJob, thread: usize) void {
+        const chunk = (self.positions.len + self.threadCount - 1) / self.threadCount;
+        const start = @min(thread * chunk, self.positions.len);
+        const end = @min(start + chunk, self.positions.len);
+        for (start..end) |i| {
+            const p = self.positions[i];
+            // Positions are finite and inside the grid, checked by load
+            const key = Key{
+                @intFromFloat(@floor((p[0] - self.min[0]) * self.invCell)),
+                @intFromFloat(@floor((p[1] - self.min[1]) * self.invCell)),
+                @intFromFloat(@floor((p[2] - self.min[2]) * self.invCell)),
+            };
+            self.keys[i] = key;
+            self.partitionOf[i] = self.owner(key);
+        }
+    }
+
+    /// Phase 2: group the corners of one partition by cell
+    fn buildCells(self: *WeldJob, partition: usize) void {
+        self.indexCells(partition) catch self.failed.store(true, .monotonic);
+    }
+
+    fn indexCells(self: *WeldJob, partition: usize) !void {
+        const bucket = self.order[self.bucketStart[partition]..self.bucketStart[partition + 1]];
+        const target = &self.partitions[partition];
+
+        // Count the corners per cell, then place them (bucket order keeps every cell ascending)
+        var counts = std.ArrayList(u32).init(allocator);
+        defer counts.deinit();
+        for (bucket) |corner| {
+            const entry = try target.cells.getOrPut(allocator, self.keys[corner]);
+            if (!entry.found_existing) {
+                entry.value_ptr.* = @intCast(counts.items.len);
+                try counts.append(0);
+            }
+            counts.items[entry.value_ptr.*] += 1;
+        }
+
+        target.cellStart = try allocator.alloc(u32, counts.items.len + 1);
+        target.cellStart[0] = 0;
+        for (counts.items, 0..) |count, cell| {
+            target.cellStart[cell + 1] = target.cellStart[cell] + count;
+        }
+        @memcpy(counts.items, target.cellStart[0..counts.items.len]); // Reused as fill cursor
+
+        target.cellCorners = try allocator.alloc(u32, bucket.len);
+        for (bucket) |corner| {
+            const cursor = &counts.items[target.cells.get(self.keys[corner]).?];
+            target.cellCorners[cursor.*] = corner;
+            cursor.* += 1;
+        }
+    }
+
+    /// Phase 3: find the lowest corner within the tolerance in the 27 surrounding cells
+    /// Only reads the other partitions, every corner is written by its own partition
+    fn findRepresentatives(self: *WeldJob, partition: usize) void {
+        const cell = 1.0 / self.invCell;
+        const toleranceSq = cell * cell;
+
+        for (self.order[self.bucketStart[partition]..self.bucketStart[partition + 1]]) |corner| {
+            const p = self.positions[corner];
+            const key = self.keys[corner];
+            var best: u32 = corner;
+
+            for (0..27) |n| {
+                const neighbour = Key{
+                    key[0] + @as(i32, @intCast(n % 3)) - 1,
+                    key[1] + @as(i32, @intCast(n / 3 % 3)) - 1,
+                    key[2] + @as(i32, @intCast(n / 9)) - 1,
+                };
+                for (self.partitions[self.owner(neighbour)].corners(neighbour)) |candidate| {
+                    if (candidate >= best) break; // Ascending, nothing lower follows
+                    const d = sub(self.positions[candidate], p);
+                    if (dot(d, d) <= toleranceSq) {
+                        best = candidate;
+                        break;
+                    }
+                }
+            }
+            self.representative[corner] = best;
+        }
+    }
+
+    fn owner(self: *const WeldJob, key: Key) u8 {
+        return @intCast(std.hash.Wyhash.hash(0, std.mem.asBytes(&key)) % self.threadCount);
+    }
+};
+
+const allocator = memory.allocator(.parser);
+
+/// Load a binary .stl file into the object struct and return the indexed vertex data
+///
+/// obj receives the welded positions, one normal per output vertex and the faces.
+/// The returned buffers use the mesh.VERTEX_STRIDE layout and are owned by the caller.
+pub fn load(path: []const u8, obj: *objectLoader.ObjectStruct, outAllocator: std.mem.Allocator) !mesh.Interleaved {
+    var file = try mappedFile.MappedFile.open(allocator, path);
+    defer file.close();
+    const data = file.data;
+
+    if (data.len < HEADER_SIZE) {
+        diagnostics.report(.ObjFileMalformed, 0, "STL file too small: {d} bytes", .{data.len});
+        return error.StlTruncated;
+    }
+
+    const triangleCount: usize = std.mem.readInt(u32, data[80..84], .little);
+    if (data.len < HEADER_SIZE + triangleCount * TRIANGLE_SIZE) {
+        if (std.mem.startsWith(u8, data, "solid")) {
+            diagnostics.report(.ObjFileMalformed, 0, "ASCII STL files are not supported, export as binary STL", .{});
+        } else {
+            diagnostics.report(.ObjFileMalformed, 0, "STL file truncated: {d} triangles declared", .{triangleCount});
+        }
+        return error.StlTruncated;
+    }
+    if (triangleCount == 0) return error.StlEmpty;
+
+    // Corner positions straight from the mapped records
+    const cornerCount = triangleCount * 3;
+    const positions = try allocator.alloc([3]f32, cornerCount);
+    defer allocator.free(positions);
+    for (0..triangleCount) |t| {
+        const record = data[HEADER_SIZE + t * TRIANGLE_SIZE + 12 ..];
+        for (0..3) |c| {
+            for (0..3) |axis| {
+                const offset = c * 12 + axis * 4;
+                positions[t * 3 + c][axis] = @bitCast(std.mem.readInt(u32, record[offset..][0..4], .little));
+            }
+        }
+    }
+
+    // Weld grid from the bounding box
+    var min = positions[0];
+    var max = positions[0];
+    for (positions, 0..) |p, i| {
+        for (0..3) |axis| {
+            if (!std.math.isFinite(p[axis])) {
+                diagnostics.report(.ObjFileMalformed, 0, "STL triangle {d} has a NaN or infinite corner", .{i / 3});
+                return error.StlInvalidPosition;
+            }
+            min[axis] = @min(min[axis], p[axis]);
+            max[axis] = @max(max[axis], p[axis]);
+        }
+    }
+    const extent = @max(@max(max[0] - min[0], max[1] - min[1]), max[2] - min[2]);
+    const cell = if (extent > 0) extent * weldTolerance else 1.0;
+    // Neighbour keys (+-1) must stay inside i32
+    if (!(extent / cell < 1 << 30)) return error.StlWeldToleranceTooSmall;
+
+    const weldedIndices = try weldPositions(positions, min, 1.0 / cell);
+    defer allocator.free(weldedIndices.remap);
+    defer allocator.free(weldedIndices.representatives);
+
+    // Welded positions and faces
+    try obj.vbo.ensureTotalCapacity(weldedIndices.representatives.len);
+    for (weldedIndices.representatives) |corner| {
+        obj.vbo.appendAssumeCapacity(.{ .position = positions[corner] });
+    }
+
+    const faceNormals = try allocator.alloc([3]f32, triangleCount);
+    defer allocator.free(faceNormals);
+    for (faceNormals, 0..) |*normal, t| {
+        const a = obj.vbo.items[weldedIndices.remap[t * 3 + 0]].position;
+        const b = obj.vbo.items[weldedIndices.remap[t * 3 + 1]].position;
+        const c = obj.vbo.items[weldedIndices.remap[t * 3 + 2]].position;
+        normal.* = cross(sub(b, a), sub(c, a)); // Area weighted
+    }
+
+    // Split every welded vertex into one output vertex per smoothing group
+    const cornerVertices = try allocator.alloc(u32, cornerCount);
+    defer allocator.free(cornerVertices);
+    try splitNormals(weldedIndices.remap, faceNormals, obj.vbo.items.len, cornerVertices, obj);
+
+    try obj.ebo.ensureTotalCapacity(triangleCount);
+    try obj.faceMaterialIndices.appendNTimes(0, triangleCount);
+    for (0..triangleCount) |t| {
+        const face = [3]usize{ weldedIndices.remap[t * 3], weldedIndices.remap[t * 3 + 1], weldedIndices.remap[t * 3 + 2] };
+        const normalIndices = [3]usize{ cornerVertices[t * 3], cornerVertices[t * 3 + 1], cornerVertices[t * 3 + 2] };
+        obj.ebo.appendAssumeCapacity(.{ .face = face, .texCoordIndices = .{ 0, 0, 0 }, .normalIndices = normalIndices });
+    }
+
+    // Interleaved output, one vertex per (position, normal) pair
+    const vertexCount = obj.normals.items.len;
+    const vertices = try outAllocator.alloc(f32, vertexCount * mesh.VERTEX_STRIDE);
+    errdefer outAllocator.free(vertices);
+    const indices = try outAllocator.alloc(u32, cornerCount);
+
+    for (0..cornerCount) |i| {
+        const vertex = cornerVertices[i];
+        indices[i] = vertex;
+
+        const normal = obj.normals.items[vertex];
+        const out = vertices[vertex * mesh.VERTEX_STRIDE ..][0..mesh.VERTEX_STRIDE];
+        out[0..3].* = obj.vbo.items[weldedIndices.remap[i]].position;
+        out[3..5].* = .{ 0.0, 0.0 }; // STL has no UVs
+        out[5..8].* = normal;
+        out[8..11].* = perpendicular(normal);
+    }
+
+    std.log.info("STL: {d} triangles, {d} corners welded to {d} positions, {d} vertices", .{ triangleCount, cornerCount, obj.vbo.items.len, vertexCount });
+
+    return .{ .vertices = vertices, .indices = indices };
+}
+
+/// Result of the weld: corner -> welded vertex and the first corner of every welded vertex
+const Welded = struct {
+    remap: []u32,
+    representatives: []u32,
+};
+
+/// Weld the corner positions within 1 / invCell of each other
+fn weldPositions(positions: []const [3]f32, min: [3]f32, invCell: f32) !Welded {
+    const cpuCount = std.Thread.getCpuCount() catch 1;
+    const threadCount = std.math.clamp(@min(cpuCount, positions.len / 4096), 1, MAX_THREADS);
+
+    var partitions = [_]Partition{.{}} ** MAX_THREADS;
+    defer for (&partitions) |*partition| partition.deinit();
+
+    const keys = try allocator.alloc(Key, positions.len);
+    defer allocator.free(keys);
+    const partitionOf = try allocator.alloc(u8, positions.len);
+    defer allocator.free(partitionOf);
+    const order = try allocator.alloc(u32, positions.len);
+    defer allocator.free(order);
+    const representative = try allocator.alloc(u32, positions.len);
+    defer allocator.free(representative);
+    var bucketStart: [MAX_THREADS + 1]usize = undefined;
+
+    var job = WeldJob{
+        .positions = positions,
+        .keys = keys,
+        .partitionOf = partitionOf,
+        .order = order,
+        .bucketStart = bucketStart[0 .. threadCount + 1],
+        .partitions = partitions[0..threadCount],
+        .representative = representative,
+        .threadCount = threadCount,
+        .min = min,
+        .invCell = invCell,
+    };
+
+    runPhase(WeldJob.quantize, &job);
+
+    // Bucket the corners by partition once (counting sort), so no thread scans all corners
+    var counts = [_]usize{0} ** MAX_THREADS;
+    for (partitionOf) |p| counts[p] += 1;
+    bucketStart[0] = 0;
+    for (0..threadCount) |p| bucketStart[p + 1] = bucketStart[p] + counts[p];
+    var cursor = bucketStart;
+    for (partitionOf, 0..) |p, corner| {
+        order[cursor[p]] = @intCast(corner);
+        cursor[p] += 1;
+    }
+
+    runPhase(WeldJob.buildCells, &job);
+    if (job.failed.load(.monotonic)) return error.OutOfMemory;
+    runPhase(WeldJob.findRepresentatives, &job);
+
+    // Representatives always precede their corners, so one ascending pass resolves chains
+    const remap = try allocator.alloc(u32, positions.len);
+    errdefer allocator.free(remap);
+    var representatives = std.ArrayList(u32).init(allocator);
+    errdefer representatives.deinit();
+    for (representative, 0..) |first, corner| {
+        if (first == corner) {
+            remap[corner] = @intCast(representatives.items.len);
+            try representatives.append(@intCast(corner));
+        } else {
+            remap[corner] = remap[first];
+        }
+    }
+
+    return .{ .remap = remap, .representatives = try representatives.toOwnedSlice() };
+}
+
+/// Run one weld phase with one task per thread, the calling thread takes index 0
+fn runPhase(comptime phase: fn (*WeldJob, usize) void, job: *WeldJob) void {
+    var threads: [MAX_THREADS]?std.Thread = [_]?std.Thread{null} ** MAX_THREADS;
+    for (1..job.threadCount) |t| {
+        threads[t] = std.Thread.spawn(.{}, phase, .{ job, t }) catch null;
+    }
+    phase(job, 0);
+    for (threads[1..job.threadCount], 1..) |thread, t| {
+        if (thread) |handle| handle.join() else phase(job, t); // Run inline if spawning failed
+    }
+}
+
+/// Group the faces around every welded vertex by normal angle
+///
+/// Writes one normal per group into obj.normals and the group of every corner into cornerVertices.
+fn splitNormals(remap: []const u32, faceNormals: []const [3]f32, vertexCount: usize, cornerVertices: []u32, obj: *objectLoader.ObjectStruct) !void {
+    // Corners per welded vertex (compressed adjacency)
+    const offsets = try allocator.alloc(u32, vertexCount + 1);
+    defer allocator.free(offsets);
+    @memset(offsets, 0);
+    for (remap) |vertex| {
+        offsets[vertex + 1] += 1;
+    }
+    for (1..offsets.len) |v| {
+        offsets[v] += offsets[v - 1];
+    }
+    const corners = try allocator.alloc(u32, remap.len);
+    defer allocator.free(corners);
+    const cursor = try allocator.dupe(u32, offsets[0..vertexCount]);
+    defer allocator.free(cursor);
+    for (remap, 0..) |vertex, corner| {
+        corners[cursor[vertex]] = @intCast(corner);
+        cursor[vertex] += 1;
+    }
+
+    const cosCrease = @cos(std.math.degreesToRadians(std.math.clamp(creaseAngle, 0.0, 180.0)));
+
+    var seeds = std.ArrayList([3]f32).init(allocator); // Unit normal of the first face of each group
+    defer seeds.deinit();
+
+    try obj.normals.ensureTotalCapacity(vertexCount);
+    for (0..vertexCount) |v| {
+        seeds.clearRetainingCapacity();
+        const groupStart = obj.normals.items.len;
+
+        for (corners[offsets[v]..offsets[v + 1]]) |corner| {
+            const faceNormal = faceNormals[corner / 3];
+            const unit = normalize(faceNormal);
+
+            // First group within the crease angle, or a new one
+            var group: usize = seeds.items.len;
+            for (seeds.items, 0..) |seed, g| {
+                if (dot(seed, unit) >= cosCrease) {
+                    group = g;
+                    break;
+                }
+            }
+            if (group == seeds.items.len) {
+                try seeds.append(unit);
+                try obj.normals.append(.{ 0.0, 0.0, 0.0 });
+            }
+
+            const sum = &obj.normals.items[groupStart + group];
+            sum.* = add(sum.*, faceNormal);
+            cornerVertices[corner] = @intCast(groupStart + group);
+        }
+
+        for (obj.normals.items[groupStart..]) |*normal| {
+            normal.* = normalize(normal.*);
+        }
+    }
+}
+
+fn add(a: [3]f32, b: [3]f32) [3]f32 {
+    return .{ a[0] + b[0], a[1] + b[1], a[2] + b[2] };
+}
+
+fn sub(a: [3]f32, b: [3]f32) [3]f32 {
+    return .{ a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+}
+
+fn dot(a: [3]f32, b: [3]f32) f32 {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+fn cross(a: [3]f32, b: [3]f32) [3]f32 {
+    return .{
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0],
+    };
+}
+
+fn normalize(v: [3]f32) [3]f32 {
+    const length = @sqrt(dot(v, v));
+    if (length == 0) return .{ 0.0, 0.0, 1.0 };
+    return .{ v[0] / length, v[1] / length, v[2] / length };
+}
+
+/// Any unit vector perpendicular to n, used as tangent since STL has no UVs
+fn perpendicular(n: [3]f32) [3]f32 {
+    const axis: [3]f32 = if (@abs(n[0]) < 0.9) .{ 1.0, 0.0, 0.0 } else .{ 0.0, 1.0, 0.0 };
+    return normalize(sub(axis, .{ n[0] * dot(axis, n), n[1] * dot(axis, n), n[2] * dot(axis, n) }));
+}
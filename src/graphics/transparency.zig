@@ -0,0 +1,153 @@
+//! Weighted blended order-independent transparency
+//!
+//! Frames with transparent materials (MTL d < 1 or Tr > 0) render into the offscreen scene target
+//! of postProcess.zig. Opaque geometry is drawn first as usual. Transparent geometry is then drawn
+//! once, in any order, into an accumulation target (RGBA16F, weighted premultiplied color) and a
+//! revealage target (R16F, product of 1 - alpha) that share the depth of the opaque pass, with
+//! depth writes off. A full screen pass composites the weighted average over the opaque color.
+//! No per-frame sorting is needed.
+//!
+//! Frames without transparent materials never touch this module.
+
+const std = @import("std");
+const gl = @import("gl");
+
+const shader = @import("shader.zig");
+const postProcess = @import("postProcess.zig");
+const glDebug = @import("glDebug.zig");
+const memory = @import("../util/memory.zig");
+
+// Texture units after the environment maps
+const ACCUM_UNIT = 6;
+const REVEALAGE_UNIT = 7;
+
+/// Accumulation targets, recreated with the scene target
+///
+/// Contains:
+/// - framebuffer: accumulation and revealage, depth of the scene target
+/// - depth: scene depth texture the framebuffer was built with
+const Targets = struct {
+    width: u32 = 0,
+    height: u32 = 0,
+    depth: gl.uint = 0,
+    framebuffer: gl.uint = 0,
+    accum: gl.uint = 0,
+    revealage: gl.uint = 0,
+};
+
+var targets: Targets = .{};
+var compositeProgram: gl.uint = 0;
+var active = false;
+
+/// Compile the composite shader
+pub fn init(allocator: std.mem.Allocator) !void {
+    compositeProgram = try shader.compile(allocator,
+        "src/graphics/shaders/fullscreen.vertex.shader.glsl",
+        "src/graphics/shaders/oitComposite.fragment.shader.glsl");
+}
+
+/// Free the targets and the composite shader
+pub fn deinit() void {
+    releaseTargets();
+    if (compositeProgram != 0) gl.DeleteProgram(compositeProgram);
+    compositeProgram = 0;
+}
+
+/// Prepare the accumulation targets, the scene target of postProcess must be bound
+/// Returns false if the transparent pass is not available this frame
+pub fn beginFrame(width: u32, height: u32) bool {
+    active = false;
+    if (compositeProgram == 0) return false;
+
+    const depth = postProcess.depthTexture();
+    if (targets.width != width or targets.height != height or targets.depth != depth) {
+        releaseTargets();
+        createTargets(width, height, depth) catch |err| {
+            std.log.err("Transparency targets unavailable: {s}", .{@errorName(err)});
+            releaseTargets();
+            return false;
+        };
+    }
+
+    active = true;
+    return true;
+}
+
+/// Switch from the opaque to the transparent pass
+pub fn beginTransparent(program: gl.uint) void {
+    if (!active) return;
+    gl.BindFramebuffer(gl.FRAMEBUFFER, targets.framebuffer);
+
+    const zero = [4]f32{ 0, 0, 0, 0 };
+    const one = [4]f32{ 1, 1, 1, 1 };
+    gl.ClearBufferfv(gl.COLOR, 0, &zero);
+    gl.ClearBufferfv(gl.COLOR, 1, &one);
+
+    gl.DepthMask(gl.FALSE);
+    gl.Enable(gl.BLEND);
+    gl.BlendFunci(0, gl.ONE, gl.ONE); // Weighted sums
+    gl.BlendFunci(1, gl.ZERO, gl.ONE_MINUS_SRC_COLOR); // Product of 1 - alpha
+    gl.Uniform1i(gl.GetUniformLocation(program, "oitPass"), 1);
+}
+
+/// Finish the transparent pass and composite it over the opaque color in the scene target
+pub fn endTransparent(program: gl.uint) void {
+    if (!active) return;
+    active = false;
+    gl.Uniform1i(gl.GetUniformLocation(program, "oitPass"), 0);
+    gl.DepthMask(gl.TRUE);
+
+    glDebug.pushGroup("Transparency composite");
+    defer glDebug.popGroup();
+
+    gl.BindFramebuffer(gl.FRAMEBUFFER, postProcess.sceneFramebuffer());
+    gl.Disable(gl.DEPTH_TEST);
+    gl.BlendFunc(gl.SRC_ALPHA, gl.ONE_MINUS_SRC_ALPHA);
+
+    gl.UseProgram(compositeProgram);
+    gl.ActiveTexture(gl.TEXTURE0 + ACCUM_UNIT);
+    gl.BindTexture(gl.TEXTURE_2D, targets.accum);
+    gl.ActiveTexture(gl.TEXTURE0 + REVEALAGE_UNIT);
+    gl.BindTexture(gl.TEXTURE_2D, targets.revealage);
+    gl.ActiveTexture(gl.TEXTURE0);
+    gl.Uniform1i(gl.GetUniformLocation(compositeProgram, "accumTexture"), ACCUM_UNIT);
+    gl.Uniform1i(gl.GetUniformLocation(compositeProgram, "revealageTexture"), REVEALAGE_UNIT);
+
+    postProcess.drawFullscreen();
+
+    gl.Disable(gl.BLEND);
+    gl.Enable(gl.DEPTH_TEST);
+    gl.UseProgram(program);
+}
+
+fn createTargets(width: u32, height: u32, depth: gl.uint) !void {
+    targets.width = width;
+    targets.height = height;
+    targets.depth = depth;
+
+    targets.accum = postProcess.createTexture(gl.RGBA16F, gl.RGBA, gl.HALF_FLOAT, 8, gl.NEAREST, "OIT accumulation");
+    targets.revealage = postProcess.createTexture(gl.R16F, gl.RED, gl.HALF_FLOAT, 2, gl.NEAREST, "OIT revealage");
+
+    gl.GenFramebuffers(1, (&targets.framebuffer)[0..1]);
+    gl.BindFramebuffer(gl.FRAMEBUFFER, targets.framebuffer);
+    gl.FramebufferTexture2D(gl.FRAMEBUFFER, gl.COLOR_ATTACHMENT0, gl.TEXTURE_2D, targets.accum, 0);
+    gl.FramebufferTexture2D(gl.FRAMEBUFFER, gl.COLOR_ATTACHMENT1, gl.TEXTURE_2D, targets.revealage, 0);
+    gl.FramebufferTexture2D(gl.FRAMEBUFFER, gl.DEPTH_ATTACHMENT, gl.TEXTURE_2D, depth, 0);
+    const drawBuffers = [_]gl.@"enum"{ gl.COLOR_ATTACHMENT0, gl.COLOR_ATTACHMENT1 };
+    gl.DrawBuffers(drawBuffers.len, &drawBuffers);
+    glDebug.label(.framebuffer, targets.framebuffer, "Transparency", .{});
+
+    const status = gl.CheckFramebufferStatus(gl.FRAMEBUFFER);
+    gl.BindFramebuffer(gl.FRAMEBUFFER, postProcess.sceneFramebuffer());
+    if (status != gl.FRAMEBUFFER_COMPLETE) return error.FramebufferIncomplete;
+}
+
+fn releaseTargets() void {
+    for ([_]gl.uint{ targets.accum, targets.revealage }) |texture| {
+        if (texture == 0) continue;
+        memory.untrackGpu(.texture, texture);
+        gl.DeleteTextures(1, (&texture)[0..1]);
+    }
+    if (targets.framebuffer != 0) gl.DeleteFramebuffers(1, (&targets.framebuffer)[0..1]);
+    targets = .{};
+}
@@ -0,0 +1,517 @@
+//! Mesh inspection tool (zigGL-inspect)
+//!
+//! Loads a model through the normal pipeline (mesh.load) in a hidden window and reports what makes
+//! it expensive: triangle and vertex counts, vertices that could be shared, degenerate triangles,
+//! post-transform vertex cache efficiency (ACMR/ATVR of a FIFO cache), an overdraw estimate, the
+//! textures of every material, estimated GPU memory and the time of each load stage.
+//!
+//! The geometry is read back from the GPU buffers, so the report describes exactly what the viewer
+//! draws. The overdraw estimate rasterizes the mesh from the six axis directions into a small depth
+//! buffer in draw order and divides the fragments that pass the depth test by the covered pixels.
+//! glTF primitives are reported from their index streams only (no overdraw, index degenerates).
+//!
+//! Usage: zigGL-inspect <model> [--json] [--cache-size N]
+
+const std = @import("std");
+const gl = @import("gl");
+const glfw = @import("mach-glfw");
+const zstbi = @import("zstbi");
+
+const mesh = @import("./graphics/mesh.zig");
+const objectLoader = @import("./graphics/objectLoader.zig");
+const gltfLoader = @import("./graphics/gltfLoader.zig");
+const memory = @import("./util/memory.zig");
+
+const OVERDRAW_GRID = 256; // Resolution of the overdraw depth buffer per view
+
+var procTable: gl.ProcTable = undefined;
+
+/// Command line options
+///
+/// Contains:
+/// - path: model file (or cube/cat)
+/// - json: print the report as JSON instead of text
+/// - cacheSize: entries of the simulated vertex cache
+const Options = struct {
+    path: []const u8 = "",
+    json: bool = false,
+    cacheSize: usize = 32,
+};
+
+/// Geometry counters, see analyzeIndexed
+///
+/// Contains:
+/// - triangles, vertices: as uploaded
+/// - uniqueVertices: vertices with distinct contents (all attributes), referenced vertices for glTF
+/// - degenerate: triangles with a repeated index or zero area
+/// - acmr: cache misses per triangle (0.5 .. 3, lower is better)
+/// - atvr: cache misses per unique vertex (1 is optimal)
+/// - overdraw: fragments passing the depth test per covered pixel, null without positions
+const Geometry = struct {
+    triangles: usize = 0,
+    vertices: usize = 0,
+    uniqueVertices: usize = 0,
+    degenerate: usize = 0,
+    acmr: f64 = 0,
+    atvr: f64 = 0,
+    overdraw: ?f64 = null,
+};
+
+/// Decoded map of a material
+const Texture = struct {
+    kind: []const u8,
+    path: []const u8,
+    width: u32,
+    height: u32,
+    format: []const u8,
+    bytes: usize,
+};
+
+/// Material with its maps
+const Material = struct {
+    name: []const u8,
+    textures: []const Texture,
+};
+
+/// Stage durations in milliseconds, see mesh.LoadStages
+const Stages = struct {
+    cached: bool,
+    read: f64,
+    materials: f64,
+    materialWait: f64,
+    textureUpload: f64,
+    convert: f64,
+    upload: f64,
+    cacheStore: f64,
+    total: f64,
+};
+
+/// Full report, also the JSON layout
+const Report = struct {
+    path: []const u8,
+    kind: []const u8,
+    points: usize = 0,
+    geometry: Geometry,
+    materials: []const Material,
+    gpu: struct { buffers: usize, textures: usize },
+    stages: Stages,
+};
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const options = parseOptions(args) catch {
+        std.log.err("Usage: zigGL-inspect <model> [--json] [--cache-size N]", .{});
+        return error.InvalidArguments;
+    };
+
+    // Hidden window with the same context as the viewer, textures and buffers are uploaded as usual
+    if (!glfw.init(.{})) {
+        std.log.err("failed to initialize GLFW: {?s}", .{glfw.getErrorString()});
+        return error.GLInitFailed;
+    }
+    defer glfw.terminate();
+
+    const window = glfw.Window.create(64, 64, "zigGL-inspect", null, null, .{
+        .visible = false,
+        .context_version_major = 4,
+        .context_version_minor = 5,
+        .opengl_profile = .opengl_core_profile,
+        .opengl_forward_compat = true,
+    }) orelse return error.WindowCreateFailed;
+    defer window.destroy();
+
+    glfw.makeContextCurrent(window);
+    if (!procTable.init(glfw.getProcAddress)) return error.GLInitFailed;
+    gl.makeProcTableCurrent(&procTable);
+
+    zstbi.init(memory.allocator(.textures));
+    defer zstbi.deinit();
+
+    // The loader only accepts absolute paths (and the bundled cube/cat)
+    const path = std.fs.cwd().realpathAlloc(allocator, options.path) catch |err| blk: {
+        if (std.mem.eql(u8, options.path, "cube") or std.mem.eql(u8, options.path, "cat")) {
+            break :blk try allocator.dupe(u8, options.path);
+        }
+        std.log.err("Cannot open {s}: {s}", .{ options.path, @errorName(err) });
+        return err;
+    };
+    defer allocator.free(path);
+
+    try mesh.load(path);
+    defer mesh.deinit();
+    const loaded = &mesh.loadedObject;
+
+    var arena = std.heap.ArenaAllocator.init(allocator);
+    defer arena.deinit();
+
+    var report = Report{
+        .path = path,
+        .kind = "triangles",
+        .geometry = .{},
+        .materials = try collectMaterials(arena.allocator(), loaded.object),
+        .gpu = .{ .buffers = memory.gpuStats(.buffer), .textures = memory.gpuStats(.texture) },
+        .stages = stagesInMs(mesh.lastStages),
+    };
+
+    if (loaded.points) |cloud| {
+        report.kind = "points";
+        report.points = cloud.pointCount;
+    } else if (loaded.gltf) |model| {
+        report.kind = "gltf";
+        report.geometry = try analyzeGltf(arena.allocator(), model, options.cacheSize);
+    } else {
+        report.geometry = try analyzeMesh(arena.allocator(), loaded, options.cacheSize);
+    }
+
+    const stdout = std.io.getStdOut().writer();
+    if (options.json) {
+        try std.json.stringify(report, .{}, stdout);
+        try stdout.writeAll("\n");
+    } else {
+        try writeText(stdout, &report, options.cacheSize);
+    }
+}
+
+fn parseOptions(args: []const [:0]u8) !Options {
+    var options = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--json")) {
+            options.json = true;
+        } else if (std.mem.eql(u8, arg, "--cache-size")) {
+            i += 1;
+            if (i >= args.len) return error.MissingValue;
+            options.cacheSize = @max(try std.fmt.parseInt(usize, args[i], 10), 1);
+        } else {
+            options.path = arg;
+        }
+    }
+    if (options.path.len == 0) return error.MissingPath;
+    return options;
+}
+
+/// Analyze the interleaved vertex and index buffers of a triangle mesh
+fn analyzeMesh(allocator: std.mem.Allocator, loaded: *const mesh.Mesh, cacheSize: usize) !Geometry {
+    const indices = try allocator.alloc(u32, loaded.index_count);
+    readBuffer(loaded.ebo, std.mem.sliceAsBytes(indices));
+
+    const vertices = try allocator.alloc(f32, bufferSize(loaded.vbo) / @sizeOf(f32));
+    readBuffer(loaded.vbo, std.mem.sliceAsBytes(vertices));
+    const vertexCount = vertices.len / mesh.VERTEX_STRIDE;
+
+    var geometry = try analyzeIndexed(allocator, indices, vertexCount, cacheSize, vertices);
+    geometry.vertices = vertexCount;
+    geometry.uniqueVertices = try countUniqueVertices(allocator, vertices);
+    geometry.overdraw = try estimateOverdraw(allocator, indices, vertices);
+    return geometry;
+}
+
+/// Analyze the index streams of the glTF primitives, vertex attributes are not read back
+fn analyzeGltf(allocator: std.mem.Allocator, model: *const gltfLoader.Model, cacheSize: usize) !Geometry {
+    const buffer = try allocator.alloc(u8, bufferSize(model.buffer));
+    readBuffer(model.buffer, buffer);
+
+    var total = Geometry{};
+    var misses: f64 = 0;
+    for (model.draws) |draw| {
+        const indices = try allocator.alloc(u32, draw.count);
+        var vertexCount: usize = 0;
+        for (indices, 0..) |*index, i| {
+            index.* = if (!draw.indexed) @intCast(i) else switch (draw.indexType) {
+                gl.UNSIGNED_BYTE => buffer[draw.indexOffset + i],
+                gl.UNSIGNED_SHORT => std.mem.readInt(u16, buffer[draw.indexOffset + i * 2 ..][0..2], .little),
+                else => std.mem.readInt(u32, buffer[draw.indexOffset + i * 4 ..][0..4], .little),
+            };
+            vertexCount = @max(vertexCount, index.* + 1);
+        }
+
+        const geometry = try analyzeIndexed(allocator, indices, vertexCount, cacheSize, null);
+        total.triangles += geometry.triangles;
+        total.vertices += geometry.uniqueVertices;
+        total.uniqueVertices += geometry.uniqueVertices;
+        total.degenerate += geometry.degenerate;
+        misses += geometry.acmr * @as(f64, @floatFromInt(geometry.triangles));
+    }
+
+    if (total.triangles > 0) total.acmr = misses / @as(f64, @floatFromInt(total.triangles));
+    if (total.uniqueVertices > 0) total.atvr = misses / @as(f64, @floatFromInt(total.uniqueVertices));
+    return total;
+}
+
+/// Triangle, degenerate and vertex cache counters of an index stream
+/// uniqueVertices is the number of referenced vertices here, vertices (with positions) enable the area test
+fn analyzeIndexed(allocator: std.mem.Allocator, indices: []const u32, vertexCount: usize, cacheSize: usize, vertices: ?[]const f32) !Geometry {
+    var geometry = Geometry{ .triangles = indices.len / 3 };
+
+    // Simulated FIFO cache: a vertex is a hit while fewer than cacheSize misses happened since it was loaded
+    const timestamps = try allocator.alloc(usize, vertexCount);
+    defer allocator.free(timestamps);
+    @memset(timestamps, 0);
+    var referenced = try std.DynamicBitSet.initEmpty(allocator, vertexCount);
+    defer referenced.deinit();
+
+    var time: usize = cacheSize + 1;
+    var misses: usize = 0;
+    for (indices) |index| {
+        if (index >= vertexCount) return error.IndexOutOfRange;
+        referenced.set(index);
+        if (time - timestamps[index] > cacheSize) {
+            timestamps[index] = time;
+            time += 1;
+            misses += 1;
+        }
+    }
+
+    for (0..geometry.triangles) |t| {
+        const tri = indices[t * 3 ..][0..3];
+        if (tri[0] == tri[1] or tri[1] == tri[2] or tri[0] == tri[2]) {
+            geometry.degenerate += 1;
+        } else if (vertices) |data| {
+            if (triangleArea(data, tri) == 0) geometry.degenerate += 1;
+        }
+    }
+
+    geometry.uniqueVertices = referenced.count();
+    if (geometry.triangles > 0) geometry.acmr = @as(f64, @floatFromInt(misses)) / @as(f64, @floatFromInt(geometry.triangles));
+    if (geometry.uniqueVertices > 0) geometry.atvr = @as(f64, @floatFromInt(misses)) / @as(f64, @floatFromInt(geometry.uniqueVertices));
+    return geometry;
+}
+
+fn position(vertices: []const f32, index: u32) [3]f32 {
+    return vertices[@as(usize, index) * mesh.VERTEX_STRIDE ..][0..3].*;
+}
+
+/// Squared length of the cross product of two edges (0 for collinear vertices)
+fn triangleArea(vertices: []const f32, tri: *const [3]u32) f32 {
+    const a = position(vertices, tri[0]);
+    const b = position(vertices, tri[1]);
+    const c = position(vertices, tri[2]);
+    const u = [3]f32{ b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const v = [3]f32{ c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    const cross = [3]f32{ u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+    return cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2];
+}
+
+/// Vertices with bit-identical attributes, what an indexed buffer without duplicates would hold
+fn countUniqueVertices(allocator: std.mem.Allocator, vertices: []const f32) !usize {
+    var seen = std.AutoHashMap([mesh.VERTEX_STRIDE]u32, void).init(allocator);
+    defer seen.deinit();
+
+    var i: usize = 0;
+    while (i + mesh.VERTEX_STRIDE <= vertices.len) : (i += mesh.VERTEX_STRIDE) {
+        const key: [mesh.VERTEX_STRIDE]u32 = @bitCast(vertices[i..][0..mesh.VERTEX_STRIDE].*);
+        try seen.put(key, {});
+    }
+    return seen.count();
+}
+
+/// Rasterize the mesh in draw order from the six axis directions with back face culling and a depth test
+/// Returns shaded fragments per covered pixel, 1 means no pixel is drawn twice
+fn estimateOverdraw(allocator: std.mem.Allocator, indices: []const u32, vertices: []const f32) !?f64 {
+    if (indices.len < 3) return null;
+
+    // Fit the bounds into the unit cube
+    var min = [3]f32{ std.math.inf(f32), std.math.inf(f32), std.math.inf(f32) };
+    var max = [3]f32{ -std.math.inf(f32), -std.math.inf(f32), -std.math.inf(f32) };
+    for (indices) |index| {
+        const p = position(vertices, index);
+        for (0..3) |axis| {
+            min[axis] = @min(min[axis], p[axis]);
+            max[axis] = @max(max[axis], p[axis]);
+        }
+    }
+    const extent = @max(max[0] - min[0], @max(max[1] - min[1], max[2] - min[2]));
+    if (!(extent > 0)) return null;
+
+    const depth = try allocator.alloc(f32, OVERDRAW_GRID * OVERDRAW_GRID);
+    defer allocator.free(depth);
+
+    var covered: u64 = 0;
+    var shaded: u64 = 0;
+    for (0..3) |axis| {
+        for ([_]bool{ false, true }) |mirrored| {
+            @memset(depth, std.math.inf(f32));
+
+            for (0..indices.len / 3) |t| {
+                var screen: [3][3]f32 = undefined;
+                for (0..3) |k| {
+                    const p = position(vertices, indices[t * 3 + k]);
+                    const u = (p[(axis + 1) % 3] - min[(axis + 1) % 3]) / extent;
+                    const v = (p[(axis + 2) % 3] - min[(axis + 2) % 3]) / extent;
+                    const z = (p[axis] - min[axis]) / extent;
+
+                    // The mirrored view flips the winding, so it keeps the other faces
+                    screen[k] = .{
+                        (if (mirrored) 1 - u else u) * OVERDRAW_GRID,
+                        v * OVERDRAW_GRID,
+                        if (mirrored) 1 - z else z,
+                    };
+                }
+                shaded += rasterize(depth, screen);
+            }
+
+            for (depth) |d| {
+                if (d != std.math.inf(f32)) covered += 1;
+            }
+        }
+    }
+
+    if (covered == 0) return null;
+    return @as(f64, @floatFromInt(shaded)) / @as(f64, @floatFromInt(covered));
+}
+
+/// Rasterize a front facing triangle at pixel centers, returns the fragments that passed the depth test
+fn rasterize(depth: []f32, screen: [3][3]f32) u64 {
+    // The view looks along +z with x and y in the order of the right handed axes, so front faces
+    // (normals towards the viewer) are clockwise on screen. Swapping b and c makes their area positive
+    const a = screen[0];
+    const b = screen[2];
+    const c = screen[1];
+    const area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+    if (!(area > 0)) return 0; // Back facing or degenerate
+
+    const grid: f32 = OVERDRAW_GRID;
+    const minX: usize = @intFromFloat(std.math.clamp(@floor(@min(a[0], @min(b[0], c[0]))), 0, grid - 1));
+    const maxX: usize = @intFromFloat(std.math.clamp(@ceil(@max(a[0], @max(b[0], c[0]))), 0, grid - 1));
+    const minY: usize = @intFromFloat(std.math.clamp(@floor(@min(a[1], @min(b[1], c[1]))), 0, grid - 1));
+    const maxY: usize = @intFromFloat(std.math.clamp(@ceil(@max(a[1], @max(b[1], c[1]))), 0, grid - 1));
+
+    var passed: u64 = 0;
+    for (minY..maxY + 1) |y| {
+        for (minX..maxX + 1) |x| {
+            const px = @as(f32, @floatFromInt(x)) + 0.5;
+            const py = @as(f32, @floatFromInt(y)) + 0.5;
+
+            // Barycentric weights from the edge functions
+            const w0 = (c[0] - b[0]) * (py - b[1]) - (c[1] - b[1]) * (px - b[0]);
+            const w1 = (a[0] - c[0]) * (py - c[1]) - (a[1] - c[1]) * (px - c[0]);
+            const w2 = (b[0] - a[0]) * (py - a[1]) - (b[1] - a[1]) * (px - a[0]);
+            if (w0 < 0 or w1 < 0 or w2 < 0) continue;
+
+            const z = (w0 * a[2] + w1 * b[2] + w2 * c[2]) / area;
+            const pixel = &depth[y * OVERDRAW_GRID + x];
+            if (z < pixel.*) {
+                pixel.* = z;
+                passed += 1;
+            }
+        }
+    }
+    return passed;
+}
+
+/// Maps of all materials with their decoded sizes
+fn collectMaterials(allocator: std.mem.Allocator, object: *const objectLoader.ObjectStruct) ![]const Material {
+    const materials = try allocator.alloc(Material, object.materials.items.len);
+    for (object.materials.items, materials) |*source, *material| {
+        var textures = std.ArrayList(Texture).init(allocator);
+        const maps = [_]struct { []const u8, ?zstbi.Image, ?[]const u8 }{
+            .{ "diffuse", source.texture, source.texturePath },
+            .{ "normal", source.normalMap, source.normalMapPath },
+            .{ "roughness", source.roughnessMap, source.roughnessMapPath },
+            .{ "metallic", source.metallicMap, source.metallicMapPath },
+        };
+        for (maps) |map| {
+            const image = map[1] orelse continue;
+            try textures.append(.{
+                .kind = map[0],
+                .path = map[2] orelse "(embedded)",
+                .width = image.width,
+                .height = image.height,
+                .format = switch (image.num_components) {
+                    1 => "R8",
+                    2 => "RG8",
+                    3 => "RGB8",
+                    else => "RGBA8",
+                },
+                .bytes = memory.textureBytes(image.width, image.height, image.num_components),
+            });
+        }
+        material.* = .{ .name = source.name, .textures = try textures.toOwnedSlice() };
+    }
+    return materials;
+}
+
+/// Size of a GPU buffer in bytes
+fn bufferSize(buffer: gl.uint) usize {
+    var size: gl.int = 0;
+    gl.BindBuffer(gl.COPY_READ_BUFFER, buffer);
+    gl.GetBufferParameteriv(gl.COPY_READ_BUFFER, gl.BUFFER_SIZE, (&size)[0..1]);
+    return @intCast(size);
+}
+
+/// Read the start of a GPU buffer
+fn readBuffer(buffer: gl.uint, out: []u8) void {
+    gl.BindBuffer(gl.COPY_READ_BUFFER, buffer);
+    gl.GetBufferSubData(gl.COPY_READ_BUFFER, 0, @intCast(out.len), out.ptr);
+    gl.BindBuffer(gl.COPY_READ_BUFFER, 0);
+}
+
+fn stagesInMs(stages: mesh.LoadStages) Stages {
+    return .{
+        .cached = stages.cached,
+        .read = nsToMs(stages.read),
+        .materials = nsToMs(stages.materials),
+        .materialWait = nsToMs(stages.materialWait),
+        .textureUpload = nsToMs(stages.textureUpload),
+        .convert = nsToMs(stages.convert),
+        .upload = nsToMs(stages.upload),
+        .cacheStore = nsToMs(stages.cacheStore),
+        .total = nsToMs(stages.total),
+    };
+}
+
+fn writeText(writer: anytype, report: *const Report, cacheSize: usize) !void {
+    const geometry = report.geometry;
+    try writer.print("{s} ({s})\n", .{ report.path, report.kind });
+
+    if (std.mem.eql(u8, report.kind, "points")) {
+        try writer.print("  points           {d}\n", .{report.points});
+    } else {
+        try writer.print("  triangles        {d}\n", .{geometry.triangles});
+        try writer.print("  vertices         {d} ({d} unique)\n", .{ geometry.vertices, geometry.uniqueVertices });
+        try writer.print("  degenerate       {d}\n", .{geometry.degenerate});
+        try writer.print("  vertex cache     ACMR {d:.3}, ATVR {d:.3} (FIFO, {d} entries)\n", .{ geometry.acmr, geometry.atvr, cacheSize });
+        if (geometry.overdraw) |overdraw| {
+            try writer.print("  overdraw         {d:.3}\n", .{overdraw});
+        } else {
+            try writer.print("  overdraw         n/a\n", .{});
+        }
+    }
+
+    try writer.print("materials\n", .{});
+    for (report.materials) |material| {
+        try writer.print("  {s}\n", .{material.name});
+        for (material.textures) |texture| {
+            try writer.print("    {s:<10} {d}x{d} {s:<5} {d:.2} MiB  {s}\n", .{ texture.kind, texture.width, texture.height, texture.format, bytesToMib(texture.bytes), texture.path });
+        }
+    }
+
+    try writer.print("GPU memory (estimated)\n", .{});
+    try writer.print("  buffers          {d:.2} MiB\n", .{bytesToMib(report.gpu.buffers)});
+    try writer.print("  textures         {d:.2} MiB\n", .{bytesToMib(report.gpu.textures)});
+
+    const stages = report.stages;
+    try writer.print("load stages (ms){s}\n", .{if (stages.cached) " from cache" else ""});
+    try writer.print("  read             {d:>9.3}\n", .{stages.read});
+    try writer.print("    materials      {d:>9.3} (worker, overlaps read)\n", .{stages.materials});
+    try writer.print("    material wait  {d:>9.3}\n", .{stages.materialWait});
+    try writer.print("    texture upload {d:>9.3}\n", .{stages.textureUpload});
+    try writer.print("  convert          {d:>9.3}\n", .{stages.convert});
+    try writer.print("  upload           {d:>9.3}\n", .{stages.upload});
+    try writer.print("  cache store      {d:>9.3}\n", .{stages.cacheStore});
+    try writer.print("  total            {d:>9.3}\n", .{stages.total});
+}
+
+fn nsToMs(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_ms;
+}
+
+fn bytesToMib(bytes: usize) f64 {
+    return @as(f64, @floatFromInt(bytes)) / (1024.0 * 1024.0);
+}
@@ -10,9 +10,22 @@ const zstbi = @import("zstbi");
 const glfw = @import("mach-glfw");
 
 const window = @import("./window/window.zig");
+const recorder = @import("./window/recorder.zig");
+const control = @import("./window/control.zig");
 const shader = @import("./graphics/shader.zig");
 const mesh = @import("./graphics/mesh.zig");
+const scene = @import("./graphics/scene.zig");
+const gltfLoader = @import("./graphics/gltfLoader.zig");
+const sequence = @import("./graphics/sequence.zig");
+const environment = @import("./graphics/environment.zig");
+const transparency = @import("./graphics/transparency.zig");
+const postProcess = @import("./graphics/postProcess.zig");
+const imageDecoder = @import("./graphics/imageDecoder.zig");
 const overlay = @import("./ui/overlay.zig");
+const glDebug = @import("./graphics/glDebug.zig");
+const glCapture = @import("./graphics/glCapture.zig");
+const memory = @import("./util/memory.zig");
+const metrics = @import("./util/metrics.zig");
 
 const c = @cImport({
     @cInclude("cimgui.h");
@@ -20,14 +33,33 @@ const c = @cImport({
 
 /// Main method
 pub fn main() !void {
-    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
-    const allocator = gpa.allocator();
+    const allocator = memory.allocator(.other);
+
+    // Optional memory report written on exit (benchmark runs): --memory-json <path>
+    const memoryReportPath = try argValue(allocator, "--memory-json");
+    defer if (memoryReportPath) |path| {
+        writeMemoryReport(path);
+        allocator.free(path);
+    };
+
+    // Optional Prometheus endpoint for long running instances: --metrics <port>
+    const metricsPort = try argValue(allocator, "--metrics");
+    if (metricsPort) |port| {
+        defer allocator.free(port);
+        try metrics.serve(try std.fmt.parseInt(u16, port, 10));
+    }
 
     // Zstbi initialization
-    zstbi.init(allocator);
-    zstbi.setFlipVerticallyOnLoad(true);
+    zstbi.init(memory.allocator(.textures));
     //defer zstbi.deinit();
 
+    // Optional PNG decoder selection for comparisons: --image-decoder <stb|native>
+    const decoder = try argValue(allocator, "--image-decoder");
+    if (decoder) |name| {
+        defer allocator.free(name);
+        imageDecoder.backend = imageDecoder.parseBackend(name) orelse return error.InvalidImageDecoder;
+    }
+
     // GLFW initialization
     if (!glfw.init(.{})) {
         std.log.err("failed to initialize GLFW: {?s}", .{glfw.getErrorString()});
@@ -39,6 +71,15 @@ pub fn main() !void {
     const win = try window.init("zigGL");
     defer win.destroy();
 
+    // Optional capture of all GL calls for the replay tool: --capture-gl <path>
+    const capturePath = try argValue(allocator, "--capture-gl");
+    defer if (capturePath) |path| allocator.free(path);
+    if (capturePath) |path| {
+        const size = win.getFramebufferSize();
+        try glCapture.start(path, window.procTable(), size.width, size.height);
+    }
+    defer glCapture.finish();
+
     // Initialize Imgui
     c.InitImgui(win.handle);
 
@@ -48,30 +89,105 @@ pub fn main() !void {
 
     // Load default mesh (cube)
     try mesh.Mesh.init();
+    defer sequence.stop();
 
     // Compile shaders
-    const program = try shader.compile(allocator,
+    const shadedProgram = try shader.compile(allocator,
         "src/graphics/shaders/vertex.shader.glsl",
         "src/graphics/shaders/fragment.shader.glsl");
-    defer gl.DeleteProgram(program);
+    defer gl.DeleteProgram(shadedProgram);
+
+    // Same shading with a geometry shader that adds the wireframe in the same pass
+    const wireframeProgram = try shader.compileWithGeometry(allocator,
+        "src/graphics/shaders/vertex.shader.glsl",
+        "src/graphics/shaders/wireframe.geometry.shader.glsl",
+        "src/graphics/shaders/fragment.shader.glsl");
+    defer gl.DeleteProgram(wireframeProgram);
+
+    const pointProgram = try shader.compile(allocator,
+        "src/graphics/shaders/point.vertex.shader.glsl",
+        "src/graphics/shaders/point.fragment.shader.glsl");
+    defer gl.DeleteProgram(pointProgram);
+
+    try postProcess.init(allocator);
+    defer postProcess.deinit();
+    try transparency.init(allocator);
+    defer transparency.deinit();
+
+    // Optional post-process antialiasing: --aa <off|low|medium|high>
+    const antialiasing = try argValue(allocator, "--aa");
+    if (antialiasing) |preset| {
+        defer allocator.free(preset);
+        state.overlayState.antialiasing = postProcess.parseQuality(preset) orelse return error.InvalidAntialiasing;
+    }
+
+    // Optional image based lighting from an HDR panorama: --environment <path>
+    const environmentPath = try argValue(allocator, "--environment");
+    if (environmentPath) |path| {
+        defer allocator.free(path);
+        try environment.load(path);
+    }
+    defer environment.deinit();
 
     gl.Enable(gl.DEPTH_TEST); // Enable depth testing
-    gl.UseProgram(program); // Use the shader program
+    gl.Enable(gl.PROGRAM_POINT_SIZE); // Point size from the point cloud shader
+    gl.UseProgram(shadedProgram); // Use the shader program
+
+    // Input recording (--record <path>) or deterministic replay with timings (--replay <path>)
+    const recordPath = try argValue(allocator, "--record");
+    defer if (recordPath) |path| allocator.free(path);
+    const replayPath = try argValue(allocator, "--replay");
+    defer if (replayPath) |path| allocator.free(path);
+
+    if (replayPath) |path| {
+        try recorder.startReplay(path, win, &state);
+    } else if (recordPath) |path| {
+        try recorder.startRecording(path, &state);
+    }
+    defer recorder.finish();
+
+    // Scripted automation over a Unix domain socket: --control <path>
+    const controlPath = try argValue(allocator, "--control");
+    defer if (controlPath) |path| allocator.free(path);
+    if (controlPath) |path| {
+        try control.start(path);
+    }
+    defer control.stop();
 
     var rotation = zmath.matFromRollPitchYaw(0, 0, 0);  // Rotation matrix
     var translation = zmath.identity();                                 // Translation matrix
     var scale = zmath.identity();                                       // Scale matrix
 
+    var frameTimer = try std.time.Timer.start();
+
     // Main loop
     while (!win.shouldClose()) {
-        overlay.beginFrame(); // Start new ImGui frame
-        try overlay.draw(&state); // Draw frame
+        if (!recorder.beginFrame()) break; // Replay finished
+        control.poll(win, &state);
+
+        try overlay.update(&state); // Build a new UI frame if anything changed
+        recorder.afterOverlay(&state.overlayState);
+
+        // Antialiasing and transparent materials render offscreen, resolved before the overlay
+        const width: u32 = @intFromFloat(state.width);
+        const height: u32 = @intFromFloat(state.height);
+        const transparent = !sequence.isActive() and mesh.loadedObject.points == null and hasTransparentMaterial();
+        const offscreen = postProcess.beginFrame(width, height, state.overlayState.antialiasing, transparent);
+        const oit = transparent and offscreen and transparency.beginFrame(width, height);
+        const firstPass: Pass = if (oit) .opaque else .all;
 
         gl.ClearColor(1.0, 1.0, 1.0, 1.0); // Clear the screen to white
         gl.Clear(gl.COLOR_BUFFER_BIT | gl.DEPTH_BUFFER_BIT);
 
+        // The wireframe program only adds a geometry shader, all uniforms are set below every frame
+        const program = if (state.overlayState.wireframe) wireframeProgram else shadedProgram;
+        gl.UseProgram(program);
+        setWireframeUniforms(program, &state);
+
         // Handle material visibility
-        handleMaterialVisibility(program, &state);
+        handleMaterialVisibility(program, &state, 0);
+        environment.update();
+        environment.bind(program);
 
         // Update transformations based on input state
         updateTransforms(&rotation, &translation, &scale, &state);
@@ -82,49 +198,104 @@ pub fn main() !void {
         // Model: scale * rotation * translation
         // View: contains the camera position and orientation
         // Projection: perspective projection matrix
+        const camera = state.camera;
         const view = zmath.lookAtRh(
-            zmath.f32x4(0, 0, 3, 1),
-            zmath.f32x4(0, 0, 0, 1),
+            zmath.f32x4(camera.eye[0], camera.eye[1], camera.eye[2], 1),
+            zmath.f32x4(camera.target[0], camera.target[1], camera.target[2], 1),
             zmath.f32x4(0, 1, 0, 0));
         const proj = zmath.perspectiveFovRhGl(
-            0.25 * math.pi,
+            camera.fov,
             state.width / state.height,
             0.1, 100);
 
+        // Model transform of the scene root, only dirty subtrees are recomputed
+        const nodes = &mesh.loadedObject.scene;
+        nodes.setLocal(0, .{ translation[3][0], translation[3][1], translation[3][2] }, zmath.quatFromMat(rotation), scale[0][0]);
+        nodes.update();
+
         // Calculate separate model matrix for lighting calculations
-        const model = zmath.mul(zmath.mul(scale, rotation), translation);
-        const mvp = zmath.mul(model, zmath.mul(view, proj));
+        const viewProj = zmath.mul(view, proj);
+        const model = nodes.worldMatrix(0);
+        const mvp = zmath.mul(model, viewProj);
 
         // Set matrices
-        gl.UniformMatrix4fv(gl.GetUniformLocation(program, "MVP"), 1, gl.FALSE, &mvp[0][0]);
-        gl.UniformMatrix4fv(gl.GetUniformLocation(program, "Model"), 1, gl.FALSE, &model[0][0]);
+        setNodeMatrices(program, nodes, 0, viewProj);
 
         // Set lighting uniforms
         const lightPos = zmath.f32x4(2.0, 2.0, 2.0, 1.0);
         gl.Uniform3f(gl.GetUniformLocation(program, "lightPos"),
             lightPos[0], lightPos[1], lightPos[2]);
 
-        const viewPos = zmath.f32x4(0.0, 0.0, 3.0, 1.0);
+        const viewPos = zmath.f32x4(camera.eye[0], camera.eye[1], camera.eye[2], 1.0);
         gl.Uniform3f(gl.GetUniformLocation(program, "viewPos"),
             viewPos[0], viewPos[1], viewPos[2]);
 
-        gl.BindVertexArray(mesh.loadedObject.vao);
-        gl.DrawElements(gl.TRIANGLES, @intCast(mesh.loadedObject.index_count), gl.UNSIGNED_INT, 0);
+        // Draw the sequence frame if one is playing, otherwise the loaded mesh
+        sequence.update();
+        var drawCalls: u64 = 0;
+        var triangles: u64 = 0;
+        glDebug.pushGroup("Scene");
+        if (sequence.isActive()) {
+            sequence.draw();
+            drawCalls += 1;
+            triangles += sequence.triangleCount();
+        } else if (mesh.loadedObject.points) |cloud| {
+            // Point clouds use their own shader
+            glDebug.pushGroup("Point cloud");
+            defer glDebug.popGroup();
+            gl.UseProgram(pointProgram);
+            gl.UniformMatrix4fv(gl.GetUniformLocation(pointProgram, "MVP"), 1, gl.FALSE, &mvp[0][0]);
+            gl.Uniform1f(gl.GetUniformLocation(pointProgram, "pointSize"), state.overlayState.pointSize);
+
+            const clipScale = zmath.length3(model[0])[0] * @max(proj[0][0], proj[1][1]);
+            const budget: usize = @intFromFloat(state.overlayState.pointBudget * 1_000_000.0);
+            cloud.draw(mvp, clipScale, state.height, state.overlayState.pointSize, budget);
+            drawCalls += 1;
+
+            gl.UseProgram(program);
+        } else if (mesh.loadedObject.gltf) |gltfModel| {
+            // One draw per glTF node primitive with its own material and transform
+            drawPrimitives(program, gltfModel, nodes, viewProj, &state, firstPass, &drawCalls, &triangles);
+        } else {
+            drawNodes(program, nodes, viewProj, &state, firstPass, &drawCalls, &triangles);
+        }
+
+        // Transparent materials in one unsorted pass, composited over the opaque color
+        if (oit) {
+            glDebug.pushGroup("Transparency");
+            transparency.beginTransparent(program);
+            if (mesh.loadedObject.gltf) |gltfModel| {
+                drawPrimitives(program, gltfModel, nodes, viewProj, &state, .transparent, &drawCalls, &triangles);
+            } else {
+                drawNodes(program, nodes, viewProj, &state, .transparent, &drawCalls, &triangles);
+            }
+            transparency.endTransparent(program);
+            glDebug.popGroup();
+        }
+        glDebug.popGroup();
+        postProcess.endFrame();
 
-        overlay.endFrame(); // Render ImGui
+        glDebug.pushGroup("Overlay");
+        overlay.render(&state); // Render the last UI frame
+        glDebug.popGroup();
+        recorder.endFrame();
+        glCapture.endFrame();
 
         win.swapBuffers();
-        glfw.pollEvents();
+        metrics.recordFrame(frameTimer.lap(), drawCalls, triangles);
+        control.frameDone();
+        recorder.pollEvents(win);
     }
 }
 
-fn handleMaterialVisibility(program: c_uint, state: *window.WindowState) void {
-    const useTexture = mesh.loadedObject.object.materials.items.len > 0;
+fn handleMaterialVisibility(program: c_uint, state: *window.WindowState, materialIndex: usize) void {
+    const materials = mesh.loadedObject.object.materials.items;
+    const useTexture = materialIndex < materials.len;
     gl.Uniform1i(gl.GetUniformLocation(program, "useTexture"), @intFromBool(useTexture));
 
     // Bind the shader program with texture
     if (useTexture) {
-        const material = mesh.loadedObject.object.materials.items[0];
+        const material = materials[materialIndex];
         // Diffuse texture
         if (material.textureId != 0 and state.overlayState.diffuseVisible) {
             gl.ActiveTexture(gl.TEXTURE0);
@@ -154,7 +325,9 @@ fn handleMaterialVisibility(program: c_uint, state: *window.WindowState) void {
         // Roughness texture
         gl.Uniform3f(gl.GetUniformLocation(program, "materialSpecular"),
             material.specular[0], material.specular[1], material.specular[2]);
-        gl.Uniform1f(gl.GetUniformLocation(program, "roughness"), 0.5); // Default roughness
+        gl.Uniform1f(gl.GetUniformLocation(program, "roughness"), material.roughness);
+        gl.Uniform1i(gl.GetUniformLocation(program, "roughnessChannel"), material.roughnessChannel);
+        gl.Uniform1i(gl.GetUniformLocation(program, "metallicChannel"), material.metallicChannel);
         if (material.roughnessMapId != 0 and state.overlayState.roughnessVisible) {
             gl.ActiveTexture(gl.TEXTURE2);
             gl.BindTexture(gl.TEXTURE_2D, material.roughnessMapId);
@@ -167,7 +340,8 @@ fn handleMaterialVisibility(program: c_uint, state: *window.WindowState) void {
         }
 
         // Metallic texture
-        gl.Uniform1f(gl.GetUniformLocation(program, "metallic"), 0.0); // Default metallic
+        gl.Uniform1f(gl.GetUniformLocation(program, "metallic"), material.metallic);
+        gl.Uniform1f(gl.GetUniformLocation(program, "opacity"), material.opacity);
         if (material.metallicMapId != 0 and state.overlayState.metallicVisible) {
             gl.ActiveTexture(gl.TEXTURE3);
             gl.BindTexture(gl.TEXTURE_2D, material.metallicMapId);
@@ -187,10 +361,156 @@ fn handleMaterialVisibility(program: c_uint, state: *window.WindowState) void {
         gl.BindTexture(gl.TEXTURE_2D, 0);
         gl.Uniform1i(gl.GetUniformLocation(program, "useTexture"), 0);
         gl.Uniform1i(gl.GetUniformLocation(program, "useNormalMap"), 0);
+        gl.Uniform1f(gl.GetUniformLocation(program, "opacity"), 1.0);
         gl.Uniform4f(gl.GetUniformLocation(program, "defaultColor"), 0.4, 0.4, 0.4, 1.0); // Default shader
     }
 }
 
+/// Set the wireframe uniforms, the edge width is in pixels of the current viewport
+fn setWireframeUniforms(program: c_uint, state: *const window.WindowState) void {
+    gl.Uniform1i(gl.GetUniformLocation(program, "wireframe"), @intFromBool(state.overlayState.wireframe));
+    gl.Uniform1f(gl.GetUniformLocation(program, "wireframeWidth"), state.overlayState.wireframeWidth);
+    gl.Uniform3f(gl.GetUniformLocation(program, "wireframeColor"), 0.05, 0.05, 0.05);
+    gl.Uniform2f(gl.GetUniformLocation(program, "viewportSize"), state.width, state.height);
+}
+
+/// Materials drawn by a pass
+const Pass = enum { all, opaque, transparent };
+
+fn inPass(pass: Pass, materialIndex: usize) bool {
+    return switch (pass) {
+        .all => true,
+        .opaque => !isTransparent(materialIndex),
+        .transparent => isTransparent(materialIndex),
+    };
+}
+
+fn isTransparent(materialIndex: usize) bool {
+    const materials = mesh.loadedObject.object.materials.items;
+    return materialIndex < materials.len and materials[materialIndex].opacity < 1.0;
+}
+
+fn hasTransparentMaterial() bool {
+    for (mesh.loadedObject.object.materials.items) |material| {
+        if (material.opacity < 1.0) return true;
+    }
+    return false;
+}
+
+/// Draw the visible scene nodes that are inside the view frustum, hidden nodes skip their subtree
+/// Every node is drawn with its own world matrix, one draw per material range of the pass
+fn drawNodes(program: c_uint, nodes: *scene.Scene, viewProj: zmath.Mat, state: *window.WindowState, pass: Pass, drawCalls: *u64, triangles: *u64) void {
+    gl.BindVertexArray(mesh.loadedObject.vao);
+    const parts = nodes.nodes.slice();
+    const indexCounts = parts.items(.indexCount);
+    const visible = parts.items(.visible);
+    const ends = parts.items(.subtreeEnd);
+
+    if (pass != .transparent) nodes.drawnNodes = 0;
+    var boundMaterial: ?usize = null;
+    var node: usize = 0;
+    while (node < nodes.count()) {
+        if (!visible[node]) {
+            node = ends[node];
+            continue;
+        }
+        if (indexCounts[node] > 0 and nodes.inFrustum(node, viewProj)) {
+            if (pass != .transparent) nodes.drawnNodes += 1;
+            var matricesSet = false;
+            for (nodes.nodeRanges(node)) |range| {
+                if (!inPass(pass, range.material)) continue;
+                if (!matricesSet) {
+                    setNodeMatrices(program, nodes, node, viewProj);
+                    matricesSet = true;
+                }
+                if (boundMaterial != @as(usize, range.material)) {
+                    handleMaterialVisibility(program, state, range.material);
+                    boundMaterial = range.material;
+                }
+                gl.DrawElements(gl.TRIANGLES, @intCast(range.indexCount), gl.UNSIGNED_INT, range.firstIndex * @sizeOf(u32));
+                drawCalls.* += 1;
+                triangles.* += range.indexCount / 3;
+            }
+        }
+        node += 1;
+    }
+}
+
+/// Draw the glTF primitives whose material belongs to the pass
+fn drawPrimitives(program: c_uint, gltfModel: *const gltfLoader.Model, nodes: *const scene.Scene, viewProj: zmath.Mat, state: *window.WindowState, pass: Pass, drawCalls: *u64, triangles: *u64) void {
+    const root = nodes.worldMatrix(0);
+    for (gltfModel.draws) |primitive| {
+        if (!inPass(pass, primitive.material)) continue;
+        setModelMatrices(program, zmath.mul(primitive.transform, root), viewProj);
+        handleMaterialVisibility(program, state, primitive.material);
+        primitive.draw();
+        drawCalls.* += 1;
+        triangles.* += primitive.count / 3;
+    }
+}
+
+/// Set the Model, MVP and NormalMatrix uniforms of an arbitrary (possibly non-uniformly scaled) model matrix
+fn setModelMatrices(program: c_uint, model: zmath.Mat, viewProj: zmath.Mat) void {
+    const mvp = zmath.mul(model, viewProj);
+    // Inverse transpose, stored in the same row vector layout as the Model uniform
+    const inverse = zmath.transpose(zmath.inverse(model));
+    const normalMatrix = [9]f32{
+        inverse[0][0], inverse[0][1], inverse[0][2],
+        inverse[1][0], inverse[1][1], inverse[1][2],
+        inverse[2][0], inverse[2][1], inverse[2][2],
+    };
+    const locations = matrixLocations(program);
+    gl.UniformMatrix4fv(locations.mvp, 1, gl.FALSE, &mvp[0][0]);
+    gl.UniformMatrix4fv(locations.model, 1, gl.FALSE, &model[0][0]);
+    gl.UniformMatrix3fv(locations.normalMatrix, 1, gl.FALSE, &normalMatrix);
+}
+
+/// Set the Model, MVP and NormalMatrix uniforms of a scene node
+fn setNodeMatrices(program: c_uint, nodes: *const scene.Scene, node: usize, viewProj: zmath.Mat) void {
+    const model = nodes.worldMatrix(node);
+    const mvp = zmath.mul(model, viewProj);
+    const normalMatrix = nodes.normalMatrix(node);
+    const locations = matrixLocations(program);
+    gl.UniformMatrix4fv(locations.mvp, 1, gl.FALSE, &mvp[0][0]);
+    gl.UniformMatrix4fv(locations.model, 1, gl.FALSE, &model[0][0]);
+    gl.UniformMatrix3fv(locations.normalMatrix, 1, gl.FALSE, &normalMatrix);
+}
+
+/// Locations of the per draw matrix uniforms of a program
+///
+/// Contains:
+/// - program the locations belong to
+/// - MVP, Model and NormalMatrix locations
+const MatrixLocations = struct {
+    program: c_uint,
+    mvp: gl.int,
+    model: gl.int,
+    normalMatrix: gl.int,
+};
+
+// Looked up once per program instead of once per node and primitive (programs live until exit)
+const MATRIX_PROGRAMS = 4;
+var matrixLocationCache: [MATRIX_PROGRAMS]MatrixLocations = undefined;
+var matrixLocationCount: usize = 0;
+
+/// Cached matrix uniform locations of a program
+fn matrixLocations(program: c_uint) MatrixLocations {
+    for (matrixLocationCache[0..matrixLocationCount]) |locations| {
+        if (locations.program == program) return locations;
+    }
+    const locations = MatrixLocations{
+        .program = program,
+        .mvp = gl.GetUniformLocation(program, "MVP"),
+        .model = gl.GetUniformLocation(program, "Model"),
+        .normalMatrix = gl.GetUniformLocation(program, "NormalMatrix"),
+    };
+    if (matrixLocationCount < MATRIX_PROGRAMS) {
+        matrixLocationCache[matrixLocationCount] = locations;
+        matrixLocationCount += 1;
+    }
+    return locations;
+}
+
 /// Update the rotation, translation, and scale matrices
 /// Values come from the window state (mouse and keyboard input from callbacks)
 fn updateTransforms(rotation: *zmath.Mat, translation: *zmath.Mat, scale: *zmath.Mat, state: *window.WindowState) void {
@@ -320,3 +640,30 @@ fn updateTransformsOverlay(rotation: *zmath.Mat, translation: *zmath.Mat, scale:
     const rotZ = zmath.rotationZ(zRad);
     rotation.* = zmath.mul(zmath.mul(rotZ, rotY), rotX);
 }
+
+/// Value following a command line flag, null if the flag is not given
+fn argValue(allocator: std.mem.Allocator, flag: []const u8) !?[]const u8 {
+    var args = try std.process.argsWithAllocator(allocator);
+    defer args.deinit();
+
+    while (args.next()) |arg| {
+        if (std.mem.eql(u8, arg, flag)) {
+            const value = args.next() orelse return null;
+            return try allocator.dupe(u8, value);
+        }
+    }
+    return null;
+}
+
+/// Write the memory counters as JSON
+fn writeMemoryReport(path: []const u8) void {
+    const file = std.fs.cwd().createFile(path, .{}) catch |err| {
+        std.log.err("Could not write memory report {s}: {s}", .{ path, @errorName(err) });
+        return;
+    };
+    defer file.close();
+
+    var buffered = std.io.bufferedWriter(file.writer());
+    memory.writeJson(buffered.writer()) catch return;
+    buffered.flush() catch return;
+}
@@ -0,0 +1,139 @@
+//! GL capture replay tool (zigGL-replay)
+//!
+//! Re-executes a capture written with `zigGL --capture-gl <path>` in a hidden window.
+//! Frames before the looped range are executed once as setup, the range is then replayed in a
+//! tight loop. The hidden window has the framebuffer size of the capture, so fill rate matches.
+//! Reports CPU submission time and total time (after glFinish) per frame on stdout, with the
+//! decoding overhead of the capture measured separately.
+//!
+//! Usage: zigGL-replay <capture> [--loops N] [--first F] [--last L]
+
+const std = @import("std");
+const gl = @import("gl");
+const glfw = @import("mach-glfw");
+
+const glCapture = @import("./graphics/glCapture.zig");
+
+var procTable: gl.ProcTable = undefined;
+
+/// Command line options
+///
+/// Contains:
+/// - path: capture file
+/// - loops: replays of the frame range
+/// - first, last: looped frame range, frame 0 holds the setup calls
+const Options = struct {
+    path: []const u8 = "",
+    loops: usize = 100,
+    first: usize = 1,
+    last: ?usize = null,
+};
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const options = parseOptions(args) catch {
+        std.log.err("Usage: zigGL-replay <capture> [--loops N] [--first F] [--last L]", .{});
+        return error.InvalidArguments;
+    };
+
+    // Loading only decodes, the window is created at the captured size afterwards
+    var capture = try glCapture.Capture.open(options.path, allocator);
+    defer capture.deinit();
+
+    // Hidden window with the same context as the viewer
+    if (!glfw.init(.{})) {
+        std.log.err("failed to initialize GLFW: {?s}", .{glfw.getErrorString()});
+        return error.GLInitFailed;
+    }
+    defer glfw.terminate();
+
+    const window = glfw.Window.create(capture.width, capture.height, "zigGL-replay", null, null, .{
+        .visible = false,
+        .context_version_major = 4,
+        .context_version_minor = 5,
+        .opengl_profile = .opengl_core_profile,
+        .opengl_forward_compat = true,
+    }) orelse return error.WindowCreateFailed;
+    defer window.destroy();
+
+    glfw.makeContextCurrent(window);
+    if (!procTable.init(glfw.getProcAddress)) return error.GLInitFailed;
+    gl.makeProcTableCurrent(&procTable);
+    glfw.swapInterval(0);
+    gl.Viewport(0, 0, @intCast(capture.width), @intCast(capture.height));
+
+    const frameCount = capture.frameCount();
+    const last = options.last orelse frameCount -| 1;
+    if (options.first > last or last >= frameCount) {
+        std.log.err("Frame range {d}..{d} outside of the {d} captured frames", .{ options.first, last, frameCount });
+        return error.InvalidArguments;
+    }
+    const frames = last - options.first + 1;
+
+    // Setup: resources created before the looped range
+    if (options.first > 0) {
+        _ = try capture.run(&procTable, 0, options.first - 1);
+    }
+    gl.Finish();
+
+    // Decoding only, for reference
+    var timer = try std.time.Timer.start();
+    var calls: usize = 0;
+    for (0..options.loops) |_| {
+        calls = try capture.run(null, options.first, last);
+    }
+    const decodeNs = timer.read();
+
+    // Submission and total time per loop
+    var submitNs: u64 = 0;
+    var bestNs: u64 = std.math.maxInt(u64);
+    timer.reset();
+    for (0..options.loops) |_| {
+        const loopStart = timer.read();
+        _ = try capture.run(&procTable, options.first, last);
+        submitNs += timer.read() - loopStart;
+
+        gl.Finish();
+        bestNs = @min(bestNs, timer.read() - loopStart);
+    }
+    const totalNs = timer.read();
+
+    // Report on stdout, so it can be redirected apart from the log
+    const perFrame = @as(f64, @floatFromInt(options.loops * frames));
+    var buffered = std.io.bufferedWriter(std.io.getStdOut().writer());
+    const out = buffered.writer();
+    try out.print("{s}: {d}x{d}, frames {d}..{d}, {d} calls per loop, {d} loops\n", .{ options.path, capture.width, capture.height, options.first, last, calls, options.loops });
+    try out.print("  decode   {d:>10.2} us/frame\n", .{nsToUs(decodeNs) / perFrame});
+    try out.print("  submit   {d:>10.2} us/frame\n", .{nsToUs(submitNs) / perFrame});
+    try out.print("  total    {d:>10.2} us/frame (best loop {d:.2} us/frame)\n", .{ nsToUs(totalNs) / perFrame, nsToUs(bestNs) / @as(f64, @floatFromInt(frames)) });
+    try buffered.flush();
+}
+
+fn parseOptions(args: []const [:0]u8) !Options {
+    var options = Options{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "--loops") or std.mem.eql(u8, arg, "--first") or std.mem.eql(u8, arg, "--last")) {
+            i += 1;
+            if (i >= args.len) return error.MissingValue;
+            const value = try std.fmt.parseInt(usize, args[i], 10);
+            if (std.mem.eql(u8, arg, "--loops")) options.loops = @max(value, 1);
+            if (std.mem.eql(u8, arg, "--first")) options.first = value;
+            if (std.mem.eql(u8, arg, "--last")) options.last = value;
+        } else {
+            options.path = arg;
+        }
+    }
+    if (options.path.len == 0) return error.MissingPath;
+    return options;
+}
+
+fn nsToUs(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_us;
+}
@@ -0,0 +1,8 @@
+//! Root of `zig build test`, collects the inline tests of the referenced files
+
+test {
+    _ = @import("graphics/meshCodec.zig");
+    _ = @import("graphics/meshCache.zig");
+    _ = @import("graphics/imageDecoder.zig");
+    _ = @import("graphics/plyLoader.zig");
+}
@@ -9,8 +9,15 @@ const glfw = @import("mach-glfw");
 const zmath = @import("zmath");
 
 const errors = @import("../util/errors.zig");
+const diagnostics = @import("../util/diagnostics.zig");
 const validator = @import("../util/validator.zig");
+const memory = @import("../util/memory.zig");
 const mesh = @import("../graphics/mesh.zig");
+const scene = @import("../graphics/scene.zig");
+const sequence = @import("../graphics/sequence.zig");
+const exporter = @import("../graphics/exporter.zig");
+const glDebug = @import("../graphics/glDebug.zig");
+const postProcess = @import("../graphics/postProcess.zig");
 const window = @import("../window/window.zig");
 const c = @cImport({
     @cInclude("cimgui.h");
@@ -21,6 +28,7 @@ const c = @cImport({
 /// Contains:
 /// - position, rotation, scale (transformations)
 /// - objPath (file path)
+/// - exportPath (.obj, .ply or .zgm output path)
 /// - manualEdit (flag for manual transformation editing)
 /// - visible (flag for overlay visibility)
 /// - errorMessage
@@ -32,6 +40,7 @@ pub const OverlayState = struct {
 
     // File paths
     objPath: [256]u8 = [_]u8{0} ** 256,
+    exportPath: [256]u8 = [_]u8{0} ** 256,
 
     // State flags
     manualEdit: bool = false,
@@ -46,6 +55,20 @@ pub const OverlayState = struct {
     roughnessVisible: bool = true,
     metallicVisible: bool = true,
 
+    // Sequence playback
+    sequenceFps: f32 = 24.0,
+
+    // Point cloud rendering
+    pointSize: f32 = 2.0,
+    pointBudget: f32 = 5.0, // Millions of points
+
+    // Wireframe on shaded
+    wireframe: bool = false,
+    wireframeWidth: f32 = 1.0, // Pixels
+
+    // Post-process antialiasing preset
+    antialiasing: postProcess.Quality = .off,
+
     /// Helper method to set error message
     pub fn setErrorMessage(self: *OverlayState, msg: []const u8) void {
         std.mem.copyForwards(u8, &self.errorMessage, msg);
@@ -61,38 +84,75 @@ pub const OverlayState = struct {
     }
 };
 
-// General purpose allocator
-var gpa = std.heap.GeneralPurposeAllocator(.{}){};
-const allocator = gpa.allocator();
+const allocator = memory.allocator(.ui);
 
 /// Initializes ImGui context
 pub fn init(win: *const glfw.Window) void {
     c.InitImgui(win.handle);
 }
 
-/// Begins new UI frame
-pub fn beginFrame() void {
+// ImGui frames are only built when something could have changed, the previous draw data is
+// rendered again otherwise (ImGui keeps it until the next NewFrame)
+const SETTLE_FRAMES = 3; // Frames built after input, ImGui needs a few to settle hover and layout
+const REFRESH_INTERVAL = 0.25; // Seconds, keeps the live panels (memory, sequence, GL debug) updating
+
+var pendingFrames: u8 = SETTLE_FRAMES;
+var lastState: ?OverlayState = null; // State after the last built frame, null while hidden
+var lastBuild: f64 = 0;
+var hasDrawData = false;
+
+/// Request new UI frames, called for every input event forwarded to ImGui
+pub fn invalidate() void {
+    pendingFrames = SETTLE_FRAMES;
+}
+
+/// Builds a new UI frame if the overlay is visible and input, a state change or the refresh
+/// interval asks for it. A hidden overlay does no ImGui work at all
+pub fn update(state: *window.WindowState) !void {
+    if (!state.overlayState.visible) {
+        lastState = null;
+        return;
+    }
+
+    const now = glfw.getTime();
+    const changed = lastState == null or !std.meta.eql(lastState.?, state.overlayState);
+    if (!changed and pendingFrames == 0 and now - lastBuild < REFRESH_INTERVAL) {
+        return;
+    }
+
     c.ImGuiImplOpenGL3_NewFrame();
     c.ImGuiImplGlfw_NewFrame();
     c.ImGuiNewFrame();
-}
-
-/// Ends UI frame and renders
-pub fn endFrame() void {
+    try draw(state);
     c.ImGuiRender();
-    c.ImGuiImplOpenGL3_RenderDrawData();
+
+    lastState = state.overlayState;
+    lastBuild = now;
+    pendingFrames -|= 1;
+    hasDrawData = true;
 }
 
-/// Main UI rendering function
-pub fn draw(state: *window.WindowState) !void {
-    // Don't render if overlay is not visible
-    if (!state.overlayState.visible) {
+/// Renders the draw data of the last built frame
+pub fn render(state: *const window.WindowState) void {
+    if (!state.overlayState.visible or !hasDrawData) {
         return;
     }
+    c.ImGuiImplOpenGL3_RenderDrawData();
+}
 
+/// Main UI rendering function
+fn draw(state: *window.WindowState) !void {
     try filePanel(&state.overlayState);
+    try sequencePanel(&state.overlayState);
     transformationPanel(&state.overlayState);
     materialPanel(&state.overlayState);
+    pointCloudPanel(&state.overlayState);
+    partsPanel();
+    wireframePanel(&state.overlayState);
+    antialiasingPanel(&state.overlayState);
+    memoryPanel();
+    diagnosticsPanel();
+    glDebugPanel();
     resetButton(&state.overlayState);
 }
 
@@ -112,26 +172,79 @@ fn filePanel(state: *OverlayState) !void {
     }
     c.SameLine(10, 35);
     c.TextColoredRGBA(1, 0, 0, 1, state.getErrorMessagePtr()); // Red RGBA
+
+    // Export path (.obj with .mtl, binary .ply or compressed .zgm)
+    c.Text("Export");
+    c.SameLine(0, 4);
+    const exportPressed = c.InputTextWithHint("##export", "Path to .obj, .ply or .zgm output", &state.exportPath, state.exportPath.len, c.ImGuiInputTextFlagsEnterReturnsTrue, null, null);
+    if (c.Button("Save") or exportPressed) {
+        exportObject(state);
+    }
     c.Separator();
 }
 
+/// Exports the loaded object to the export path
+fn exportObject(state: *OverlayState) void {
+    const path = std.mem.trim(u8, std.mem.sliceTo(&state.exportPath, 0), " ");
+    if (path.len == 0) {
+        state.setErrorMessage(errors.ErrorCode.EmptyPath.getMessage());
+        return;
+    }
+
+    exporter.exportMesh(&mesh.loadedObject, path) catch {
+        state.setErrorMessage(errors.ErrorCode.ExportFailed.getMessage());
+        return;
+    };
+    state.setErrorMessage("");
+}
+
 /// Loads new object from .obj path
-fn loadNewObject(objPath: []const u8, state: *OverlayState) !void {
-    // Clear any previous errors
-    errors.errorCollector.clearError();
+pub fn loadNewObject(objPath: []const u8, state: *OverlayState) !void {
+    // Diagnostics of the previous load are dropped
+    diagnostics.clear();
 
+    sequence.stop();
     mesh.deinit();
     try mesh.load(objPath);
 
-    // Check if errorCollector has any error to display
-    if (errors.errorCollector.getLastErrorMessage()) |errorMsg| {
-        state.setErrorMessage(errorMsg);
-        errors.errorCollector.clearError();
+    // Show the most recent problem of this load
+    if (diagnostics.lastError()) |code| {
+        state.setErrorMessage(code.getMessage());
     } else {
         state.setErrorMessage("");
     }
 }
 
+/// UI part that plays a numbered .obj sequence starting at the entered path
+fn sequencePanel(state: *OverlayState) !void {
+    c.ImGuiBeginGroup();
+    defer c.ImGuiEndGroup();
+
+    if (c.CollapsingHeaderStatic("Sequence", 0)) {
+        c.Text("FPS:");
+        c.SameLine(0, 10);
+        _ = c.DragFloat("##fps", &state.sequenceFps, 0.1, 1.0, 240.0, "%.01f", 0);
+        sequence.playback.fps = state.sequenceFps;
+
+        if (c.Button("Play")) {
+            // First frame provides the materials, the sequence streams the geometry
+            try loadNewObject(&state.objPath, state);
+            try sequence.start(&state.objPath, state.sequenceFps);
+        }
+        c.SameLine(0, 10);
+        if (c.Button("Stop")) {
+            sequence.stop();
+        }
+
+        if (sequence.playback.active) {
+            var buf: [64]u8 = undefined;
+            const text = std.fmt.bufPrintZ(&buf, "Frame {d} / {d}", .{ sequence.playback.currentFrame + 1, sequence.playback.frameCount }) catch "";
+            c.Text(text.ptr);
+        }
+    }
+    c.Separator();
+}
+
 /// UI part that handles transformation editing
 fn transformationPanel(state: *OverlayState) void {
     c.ImGuiBeginGroup();
@@ -207,6 +320,224 @@ fn materialPanel(state: *OverlayState) void {
     c.Separator();
 }
 
+/// UI part that handles point cloud settings (only shown for point clouds)
+fn pointCloudPanel(state: *OverlayState) void {
+    const cloud = mesh.loadedObject.points orelse return;
+
+    c.ImGuiBeginGroup();
+    defer c.ImGuiEndGroup();
+
+    if (c.CollapsingHeaderStatic("Point Cloud", 0)) {
+        c.Text("Size:");
+        c.SameLine(0, 10);
+        _ = c.DragFloat("##pointSize", &state.pointSize, 0.05, 1.0, 16.0, "%.01f px", 0);
+        c.Text("Budget:");
+        c.SameLine(0, 10);
+        _ = c.DragFloat("##pointBudget", &state.pointBudget, 0.05, 0.1, 100.0, "%.01f M", 0);
+
+        var buf: [96]u8 = undefined;
+        const text = std.fmt.bufPrintZ(&buf, "Drawn: {d} / {d} points", .{ cloud.drawnPoints, cloud.pointCount }) catch "";
+        c.Text(text.ptr);
+    }
+
+    c.Separator();
+}
+
+/// UI part that lists the o/g parts of the model as a tree with visibility checkboxes
+fn partsPanel() void {
+    const nodes = &mesh.loadedObject.scene;
+    if (nodes.count() < 2) return;
+
+    c.ImGuiBeginGroup();
+    defer c.ImGuiEndGroup();
+
+    if (c.CollapsingHeaderStatic("Parts", 0)) {
+        var buf: [64]u8 = undefined;
+        const text = std.fmt.bufPrintZ(&buf, "Drawn: {d} / {d} parts", .{ nodes.drawnNodes, nodes.count() }) catch "";
+        c.Text(text.ptr);
+        _ = partNode(nodes, 0);
+    }
+
+    c.Separator();
+}
+
+/// Tree entry of a node and its children, returns the node after its subtree
+fn partNode(nodes: *scene.Scene, node: u32) u32 {
+    const slice = nodes.nodes.slice();
+    const end = slice.items(.subtreeEnd)[node];
+
+    c.PushID(@intCast(node));
+    defer c.PopID();
+
+    _ = c.Checkbox("##visible", &slice.items(.visible)[node]);
+    c.SameLine(0, 4);
+
+    var label: [128]u8 = undefined;
+    const name = nodes.names.items[node];
+    const shown = if (name.len > 0) name[0..@min(name.len, label.len - 1)] else "(unnamed)";
+    const text = std.fmt.bufPrintZ(&label, "{s}", .{shown}) catch "";
+    const flags = if (end == node + 1) c.ImGuiTreeNodeFlagsLeaf else c.ImGuiTreeNodeFlagsDefaultOpen;
+    if (c.TreeNodeEx(text.ptr, flags)) {
+        var child = node + 1;
+        while (child < end) child = partNode(nodes, child);
+        c.TreePop();
+    }
+    return end;
+}
+
+/// UI part that toggles the wireframe on the shaded model
+fn wireframePanel(state: *OverlayState) void {
+    c.ImGuiBeginGroup();
+    defer c.ImGuiEndGroup();
+
+    if (c.CollapsingHeaderStatic("Wireframe", 0)) {
+        _ = c.Checkbox("Show", &state.wireframe);
+        c.Text("Width:");
+        c.SameLine(0, 10);
+        _ = c.DragFloat("##wireframeWidth", &state.wireframeWidth, 0.05, 0.5, 8.0, "%.01f px", 0);
+    }
+
+    c.Separator();
+}
+
+/// UI part that selects the antialiasing preset and shows its GPU time
+fn antialiasingPanel(state: *OverlayState) void {
+    c.ImGuiBeginGroup();
+    defer c.ImGuiEndGroup();
+
+    if (c.CollapsingHeaderStatic("Antialiasing", 0)) {
+        inline for (std.meta.fields(postProcess.Quality), 0..) |field, index| {
+            if (index > 0) c.SameLine(0, 10);
+            if (c.RadioButton(field.name.ptr, state.antialiasing == @as(postProcess.Quality, @enumFromInt(field.value)))) {
+                state.antialiasing = @enumFromInt(field.value);
+            }
+        }
+
+        var buf: [48]u8 = undefined;
+        const text = if (postProcess.gpuTime()) |ms|
+            std.fmt.bufPrintZ(&buf, "GPU: {d:.3} ms", .{ms}) catch ""
+        else
+            std.fmt.bufPrintZ(&buf, "GPU: -", .{}) catch "";
+        c.Text(text.ptr);
+    }
+
+    c.Separator();
+}
+
+/// UI part that shows memory per subsystem and the estimated GPU memory
+fn memoryPanel() void {
+    c.ImGuiBeginGroup();
+    defer c.ImGuiEndGroup();
+
+    if (c.CollapsingHeaderStatic("Memory", 0)) {
+        if (c.BeginTable2("MemoryTable", 4, c.ImGuiTableFlagsNone)) {
+            const header = [_][*c]const u8{ "Subsystem", "Current", "Peak", "Allocs" };
+            for (header) |title| {
+                _ = c.TableNextColumn();
+                c.Text(title);
+            }
+
+            inline for (std.meta.fields(memory.Subsystem)) |field| {
+                const stats = memory.stats(@enumFromInt(field.value));
+                var buf: [32]u8 = undefined;
+
+                _ = c.TableNextColumn();
+                c.Text(field.name.ptr);
+                _ = c.TableNextColumn();
+                c.Text(formatBytes(&buf, stats.current).ptr);
+                _ = c.TableNextColumn();
+                c.Text(formatBytes(&buf, stats.peak).ptr);
+                _ = c.TableNextColumn();
+                c.Text((std.fmt.bufPrintZ(&buf, "{d}", .{stats.allocations}) catch "").ptr);
+            }
+
+            c.EndTable();
+        }
+
+        var buf: [32]u8 = undefined;
+        var line: [96]u8 = undefined;
+        const buffers = std.fmt.bufPrintZ(&line, "GPU buffers: {s}", .{formatBytes(&buf, memory.gpuStats(.buffer))}) catch "";
+        c.Text(buffers.ptr);
+        const textures = std.fmt.bufPrintZ(&line, "GPU textures: {s}", .{formatBytes(&buf, memory.gpuStats(.texture))}) catch "";
+        c.Text(textures.ptr);
+    }
+
+    c.Separator();
+}
+
+var diagnosticsSummary: diagnostics.Summary = undefined; // Too large for the stack of every UI frame
+
+/// UI part that shows the problems of the last load per error code with their first occurrences
+fn diagnosticsPanel() void {
+    c.ImGuiBeginGroup();
+    defer c.ImGuiEndGroup();
+
+    diagnostics.summary(&diagnosticsSummary);
+    var title: [48]u8 = undefined;
+    const header = std.fmt.bufPrintZ(&title, "Diagnostics ({d})###Diagnostics", .{diagnosticsSummary.total()}) catch "Diagnostics";
+
+    if (c.CollapsingHeaderStatic(header.ptr, 0)) {
+        var line: [192]u8 = undefined;
+        for (diagnosticsSummary.counts, diagnosticsSummary.sampleCounts, 0..) |count, sampleCount, index| {
+            if (count == 0) continue;
+            const code: errors.ErrorCode = @enumFromInt(index);
+            const text = std.fmt.bufPrintZ(&line, "{s}: {d}", .{ code.getMessage(), count }) catch "";
+            c.TextColoredRGBA(1, 0, 0, 1, text.ptr);
+
+            // Samples may contain file content, passed as argument instead of format string
+            for (diagnosticsSummary.samples[index][0..sampleCount]) |*sample| {
+                const sampleText = if (sample.line > 0)
+                    std.fmt.bufPrintZ(&line, "line {d}: {s}", .{ sample.line, sample.text() }) catch ""
+                else
+                    std.fmt.bufPrintZ(&line, "{s}", .{sample.text()}) catch "";
+                c.BulletText("%s", sampleText.ptr);
+            }
+            if (count > sampleCount) {
+                c.BulletText("... %llu more", @as(c_ulonglong, count - sampleCount));
+            }
+        }
+    }
+
+    c.Separator();
+}
+
+/// UI part that shows GL debug message counts and the latest performance warning
+fn glDebugPanel() void {
+    c.ImGuiBeginGroup();
+    defer c.ImGuiEndGroup();
+
+    if (c.CollapsingHeaderStatic("GL Debug", 0)) {
+        const counters = glDebug.getCounters();
+        var line: [128]u8 = undefined;
+
+        inline for (std.meta.fields(glDebug.Severity)) |field| {
+            const text = std.fmt.bufPrintZ(&line, field.name ++ ": {d}", .{counters.bySeverity[field.value]}) catch "";
+            c.Text(text.ptr);
+        }
+        const performance = std.fmt.bufPrintZ(&line, "performance: {d}", .{counters.performance}) catch "";
+        c.Text(performance.ptr);
+
+        var warning: [256]u8 = undefined;
+        if (glDebug.latestWarning(warning[0 .. warning.len - 1])) |text| {
+            // Driver text is passed as ImGui format string
+            std.mem.replaceScalar(u8, warning[0..text.len], '%', ' ');
+            warning[text.len] = 0;
+            c.TextColoredRGBA(0.8, 0.5, 0.0, 1.0, &warning);
+        }
+    }
+
+    c.Separator();
+}
+
+/// Format a byte count with a binary unit
+fn formatBytes(buf: []u8, bytes: usize) [:0]const u8 {
+    const value: f64 = @floatFromInt(bytes);
+    if (bytes >= 1 << 30) return std.fmt.bufPrintZ(buf, "{d:.2} GiB", .{value / (1 << 30)}) catch "";
+    if (bytes >= 1 << 20) return std.fmt.bufPrintZ(buf, "{d:.1} MiB", .{value / (1 << 20)}) catch "";
+    if (bytes >= 1 << 10) return std.fmt.bufPrintZ(buf, "{d:.1} KiB", .{value / (1 << 10)}) catch "";
+    return std.fmt.bufPrintZ(buf, "{d} B", .{bytes}) catch "";
+}
+
 /// UI part that handles reset button
 fn resetButton(state: *OverlayState) void {
     c.ImGuiBeginGroup();
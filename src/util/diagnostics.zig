@@ -0,0 +1,183 @@
+//! Load diagnostics
+//!
+//! Thread-safe sink for problems found while loading (malformed faces, missing files, ...).
+//! Every report increments a counter per error code in a thread local buffer, which is merged
+//! into the shared counters when it fills up or the thread flushes. Only the first SAMPLE_COUNT
+//! reports of each code are formatted, logged and kept with their line number, so the cost of a
+//! file with millions of broken faces is one counter increment per face.
+//!
+//! clear starts a new load; buffers still holding reports of an older load are dropped on flush.
+
+const std = @import("std");
+
+const errors = @import("errors.zig");
+
+pub const SAMPLE_COUNT = 8; // Kept and logged per error code and load
+const MESSAGE_LENGTH = 128;
+const FLUSH_INTERVAL = 4096; // Reports buffered per thread before they are merged
+
+const CODE_COUNT = std.meta.fields(errors.ErrorCode).len;
+
+/// Formatted report
+///
+/// Contains:
+/// - code: error code of the report
+/// - line: line in the source file (0 if unknown)
+/// - message: formatted text, see text()
+pub const Sample = struct {
+    code: errors.ErrorCode,
+    line: usize,
+    message: [MESSAGE_LENGTH]u8 = undefined,
+    len: usize = 0,
+
+    pub fn text(self: *const Sample) []const u8 {
+        return self.message[0..self.len];
+    }
+};
+
+/// Reports of one thread not merged yet
+///
+/// Contains:
+/// - generation: load the counts belong to
+/// - counts: reports per error code
+/// - pending: reports since the last flush
+/// - last: most recent code
+const Local = struct {
+    generation: u64 = 0,
+    counts: [CODE_COUNT]u64 = [_]u64{0} ** CODE_COUNT,
+    pending: usize = 0,
+    last: ?errors.ErrorCode = null,
+};
+
+threadlocal var local: Local = .{};
+
+// Shared state of the current load (guarded by mutex)
+var mutex = std.Thread.Mutex{};
+var generation: u64 = 1;
+var counts = [_]u64{0} ** CODE_COUNT;
+var samples: [CODE_COUNT][SAMPLE_COUNT]Sample = undefined;
+var sampleCounts = [_]usize{0} ** CODE_COUNT;
+var last: ?errors.ErrorCode = null;
+
+// Sample slots handed out per code, checked without the lock
+var reserved = [_]std.atomic.Value(usize){std.atomic.Value(usize).init(0)} ** CODE_COUNT;
+var currentGeneration = std.atomic.Value(u64).init(1);
+
+/// Report a problem, line is the line in the source file or 0
+/// Only the first SAMPLE_COUNT reports of a code per load are formatted and logged
+pub fn report(code: errors.ErrorCode, line: usize, comptime fmt: []const u8, args: anytype) void {
+    const loadGeneration = currentGeneration.load(.acquire);
+    if (local.generation != loadGeneration) {
+        local = .{ .generation = loadGeneration };
+    }
+
+    const index = @intFromEnum(code);
+    local.counts[index] += 1;
+    local.last = code;
+    local.pending += 1;
+
+    // Rare path: a free sample slot
+    const slots = &reserved[index];
+    if (slots.load(.monotonic) < SAMPLE_COUNT and slots.fetchAdd(1, .monotonic) < SAMPLE_COUNT) {
+        var sample = Sample{ .code = code, .line = line };
+        sample.len = (std.fmt.bufPrint(&sample.message, fmt, args) catch &sample.message).len;
+        if (line > 0) {
+            std.log.err("{s} (line {d})", .{ sample.text(), line });
+        } else {
+            std.log.err("{s}", .{sample.text()});
+        }
+        addSample(loadGeneration, sample);
+    }
+
+    if (local.pending >= FLUSH_INTERVAL) flush();
+}
+
+/// Merge the reports of the calling thread, call when a loader thread finishes its work
+pub fn flush() void {
+    if (local.pending == 0) return;
+    defer local = .{ .generation = local.generation };
+
+    mutex.lock();
+    defer mutex.unlock();
+    if (local.generation != generation) return; // Reports of an older load
+
+    for (&counts, local.counts) |*count, localCount| {
+        count.* += localCount;
+    }
+    if (local.last) |code| last = code;
+}
+
+/// Start a new load, drops all counters and samples
+pub fn clear() void {
+    flush();
+
+    mutex.lock();
+    defer mutex.unlock();
+    generation += 1;
+    counts = [_]u64{0} ** CODE_COUNT;
+    sampleCounts = [_]usize{0} ** CODE_COUNT;
+    last = null;
+    for (&reserved) |*slots| slots.store(0, .monotonic);
+    currentGeneration.store(generation, .release);
+}
+
+/// Most recent error code of the current load (flushes the calling thread)
+pub fn lastError() ?errors.ErrorCode {
+    flush();
+    mutex.lock();
+    defer mutex.unlock();
+    return last;
+}
+
+/// Counters and samples of the current load
+///
+/// Contains:
+/// - counts: reports per error code
+/// - samples, sampleCounts: first reports per error code
+pub const Summary = struct {
+    counts: [CODE_COUNT]u64,
+    samples: [CODE_COUNT][SAMPLE_COUNT]Sample,
+    sampleCounts: [CODE_COUNT]usize,
+
+    /// Total number of reports
+    pub fn total(self: *const Summary) u64 {
+        var sum: u64 = 0;
+        for (self.counts) |count| sum += count;
+        return sum;
+    }
+};
+
+/// Copy the state of the current load (flushes the calling thread)
+pub fn summary(out: *Summary) void {
+    flush();
+    mutex.lock();
+    defer mutex.unlock();
+    out.counts = counts;
+    out.samples = samples;
+    out.sampleCounts = sampleCounts;
+}
+
+/// Log one line per error code that had more reports than were logged
+pub fn logSuppressed() void {
+    flush();
+    mutex.lock();
+    defer mutex.unlock();
+    for (counts, sampleCounts, 0..) |count, shown, index| {
+        if (count > shown) {
+            const code: errors.ErrorCode = @enumFromInt(index);
+            std.log.err("{s}: {d} occurrences, {d} logged", .{ code.getMessage(), count, shown });
+        }
+    }
+}
+
+fn addSample(loadGeneration: u64, sample: Sample) void {
+    mutex.lock();
+    defer mutex.unlock();
+    if (loadGeneration != generation) return;
+
+    const index = @intFromEnum(sample.code);
+    if (sampleCounts[index] < SAMPLE_COUNT) {
+        samples[index][sampleCounts[index]] = sample;
+        sampleCounts[index] += 1;
+    }
+}
@@ -1,29 +1,6 @@
 //! Error code catalog
-
-pub const ErrorCollector = struct {
-    lastError: ?ErrorCode = null,
-
-    pub fn reportError(self: *ErrorCollector, code: ErrorCode) void {
-        self.lastError = code;
-    }
-
-    pub fn getLastError(self: *const ErrorCollector) ?ErrorCode {
-        return self.lastError;
-    }
-
-    pub fn getLastErrorMessage(self: *const ErrorCollector) ?[]const u8 {
-        return if (self.lastError) |code|
-            ErrorCode.getMessage(code)
-        else
-            null;
-    }
-
-    pub fn clearError(self: *ErrorCollector) void {
-        self.lastError = null;
-    }
-};
-
-pub var errorCollector: ErrorCollector = .{};
+//!
+//! Codes are reported through diagnostics.zig
 
 /// Error codes that are NOT zig errors but rather application-specific
 pub const ErrorCode = enum {
@@ -33,6 +10,9 @@ pub const ErrorCode = enum {
     PathTooLong,
     MtlFileNotFound,
     ObjFileMalformed,
+    SequenceNotNumbered,
+    ExportFailed,
+    EnvironmentLoadFailed,
 
     pub fn getMessage(self: ErrorCode) []const u8 {
         return switch (self) {
@@ -42,9 +22,9 @@ pub const ErrorCode = enum {
             .PathTooLong => "Path is too long (max 255 characters)",
             .MtlFileNotFound => "Material file not found",
             .ObjFileMalformed => "Object file is malformed / format not yet supported",
+            .SequenceNotNumbered => "Sequence path must end with a frame number",
+            .ExportFailed => "Export failed",
+            .EnvironmentLoadFailed => "Environment map could not be loaded",
         };
     }
 };
-
-// Global instance
-var lastError: ?ErrorCode = null;
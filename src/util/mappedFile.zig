@@ -0,0 +1,76 @@
+//! Read-only file mapping
+//!
+//! Maps whole files into memory, with mmap on POSIX systems and a file mapping object on Windows
+//! Falls back to reading the file into an allocated buffer if Windows cannot map it (e.g. some network shares)
+
+const std = @import("std");
+const builtin = @import("builtin");
+
+/// MappedFile struct
+///
+/// Contains:
+/// - data: file contents
+/// - mapping: page aligned mapping, null when the file was read
+/// - allocator: owner of data when the file was read instead of mapped
+///
+/// close method
+pub const MappedFile = struct {
+    data: []const u8,
+    mapping: ?[]align(std.mem.page_size) const u8 = null,
+    allocator: std.mem.Allocator,
+
+    /// Map (or read) the whole file
+    pub fn open(allocator: std.mem.Allocator, path: []const u8) !MappedFile {
+        const file = try std.fs.cwd().openFile(path, .{});
+        defer file.close();
+
+        const size = (try file.stat()).size;
+        if (size == 0) {
+            return .{ .data = &.{}, .allocator = allocator };
+        }
+
+        if (builtin.os.tag != .windows) {
+            const mapping = try std.posix.mmap(null, size, std.posix.PROT.READ, .{ .TYPE = .PRIVATE }, file.handle, 0);
+            return .{ .data = mapping, .mapping = mapping, .allocator = allocator };
+        }
+        if (mapWindows(file, size)) |mapping| {
+            return .{ .data = mapping, .mapping = mapping, .allocator = allocator };
+        } else |_| {}
+
+        const data = try file.readToEndAlloc(allocator, size);
+        return .{ .data = data, .allocator = allocator };
+    }
+
+    /// Unmap (or free) the file contents
+    pub fn close(self: *MappedFile) void {
+        if (self.mapping) |mapping| {
+            if (builtin.os.tag == .windows) {
+                _ = UnmapViewOfFile(@ptrCast(mapping.ptr));
+            } else {
+                std.posix.munmap(mapping);
+            }
+        } else if (self.data.len > 0) {
+            self.allocator.free(self.data);
+        }
+        self.data = &.{};
+        self.mapping = null;
+    }
+};
+
+// Not declared by std.os.windows
+const windows = std.os.windows;
+const PAGE_READONLY: windows.DWORD = 0x02;
+const FILE_MAP_READ: windows.DWORD = 0x04;
+extern "kernel32" fn CreateFileMappingW(file: windows.HANDLE, attributes: ?*anyopaque, protect: windows.DWORD, maximumSizeHigh: windows.DWORD, maximumSizeLow: windows.DWORD, name: ?windows.LPCWSTR) callconv(windows.WINAPI) ?windows.HANDLE;
+extern "kernel32" fn MapViewOfFile(mapping: windows.HANDLE, access: windows.DWORD, offsetHigh: windows.DWORD, offsetLow: windows.DWORD, size: windows.SIZE_T) callconv(windows.WINAPI) ?*anyopaque;
+extern "kernel32" fn UnmapViewOfFile(base: *const anyopaque) callconv(windows.WINAPI) windows.BOOL;
+
+/// Map a whole file read-only, the view keeps the mapping object alive after its handle is closed
+fn mapWindows(file: std.fs.File, size: u64) ![]align(std.mem.page_size) const u8 {
+    const section = CreateFileMappingW(file.handle, null, PAGE_READONLY, 0, 0, null) orelse return error.FileMappingFailed;
+    defer windows.CloseHandle(section);
+
+    const view = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0) orelse return error.FileMappingFailed;
+    const bytes: [*]align(std.mem.page_size) const u8 = @ptrCast(@alignCast(view));
+    return bytes[0..@intCast(size)];
+}
@@ -0,0 +1,161 @@
+//! Memory accounting per subsystem
+//!
+//! Every subsystem gets a tracking allocator that forwards to one shared general purpose allocator
+//! and counts current bytes, peak bytes and allocations with atomics (loaders run on worker threads).
+//! GPU memory is estimated from the sizes passed to glBufferData / glTexImage2D, keyed by object id.
+
+const std = @import("std");
+
+/// Subsystems that own memory
+pub const Subsystem = enum {
+    parser, // .obj/.mtl/.ply/.stl parsing
+    mesh, // Interleaved buffers, point clouds, glTF, sequences
+    textures, // zstbi images
+    ui, // Overlay
+    cache, // Mesh cache and codec
+    exporter, // Export buffers
+    window, // Window and icon
+    other,
+};
+
+/// Counters of one subsystem
+///
+/// Contains:
+/// - current: bytes currently allocated
+/// - peak: highest value of current
+/// - allocations: number of allocations since start
+/// - live: allocations not freed yet
+pub const Stats = struct {
+    current: usize,
+    peak: usize,
+    allocations: usize,
+    live: usize,
+};
+
+/// GPU resource kinds with estimated sizes
+pub const GpuResource = enum {
+    buffer,
+    texture,
+};
+
+/// Allocator wrapper that counts the memory of one subsystem
+const TrackingAllocator = struct {
+    current: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    peak: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    allocations: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    live: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+
+    const vtable = std.mem.Allocator.VTable{
+        .alloc = alloc,
+        .resize = resize,
+        .free = free,
+    };
+
+    fn alloc(ctx: *anyopaque, len: usize, ptr_align: u8, ret_addr: usize) ?[*]u8 {
+        const self: *TrackingAllocator = @ptrCast(@alignCast(ctx));
+        const result = backing.rawAlloc(len, ptr_align, ret_addr) orelse return null;
+        self.grow(len);
+        _ = self.allocations.fetchAdd(1, .monotonic);
+        _ = self.live.fetchAdd(1, .monotonic);
+        return result;
+    }
+
+    fn resize(ctx: *anyopaque, buf: []u8, buf_align: u8, new_len: usize, ret_addr: usize) bool {
+        const self: *TrackingAllocator = @ptrCast(@alignCast(ctx));
+        if (!backing.rawResize(buf, buf_align, new_len, ret_addr)) return false;
+        if (new_len > buf.len) {
+            self.grow(new_len - buf.len);
+        } else {
+            _ = self.current.fetchSub(buf.len - new_len, .monotonic);
+        }
+        return true;
+    }
+
+    fn free(ctx: *anyopaque, buf: []u8, buf_align: u8, ret_addr: usize) void {
+        const self: *TrackingAllocator = @ptrCast(@alignCast(ctx));
+        backing.rawFree(buf, buf_align, ret_addr);
+        _ = self.current.fetchSub(buf.len, .monotonic);
+        _ = self.live.fetchSub(1, .monotonic);
+    }
+
+    fn grow(self: *TrackingAllocator, bytes: usize) void {
+        const current = self.current.fetchAdd(bytes, .monotonic) + bytes;
+        _ = self.peak.fetchMax(current, .monotonic);
+    }
+};
+
+var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+const backing = gpa.allocator();
+
+var trackers = [_]TrackingAllocator{.{}} ** std.meta.fields(Subsystem).len;
+
+// GPU size estimates per object id
+var gpuMutex = std.Thread.Mutex{};
+var gpuSizes = [_]std.AutoHashMapUnmanaged(u32, usize){.{}} ** std.meta.fields(GpuResource).len;
+var gpuBytes = [_]usize{0} ** std.meta.fields(GpuResource).len;
+
+/// Allocator of a subsystem
+pub fn allocator(comptime subsystem: Subsystem) std.mem.Allocator {
+    return .{
+        .ptr = &trackers[@intFromEnum(subsystem)],
+        .vtable = &TrackingAllocator.vtable,
+    };
+}
+
+/// Current counters of a subsystem
+pub fn stats(subsystem: Subsystem) Stats {
+    const tracker = &trackers[@intFromEnum(subsystem)];
+    return .{
+        .current = tracker.current.load(.monotonic),
+        .peak = tracker.peak.load(.monotonic),
+        .allocations = tracker.allocations.load(.monotonic),
+        .live = tracker.live.load(.monotonic),
+    };
+}
+
+/// Record the size of a GPU object, replaces the previous size of the same id (e.g. orphaned buffers)
+pub fn trackGpu(kind: GpuResource, id: u32, bytes: usize) void {
+    gpuMutex.lock();
+    defer gpuMutex.unlock();
+
+    const sizes = &gpuSizes[@intFromEnum(kind)];
+    const entry = sizes.getOrPut(backing, id) catch return; // Estimates only, skip on failure
+    if (entry.found_existing) {
+        gpuBytes[@intFromEnum(kind)] -= entry.value_ptr.*;
+    }
+    entry.value_ptr.* = bytes;
+    gpuBytes[@intFromEnum(kind)] += bytes;
+}
+
+/// Forget a GPU object, call before deleting it
+pub fn untrackGpu(kind: GpuResource, id: u32) void {
+    gpuMutex.lock();
+    defer gpuMutex.unlock();
+
+    if (gpuSizes[@intFromEnum(kind)].fetchRemove(id)) |entry| {
+        gpuBytes[@intFromEnum(kind)] -= entry.value;
+    }
+}
+
+/// Estimated GPU bytes of a resource kind
+pub fn gpuStats(kind: GpuResource) usize {
+    gpuMutex.lock();
+    defer gpuMutex.unlock();
+    return gpuBytes[@intFromEnum(kind)];
+}
+
+/// Estimated size of a texture without mipmaps (drivers may pad RGB to RGBA)
+pub fn textureBytes(width: usize, height: usize, components: usize) usize {
+    return width * height * components;
+}
+
+/// Write all counters as a JSON object
+pub fn writeJson(writer: anytype) !void {
+    try writer.writeAll("{\"cpu\":{");
+    inline for (std.meta.fields(Subsystem), 0..) |field, i| {
+        const s = stats(@enumFromInt(field.value));
+        if (i > 0) try writer.writeAll(",");
+        try writer.print("\"{s}\":{{\"current\":{d},\"peak\":{d},\"allocations\":{d},\"live\":{d}}}", .{ field.name, s.current, s.peak, s.allocations, s.live });
+    }
+    try writer.print("}},\"gpu\":{{\"buffers\":{d},\"textures\":{d}}}}}", .{ gpuStats(.buffer), gpuStats(.texture) });
+}
@@ -0,0 +1,191 @@
+//! Runtime metrics and Prometheus endpoint
+//!
+//! Render and loader threads update atomic counters and a ring of recent frame times without locks.
+//! An optional HTTP thread on 127.0.0.1 serves them in the Prometheus text format on /metrics,
+//! together with the memory counters of memory.zig. Frame time quantiles are computed per scrape
+//! from the last FRAME_HISTORY frames, sum and count of the summary are totals since start.
+//! Clients that do not send their request within READ_TIMEOUT_MS are dropped.
+
+const std = @import("std");
+const builtin = @import("builtin");
+
+const memory = @import("memory.zig");
+
+const FRAME_HISTORY = 1024;
+const REQUEST_SIZE = 4096;
+const READ_TIMEOUT_MS = 2000; // The server is single threaded, a silent client would block it
+
+/// Monotonic counters
+pub const Counter = enum {
+    frames,
+    frameNanoseconds,
+    drawCalls,
+    triangles,
+    loads,
+    loadNanoseconds,
+    cacheHits,
+    cacheMisses,
+    sequenceFrames, // Decoded by the sequence workers
+};
+
+const allocator = memory.allocator(.other);
+
+var counters = [_]std.atomic.Value(u64){std.atomic.Value(u64).init(0)} ** std.meta.fields(Counter).len;
+
+// Written by the render thread only, read by the server
+var frameTimes = [_]std.atomic.Value(u64){std.atomic.Value(u64).init(0)} ** FRAME_HISTORY;
+var frameHead = std.atomic.Value(u64).init(0);
+var lastDrawCalls = std.atomic.Value(u64).init(0);
+var lastTriangles = std.atomic.Value(u64).init(0);
+var lastLoad = std.atomic.Value(u64).init(0);
+
+/// Add to a counter (any thread)
+pub fn add(counter: Counter, value: u64) void {
+    _ = counters[@intFromEnum(counter)].fetchAdd(value, .monotonic);
+}
+
+/// Record a finished frame (render thread)
+pub fn recordFrame(nanoseconds: u64, drawCalls: u64, triangles: u64) void {
+    const head = frameHead.load(.monotonic);
+    frameTimes[head % FRAME_HISTORY].store(nanoseconds, .monotonic);
+    frameHead.store(head + 1, .release);
+
+    lastDrawCalls.store(drawCalls, .monotonic);
+    lastTriangles.store(triangles, .monotonic);
+    add(.frames, 1);
+    add(.frameNanoseconds, nanoseconds);
+    add(.drawCalls, drawCalls);
+    add(.triangles, triangles);
+}
+
+/// Record the duration of a successful model load
+pub fn recordLoad(nanoseconds: u64) void {
+    lastLoad.store(nanoseconds, .monotonic);
+    add(.loads, 1);
+    add(.loadNanoseconds, nanoseconds);
+}
+
+/// Serve /metrics on 127.0.0.1:port from a detached thread
+pub fn serve(port: u16) !void {
+    const address = try std.net.Address.parseIp("127.0.0.1", port);
+    const server = try allocator.create(std.net.Server);
+    errdefer allocator.destroy(server);
+    server.* = try address.listen(.{ .reuse_address = true });
+
+    const thread = try std.Thread.spawn(.{}, serverMain, .{server});
+    thread.detach();
+    std.log.info("Metrics on http://127.0.0.1:{d}/metrics", .{port});
+}
+
+/// Accept loop, one request per connection
+fn serverMain(server: *std.net.Server) void {
+    while (true) {
+        const connection = server.accept() catch |err| {
+            std.log.err("Metrics server stopped: {s}", .{@errorName(err)});
+            return;
+        };
+        setReadTimeout(connection.stream) catch |err| {
+            std.log.warn("Metrics request failed: {s}", .{@errorName(err)});
+            connection.stream.close();
+            continue;
+        };
+        handle(connection) catch |err| {
+            std.log.warn("Metrics request failed: {s}", .{@errorName(err)});
+        };
+        connection.stream.close();
+    }
+}
+
+/// Reads of the stream fail after READ_TIMEOUT_MS without data
+fn setReadTimeout(stream: std.net.Stream) !void {
+    const posix = std.posix;
+    if (builtin.os.tag == .windows) {
+        const milliseconds: u32 = READ_TIMEOUT_MS;
+        try posix.setsockopt(stream.handle, posix.SOL.SOCKET, posix.SO.RCVTIMEO, std.mem.asBytes(&milliseconds));
+    } else {
+        const timeout = posix.timeval{ .tv_sec = READ_TIMEOUT_MS / 1000, .tv_usec = (READ_TIMEOUT_MS % 1000) * 1000 };
+        try posix.setsockopt(stream.handle, posix.SOL.SOCKET, posix.SO.RCVTIMEO, std.mem.asBytes(&timeout));
+    }
+}
+
+fn handle(connection: std.net.Server.Connection) !void {
+    var request: [REQUEST_SIZE]u8 = undefined;
+    const n = try connection.stream.read(&request);
+    const line = request[0 .. std.mem.indexOfScalar(u8, request[0..n], '\r') orelse n];
+
+    if (!std.mem.startsWith(u8, line, "GET /metrics ") and !std.mem.startsWith(u8, line, "GET / ")) {
+        try connection.stream.writeAll("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+
+    var body = std.ArrayList(u8).init(allocator);
+    defer body.deinit();
+    try writeMetrics(body.writer());
+
+    var header: [128]u8 = undefined;
+    const head = try std.fmt.bufPrint(&header, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {d}\r\nConnection: close\r\n\r\n", .{body.items.len});
+    try connection.stream.writeAll(head);
+    try connection.stream.writeAll(body.items);
+}
+
+/// Write all metrics in the Prometheus text format
+pub fn writeMetrics(writer: anytype) !void {
+    // Quantiles of the recent frames
+    var times: [FRAME_HISTORY]u64 = undefined;
+    const head = frameHead.load(.acquire);
+    const count: usize = @intCast(@min(head, FRAME_HISTORY));
+    for (times[0..count], 0..) |*time, i| {
+        time.* = frameTimes[i].load(.monotonic);
+    }
+    std.mem.sort(u64, times[0..count], {}, std.sort.asc(u64));
+
+    try writer.writeAll("# HELP zigGL_frame_time_seconds Frame time, quantiles of the recent frames\n# TYPE zigGL_frame_time_seconds summary\n");
+    for ([_]f64{ 0.5, 0.9, 0.95, 0.99 }) |quantile| {
+        const value = if (count == 0) 0 else times[@min(count - 1, @as(usize, @intFromFloat(@as(f64, @floatFromInt(count)) * quantile)))];
+        try writer.print("zigGL_frame_time_seconds{{quantile=\"{d}\"}} {d:.6}\n", .{ quantile, seconds(value) });
+    }
+    // Totals since start, so rate(sum) / rate(count) gives the mean over any window
+    try writer.print("zigGL_frame_time_seconds_sum {d:.6}\nzigGL_frame_time_seconds_count {d}\n", .{ seconds(load(.frameNanoseconds)), load(.frames) });
+
+    try gauge(writer, "zigGL_draw_calls", "Draw calls of the last frame", lastDrawCalls.load(.monotonic));
+    try gauge(writer, "zigGL_triangles", "Triangles of the last frame", lastTriangles.load(.monotonic));
+    try counter(writer, "zigGL_frames_total", "Rendered frames", .frames);
+    try counter(writer, "zigGL_draw_calls_total", "Draw calls since start", .drawCalls);
+    try counter(writer, "zigGL_triangles_total", "Triangles since start", .triangles);
+    try counter(writer, "zigGL_sequence_frames_total", "Sequence frames decoded by the workers", .sequenceFrames);
+
+    // Loads and cache
+    try counter(writer, "zigGL_loads_total", "Model loads", .loads);
+    try writer.print("# HELP zigGL_load_seconds_total Time spent loading models\n# TYPE zigGL_load_seconds_total counter\nzigGL_load_seconds_total {d:.6}\n", .{seconds(load(.loadNanoseconds))});
+    try writer.print("# HELP zigGL_last_load_seconds Duration of the last model load\n# TYPE zigGL_last_load_seconds gauge\nzigGL_last_load_seconds {d:.6}\n", .{seconds(lastLoad.load(.monotonic))});
+    try counter(writer, "zigGL_mesh_cache_hits_total", "Mesh cache hits", .cacheHits);
+    try counter(writer, "zigGL_mesh_cache_misses_total", "Mesh cache misses", .cacheMisses);
+
+    // Memory
+    try writer.writeAll("# HELP zigGL_memory_bytes Memory currently allocated per subsystem\n# TYPE zigGL_memory_bytes gauge\n");
+    inline for (std.meta.fields(memory.Subsystem)) |field| {
+        try writer.print("zigGL_memory_bytes{{subsystem=\"{s}\"}} {d}\n", .{ field.name, memory.stats(@enumFromInt(field.value)).current });
+    }
+    try writer.writeAll("# HELP zigGL_memory_peak_bytes Peak memory per subsystem\n# TYPE zigGL_memory_peak_bytes gauge\n");
+    inline for (std.meta.fields(memory.Subsystem)) |field| {
+        try writer.print("zigGL_memory_peak_bytes{{subsystem=\"{s}\"}} {d}\n", .{ field.name, memory.stats(@enumFromInt(field.value)).peak });
+    }
+    try writer.writeAll("# HELP zigGL_gpu_memory_bytes Estimated GPU memory\n# TYPE zigGL_gpu_memory_bytes gauge\n");
+    try writer.print("zigGL_gpu_memory_bytes{{kind=\"buffer\"}} {d}\nzigGL_gpu_memory_bytes{{kind=\"texture\"}} {d}\n", .{ memory.gpuStats(.buffer), memory.gpuStats(.texture) });
+}
+
+fn gauge(writer: anytype, comptime name: []const u8, comptime help: []const u8, value: u64) !void {
+    try writer.print("# HELP " ++ name ++ " " ++ help ++ "\n# TYPE " ++ name ++ " gauge\n" ++ name ++ " {d}\n", .{value});
+}
+
+fn counter(writer: anytype, comptime name: []const u8, comptime help: []const u8, comptime which: Counter) !void {
+    try writer.print("# HELP " ++ name ++ " " ++ help ++ "\n# TYPE " ++ name ++ " counter\n" ++ name ++ " {d}\n", .{load(which)});
+}
+
+fn load(which: Counter) u64 {
+    return counters[@intFromEnum(which)].load(.monotonic);
+}
+
+fn seconds(nanoseconds: u64) f64 {
+    return @as(f64, @floatFromInt(nanoseconds)) / std.time.ns_per_s;
+}
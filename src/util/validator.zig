@@ -2,7 +2,7 @@
 
 const std = @import("std");
 
-const errors = @import("./errors.zig");
+const diagnostics = @import("./diagnostics.zig");
 
 /// Trims a string by removing whitespace and quotes
 pub fn trimString(str: []const u8) []const u8 {
@@ -13,10 +13,11 @@ pub fn trimString(str: []const u8) []const u8 {
 }
 
 /// Validates and cleans up a path string
+/// The result is allocated (empty if invalid), so callers can always free it
 pub fn cleanPath(allocator: std.mem.Allocator, path: []const u8) ![]const u8 {
     // Check if path points to default objects
     if (checkPredefinedObjects(trimString(path)).len > 0) {
-        return checkPredefinedObjects(trimString(path));
+        return allocator.dupe(u8, checkPredefinedObjects(trimString(path)));
     }
 
     // Convert backslashes to forward slashes
@@ -28,18 +29,15 @@ pub fn cleanPath(allocator: std.mem.Allocator, path: []const u8) ![]const u8 {
 
     // Validate Path
     if (trimmed.len >= 256) {
-        errors.errorCollector.reportError(errors.ErrorCode.PathTooLong);
-        std.log.err("Path too long: {d}", .{trimmed.len});
+        diagnostics.report(.PathTooLong, 0, "Path too long: {d}", .{trimmed.len});
         return "";
     }
     if (trimmed.len == 0) {
-        errors.errorCollector.reportError(errors.ErrorCode.EmptyPath);
-        std.log.err("Path is empty: {d}", .{trimmed.len});
+        diagnostics.report(.EmptyPath, 0, "Path is empty: {d}", .{trimmed.len});
         return "";
     }
     if (!std.fs.path.isAbsolute(trimmed)) {
-        errors.errorCollector.reportError(errors.ErrorCode.InvalidPath);
-        std.log.err("Path is not absolute: {s}", .{trimmed});
+        diagnostics.report(.InvalidPath, 0, "Path is not absolute: {s}", .{trimmed});
         return "";
     }
 
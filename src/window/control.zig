@@ -0,0 +1,381 @@
+//! Automation control socket
+//!
+//! Optional Unix domain socket that accepts line based commands from scripts (performance CI).
+//! The socket and all clients are non-blocking and polled once per frame from the main loop,
+//! so commands run on the render thread between frames. Every command is answered with one JSON line.
+//!
+//! Commands:
+//! - load <path>                          load a model, answers the load time
+//! - position <x> <y> <z>                 model translation
+//! - rotation <x> <y> <z>                 model rotation in degrees
+//! - scale <s>                            uniform model scale
+//! - camera <ex> <ey> <ez> <tx> <ty> <tz> [fov]   eye, target and vertical field of view in degrees
+//! - map <diffuse|normal|roughness|metallic> <on|off>
+//! - environment <path>                   prefilter an HDR panorama in the background
+//! - wireframe <on|off> [width]           wireframe on the shaded model, width in pixels
+//! - aa <off|low|medium|high>             post-process antialiasing preset
+//! - vsync <on|off>
+//! - render <n>                           answers frame time statistics after n frames
+//! - memory                               memory counters as JSON
+//! - quit                                 close the window
+
+const std = @import("std");
+const glfw = @import("mach-glfw");
+
+const window = @import("window.zig");
+const overlay = @import("../ui/overlay.zig");
+const environment = @import("../graphics/environment.zig");
+const postProcess = @import("../graphics/postProcess.zig");
+const memory = @import("../util/memory.zig");
+
+const posix = std.posix;
+
+const MAX_CLIENTS = 4;
+const LINE_LENGTH = 1024;
+
+const allocator = memory.allocator(.other);
+
+/// Connected client
+///
+/// Contains:
+/// - socket: non-blocking stream socket
+/// - input: bytes received but not terminated by a newline yet
+/// - output: responses not sent yet
+/// - finished: the client shut down its sending side, buffered commands still run
+const Client = struct {
+    socket: posix.socket_t,
+    input: std.ArrayListUnmanaged(u8) = .{},
+    output: std.ArrayListUnmanaged(u8) = .{},
+    finished: bool = false,
+
+    fn deinit(self: *Client) void {
+        closeSocket(self.socket);
+        self.input.deinit(allocator);
+        self.output.deinit(allocator);
+    }
+};
+
+/// Pending render command
+///
+/// Contains:
+/// - client: index of the client waiting for the statistics
+/// - remaining: frames still to render
+/// - frameTimes: nanoseconds per rendered frame
+const RenderRequest = struct {
+    client: usize,
+    remaining: usize,
+    frameTimes: std.ArrayListUnmanaged(u64) = .{},
+};
+
+var listener: ?posix.socket_t = null;
+var socketPath: []const u8 = "";
+var clients: [MAX_CLIENTS]?Client = [_]?Client{null} ** MAX_CLIENTS;
+var render: ?RenderRequest = null;
+var frameTimer: ?std.time.Timer = null;
+
+/// Create the socket, a stale socket file at the path is replaced
+pub fn start(path: []const u8) !void {
+    if (!std.net.has_unix_sockets) {
+        std.log.err("Unix domain sockets are not supported on this system", .{});
+        return error.Unsupported;
+    }
+
+    const address = try std.net.Address.initUnix(path);
+    std.fs.cwd().deleteFile(path) catch {};
+
+    const socket = try posix.socket(posix.AF.UNIX, posix.SOCK.STREAM | posix.SOCK.NONBLOCK, 0);
+    errdefer closeSocket(socket);
+    try posix.bind(socket, &address.any, address.getOsSockLen());
+    try posix.listen(socket, MAX_CLIENTS);
+
+    listener = socket;
+    socketPath = try allocator.dupe(u8, path);
+    std.log.info("Control socket listening on {s}", .{path});
+}
+
+/// Close the socket and all clients
+pub fn stop() void {
+    const socket = listener orelse return;
+    for (&clients) |*slot| {
+        if (slot.*) |*client| client.deinit();
+        slot.* = null;
+    }
+    if (render) |*request| request.frameTimes.deinit(allocator);
+    render = null;
+
+    closeSocket(socket);
+    std.fs.cwd().deleteFile(socketPath) catch {};
+    allocator.free(socketPath);
+    listener = null;
+}
+
+/// Accept clients, run received commands and send responses (never blocks)
+pub fn poll(win: glfw.Window, state: *window.WindowState) void {
+    const socket = listener orelse return;
+
+    // New clients
+    while (true) {
+        const accepted = posix.accept(socket, null, null, posix.SOCK.NONBLOCK) catch break;
+        if (freeSlot()) |slot| {
+            slot.* = Client{ .socket = accepted };
+        } else {
+            closeSocket(accepted);
+            std.log.warn("Control socket: too many clients", .{});
+        }
+    }
+
+    for (&clients, 0..) |*slot, index| {
+        const client = if (slot.*) |*client| client else continue;
+        if (!receive(client)) {
+            drop(index);
+            continue;
+        }
+
+        // Complete lines, a pending render request holds back further commands of its client
+        while (std.mem.indexOfScalar(u8, client.input.items, '\n')) |end| {
+            if (render != null and render.?.client == index) break;
+
+            const line = std.mem.trim(u8, client.input.items[0..end], " \r\t");
+            execute(win, state, index, line);
+            client.input.replaceRange(allocator, 0, end + 1, &.{}) catch unreachable; // Shrinks only
+        }
+
+        if (!send(client)) {
+            drop(index);
+            continue;
+        }
+
+        // After EOF the client is dropped once its commands ran and all responses are sent
+        const waiting = render != null and render.?.client == index;
+        if (client.finished and !waiting and client.input.items.len == 0 and client.output.items.len == 0) {
+            drop(index);
+        }
+    }
+}
+
+/// Count a finished frame for a pending render command, call once per frame after the buffer swap
+pub fn frameDone() void {
+    if (listener == null) return;
+
+    var timer = frameTimer orelse {
+        frameTimer = std.time.Timer.start() catch null;
+        return;
+    };
+    const elapsed = timer.lap();
+    frameTimer = timer;
+
+    const request = if (render) |*request| request else return;
+    request.frameTimes.append(allocator, elapsed) catch {};
+    request.remaining -= 1;
+    if (request.remaining == 0) {
+        finishRender();
+    }
+}
+
+fn execute(win: glfw.Window, state: *window.WindowState, index: usize, line: []const u8) void {
+    var args = std.mem.tokenizeAny(u8, line, " \t");
+    const command = args.next() orelse return;
+
+    runCommand(win, state, index, command, &args) catch |err| {
+        respondError(index, @errorName(err));
+    };
+}
+
+fn runCommand(win: glfw.Window, state: *window.WindowState, index: usize, command: []const u8, args: *std.mem.TokenIterator(u8, .any)) !void {
+    const eql = std.mem.eql;
+    const overlayState = &state.overlayState;
+
+    if (eql(u8, command, "load")) {
+        const path = args.rest();
+        if (path.len == 0 or path.len >= overlayState.objPath.len) return error.InvalidPath;
+
+        var timer = try std.time.Timer.start();
+        try overlay.loadNewObject(path, overlayState);
+        const elapsed = timer.read();
+
+        if (std.mem.sliceTo(&overlayState.errorMessage, 0).len > 0) {
+            respondError(index, std.mem.sliceTo(&overlayState.errorMessage, 0));
+        } else {
+            respond(index, "{{\"ok\":true,\"load_ms\":{d:.3}}}", .{nsToMs(elapsed)});
+        }
+    } else if (eql(u8, command, "position")) {
+        overlayState.position = try parseFloats(3, args);
+        overlayState.manualEdit = true;
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "rotation")) {
+        overlayState.rotation = try parseFloats(3, args);
+        overlayState.manualEdit = true;
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "scale")) {
+        overlayState.scale = (try parseFloats(1, args))[0];
+        overlayState.manualEdit = true;
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "camera")) {
+        const values = try parseFloats(6, args);
+        state.camera.eye = values[0..3].*;
+        state.camera.target = values[3..6].*;
+        if (args.next()) |fov| {
+            state.camera.fov = std.math.degreesToRadians(try std.fmt.parseFloat(f32, fov));
+        }
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "map")) {
+        const name = args.next() orelse return error.MissingArgument;
+        const enabled = try parseSwitch(args);
+        if (eql(u8, name, "diffuse")) {
+            overlayState.diffuseVisible = enabled;
+        } else if (eql(u8, name, "normal")) {
+            overlayState.normalVisible = enabled;
+        } else if (eql(u8, name, "roughness")) {
+            overlayState.roughnessVisible = enabled;
+        } else if (eql(u8, name, "metallic")) {
+            overlayState.metallicVisible = enabled;
+        } else {
+            return error.UnknownMap;
+        }
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "environment")) {
+        const path = args.rest();
+        if (path.len == 0) return error.InvalidPath;
+        try environment.load(path);
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "wireframe")) {
+        overlayState.wireframe = try parseSwitch(args);
+        if (args.next()) |width| {
+            overlayState.wireframeWidth = try std.fmt.parseFloat(f32, width);
+        }
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "aa")) {
+        const preset = args.next() orelse return error.MissingArgument;
+        overlayState.antialiasing = postProcess.parseQuality(preset) orelse return error.UnknownPreset;
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "vsync")) {
+        glfw.swapInterval(if (try parseSwitch(args)) 1 else 0);
+        respond(index, "{{\"ok\":true}}", .{});
+    } else if (eql(u8, command, "render")) {
+        const frames = try std.fmt.parseInt(usize, args.next() orelse return error.MissingArgument, 10);
+        if (frames == 0) return error.InvalidFrameCount;
+        if (render != null) return error.RenderPending;
+        render = .{ .client = index, .remaining = frames };
+    } else if (eql(u8, command, "memory")) {
+        var json = std.ArrayList(u8).init(allocator);
+        defer json.deinit();
+        try memory.writeJson(json.writer());
+        respond(index, "{{\"ok\":true,\"memory\":{s}}}", .{json.items});
+    } else if (eql(u8, command, "quit")) {
+        win.setShouldClose(true);
+        respond(index, "{{\"ok\":true}}", .{});
+    } else {
+        return error.UnknownCommand;
+    }
+}
+
+/// Answer a finished render command with frame time percentiles
+fn finishRender() void {
+    var request = render.?;
+    render = null;
+    defer request.frameTimes.deinit(allocator);
+
+    const times = request.frameTimes.items;
+    std.mem.sort(u64, times, {}, std.sort.asc(u64));
+
+    var total: u64 = 0;
+    for (times) |time| total += time;
+
+    respond(request.client, "{{\"ok\":true,\"frames\":{d},\"mean_ms\":{d:.3},\"p50_ms\":{d:.3},\"p95_ms\":{d:.3},\"p99_ms\":{d:.3},\"max_ms\":{d:.3}}}", .{
+        times.len,
+        nsToMs(total) / @as(f64, @floatFromInt(times.len)),
+        nsToMs(percentile(times, 50)),
+        nsToMs(percentile(times, 95)),
+        nsToMs(percentile(times, 99)),
+        nsToMs(times[times.len - 1]),
+    });
+}
+
+fn respond(index: usize, comptime fmt: []const u8, args: anytype) void {
+    const client = if (clients[index]) |*client| client else return;
+    client.output.writer(allocator).print(fmt ++ "\n", args) catch {};
+}
+
+/// Answer with an error, the message is escaped as JSON string (load errors contain paths)
+fn respondError(index: usize, message: []const u8) void {
+    const client = if (clients[index]) |*client| client else return;
+    const out = client.output.writer(allocator);
+    out.writeAll("{\"ok\":false,\"error\":") catch return;
+    std.json.stringify(message, .{}, out) catch return;
+    out.writeAll("}\n") catch return;
+}
+
+/// Read everything available, false when the connection failed
+/// EOF only marks the client as finished, so commands sent before a half-close still run
+fn receive(client: *Client) bool {
+    if (client.finished) return true;
+
+    var buf: [LINE_LENGTH]u8 = undefined;
+    while (true) {
+        const n = posix.recv(client.socket, &buf, 0) catch |err| return err == error.WouldBlock;
+        if (n == 0) {
+            client.finished = true;
+            // A last command without newline is complete at EOF
+            if (client.input.items.len > 0 and client.input.items[client.input.items.len - 1] != '\n') {
+                client.input.append(allocator, '\n') catch return false;
+            }
+            return true;
+        }
+        client.input.appendSlice(allocator, buf[0..n]) catch return false;
+        if (client.input.items.len > 16 * LINE_LENGTH) return false; // No newline in sight
+    }
+}
+
+/// Send as much pending output as the socket takes, false when the client disconnected
+fn send(client: *Client) bool {
+    while (client.output.items.len > 0) {
+        const n = posix.send(client.socket, client.output.items, 0) catch |err| return err == error.WouldBlock;
+        client.output.replaceRange(allocator, 0, n, &.{}) catch unreachable; // Shrinks only
+    }
+    return true;
+}
+
+/// Close a socket through std.net.Stream (closesocket on Windows, close elsewhere)
+fn closeSocket(socket: posix.socket_t) void {
+    const stream = std.net.Stream{ .handle = socket };
+    stream.close();
+}
+
+fn freeSlot() ?*?Client {
+    for (&clients) |*slot| {
+        if (slot.* == null) return slot;
+    }
+    return null;
+}
+
+fn drop(index: usize) void {
+    clients[index].?.deinit();
+    clients[index] = null;
+    if (render != null and render.?.client == index) {
+        render.?.frameTimes.deinit(allocator);
+        render = null;
+    }
+}
+
+fn parseFloats(comptime n: usize, args: *std.mem.TokenIterator(u8, .any)) ![n]f32 {
+    var values: [n]f32 = undefined;
+    for (&values) |*value| {
+        value.* = try std.fmt.parseFloat(f32, args.next() orelse return error.MissingArgument);
+    }
+    return values;
+}
+
+fn parseSwitch(args: *std.mem.TokenIterator(u8, .any)) !bool {
+    const value = args.next() orelse return error.MissingArgument;
+    if (std.mem.eql(u8, value, "on")) return true;
+    if (std.mem.eql(u8, value, "off")) return false;
+    return error.InvalidSwitch;
+}
+
+fn percentile(sorted: []const u64, p: usize) u64 {
+    return sorted[@min(sorted.len - 1, (sorted.len * p) / 100)];
+}
+
+fn nsToMs(ns: u64) f64 {
+    return @as(f64, @floatFromInt(ns)) / std.time.ns_per_ms;
+}
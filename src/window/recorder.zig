@@ -0,0 +1,345 @@
+//! Input recording and deterministic replay
+//!
+//! Recording writes every GLFW callback event and every change of the overlay state to a file,
+//! tagged with the frame it arrived in. Replay injects the events at the same frame on a fixed
+//! timestep (the GLFW clock is set per frame, so ImGui sees identical frame times) and measures
+//! CPU and GPU time per frame. GPU time comes from timestamp pairs, which unlike TIME_ELAPSED
+//! queries can overlap with the timer queries of the passes. Timings are written as CSV next to the recording.
+
+const std = @import("std");
+const gl = @import("gl");
+const glfw = @import("mach-glfw");
+
+const window = @import("window.zig");
+const overlay = @import("../ui/overlay.zig");
+const memory = @import("../util/memory.zig");
+
+const MAGIC = "ZGR1";
+const FIXED_TIMESTEP = 1.0 / 60.0; // Seconds per replayed frame
+const QUERY_RING_SIZE = 4; // GPU timer results are read a few frames late to avoid stalls
+
+const allocator = memory.allocator(.window);
+
+/// Recorded event kinds, one per GLFW callback plus overlay snapshots
+pub const EventKind = enum(u8) {
+    cursor,
+    mouseButton,
+    key,
+    scroll,
+    resize,
+    overlay, // Followed by a raw OverlayState
+    end, // Written when recording stops, frame is the number of recorded frames
+};
+
+/// Fixed size event record
+///
+/// Contains:
+/// - frame: frame the event arrived in
+/// - kind: callback that produced the event
+/// - time: nanoseconds since the recording started (informational, replay is frame based)
+/// - x, y: cursor position, scroll offsets or framebuffer size
+/// - values: button/key, scancode, action and mods
+pub const Event = extern struct {
+    frame: u32 = 0,
+    kind: EventKind,
+    padding: [3]u8 = .{ 0, 0, 0 },
+    time: u64 = 0,
+    x: f64 = 0,
+    y: f64 = 0,
+    values: [4]i32 = .{ 0, 0, 0, 0 },
+};
+
+/// File header
+///
+/// Contains:
+/// - overlaySize: size of the overlay snapshots (snapshots are skipped when the layout changed)
+/// - width, height: framebuffer size at the start of the recording
+const Header = extern struct {
+    magic: [4]u8 = MAGIC.*,
+    overlaySize: u32 = @sizeOf(overlay.OverlayState),
+    width: f32,
+    height: f32,
+};
+
+/// Timing of one replayed frame
+///
+/// Contains:
+/// - cpu: nanoseconds from beginFrame to endFrame
+/// - gpu: nanoseconds of GPU work between beginFrame and endFrame
+const FrameTiming = struct {
+    cpu: u64,
+    gpu: u64 = 0,
+};
+
+const Mode = enum {
+    off,
+    recording,
+    replaying,
+};
+
+var mode: Mode = .off;
+var frame: u32 = 0;
+var timer: std.time.Timer = undefined;
+
+// Recording
+var file: ?std.fs.File = null;
+var writer: std.io.BufferedWriter(4096, std.fs.File.Writer) = undefined;
+var lastOverlay: overlay.OverlayState = .{};
+
+// Replay
+var events: []Event = &.{};
+var snapshots: []overlay.OverlayState = &.{}; // Indexed by Event.values[0] of overlay events
+var nextEvent: usize = 0;
+var injecting = false;
+var frameStart: u64 = 0;
+var endFrameIndex: u32 = 0; // Replay stops before this frame
+var timings = std.ArrayList(FrameTiming).init(allocator);
+var queries: [QUERY_RING_SIZE][2]gl.uint = [_][2]gl.uint{.{ 0, 0 }} ** QUERY_RING_SIZE; // Start and end timestamps
+var replayPath: []const u8 = "";
+
+/// Start recording input into a file
+pub fn startRecording(path: []const u8, state: *const window.WindowState) !void {
+    const created = try std.fs.cwd().createFile(path, .{});
+    file = created;
+    writer = std.io.bufferedWriter(created.writer());
+
+    const header = Header{ .width = state.width, .height = state.height };
+    try writer.writer().writeAll(std.mem.asBytes(&header));
+
+    lastOverlay = state.overlayState;
+    timer = try std.time.Timer.start();
+    mode = .recording;
+    std.log.info("Recording input to {s}", .{path});
+}
+
+/// Load a recording and replay it from the next frame on
+/// Real input is ignored while replaying
+pub fn startReplay(path: []const u8, win: glfw.Window, state: *window.WindowState) !void {
+    const data = try std.fs.cwd().readFileAlloc(allocator, path, 1 << 30);
+    defer allocator.free(data);
+
+    if (data.len < @sizeOf(Header)) return error.InvalidRecording;
+    const header = std.mem.bytesToValue(Header, data[0..@sizeOf(Header)]);
+    if (!std.mem.eql(u8, &header.magic, MAGIC)) return error.InvalidRecording;
+
+    const applySnapshots = header.overlaySize == @sizeOf(overlay.OverlayState);
+    if (!applySnapshots) {
+        std.log.warn("Overlay layout changed since the recording, replaying input only", .{});
+    }
+
+    // Split the stream into events and overlay snapshots
+    var eventList = std.ArrayList(Event).init(allocator);
+    defer eventList.deinit();
+    var snapshotList = std.ArrayList(overlay.OverlayState).init(allocator);
+    defer snapshotList.deinit();
+
+    var endMarker: ?u32 = null;
+    var cursor: usize = @sizeOf(Header);
+    while (cursor + @sizeOf(Event) <= data.len) {
+        var event = std.mem.bytesToValue(Event, data[cursor..][0..@sizeOf(Event)]);
+        cursor += @sizeOf(Event);
+
+        if (event.kind == .end) {
+            endMarker = event.frame;
+            break;
+        }
+
+        if (event.kind == .overlay) {
+            if (cursor + header.overlaySize > data.len) return error.InvalidRecording;
+            const bytes = data[cursor..][0..header.overlaySize];
+            cursor += header.overlaySize;
+            if (!applySnapshots) continue;
+
+            event.values[0] = @intCast(snapshotList.items.len);
+            try snapshotList.append(std.mem.bytesToValue(overlay.OverlayState, bytes[0..@sizeOf(overlay.OverlayState)]));
+        }
+        try eventList.append(event);
+    }
+
+    // Recordings without end marker (e.g. the application was killed) stop after the last event
+    endFrameIndex = endMarker orelse if (eventList.items.len > 0) eventList.getLast().frame + 1 else 0;
+
+    events = try eventList.toOwnedSlice();
+    snapshots = try snapshotList.toOwnedSlice();
+    replayPath = try allocator.dupe(u8, path);
+
+    // Same framebuffer size as during the recording
+    win.setSize(.{ .width = @intFromFloat(header.width), .height = @intFromFloat(header.height) });
+    state.width = header.width;
+    state.height = header.height;
+    gl.Viewport(0, 0, @intFromFloat(header.width), @intFromFloat(header.height));
+
+    gl.GenQueries(QUERY_RING_SIZE * 2, @ptrCast(&queries));
+    glfw.swapInterval(0); // Measure frames, not the display refresh
+    timer = try std.time.Timer.start();
+    mode = .replaying;
+    std.log.info("Replaying {d} events over {d} frames from {s}", .{ events.len, endFrameIndex, path });
+}
+
+/// True while real input should reach the callbacks
+pub fn acceptsInput() bool {
+    return mode != .replaying or injecting;
+}
+
+/// Start of a frame: fixes the clock and starts the timers during replay
+/// Returns false once the replay has finished
+pub fn beginFrame() bool {
+    if (mode != .replaying) return true;
+
+    // Frames after the last event still count, the recording ends at the end marker
+    if (frame >= endFrameIndex) {
+        finish();
+        return false;
+    }
+
+    glfw.setTime(@as(f64, @floatFromInt(frame)) * FIXED_TIMESTEP);
+    frameStart = timer.read();
+    gl.QueryCounter(queries[frame % QUERY_RING_SIZE][0], gl.TIMESTAMP);
+    return true;
+}
+
+/// Called after the overlay was drawn: records or restores overlay state changes
+pub fn afterOverlay(state: *overlay.OverlayState) void {
+    switch (mode) {
+        .off => {},
+        .recording => {
+            if (std.meta.eql(state.*, lastOverlay)) return;
+            lastOverlay = state.*;
+            write(.{ .frame = frame, .kind = .overlay, .time = timer.read() }, std.mem.asBytes(state));
+        },
+        .replaying => {
+            // Snapshots of this frame win over whatever the replayed input did in ImGui
+            var i = nextEvent;
+            while (i < events.len and events[i].frame == frame) : (i += 1) {
+                if (events[i].kind == .overlay) {
+                    state.* = snapshots[@intCast(events[i].values[0])];
+                }
+            }
+        },
+    }
+}
+
+/// End of a frame, before the buffer swap: stops the timers during replay
+pub fn endFrame() void {
+    if (mode != .replaying) return;
+
+    gl.QueryCounter(queries[frame % QUERY_RING_SIZE][1], gl.TIMESTAMP);
+    timings.append(.{ .cpu = timer.read() - frameStart }) catch {};
+
+    // Result of the oldest query in the ring, its frame has long been submitted
+    if (frame + 1 >= QUERY_RING_SIZE) {
+        collectGpuTime(frame + 1 - QUERY_RING_SIZE);
+    }
+}
+
+/// Poll window events and advance the frame counter
+/// During replay the recorded events of this frame are injected after the real ones are dropped
+pub fn pollEvents(win: glfw.Window) void {
+    glfw.pollEvents();
+
+    if (mode == .replaying) {
+        injecting = true;
+        defer injecting = false;
+
+        while (nextEvent < events.len and events[nextEvent].frame == frame) : (nextEvent += 1) {
+            window.injectEvent(win, events[nextEvent]);
+        }
+    }
+    frame += 1;
+}
+
+/// Record a callback event (no-op unless recording)
+pub fn capture(event: Event) void {
+    if (mode != .recording) return;
+
+    var stamped = event;
+    stamped.frame = frame;
+    stamped.time = timer.read();
+    write(stamped, &.{});
+}
+
+/// Stop recording or replaying, writes the file or the timing report
+pub fn finish() void {
+    switch (mode) {
+        .off => return,
+        .recording => {
+            write(.{ .frame = frame, .kind = .end, .time = timer.read() }, &.{});
+            writer.flush() catch |err| std.log.err("Could not write recording: {s}", .{@errorName(err)});
+            file.?.close();
+            file = null;
+            std.log.info("Recorded {d} frames", .{frame});
+        },
+        .replaying => {
+            // Remaining GPU results
+            const first = if (frame >= QUERY_RING_SIZE) frame - QUERY_RING_SIZE + 1 else 0;
+            for (first..timings.items.len) |i| {
+                collectGpuTime(@intCast(i));
+            }
+            gl.DeleteQueries(QUERY_RING_SIZE * 2, @ptrCast(&queries));
+
+            report() catch |err| std.log.err("Could not write replay report: {s}", .{@errorName(err)});
+
+            allocator.free(events);
+            allocator.free(snapshots);
+            allocator.free(replayPath);
+            timings.deinit();
+        },
+    }
+    mode = .off;
+}
+
+fn write(event: Event, payload: []const u8) void {
+    const out = writer.writer();
+    out.writeAll(std.mem.asBytes(&event)) catch return;
+    out.writeAll(payload) catch return;
+}
+
+fn collectGpuTime(index: u32) void {
+    if (index >= timings.items.len) return;
+
+    var start: u64 = 0;
+    var end: u64 = 0;
+    const pair = queries[index % QUERY_RING_SIZE];
+    gl.GetQueryObjectui64v(pair[0], gl.QUERY_RESULT, (&start)[0..1]);
+    gl.GetQueryObjectui64v(pair[1], gl.QUERY_RESULT, (&end)[0..1]);
+    timings.items[index].gpu = end -| start;
+}
+
+/// Write per-frame timings as CSV and log percentiles
+fn report() !void {
+    const csvPath = try std.fmt.allocPrint(allocator, "{s}.csv", .{replayPath});
+    defer allocator.free(csvPath);
+
+    const csv = try std.fs.cwd().createFile(csvPath, .{});
+    defer csv.close();
+    var buffered = std.io.bufferedWriter(csv.writer());
+    const out = buffered.writer();
+
+    try out.writeAll("frame,cpu_us,gpu_us\n");
+    for (timings.items, 0..) |timing, i| {
+        try out.print("{d},{d},{d}\n", .{ i, timing.cpu / std.time.ns_per_us, timing.gpu / std.time.ns_per_us });
+    }
+    try buffered.flush();
+
+    if (timings.items.len == 0) return;
+    const cpu = try allocator.alloc(u64, timings.items.len);
+    defer allocator.free(cpu);
+    const gpu = try allocator.alloc(u64, timings.items.len);
+    defer allocator.free(gpu);
+    for (timings.items, cpu, gpu) |timing, *c, *g| {
+        c.* = timing.cpu;
+        g.* = timing.gpu;
+    }
+    std.mem.sort(u64, cpu, {}, std.sort.asc(u64));
+    std.mem.sort(u64, gpu, {}, std.sort.asc(u64));
+
+    std.log.info("Replayed {d} frames, timings in {s}", .{ timings.items.len, csvPath });
+    std.log.info("CPU ms p50 {d:.3} p95 {d:.3} p99 {d:.3} max {d:.3}", .{ percentile(cpu, 50), percentile(cpu, 95), percentile(cpu, 99), percentile(cpu, 100) });
+    std.log.info("GPU ms p50 {d:.3} p95 {d:.3} p99 {d:.3} max {d:.3}", .{ percentile(gpu, 50), percentile(gpu, 95), percentile(gpu, 99), percentile(gpu, 100) });
+}
+
+/// Percentile of sorted nanoseconds in milliseconds
+fn percentile(sorted: []const u64, p: usize) f64 {
+    const index = @min(sorted.len - 1, (sorted.len * p) / 100);
+    return @as(f64, @floatFromInt(sorted[index])) / std.time.ns_per_ms;
+}
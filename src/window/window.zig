@@ -8,9 +8,12 @@ const std = @import("std");
 const glfw = @import("mach-glfw");
 const zmath = @import("zmath");
 const gl = @import("gl");
-const zstbi = @import("zstbi");
 
 const overlay = @import("../ui/overlay.zig");
+const memory = @import("../util/memory.zig");
+const glDebug = @import("../graphics/glDebug.zig");
+const imageDecoder = @import("../graphics/imageDecoder.zig");
+const recorder = @import("recorder.zig");
 const c = @cImport({
     @cInclude("cimgui.h");
 });
@@ -27,6 +30,12 @@ const OVERLAY_MODS: glfw.Mods = .{
 
 var keyPressed: bool = false; // Debounce overlay visibility
 
+// Keys and mouse buttons whose press reached ImGui, their release is forwarded even after the
+// overlay was hidden so ImGui does not keep them held down
+const KEY_SLOTS = @intFromEnum(glfw.Key.last) + 2; // Key.unknown is -1
+var overlayKeys = std.StaticBitSet(KEY_SLOTS).initEmpty();
+var overlayButtons = std.StaticBitSet(@intFromEnum(glfw.MouseButton.eight) + 1).initEmpty();
+
 /// Window state struct
 ///
 /// Contains:
@@ -35,6 +44,7 @@ var keyPressed: bool = false; // Debounce overlay visibility
 /// - key state union
 /// - overlayState
 /// - scroll value
+/// - camera
 pub const WindowState = struct {
     width: f32 = DEFAULT_WIDTH,
     height: f32 = DEFAULT_HEIGHT,
@@ -42,6 +52,19 @@ pub const WindowState = struct {
     overlayState: overlay.OverlayState = .{},
     keys: KeyState = .none,
     scroll: f64 = 0,
+    camera: Camera = .{},
+};
+
+/// Camera struct
+///
+/// Contains:
+/// - eye: camera position
+/// - target: point the camera looks at
+/// - fov: vertical field of view in radians
+pub const Camera = struct {
+    eye: [3]f32 = .{ 0.0, 0.0, 3.0 },
+    target: [3]f32 = .{ 0.0, 0.0, 0.0 },
+    fov: f32 = 0.25 * std.math.pi,
 };
 
 /// Mouse state struct
@@ -88,12 +111,11 @@ pub fn init(title: [*:0]const u8) !glfw.Window {
         .context_version_minor = 5,                      // OpenGL minor version
         .opengl_profile = .opengl_core_profile,  // OpenGL profile
         .opengl_forward_compat = true,                   // OpenGL forward compatibility
+        .context_debug = true,                           // Debug output, labels and debug groups
     }) orelse return error.WindowCreateFailed;
 
     // Window icon
-    zstbi.setFlipVerticallyOnLoad(false);
-    var icon_image = try zstbi.Image.loadFromFile("objects/icon.png", 4);
-    zstbi.setFlipVerticallyOnLoad(true);
+    var icon_image = try imageDecoder.loadFromFile("objects/icon.png", 4, false);
     defer icon_image.deinit();
 
     // GLFW-compatible image
@@ -105,7 +127,7 @@ pub fn init(title: [*:0]const u8) !glfw.Window {
     };
 
     // Allocator
-    const allocator = std.heap.page_allocator;
+    const allocator = memory.allocator(.window);
 
     // Set window icon
     try window.setIcon(allocator, (&glfw_icon)[0..1]);
@@ -118,11 +140,17 @@ pub fn init(title: [*:0]const u8) !glfw.Window {
         return error.GLInitFailed;
     }
     gl.makeProcTableCurrent(&gl_proc_table);
+    glDebug.init();
 
     glfw.swapInterval(1);
     return window;
 }
 
+/// Proc table of the window context, e.g. to wrap it for a GL capture
+pub fn procTable() *const gl.ProcTable {
+    return &gl_proc_table;
+}
+
 fn errorCallback(error_code: glfw.ErrorCode, description: [:0]const u8) void {
     std.log.err("GLFW error: {}: {s}", .{ error_code, description });
 }
@@ -136,15 +164,20 @@ pub fn setupCallbacks(window: glfw.Window, state: *WindowState) void {
     window.setCursorPosCallback(cursorCallback);
     window.setKeyCallback(keyCallback);
     window.setScrollCallback(scrollCallback);
+    window.setCharCallback(charCallback);
+    window.setFocusCallback(focusCallback);
+    window.setCursorEnterCallback(cursorEnterCallback);
     window.setFramebufferSizeCallback(resizeCallback);
 }
 
 /// GLFW cursor position callback
 /// Updates the mouse position when the cursor moves
 fn cursorCallback(window: glfw.Window, xpos: f64, ypos: f64) void {
+    if (!recorder.acceptsInput()) return;
+    recorder.capture(.{ .kind = .cursor, .x = xpos, .y = ypos });
     const state: *WindowState = window.getUserPointer(WindowState).?; // Retrieve the window state
 
-    c.ImGui_CursorPosCallback(@ptrCast(window.handle), xpos, ypos); // Cpp glfw callback
+    if (forwardToOverlay(state)) c.ImGui_CursorPosCallback(@ptrCast(window.handle), xpos, ypos); // Cpp glfw callback
 
     state.mouse.x = xpos;
     state.mouse.y = ypos;
@@ -153,10 +186,13 @@ fn cursorCallback(window: glfw.Window, xpos: f64, ypos: f64) void {
 /// GLFW mouse button callback
 /// Updates the mouse dragging state when a mouse button is pressed or released
 fn mouseCallback(window: glfw.Window, button: glfw.MouseButton, action: glfw.Action, mods: glfw.Mods) void {
+    if (!recorder.acceptsInput()) return;
+    recorder.capture(.{ .kind = .mouseButton, .values = .{ @intFromEnum(button), @intFromEnum(action), mods.toInt(c_int), 0 } });
     const state: *WindowState = window.getUserPointer(WindowState).?; // Retrieve the window state
     state.keys = .none;
 
-    c.ImGui_MouseButtonCallback(@ptrCast(window.handle), @intFromEnum(button), @intFromEnum(action), mods.toInt(c_int)); // Cpp glfw callback
+    const buttonSlot: usize = @intCast(@intFromEnum(button));
+    if (forwardPress(state, &overlayButtons, buttonSlot, action)) c.ImGui_MouseButtonCallback(@ptrCast(window.handle), @intFromEnum(button), @intFromEnum(action), mods.toInt(c_int)); // Cpp glfw callback
 
     // Left mouse button pressed with shift key -> dragging
     if (button == .left and mods.shift == true) {
@@ -177,9 +213,12 @@ fn mouseCallback(window: glfw.Window, button: glfw.MouseButton, action: glfw.Act
 fn keyCallback(window: glfw.Window, key: glfw.Key, scancode: i32, action: glfw.Action, mods: glfw.Mods) void {
     _ = &scancode;
     _ = &window;
+    if (!recorder.acceptsInput()) return;
+    recorder.capture(.{ .kind = .key, .values = .{ @intFromEnum(key), scancode, @intFromEnum(action), mods.toInt(c_int) } });
     const state: *WindowState = window.getUserPointer(WindowState).?; // Retrieve the window state
 
-    c.ImGui_KeyCallback(@ptrCast(window.handle), @intFromEnum(key), scancode, @intFromEnum(action), mods.toInt(c_int)); // Cpp glfw callback
+    const keySlot: usize = @intCast(@intFromEnum(key) + 1);
+    if (forwardPress(state, &overlayKeys, keySlot, action)) c.ImGui_KeyCallback(@ptrCast(window.handle), @intFromEnum(key), scancode, @intFromEnum(action), mods.toInt(c_int)); // Cpp glfw callback
 
     // Set key union based on key pressed
     if (action == .press and mods.control == false and mods.shift == false) {
@@ -205,6 +244,56 @@ fn keyCallback(window: glfw.Window, key: glfw.Key, scancode: i32, action: glfw.A
     }
 }
 
+/// ImGui only receives input while the overlay is visible, its event queue is drained by
+/// NewFrame which does not run while hidden. Forwarded input requests new UI frames
+fn forwardToOverlay(state: *WindowState) bool {
+    if (!state.overlayState.visible) return false;
+    overlay.invalidate();
+    return true;
+}
+
+/// Like forwardToOverlay, but a release is also forwarded while hidden if ImGui saw the press
+fn forwardPress(state: *WindowState, pressed: anytype, slot: usize, action: glfw.Action) bool {
+    if (action == .release) {
+        const wasPressed = pressed.isSet(slot);
+        pressed.unset(slot);
+        if (!state.overlayState.visible) return wasPressed;
+        return forwardToOverlay(state);
+    }
+    if (!forwardToOverlay(state)) return false;
+    pressed.set(slot);
+    return true;
+}
+
+/// GLFW character callback
+/// Text input for the overlay
+fn charCallback(window: glfw.Window, codepoint: u21) void {
+    if (!recorder.acceptsInput()) return;
+    const state: *WindowState = window.getUserPointer(WindowState).?; // Retrieve the window state
+
+    if (forwardToOverlay(state)) c.ImGui_CharCallback(@ptrCast(window.handle), codepoint); // Cpp glfw callback
+}
+
+/// GLFW focus callback
+/// ImGui releases its held keys when the window loses focus
+fn focusCallback(window: glfw.Window, focused: bool) void {
+    const state: *WindowState = window.getUserPointer(WindowState).?; // Retrieve the window state
+
+    const held = overlayKeys.count() + overlayButtons.count() > 0;
+    if (!focused) {
+        overlayKeys = @TypeOf(overlayKeys).initEmpty();
+        overlayButtons = @TypeOf(overlayButtons).initEmpty();
+    }
+    if (forwardToOverlay(state) or (!focused and held)) c.ImGui_WindowFocusCallback(@ptrCast(window.handle), @intFromBool(focused)); // Cpp glfw callback
+}
+
+/// GLFW cursor enter callback
+fn cursorEnterCallback(window: glfw.Window, entered: bool) void {
+    const state: *WindowState = window.getUserPointer(WindowState).?; // Retrieve the window state
+
+    if (forwardToOverlay(state)) c.ImGui_CursorEnterCallback(@ptrCast(window.handle), @intFromBool(entered)); // Cpp glfw callback
+}
+
 /// Check if two glfw mods are equal
 fn modsEqual(a: glfw.Mods, b: glfw.Mods) bool {
     return @as(u8, @bitCast(a)) == @as(u8, @bitCast(b));
@@ -215,9 +304,11 @@ fn modsEqual(a: glfw.Mods, b: glfw.Mods) bool {
 fn scrollCallback(window: glfw.Window, xoffset: f64, yoffset: f64) void {
     _ = &xoffset;
     _ = &window;
+    if (!recorder.acceptsInput()) return;
+    recorder.capture(.{ .kind = .scroll, .x = xoffset, .y = yoffset });
     const state: *WindowState = window.getUserPointer(WindowState).?; // Retrieve the window state
 
-    c.ImGui_ScrollCallback(@ptrCast(window.handle), xoffset, yoffset); // Cpp glfw callback
+    if (forwardToOverlay(state)) c.ImGui_ScrollCallback(@ptrCast(window.handle), xoffset, yoffset); // Cpp glfw callback
 
     state.scroll += yoffset;
 }
@@ -226,10 +317,26 @@ fn scrollCallback(window: glfw.Window, xoffset: f64, yoffset: f64) void {
 /// Updates the window width and height when the window is resized
 fn resizeCallback(window: glfw.Window, width: u32, height: u32) void {
     _ = &window;
+    if (!recorder.acceptsInput()) return;
+    recorder.capture(.{ .kind = .resize, .x = @floatFromInt(width), .y = @floatFromInt(height) });
     const state: *WindowState = window.getUserPointer(WindowState).?; // Retrieve the window state
 
     // Update window width and height
     state.width = @floatFromInt(width);
     state.height = @floatFromInt(height);
+    overlay.invalidate();
     gl.Viewport(0, 0, @intCast(width), @intCast(height));
 }
+
+/// Feed a recorded event through the same callback that produced it
+/// Overlay snapshots are applied by the recorder itself
+pub fn injectEvent(window: glfw.Window, event: recorder.Event) void {
+    switch (event.kind) {
+        .cursor => cursorCallback(window, event.x, event.y),
+        .mouseButton => mouseCallback(window, @enumFromInt(event.values[0]), @enumFromInt(event.values[1]), glfw.Mods.fromInt(event.values[2])),
+        .key => keyCallback(window, @enumFromInt(event.values[0]), event.values[1], @enumFromInt(event.values[2]), glfw.Mods.fromInt(event.values[3])),
+        .scroll => scrollCallback(window, event.x, event.y),
+        .resize => resizeCallback(window, @intFromFloat(event.x), @intFromFloat(event.y)),
+        .overlay, .end => {},
+    }
+}